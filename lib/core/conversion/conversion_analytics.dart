@@ -35,6 +35,53 @@ class WorkerTiming {
       layers <= 0 ? 0 : total.inMicroseconds / 1000.0 / layers;
 }
 
+/// Fit of measured per-layer time against the native scheduler's cost
+/// prediction (encoded layer size), used to order layers longest-first.
+class CostModelFit {
+  final int samples;
+  final double correlation;
+  final double nsPerByte;
+  final double interceptNs;
+
+  const CostModelFit({
+    required this.samples,
+    required this.correlation,
+    required this.nsPerByte,
+    required this.interceptNs,
+  });
+
+  static CostModelFit? fromMap(Map? raw) {
+    if (raw == null) return null;
+    final samples = raw['samples'] as int? ?? 0;
+    if (samples < 2) return null;
+    return CostModelFit(
+      samples: samples,
+      correlation: (raw['correlation'] as num? ?? 0).toDouble(),
+      nsPerByte: (raw['nsPerByte'] as num? ?? 0).toDouble(),
+      interceptNs: (raw['interceptNs'] as num? ?? 0).toDouble(),
+    );
+  }
+}
+
+/// Layers whose output was reused instead of being encoded again: copied
+/// from an identical layer of the job (dedup) or read back from the layer
+/// cache.
+class LayerReuseStats {
+  final int layers;
+  final int hits;
+
+  const LayerReuseStats({required this.layers, required this.hits});
+
+  double get hitRate => layers <= 0 ? 0 : hits / layers;
+
+  static LayerReuseStats? fromMap(Map? raw) {
+    if (raw == null) return null;
+    final layers = raw['layers'] as int? ?? 0;
+    if (layers <= 0) return null;
+    return LayerReuseStats(layers: layers, hits: raw['hits'] as int? ?? 0);
+  }
+}
+
 class DiagnosisItem {
   final String title;
   final String detail;
@@ -53,6 +100,10 @@ class ConversionAnalytics {
   final int cpuCores;
   final int workers;
   final String processingEngine;
+  final String? compressor;
+  // Latency-first mode: when the fast plate and the final plate were ready.
+  final Duration? timeToPrintable;
+  final Duration? timeToFinal;
   final bool gpuActive;
   final int gpuAttempts;
   final int gpuSuccesses;
@@ -60,6 +111,9 @@ class ConversionAnalytics {
   final Map<String, Duration> stages;
   final Map<String, Duration> nativeStages;
   final List<WorkerTiming> workerTimings;
+  final CostModelFit? costModel;
+  final LayerReuseStats? dedup;
+  final LayerReuseStats? layerCache;
   final List<DiagnosisItem> diagnosis;
 
   const ConversionAnalytics({
@@ -68,6 +122,9 @@ class ConversionAnalytics {
     required this.cpuCores,
     required this.workers,
     required this.processingEngine,
+    this.compressor,
+    this.timeToPrintable,
+    this.timeToFinal,
     required this.gpuActive,
     required this.gpuAttempts,
     required this.gpuSuccesses,
@@ -75,6 +132,9 @@ class ConversionAnalytics {
     required this.stages,
     required this.nativeStages,
     required this.workerTimings,
+    this.costModel,
+    this.dedup,
+    this.layerCache,
     required this.diagnosis,
   });
 
@@ -99,6 +159,9 @@ class ConversionAnalytics {
       return Duration(microseconds: (ns / 1000).round());
     }
 
+    Duration? _durFromMs(dynamic v) =>
+        v is int ? Duration(milliseconds: v) : null;
+
     final stages = stageNs.map((k, v) => MapEntry(k, _durFromNs(v)));
     final nativeStages = nativeStageNs.map(
       (k, v) => MapEntry(k, _durFromNs(v)),
@@ -127,6 +190,9 @@ class ConversionAnalytics {
       cpuCores: data['cpuCores'] as int? ?? 0,
       workers: data['workers'] as int? ?? 0,
       processingEngine: data['processingEngine'] as String? ?? 'Unknown',
+      compressor: data['compressor'] as String?,
+      timeToPrintable: _durFromMs(data['timeToPrintableMs']),
+      timeToFinal: _durFromMs(data['timeToFinalMs']),
       gpuActive: data['gpuActive'] as bool? ?? false,
       gpuAttempts: data['gpuAttempts'] as int? ?? 0,
       gpuSuccesses: data['gpuSuccesses'] as int? ?? 0,
@@ -134,6 +200,9 @@ class ConversionAnalytics {
       stages: stages,
       nativeStages: nativeStages,
       workerTimings: workerTimings,
+      costModel: CostModelFit.fromMap(data['costModel'] as Map?),
+      dedup: LayerReuseStats.fromMap(data['dedup'] as Map?),
+      layerCache: LayerReuseStats.fromMap(data['layerCache'] as Map?),
       diagnosis: const [],
     );
 
@@ -144,6 +213,9 @@ class ConversionAnalytics {
       cpuCores: analytics.cpuCores,
       workers: analytics.workers,
       processingEngine: analytics.processingEngine,
+      compressor: analytics.compressor,
+      timeToPrintable: analytics.timeToPrintable,
+      timeToFinal: analytics.timeToFinal,
       gpuActive: analytics.gpuActive,
       gpuAttempts: analytics.gpuAttempts,
       gpuSuccesses: analytics.gpuSuccesses,
@@ -151,6 +223,9 @@ class ConversionAnalytics {
       stages: analytics.stages,
       nativeStages: analytics.nativeStages,
       workerTimings: analytics.workerTimings,
+      costModel: analytics.costModel,
+      dedup: analytics.dedup,
+      layerCache: analytics.layerCache,
       diagnosis: diagnosis,
     );
   }
@@ -162,6 +237,9 @@ class ConversionAnalytics {
       cpuCores: cpuCores,
       workers: workers,
       processingEngine: processingEngine,
+      compressor: compressor,
+      timeToPrintable: timeToPrintable,
+      timeToFinal: timeToFinal,
       gpuActive: gpuActive,
       gpuAttempts: gpuAttempts,
       gpuSuccesses: gpuSuccesses,
@@ -169,6 +247,9 @@ class ConversionAnalytics {
       stages: stages,
       nativeStages: nativeStages,
       workerTimings: workerTimings,
+      costModel: costModel,
+      dedup: dedup,
+      layerCache: layerCache,
       diagnosis: diagnosis,
     );
   }
@@ -298,6 +379,22 @@ List<DiagnosisItem> _analyze(ConversionAnalytics a) {
     }
   }
 
+  final costModel = a.costModel;
+  if (costModel != null && costModel.samples >= 32 &&
+      costModel.correlation < 0.5) {
+    items.add(
+      DiagnosisItem(
+        title: 'Weak layer cost prediction',
+        detail:
+            'Layer time vs encoded size correlation is '
+            '${costModel.correlation.toStringAsFixed(2)} over '
+            '${costModel.samples} layers; longest-first ordering may not '
+            'shorten the batch tail on this file.',
+        score: ((0.5 - costModel.correlation) * 120).clamp(0, 100).toDouble(),
+      ),
+    );
+  }
+
   double _stagePct(String key) {
     final totalMs = a.totalStageTime.inMilliseconds.toDouble();
     if (totalMs <= 0) return 0;
@@ -3,11 +3,18 @@ import 'dart:isolate';
 import 'dart:math' as math;
 import 'dart:typed_data';
 
+import 'package:archive/archive_io.dart';
+
 import '../models/models.dart';
 import 'ctb_parser.dart';
+import 'job_cache.dart';
 import 'layer_processor.dart';
 import 'native_gpu_accel.dart';
 import 'native_layer_batch_process.dart';
+import 'native_layer_source.dart';
+import 'native_png_recompress.dart';
+import 'native_thread_priority.dart';
+import 'native_zip_writer.dart';
 import 'nanodlp_file_writer.dart';
 import 'profile_detector.dart';
 import 'thumbnail_processor.dart';
@@ -33,6 +40,16 @@ class WorkerLog {
   const WorkerLog(this.text);
 }
 
+/// A printable plate was written ahead of the final one (latency-first
+/// mode); the worker keeps running and still sends [WorkerDone]. The final
+/// plate replaces the printable one only after a message on [swapGate],
+/// sent once the caller is done uploading it.
+class WorkerPrintable {
+  final ConversionResult result;
+  final SendPort swapGate;
+  const WorkerPrintable(this.result, this.swapGate);
+}
+
 /// Conversion finished (success or failure).
 class WorkerDone {
   final ConversionResult result;
@@ -80,10 +97,61 @@ class _ThreadStat {
   };
 }
 
+/// Least-squares fit of measured per-layer time against the scheduler's cost
+/// prediction (encoded layer bytes), to validate longest-first ordering.
+class _CostModelStat {
+  int samples = 0;
+  double _sx = 0;
+  double _sy = 0;
+  double _sxx = 0;
+  double _syy = 0;
+  double _sxy = 0;
+
+  void add(NativeCostSamples s) {
+    for (int i = 0; i < s.length; i++) {
+      final y = s.actualNs[i].toDouble();
+      if (y <= 0) continue; // layer was not timed (batch stopped early)
+      final x = s.predicted[i].toDouble();
+      samples++;
+      _sx += x;
+      _sy += y;
+      _sxx += x * x;
+      _syy += y * y;
+      _sxy += x * y;
+    }
+  }
+
+  Map<String, dynamic> toJson() {
+    final result = <String, dynamic>{
+      'predictor': 'inputBytes',
+      'samples': samples,
+    };
+    if (samples < 2) return result;
+    final n = samples.toDouble();
+    final varX = n * _sxx - _sx * _sx;
+    final varY = n * _syy - _sy * _sy;
+    final cov = n * _sxy - _sx * _sy;
+    final slope = varX > 0 ? cov / varX : 0.0;
+    result['correlation'] =
+        varX > 0 && varY > 0 ? cov / math.sqrt(varX * varY) : 0.0;
+    result['nsPerByte'] = slope;
+    result['interceptNs'] = (_sy - slope * _sx) / n;
+    return result;
+  }
+}
+
 class _AnalyticsCollector {
   final bool enabled;
   final Map<String, int> _stageNs = {};
   final List<_ThreadStat> _threads = [];
+  final _CostModelStat _costModel = _CostModelStat();
+  int _dedupLayers = 0;
+  int _dedupHits = 0;
+  int _cacheLayers = 0;
+  int _cacheHits = 0;
+  String? _compressor;
+  Duration? _timeToPrintable;
+  Duration? _timeToFinal;
 
   _AnalyticsCollector(this.enabled);
 
@@ -105,6 +173,41 @@ class _AnalyticsCollector {
     }
   }
 
+  void addCostSamples(NativeCostSamples samples) {
+    if (!enabled || samples.length == 0) return;
+    _costModel.add(samples);
+  }
+
+  /// Count [layers] processed natively, [hits] of which reused the output
+  /// of an identical layer.
+  void addDedup(int layers, int hits) {
+    if (!enabled || layers <= 0) return;
+    _dedupLayers += layers;
+    _dedupHits += hits;
+  }
+
+  /// Count [layers] processed natively, [hits] of which were read back from
+  /// the layer cache.
+  void addLayerCache(int layers, int hits) {
+    if (!enabled || layers <= 0) return;
+    _cacheLayers += layers;
+    _cacheHits += hits;
+  }
+
+  /// Record which deflate backend wrote the job's PNG streams.
+  void setCompressor(String description) {
+    if (!enabled) return;
+    _compressor = description;
+  }
+
+  /// Record when the fast plate and the final plate were ready
+  /// (latency-first mode).
+  void setLatency(Duration printable, Duration finished) {
+    if (!enabled) return;
+    _timeToPrintable = printable;
+    _timeToFinal = finished;
+  }
+
   Map<String, dynamic> toMap({
     required int cpuCores,
     required int workers,
@@ -132,12 +235,27 @@ class _AnalyticsCollector {
       'cpuCores': cpuCores,
       'workers': workers,
       'processingEngine': processingEngine,
+      'compressor': _compressor,
+      if (_timeToPrintable != null)
+        'timeToPrintableMs': _timeToPrintable!.inMilliseconds,
+      if (_timeToFinal != null) 'timeToFinalMs': _timeToFinal!.inMilliseconds,
       'gpuActive': gpuActive,
       'gpuAttempts': gpuAttempts,
       'gpuSuccesses': gpuSuccesses,
       'gpuFallbacks': gpuFallbacks,
       'stagesNs': _stageNs,
       'nativeStagesNs': nativeTotals,
+      'costModel': _costModel.toJson(),
+      'dedup': {
+        'layers': _dedupLayers,
+        'hits': _dedupHits,
+        'hitRate': _dedupLayers > 0 ? _dedupHits / _dedupLayers : 0.0,
+      },
+      'layerCache': {
+        'layers': _cacheLayers,
+        'hits': _cacheHits,
+        'hitRate': _cacheLayers > 0 ? _cacheHits / _cacheLayers : 0.0,
+      },
       'threadStats': [
         for (int i = 0; i < _threads.length; i++) _threads[i].toJson(i),
       ],
@@ -218,10 +336,57 @@ Future<void> conversionWorkerEntry(ConversionWorkerRequest req) async {
     log('Opening ${_fileName(req.ctbPath)}...');
     progress(0, 1, 'Opening CTB file...', force: true);
 
+    // Finished plates are kept between conversions, keyed by the source
+    // file's content hash. The hash pass reads the whole file natively on
+    // its own isolate while the header is parsed and the profile resolved.
+    final jobCacheDir = _settingString(
+      settings,
+      'jobCacheDir',
+      envKey: 'VOXELSHIFT_JOB_CACHE_DIR',
+    );
+    final jobCache =
+        jobCacheDir != null &&
+            _settingBool(
+              settings,
+              'jobCache',
+              envKey: 'VOXELSHIFT_JOB_CACHE',
+              defaultValue: true,
+            )
+        ? JobResultCache(
+            jobCacheDir,
+            (_settingInt(
+                      settings,
+                      'jobCacheMaxMb',
+                      envKey: 'VOXELSHIFT_JOB_CACHE_MAX_MB',
+                    ) ??
+                    4096) <<
+                20,
+          )
+        : null;
+    final sourceStat = jobCache == null ? null : await File(req.ctbPath).stat();
+    final digestFuture = jobCache == null
+        ? null
+        : JobResultCache.digestFile(req.ctbPath);
+
     final openSw = Stopwatch()..start();
     final parser = await CtbParser.open(req.ctbPath);
     openSw.stop();
     analytics.addStage('open', openSw.elapsed);
+    NativeLayerSource? layerSource;
+    var compressPlan = 0;
+    // This job's deflate settings, passed to each of its batches.
+    var encodeJob = 0;
+    // This job's layer cache, or 0 when it does not use one.
+    var layerCache = 0;
+    // Opened when latency-first mode hands over the printable plate.
+    ReceivePort? swapGate;
+    // Set for the background pass; the finally below drops it again even
+    // when the pass throws, since the pool priority is process-wide.
+    var backgroundPriority = false;
+    // The plate is written here and renamed over the output once complete,
+    // so a failed conversion leaves an earlier output untouched; the
+    // finally below removes what is left of it.
+    String? workPath;
 
     try {
       ThumbnailPair? thumbnailPair;
@@ -280,6 +445,112 @@ Future<void> conversionWorkerEntry(ConversionWorkerRequest req) async {
         'max Z: ${targetProfile.maxZHeight}mm)',
       );
 
+      final outputDir = req.outputDirectory ?? File(req.ctbPath).parent.path;
+      final outputName = req.outputFileName ?? _fileNameWithoutExt(req.ctbPath);
+      final outputPath =
+          '$outputDir${Platform.pathSeparator}$outputName.nanodlp';
+      final platePath = '$outputPath.part';
+      workPath = platePath;
+
+      // ── 2b. Job result cache ──────────────────────────────
+      String? jobCacheKey;
+      final digest = await digestFuture;
+      if (jobCache != null && digest != null && sourceStat != null) {
+        jobCacheKey = JobResultCache.keyFor(
+          digest: digest,
+          sourceFileName: _fileName(req.ctbPath),
+          sourceStat: sourceStat,
+          targetProfile: targetProfile,
+          maxZHeightOverride: req.maxZHeightOverride,
+          outputSettings: {
+            'fastMode': _settingBool(
+              settings,
+              'fastMode',
+              envKey: 'VOXELSHIFT_FAST_MODE',
+              defaultValue: false,
+            ),
+            'processPngLevel': _settingInt(
+              settings,
+              'processPngLevel',
+              envKey: 'VOXELSHIFT_PROCESS_PNG_LEVEL',
+            ),
+            'recompressMode': _settingString(
+              settings,
+              'recompressMode',
+              envKey: 'VOXELSHIFT_RECOMPRESS_MODE',
+            ),
+            'islandStats': _settingBool(
+              settings,
+              'islandStats',
+              envKey: 'VOXELSHIFT_ISLAND_STATS',
+              defaultValue: true,
+            ),
+            'deflateWindowBits': _settingInt(
+              settings,
+              'deflateWindowBits',
+              envKey: 'VOXELSHIFT_DEFLATE_WINDOW_BITS',
+            ),
+            'deflateMemLevel': _settingInt(
+              settings,
+              'deflateMemLevel',
+              envKey: 'VOXELSHIFT_DEFLATE_MEM_LEVEL',
+            ),
+            'deflateStrategy': _settingString(
+              settings,
+              'deflateStrategy',
+              envKey: 'VOXELSHIFT_DEFLATE_STRATEGY',
+            ),
+            'deflateEncoder': _settingString(
+              settings,
+              'deflateEncoder',
+              envKey: 'VOXELSHIFT_DEFLATE_ENCODER',
+            ),
+            'splitDeflate': _settingBool(
+              settings,
+              'splitDeflate',
+              envKey: 'VOXELSHIFT_SPLIT_DEFLATE',
+              defaultValue: true,
+            ),
+            'compressDeadlineSec': _settingInt(
+              settings,
+              'compressDeadlineSec',
+              envKey: 'VOXELSHIFT_COMPRESS_DEADLINE',
+            ),
+            'compressTargetMb': _settingInt(
+              settings,
+              'compressTargetMb',
+              envKey: 'VOXELSHIFT_COMPRESS_TARGET_MB',
+            ),
+          },
+        );
+        if (await jobCache.restore(
+          jobCacheKey,
+          outputPath,
+          layerCount: info.layerCount,
+        )) {
+          sw.stop();
+          final fileSize = await File(outputPath).length();
+          log(
+            'Job cache hit: reused the plate from an identical conversion '
+            'in ${sw.elapsedMilliseconds} ms.',
+          );
+          port.send(
+            WorkerDone(
+              ConversionResult(
+                success: true,
+                outputPath: outputPath,
+                sourceInfo: info,
+                targetProfile: targetProfile,
+                layerCount: info.layerCount,
+                outputFileSizeBytes: fileSize,
+                duration: sw.elapsed,
+              ),
+            ),
+          );
+          return;
+        }
+      }
+
       // Optional native GPU backend toggle/detection (safe no-op when unavailable).
       final gpu = NativeGpuAccel.instance;
       bool gpuRequested = false;
@@ -403,8 +674,147 @@ Future<void> conversionWorkerEntry(ConversionWorkerRequest req) async {
         progress(0, info.layerCount, 'Reading layers...', force: true);
       }
 
+      // Native layer input: C reads (or maps) the layer payloads and hands
+      // them to the batch calls without copying through Dart; the next
+      // chunk is read while the current one is processed.
+      final layerInputMode =
+          (_settingString(
+                    settings,
+                    'layerInput',
+                    envKey: 'VOXELSHIFT_LAYER_INPUT',
+                  ) ??
+                  'auto')
+              .toLowerCase()
+              .trim();
+      final layerInputBackend = switch (layerInputMode) {
+        'mmap' => NativeLayerSource.backendMmap,
+        'pread' => NativeLayerSource.backendPread,
+        _ => NativeLayerSource.backendAuto,
+      };
+      if (!shouldPreload &&
+          layerInputMode != 'dart' &&
+          NativeLayerSource.available) {
+        layerSource = NativeLayerSource.open(
+          req.ctbPath,
+          layerOffsets: parser.layerDataOffsets,
+          layerLengths: parser.layerDataLengths,
+          backend: layerInputBackend,
+        );
+        if (layerSource != null) {
+          log('Layer input: native ${layerSource.backendName}.');
+        }
+      }
+
+      // Raw layers [start, end): preloaded bytes, a native chunk (valid
+      // until the next call), or a Dart-side read as the last resort.
+      Future<({List<Uint8List> layers, NativeLayerChunk? native})> readChunk(
+        int start,
+        int end,
+      ) async {
+        if (shouldPreload) {
+          return (layers: rawLayers.sublist(start, end), native: null);
+        }
+        final chunkReadSw = Stopwatch()..start();
+        try {
+          final native = layerSource?.fetch(start, end);
+          if (native != null) {
+            return (layers: const <Uint8List>[], native: native);
+          }
+          return (
+            layers: await _readRawLayerRange(parser, start, end),
+            native: null,
+          );
+        } finally {
+          chunkReadSw.stop();
+          readStreamingTime += chunkReadSw.elapsed;
+        }
+      }
+
       final nativeBatch = NativeLayerBatchProcess.instance;
       nativeBatch.setAnalyticsEnabled(analyticsEnabled);
+
+      // Window size, memLevel and strategy of every PNG deflate stream in
+      // this job; unset values keep zlib's defaults (15, 8, default). The
+      // 'auto' strategy trial-compresses the first layers at each level and
+      // keeps the fastest setting within 1/64 of the smallest output.
+      final deflateWindowBits = _settingInt(
+        settings,
+        'deflateWindowBits',
+        envKey: 'VOXELSHIFT_DEFLATE_WINDOW_BITS',
+      );
+      final deflateMemLevel = _settingInt(
+        settings,
+        'deflateMemLevel',
+        envKey: 'VOXELSHIFT_DEFLATE_MEM_LEVEL',
+      );
+      final deflateStrategy = _deflateStrategyCode(
+        _settingString(
+          settings,
+          'deflateStrategy',
+          envKey: 'VOXELSHIFT_DEFLATE_STRATEGY',
+        ),
+      );
+
+      // The built-in encoder writes layer masks faster than zlib level 1 and
+      // smaller than level 6, so native layers skip the recompress pass.
+      // zlib-ng and libdeflate are loaded at runtime and fall back to zlib
+      // when missing; 'auto' benchmarks the loaded ones once per level.
+      final deflateEncoder = _deflateEncoderCode(
+        _settingString(
+          settings,
+          'deflateEncoder',
+          envKey: 'VOXELSHIFT_DEFLATE_ENCODER',
+        ),
+      );
+
+      // Lone layers (previews, short jobs, few PNGs to recompress) spread
+      // their deflate over the idle threads in row bands.
+      final splitDeflate = _settingBool(
+        settings,
+        'splitDeflate',
+        envKey: 'VOXELSHIFT_SPLIT_DEFLATE',
+        defaultValue: true,
+      );
+      encodeJob = nativeBatch.openEncodeJob(
+        deflateWindowBits ?? -1,
+        deflateMemLevel ?? -1,
+        deflateStrategy,
+        deflateEncoder,
+        splitDeflate: splitDeflate,
+      );
+      if (deflateWindowBits != null ||
+          deflateMemLevel != null ||
+          deflateStrategy > 0) {
+        log(
+          'Deflate streams: window bits ${deflateWindowBits ?? 15}, '
+          'memLevel ${deflateMemLevel ?? 8}, '
+          'strategy ${_deflateStrategyNames[math.max(deflateStrategy, 0)]}.',
+        );
+      }
+      final builtinEncoder = deflateEncoder == _deflateEncoderBuiltin;
+      if (builtinEncoder) {
+        log('PNG encoder: built-in (level, memLevel and strategy unused).');
+      }
+
+      // Backend that wrote the streams at [level], after fallback and the
+      // auto encoder's benchmark; null without the native library.
+      String? deflateEncoderAt(int level) {
+        final code = nativeBatch.deflateEncoder(encodeJob, level);
+        if (code == null || code < 0 || code >= _deflateEncoderAuto) {
+          return null;
+        }
+        return _deflateEncoderNames[code];
+      }
+
+      void logDeflateAutoChoice(int level) {
+        if (deflateStrategy != _deflateStrategyAuto) return;
+        final choice = nativeBatch.deflateAutoChoice(encodeJob, level);
+        if (choice == null) return;
+        log(
+          'Auto deflate for PNG level $level: '
+          '${_deflateStrategyNames[choice.$1]} strategy at level ${choice.$2}.',
+        );
+      }
       final outWidth = targetProfile.pngOutputWidth;
       final outChannels = targetProfile.board == BoardType.rgb8Bit ? 3 : 1;
 
@@ -430,6 +840,112 @@ Future<void> conversionWorkerEntry(ConversionWorkerRequest req) async {
         );
       }
 
+      final recompressModeRaw = _settingString(
+        settings,
+        'recompressMode',
+        envKey: 'VOXELSHIFT_RECOMPRESS_MODE',
+      );
+      final recompressMode =
+          ((recompressModeRaw == null || recompressModeRaw.trim().isEmpty) &&
+                      fastMode
+                  ? 'off'
+                  : (recompressModeRaw ?? 'adaptive'))
+              .toLowerCase()
+              .trim();
+
+      // plate.json only needs each layer's total area and bounding box; the
+      // island fields (LargestArea, SmallestArea, AreaCount) only feed
+      // info.json, so native batches skip island labelling when they are off.
+      final islandStats = _settingBool(
+        settings,
+        'islandStats',
+        envKey: 'VOXELSHIFT_ISLAND_STATS',
+        defaultValue: true,
+      );
+      final areaMode = islandStats ? NativeAreaMode.full : NativeAreaMode.bbox;
+      if (!islandStats) {
+        log(
+          'Island stats disabled: native layers compute area and bounds '
+          'only.',
+        );
+      }
+
+      // zlib level layers end up at once any recompress pass has run.
+      final finalPngLevel = switch (recompressMode) {
+        'off' || 'false' || '0' => processPngLevel,
+        _ => math.max(
+          processPngLevel,
+          recompressLevelForLayerCount(info.layerCount),
+        ),
+      };
+
+      // Compression plan: with a deadline or a target size, native batches
+      // pick each layer's zlib level from measured throughput and size
+      // instead of using one level and a recompress pass.
+      final compressDeadlineSec = _settingInt(
+        settings,
+        'compressDeadlineSec',
+        envKey: 'VOXELSHIFT_COMPRESS_DEADLINE',
+      );
+      final compressTargetMb = _settingInt(
+        settings,
+        'compressTargetMb',
+        envKey: 'VOXELSHIFT_COMPRESS_TARGET_MB',
+      );
+      final planRequested = !builtinEncoder &&
+          (compressDeadlineSec != null || compressTargetMb != null);
+
+      // Latency-first (post-processor mode): the plate is first written at
+      // [processPngLevel] and handed over for upload and printing, then
+      // re-encoded at [finalPngLevel] in the background and swapped in.
+      final latencyFirst = finalPngLevel > processPngLevel &&
+          !builtinEncoder &&
+          !planRequested &&
+          _settingBool(
+            settings,
+            'latencyFirst',
+            envKey: 'VOXELSHIFT_LATENCY_FIRST',
+            defaultValue: false,
+          );
+      if (latencyFirst) {
+        log(
+          'Latency-first mode: printable plate at PNG level '
+          '$processPngLevel, final plate at level $finalPngLevel.',
+        );
+      }
+
+      // Finished layers are kept on disk between conversions, keyed by
+      // layer content and output settings, so a re-exported plate only
+      // converts the layers that changed. Cached layers are stored at
+      // [finalPngLevel] and skip the recompress pass.
+      final layerCacheDir = _settingString(
+        settings,
+        'layerCacheDir',
+        envKey: 'VOXELSHIFT_LAYER_CACHE_DIR',
+      );
+      final layerCacheMaxMb = _settingInt(
+            settings,
+            'layerCacheMaxMb',
+            envKey: 'VOXELSHIFT_LAYER_CACHE_MAX_MB',
+          ) ??
+          2048;
+      if (layerCacheDir != null &&
+          _settingBool(
+            settings,
+            'layerCache',
+            envKey: 'VOXELSHIFT_LAYER_CACHE',
+            defaultValue: true,
+          )) {
+        layerCache = nativeBatch.openLayerCache(
+          layerCacheDir,
+          layerCacheMaxMb << 20,
+        );
+      }
+      final layerCacheEnabled = layerCache != 0;
+      if (layerCacheEnabled) {
+        log('Layer cache: $layerCacheDir (limit $layerCacheMaxMb MB).');
+      }
+
       // Process in parallel using worker pool
       var processingEngine = _processingEngineLabel(
         gpuAccelActive,
@@ -725,6 +1241,9 @@ Future<void> conversionWorkerEntry(ConversionWorkerRequest req) async {
             xPixelSizeMm: xPix,
             yPixelSizeMm: yPix,
             pngLevel: processPngLevel,
+            encodeJob: encodeJob,
+            layerCache: layerCache,
+            areaMode: areaMode,
             threadCount: backendGpuWorkersBench,
           );
           sw.stop();
@@ -778,6 +1297,9 @@ Future<void> conversionWorkerEntry(ConversionWorkerRequest req) async {
             xPixelSizeMm: xPix,
             yPixelSizeMm: yPix,
             pngLevel: processPngLevel,
+            encodeJob: encodeJob,
+            layerCache: layerCache,
+            areaMode: areaMode,
             threadCount: cpuWorkersBench,
           );
           cpuSw.stop();
@@ -877,11 +1399,213 @@ Future<void> conversionWorkerEntry(ConversionWorkerRequest req) async {
       }
 
       bool usedNativeBatch = false;
+      // Set when layers were encoded at [finalPngLevel] for the layer cache.
+      bool layersAtFinalLevel = false;
       final processingPhaseSw = Stopwatch()..start();
       var processingGpuAttempts = 0;
       var processingGpuSuccesses = 0;
       var processingGpuFallbacks = 0;
 
+      final sourceProfile = PrinterProfileDetector.detectSourceProfile(
+        info.resolutionX,
+        info.resolutionY,
+      );
+
+      NanoDlpPlateMetadata buildMetadata(int layerCount) =>
+          NanoDlpPlateMetadata(
+            sourceFile: _fileName(req.ctbPath),
+            sourcePrinterProfile:
+                sourceProfile?.name ?? info.machineName ?? 'Unknown',
+            targetPrinterProfile: targetProfile.name,
+            resolutionX: info.resolutionX,
+            resolutionY: info.resolutionY,
+            displayWidthMm: info.displayWidth,
+            displayHeightMm: info.displayHeight,
+            maxZHeightMm: maxZ,
+            layerHeightMm: info.layerHeight,
+            layerCount: layerCount,
+            bottomExposureTimeSec: info.bottomExposureTime,
+            normalExposureTimeSec: info.exposureTime,
+            bottomLayerCount: info.bottomLayerCount,
+            liftHeightMm: info.liftHeight,
+            liftSpeedMmPerMin: info.liftSpeed,
+            retractSpeedMmPerMin: info.retractSpeed,
+            xPixelSizeMm: xPix,
+            yPixelSizeMm: yPix,
+            thumbnailPng: thumbnailPair?.nanodlpThumbnail,
+          );
+
+      // Set when latency-first mode handed over the fast plate.
+      Duration? timeToPrintable;
+
+      /// Move the finished plate from [platePath] over [outputPath]. Runs
+      /// once; later calls find nothing left to move.
+      Future<void> publishPlate() async {
+        final plate = File(platePath);
+        if (await plate.exists()) await plate.rename(outputPath);
+      }
+
+      /// Hand the fast plate at [outputPath] to the caller; the worker keeps
+      /// running and finishConversion reports the final plate.
+      Future<void> finishPrintable(int layerCount) async {
+        await publishPlate();
+        final printable = sw.elapsed;
+        timeToPrintable = printable;
+        final fileSize = await File(outputPath).length();
+        final gate = ReceivePort();
+        swapGate = gate;
+        log(
+          'Printable plate ready: $outputPath '
+          '(${(fileSize / 1024 / 1024).toStringAsFixed(1)} MB) '
+          'in ${(printable.inMilliseconds / 1000).toStringAsFixed(1)}s; '
+          'recompressing in the background.',
+        );
+        port.send(
+          WorkerPrintable(
+            ConversionResult(
+              success: true,
+              outputPath: outputPath,
+              sourceInfo: info,
+              targetProfile: targetProfile,
+              layerCount: layerCount,
+              outputFileSizeBytes: fileSize,
+              duration: printable,
+              timeToPrintable: printable,
+              finalPending: true,
+            ),
+            gate.sendPort,
+          ),
+        );
+        backgroundPriority = true;
+        NativeThreadPriority.instance.setBackgroundPriority(true);
+        nativeBatch.setEncodeJobBackground(encodeJob, true);
+      }
+
+      /// Log how the plan split the layers and how close its projection was.
+      void logCompressPlan(int fileSize) {
+        final report = nativeBatch.compressPlanReport(compressPlan);
+        if (report == null || report.layersDone == 0) return;
+        final split = [
+          for (final e in report.levelLayers.entries) 'L${e.key}: ${e.value}',
+        ].join(', ');
+        log(
+          'Compression plan: $split '
+          '(${report.layersReused} reused, ${report.probes} probes, '
+          '${report.replans} replans).',
+        );
+        if (report.plannedBytes <= 0) return;
+        String delta(num actual, num planned) {
+          final pct = (actual - planned) * 100 / planned;
+          return '${pct >= 0 ? '+' : ''}${pct.toStringAsFixed(1)}%';
+        }
+        final plannedMb = report.plannedBytes / 1024 / 1024;
+        final actualMb = report.actualBytes / 1024 / 1024;
+        final plannedSec = report.plannedTime.inMilliseconds / 1000;
+        final actualSec = report.actualTime.inMilliseconds / 1000;
+        log(
+          '  Planned ${plannedMb.toStringAsFixed(1)} MB of layers in '
+          '${plannedSec.toStringAsFixed(1)}s, got '
+          '${actualMb.toStringAsFixed(1)} MB '
+          '(${delta(actualMb, plannedMb)}) in '
+          '${actualSec.toStringAsFixed(1)}s '
+          '(${delta(actualSec, plannedSec)}); plate '
+          '${(fileSize / 1024 / 1024).toStringAsFixed(1)} MB.',
+        );
+        final budget = report.budget;
+        final target = report.targetBytes;
+        final missedDeadline = budget != null && report.actualTime > budget;
+        final missedTarget = target != null && report.actualBytes > target;
+        if (report.unreachable && (missedDeadline || missedTarget)) {
+          log(
+            '  The ${missedDeadline ? 'deadline' : 'target size'} was out '
+            'of reach; the plan got as close as it could.',
+          );
+        }
+      }
+
+      /// Finish the job. [fastPlateKept] is true when latency-first mode
+      /// could not replace the fast plate: the result reports it and the job
+      /// cache, whose key describes the final plate, is not updated.
+      Future<void> finishConversion(
+        int layerCount, {
+        bool fastPlateKept = false,
+      }) async {
+        await publishPlate();
+        sw.stop();
+        final fileSize = await File(outputPath).length();
+        final cacheKey = jobCacheKey;
+        if (fastPlateKept) {
+          log('Background recompress failed; keeping the printable plate.');
+        }
+        if (jobCache != null && cacheKey != null && !fastPlateKept) {
+          await jobCache.store(cacheKey, outputPath);
+        }
+        logCompressPlan(fileSize);
+        logDeflateAutoChoice(processPngLevel);
+        if (finalPngLevel != processPngLevel) {
+          logDeflateAutoChoice(finalPngLevel);
+        }
+        final compressors = <String>[
+          for (final level in {processPngLevel, finalPngLevel})
+            if (deflateEncoderAt(level) case final name?)
+              '$name at level $level',
+        ].join(', ');
+        if (compressors.isNotEmpty) {
+          if (deflateEncoder != _deflateEncoderZlib && !builtinEncoder) {
+            log('PNG encoder: $compressors.');
+          }
+          analytics.setCompressor(compressors);
+        }
+
+        log(
+          'Conversion complete: $outputPath '
+          '(${(fileSize / 1024 / 1024).toStringAsFixed(1)} MB) '
+          'in ${(sw.elapsedMilliseconds / 1000).toStringAsFixed(1)}s',
+        );
+        final printable = timeToPrintable;
+        if (printable != null) {
+          log(
+            'Time to printable: '
+            '${(printable.inMilliseconds / 1000).toStringAsFixed(1)}s, '
+            'time to final: '
+            '${(sw.elapsedMilliseconds / 1000).toStringAsFixed(1)}s.',
+          );
+          analytics.setLatency(printable, sw.elapsed);
+        }
+
+        if (analyticsEnabled) {
+          port.send(
+            WorkerAnalyticsUpdate(
+              analytics.toMap(
+                cpuCores: Platform.numberOfProcessors,
+                workers: processingMaxConcurrency,
+                processingEngine: processingEngine,
+                gpuActive: gpuAccelActive,
+                gpuAttempts: processingGpuAttempts,
+                gpuSuccesses: processingGpuSuccesses,
+                gpuFallbacks: processingGpuFallbacks,
+              ),
+            ),
+          );
+        }
+
+        port.send(
+          WorkerDone(
+            ConversionResult(
+              success: true,
+              outputPath: outputPath,
+              sourceInfo: info,
+              targetProfile: targetProfile,
+              layerCount: layerCount,
+              outputFileSizeBytes: fileSize,
+              duration: sw.elapsed,
+              timeToPrintable: printable,
+              fastPlateKept: fastPlateKept,
+            ),
+          ),
+        );
+      }
+
       // ── Try phased pipeline (opt-in, CPU+GPU hybrid) ──
       // For large layers (16K), the integrated chunked pipeline with per-layer
       // GPU is typically faster due to natural overlap between decode/scanlines/
@@ -893,6 +1617,372 @@ Future<void> conversionWorkerEntry(ConversionWorkerRequest req) async {
         envKey: 'VOXELSHIFT_USE_PHASED',
         defaultValue: false,
       );
+
+      // The phased pipeline and the Dart fallback encode at fixed levels.
+      // The target covers the whole plate, so the planner gets it less an
+      // allowance for metadata and archive headers.
+      // Opened again for a fallback pipeline, so the deadline counts from
+      // the time already spent.
+      int openPlan() {
+        final deadline = compressDeadlineSec;
+        final targetMb = compressTargetMb;
+        return nativeBatch.openCompressPlan(
+          info.layerCount,
+          budget: deadline == null
+              ? null
+              : Duration(
+                  milliseconds: math.max(
+                    1,
+                    deadline * 1000 - sw.elapsedMilliseconds,
+                  ),
+                ),
+          targetBytes: targetMb == null
+              ? null
+              : math.max(
+                  1,
+                  targetMb * 1024 * 1024 -
+                      info.layerCount * _planArchiveBytesPerLayer,
+                ),
+        );
+      }
+
+      if (planRequested && !usePhasedPipeline) {
+        compressPlan = openPlan();
+        if (compressPlan != 0) {
+          final deadline = compressDeadlineSec;
+          final targetMb = compressTargetMb;
+          final goals = [
+            if (deadline != null) 'a ${deadline}s deadline',
+            if (targetMb != null) 'a $targetMb MB plate',
+          ].join(' and ');
+          log('Compression plan: per-layer PNG levels for $goals.');
+        }
+      }
+
+      /// Swap the plan for a fresh one before a fallback pipeline: the
+      /// aborted one already booked its layers and time in the old plan.
+      void reopenPlan() {
+        if (compressPlan == 0) return;
+        nativeBatch.closeCompressPlan(compressPlan);
+        compressPlan = openPlan();
+      }
+
+      // ── Streaming pipeline (bounded memory) ──
+      // Layers go read → decode → scanlines → deflate → ZIP without ever
+      // being collected, so peak RAM is set by the number of in-flight
+      // layers instead of the job size. There is no separate recompress
+      // pass here: layers are deflated once at the final level.
+      final streamingModeRaw =
+          (_settingString(
+                    settings,
+                    'streamingMode',
+                    envKey: 'VOXELSHIFT_STREAMING_MODE',
+                  ) ??
+                  'auto')
+              .toLowerCase()
+              .trim();
+      final streamingRequested = switch (streamingModeRaw) {
+        'off' || 'false' || '0' => false,
+        'on' || 'true' || '1' => true,
+        _ => !shouldPreload,
+      };
+      if (streamingRequested &&
+          !usePhasedPipeline &&
+          nativeBatch.available &&
+          nativeBatch.streamAvailable &&
+          NativeZipWriter.instance.available) {
+        final streamChunkSize = math.min(96, info.layerCount);
+        final maxInFlight = processingMaxConcurrency * 2;
+
+        // Single native call: CTB parse, layer reads, processing and the
+        // archive writes all happen in C; Dart only supplies metadata.
+        // Preloaded jobs already hold every layer in RAM, so they keep
+        // feeding the in-memory bytes below.
+        final useNativeConvert = !shouldPreload &&
+            nativeBatch.convertFileAvailable &&
+            _settingBool(
+              settings,
+              'nativeConvert',
+              envKey: 'VOXELSHIFT_NATIVE_CONVERT',
+              defaultValue: true,
+            );
+        // Latency-first: the printable plate is streamed at the fast level,
+        // then its PNGs are re-deflated in the background for the final one.
+        final streamPngLevel = latencyFirst ? processPngLevel : finalPngLevel;
+        log(
+          'Using streaming pipeline [$processingEngine] '
+          '(PNG level: $streamPngLevel, in-flight cap: $maxInFlight layers).',
+        );
+        log('Writing ${_fileName(outputPath)}...');
+        progress(
+          0,
+          info.layerCount,
+          'Processing layers (streaming)... [$processingEngine]',
+          workers: processingMaxConcurrency,
+          force: true,
+        );
+
+        final streamLogStep = (info.layerCount ~/ 4).clamp(1, info.layerCount);
+        int nextStreamLog = streamLogStep;
+        int streamed = 0;
+        final writer = NanoDlpFileWriter();
+        final metadata = buildMetadata(info.layerCount);
+
+        /// Latency-first background pass for a streamed plate: hand over the
+        /// fast plate, re-deflate its layer PNGs at [finalPngLevel] on half
+        /// the workers into a plate next to it (recompress_png_batch; the
+        /// layers are not decoded again) and swap that in after the upload.
+        Future<void> finishStreamedLatencyFirst(
+          List<LayerAreaInfo> areas,
+        ) async {
+          await finishPrintable(info.layerCount);
+          final backgroundSw = Stopwatch()..start();
+          final finalPath = '$outputPath.tmp';
+          final finalOk = await writer.writeStreamingAsync(
+                finalPath,
+                metadata,
+                writeLayers: (zip) async => await _recompressPlateLayers(
+                      fastPath: outputPath,
+                      zip: zip,
+                      layerCount: info.layerCount,
+                      pngLevel: finalPngLevel,
+                      encodeJob: encodeJob,
+                      threads: math.max(1, processingMaxConcurrency ~/ 2),
+                      chunkLayers: streamChunkSize,
+                      log: log,
+                    )
+                    ? areas
+                    : null,
+              ) &&
+              await _swapInFinalPlate(finalPath, outputPath, swapGate!, log);
+          backgroundSw.stop();
+          analytics.addStage('background', backgroundSw.elapsed);
+          if (!finalOk) {
+            final partial = File(finalPath);
+            if (await partial.exists()) await partial.delete();
+          }
+          await finishConversion(info.layerCount, fastPlateKept: !finalOk);
+        }
+
+        if (useNativeConvert) {
+          await Directory(outputDir).create(recursive: true);
+
+          NativeConvertResult? convertTo(
+            String path,
+            int pngLevel,
+            int threads, {
+            void Function(int done, int total)? onProgress,
+          }) {
+            nativeBatch.setBatchThreads(threads);
+            return nativeBatch.convertFile(
+              ctbPath: req.ctbPath,
+              outputPath: path,
+              headEntries: writer.buildHeadEntries(metadata),
+              outWidth: outWidth,
+              channels: outChannels,
+              xPixelSizeMm: xPix,
+              yPixelSizeMm: yPix,
+              pngLevel: pngLevel,
+              compressPlan: compressPlan,
+              encodeJob: encodeJob,
+              layerCache: layerCache,
+              areaMode: areaMode,
+              threadCount: threads,
+              maxInFlight: threads * 2,
+              chunkLayers: streamChunkSize,
+              inputBackend: layerInputBackend,
+              headerOverride: parser.hasEncryptedSettings
+                  ? (
+                      layerTableOffset: parser.layerTableOffset,
+                      layerCount: parser.layerCount,
+                      resolutionX: parser.resolutionX,
+                      resolutionY: parser.resolutionY,
+                      encryptionKey: parser.encryptionKey,
+                    )
+                  : null,
+              onProgress: onProgress,
+            );
+          }
+
+          Future<bool> finishArchive(
+            NativeConvertResult? converted,
+            String path,
+          ) async {
+            if (converted == null || !converted.ok) return false;
+            final zip = NativeZipWriter.instance.adoptStream(
+              converted.zipHandle,
+            );
+            return zip != null &&
+                await writer.finishStreamingAsync(
+                  zip,
+                  path,
+                  metadata,
+                  converted.areas,
+                );
+          }
+
+          final converted = convertTo(
+            platePath,
+            streamPngLevel,
+            processingMaxConcurrency,
+            onProgress: (done, total) {
+              streamed = done;
+              progress(
+                done,
+                total,
+                'Processing layers (native)... [$processingEngine]',
+                workers: processingMaxConcurrency,
+              );
+              while (done >= nextStreamLog && nextStreamLog <= total) {
+                log('  Layer $nextStreamLog/$total');
+                nextStreamLog += streamLogStep;
+              }
+            },
+          );
+
+          final convertedOk = await finishArchive(converted, platePath);
+          processingPhaseSw.stop();
+
+          if (convertedOk) {
+            processingEngine =
+                NativeLayerBatchProcess.backendNameFor(converted!.backendCode);
+            processingGpuAttempts = converted.gpuAttempts;
+            processingGpuSuccesses = converted.gpuSuccesses;
+            processingGpuFallbacks = converted.gpuFallbacks;
+            analytics.addStage('process', converted.processTime);
+            analytics.addStage('read', converted.readTime);
+            analytics.addDedup(converted.layersDone, converted.dedupHits);
+            analytics.addLayerCache(converted.layersDone, converted.cacheHits);
+            log(
+              'Native conversion finished in '
+              '${(processingPhaseSw.elapsedMilliseconds / 1000).toStringAsFixed(2)}s '
+              '[$processingEngine].',
+            );
+            if (streamPngLevel == finalPngLevel) {
+              await finishConversion(info.layerCount);
+            } else {
+              await finishStreamedLatencyFirst(converted.areas);
+            }
+            return;
+          }
+
+          log(
+            'Native conversion failed at layer $streamed '
+            '(${converted?.errorName ?? 'unavailable'}) '
+            '— falling back to streaming pipeline.',
+          );
+          reopenPlan();
+          processingPhaseSw
+            ..reset()
+            ..start();
+          nextStreamLog = streamLogStep;
+          streamed = 0;
+        }
+
+        List<LayerAreaInfo>? streamedAreas;
+        final streamingOk = await writer.writeStreamingAsync(
+          platePath,
+          metadata,
+          writeLayers: (zip) async {
+            final areas = <LayerAreaInfo>[];
+            for (
+              int start = 0;
+              start < info.layerCount;
+              start += streamChunkSize
+            ) {
+              final end = math.min(start + streamChunkSize, info.layerCount);
+              final chunk = await readChunk(start, end);
+
+              nativeBatch.setBatchThreads(processingMaxConcurrency);
+              final chunkAreas = nativeBatch.processBatchToZip(
+                zipHandle: zip.handle,
+                rawLayers: chunk.layers,
+                input: chunk.native,
+                layerIndexBase: start,
+                encryptionKey: parser.encryptionKey,
+                srcWidth: info.resolutionX,
+                height: info.resolutionY,
+                outWidth: outWidth,
+                channels: outChannels,
+                xPixelSizeMm: xPix,
+                yPixelSizeMm: yPix,
+                pngLevel: streamPngLevel,
+                compressPlan: compressPlan,
+                encodeJob: encodeJob,
+                layerCache: layerCache,
+                areaMode: areaMode,
+                threadCount: processingMaxConcurrency,
+                maxInFlight: maxInFlight,
+              );
+              if (chunkAreas == null || chunkAreas.length != end - start) {
+                return null;
+              }
+              areas.addAll(chunkAreas);
+
+              processingEngine = nativeBatch.lastBackendName;
+              processingGpuAttempts += nativeBatch.lastGpuAttempts;
+              processingGpuSuccesses += nativeBatch.lastGpuSuccesses;
+              processingGpuFallbacks += nativeBatch.lastGpuFallbacks;
+              if (analyticsEnabled) {
+                analytics.addNativeStats(nativeBatch.getLastThreadStats());
+                analytics.addCostSamples(nativeBatch.getLastCostSamples());
+                analytics.addDedup(end - start, nativeBatch.lastDedupHits);
+                analytics.addLayerCache(end - start, nativeBatch.lastCacheHits);
+              }
+
+              streamed = end;
+              progress(
+                streamed,
+                info.layerCount,
+                'Processing layers (streaming)... [$processingEngine]',
+                workers: processingMaxConcurrency,
+                force: true,
+              );
+              while (streamed >= nextStreamLog &&
+                  nextStreamLog <= info.layerCount) {
+                log('  Layer $nextStreamLog/${info.layerCount}');
+                nextStreamLog += streamLogStep;
+              }
+              // Let progress/log messages flush between chunks.
+              await Future.delayed(Duration.zero);
+            }
+            return streamedAreas = areas;
+          },
+        );
+        processingPhaseSw.stop();
+
+        if (streamingOk) {
+          analytics.addStage('process', processingPhaseSw.elapsed);
+          if (!shouldPreload && readStreamingTime.inMicroseconds > 0) {
+            analytics.addStage('read', readStreamingTime);
+          }
+          log(
+            'Streaming pipeline finished in '
+            '${(processingPhaseSw.elapsedMilliseconds / 1000).toStringAsFixed(2)}s '
+            '[$processingEngine].',
+          );
+          if (streamPngLevel == finalPngLevel) {
+            await finishConversion(info.layerCount);
+          } else {
+            await finishStreamedLatencyFirst(streamedAreas!);
+          }
+          return;
+        }
+
+        log(
+          'Streaming pipeline failed at layer $streamed '
+          '— falling back to in-memory pipeline.',
+        );
+        reopenPlan();
+        processingPhaseSw
+          ..reset()
+          ..start();
+        readStreamingTime = Duration.zero;
+        processingGpuAttempts = 0;
+        processingGpuSuccesses = 0;
+        processingGpuFallbacks = 0;
+      }
+
       if (usePhasedPipeline &&
           nativeBatch.available &&
           nativeBatch.phasedAvailable) {
@@ -931,19 +2021,12 @@ Future<void> conversionWorkerEntry(ConversionWorkerRequest req) async {
 
         for (int start = 0; start < info.layerCount; start += phasedChunkSize) {
           final end = math.min(start + phasedChunkSize, info.layerCount);
-          late final List<Uint8List> chunk;
-          if (shouldPreload) {
-            chunk = rawLayers.sublist(start, end);
-          } else {
-            final chunkReadSw = Stopwatch()..start();
-            chunk = await _readRawLayerRange(parser, start, end);
-            chunkReadSw.stop();
-            readStreamingTime += chunkReadSw.elapsed;
-          }
+          final chunk = await readChunk(start, end);
 
           nativeBatch.setBatchThreads(phasedThreads);
           final chunkResults = nativeBatch.processBatchPhased(
-            rawLayers: chunk,
+            rawLayers: chunk.layers,
+            input: chunk.native,
             layerIndexBase: start,
             encryptionKey: parser.encryptionKey,
             srcWidth: info.resolutionX,
@@ -953,11 +2036,13 @@ Future<void> conversionWorkerEntry(ConversionWorkerRequest req) async {
             xPixelSizeMm: xPix,
             yPixelSizeMm: yPix,
             pngLevel: processPngLevel,
+            encodeJob: encodeJob,
+            areaMode: areaMode,
             threadCount: phasedThreads,
             useGpuBatch: useMegaBatchGpu,
           );
 
-          if (chunkResults == null || chunkResults.length != chunk.length) {
+          if (chunkResults == null || chunkResults.length != end - start) {
             phasedFailed = true;
             break;
           }
@@ -1028,24 +2113,20 @@ Future<void> conversionWorkerEntry(ConversionWorkerRequest req) async {
             ? 64
             : 96;
 
+        final chunkPngLevel = layerCacheEnabled && !latencyFirst
+            ? finalPngLevel
+            : processPngLevel;
         int done = 0;
         final chunkLogStep = (info.layerCount ~/ 4).clamp(1, info.layerCount);
         int nextChunkLog = chunkLogStep;
         for (int start = 0; start < info.layerCount; start += nativeChunkSize) {
           final end = math.min(start + nativeChunkSize, info.layerCount);
-          late final List<Uint8List> chunk;
-          if (shouldPreload) {
-            chunk = rawLayers.sublist(start, end);
-          } else {
-            final chunkReadSw = Stopwatch()..start();
-            chunk = await _readRawLayerRange(parser, start, end);
-            chunkReadSw.stop();
-            readStreamingTime += chunkReadSw.elapsed;
-          }
+          final chunk = await readChunk(start, end);
 
           nativeBatch.setBatchThreads(processingMaxConcurrency);
           final chunkResults = nativeBatch.processBatch(
-            rawLayers: chunk,
+            rawLayers: chunk.layers,
+            input: chunk.native,
             layerIndexBase: start,
             encryptionKey: parser.encryptionKey,
             srcWidth: info.resolutionX,
@@ -1054,11 +2135,15 @@ Future<void> conversionWorkerEntry(ConversionWorkerRequest req) async {
             channels: outChannels,
             xPixelSizeMm: xPix,
             yPixelSizeMm: yPix,
-            pngLevel: processPngLevel,
+            pngLevel: chunkPngLevel,
+            compressPlan: compressPlan,
+            encodeJob: encodeJob,
+            layerCache: layerCache,
+            areaMode: areaMode,
             threadCount: processingMaxConcurrency,
           );
 
-          if (chunkResults == null || chunkResults.length != chunk.length) {
+          if (chunkResults == null || chunkResults.length != end - start) {
             usedNativeBatch = false;
             break;
           }
@@ -1069,9 +2154,14 @@ Future<void> conversionWorkerEntry(ConversionWorkerRequest req) async {
           processingGpuFallbacks += nativeBatch.lastGpuFallbacks;
           if (analyticsEnabled) {
             analytics.addNativeStats(nativeBatch.getLastThreadStats());
+            analytics.addCostSamples(nativeBatch.getLastCostSamples());
+            analytics.addDedup(end - start, nativeBatch.lastDedupHits);
+            analytics.addLayerCache(end - start, nativeBatch.lastCacheHits);
           }
 
           usedNativeBatch = true;
+          layersAtFinalLevel =
+              (layerCacheEnabled && !latencyFirst) || compressPlan != 0;
           for (final r in chunkResults) {
             layerImages.add(r.pngBytes);
             layerAreas.add(r.areaInfo);
@@ -1098,6 +2188,7 @@ Future<void> conversionWorkerEntry(ConversionWorkerRequest req) async {
       if (!usedNativeBatch) {
         layerImages.clear();
         layerAreas.clear();
+        layersAtFinalLevel = false;
         processingEngine = 'CPU Dart';
         log('Processing engine fallback: $processingEngine');
 
@@ -1199,38 +2290,70 @@ Future<void> conversionWorkerEntry(ConversionWorkerRequest req) async {
         'Preparing compression pass...',
         force: true,
       );
-      final recompressModeRaw = _settingString(
-        settings,
-        'recompressMode',
-        envKey: 'VOXELSHIFT_RECOMPRESS_MODE',
-      );
-      final recompressMode =
-          ((recompressModeRaw == null || recompressModeRaw.trim().isEmpty) &&
-                      fastMode
-                  ? 'off'
-                  : (recompressModeRaw ?? 'adaptive'))
-              .toLowerCase()
-              .trim();
-      final shouldRecompress = switch (recompressMode) {
-        'off' || 'false' || '0' => false,
-        'on' || 'true' || '1' || 'force' => true,
-        _ => _shouldRecompressLayers(layerImages, log),
-      };
-
-      if (!shouldRecompress && recompressMode != 'adaptive') {
+      final builtinLayers = builtinEncoder && usedNativeBatch;
+      final shouldRecompress = !layersAtFinalLevel &&
+          !builtinLayers &&
+          switch (recompressMode) {
+            'off' || 'false' || '0' => false,
+            'on' || 'true' || '1' || 'force' => true,
+            _ => _shouldRecompressLayers(layerImages, encodeJob, log),
+          };
+
+      if (layersAtFinalLevel && compressPlan != 0) {
+        log('Skipping PNG recompression (layers encoded at planned levels).');
+      } else if (layersAtFinalLevel) {
+        log('Skipping PNG recompression (layers encoded at final level).');
+      } else if (builtinLayers) {
+        log('Skipping PNG recompression (built-in encoder).');
+      } else if (!shouldRecompress && recompressMode != 'adaptive') {
         log('Skipping PNG recompression (mode: $recompressMode).');
       }
 
+      // ── 4. Metadata ───────────────────────────────────────
+      final metadata = buildMetadata(layerImages.length);
+      final writer = NanoDlpFileWriter();
+
+      // ── 5. Write .nanodlp ZIP ─────────────────────────────
+      Future<void> writePlate(String path) async {
+        log('Writing ${_fileName(path)}...');
+        final writeSw = Stopwatch()..start();
+        await writer.writeAsync(
+          path,
+          layerImages,
+          metadata,
+          layerAreaInfos: layerAreas,
+          onProgress: (p) {
+            progress(
+              (p * layerImages.length).round(),
+              layerImages.length,
+              'Writing NanoDLP file...',
+            );
+          },
+        );
+        writeSw.stop();
+        analytics.addStage('write', writeSw.elapsed);
+      }
+
+      // Latency-first: the fast layers go out as the printable plate and
+      // the recompress pass below runs on half the workers.
+      final deferRecompress = shouldRecompress && latencyFirst;
+      if (deferRecompress) {
+        await writePlate(platePath);
+        await finishPrintable(layerImages.length);
+      }
+
       if (shouldRecompress) {
         final recompressSw = Stopwatch()..start();
         log('Recompressing ${layerImages.length} PNGs (adaptive pass)...');
-        final recompressWorkers =
+        final fullWorkers =
             _positiveEnvInt('VOXELSHIFT_RECOMPRESS_WORKERS') ??
             _nativeWorkerTarget(
               layerCount: layerImages.length,
               gpuActive: false,
               settings: settings,
             );
+        final recompressWorkers =
+            deferRecompress ? math.max(1, fullWorkers ~/ 2) : fullWorkers;
         int? compressWorkers;
         final compressStep = (info.layerCount ~/ 4).clamp(1, info.layerCount);
         int nextCompressLog = compressStep;
@@ -1238,6 +2361,7 @@ Future<void> conversionWorkerEntry(ConversionWorkerRequest req) async {
         final recompressed = await recompressPngsParallel(
           pngs: layerImages,
           maxConcurrency: recompressWorkers,
+          encodeJob: encodeJob,
           onWorkersReady: (workers) {
             compressWorkers = workers;
             progress(
@@ -1277,101 +2401,46 @@ Future<void> conversionWorkerEntry(ConversionWorkerRequest req) async {
         log('Skipping PNG recompression (expected gain too small).');
       }
 
-      // ── 4. Metadata ───────────────────────────────────────
-      final sourceProfile = PrinterProfileDetector.detectSourceProfile(
-        info.resolutionX,
-        info.resolutionY,
-      );
-
-      final metadata = NanoDlpPlateMetadata(
-        sourceFile: _fileName(req.ctbPath),
-        sourcePrinterProfile:
-            sourceProfile?.name ?? info.machineName ?? 'Unknown',
-        targetPrinterProfile: targetProfile.name,
-        resolutionX: info.resolutionX,
-        resolutionY: info.resolutionY,
-        displayWidthMm: info.displayWidth,
-        displayHeightMm: info.displayHeight,
-        maxZHeightMm: maxZ,
-        layerHeightMm: info.layerHeight,
-        layerCount: layerImages.length,
-        bottomExposureTimeSec: info.bottomExposureTime,
-        normalExposureTimeSec: info.exposureTime,
-        bottomLayerCount: info.bottomLayerCount,
-        liftHeightMm: info.liftHeight,
-        liftSpeedMmPerMin: info.liftSpeed,
-        retractSpeedMmPerMin: info.retractSpeed,
-        xPixelSizeMm: xPix,
-        yPixelSizeMm: yPix,
-        thumbnailPng: thumbnailPair?.nanodlpThumbnail,
-      );
-
-      // ── 5. Write .nanodlp ZIP ─────────────────────────────
-      final outputDir = req.outputDirectory ?? File(req.ctbPath).parent.path;
-      final outputName = req.outputFileName ?? _fileNameWithoutExt(req.ctbPath);
-      final outputPath =
-          '$outputDir${Platform.pathSeparator}$outputName.nanodlp';
-
-      log('Writing ${_fileName(outputPath)}...');
-
-      final writer = NanoDlpFileWriter();
-      final writeSw = Stopwatch()..start();
-      await writer.writeAsync(
-        outputPath,
-        layerImages,
-        metadata,
-        layerAreaInfos: layerAreas,
-        onProgress: (p) {
-          progress(
-            (p * layerImages.length).round(),
-            layerImages.length,
-            'Writing NanoDLP file...',
-          );
-        },
-      );
-      writeSw.stop();
-      analytics.addStage('write', writeSw.elapsed);
-
-      sw.stop();
-      final fileSize = await File(outputPath).length();
-
-      log(
-        'Conversion complete: $outputPath '
-        '(${(fileSize / 1024 / 1024).toStringAsFixed(1)} MB) '
-        'in ${(sw.elapsedMilliseconds / 1000).toStringAsFixed(1)}s',
-      );
-
-      if (analyticsEnabled) {
-        port.send(
-          WorkerAnalyticsUpdate(
-            analytics.toMap(
-              cpuCores: Platform.numberOfProcessors,
-              workers: processingMaxConcurrency,
-              processingEngine: processingEngine,
-              gpuActive: gpuAccelActive,
-              gpuAttempts: processingGpuAttempts,
-              gpuSuccesses: processingGpuSuccesses,
-              gpuFallbacks: processingGpuFallbacks,
-            ),
-          ),
-        );
+      if (!deferRecompress) {
+        await writePlate(platePath);
+        await finishConversion(layerImages.length);
+        return;
       }
 
-      port.send(
-        WorkerDone(
-          ConversionResult(
-            success: true,
-            outputPath: outputPath,
-            sourceInfo: info,
-            targetProfile: targetProfile,
-            layerCount: layerImages.length,
-            outputFileSizeBytes: fileSize,
-            duration: sw.elapsed,
-          ),
-        ),
-      );
+      final finalPath = '$outputPath.tmp';
+      var finalOk = false;
+      try {
+        await writePlate(finalPath);
+        finalOk =
+            await _swapInFinalPlate(finalPath, outputPath, swapGate!, log);
+      } on FileSystemException catch (e) {
+        log('Final plate write failed: ${e.message}');
+      }
+      if (!finalOk) {
+        final partial = File(finalPath);
+        if (await partial.exists()) await partial.delete();
+      }
+      await finishConversion(layerImages.length, fastPlateKept: !finalOk);
     } finally {
+      if (backgroundPriority) {
+        NativeThreadPriority.instance.setBackgroundPriority(false);
+      }
+      swapGate?.close();
+      if (compressPlan != 0) {
+        NativeLayerBatchProcess.instance.closeCompressPlan(compressPlan);
+      }
+      NativeLayerBatchProcess.instance.closeEncodeJob(encodeJob);
+      NativeLayerBatchProcess.instance.closeLayerCache(layerCache);
+      layerSource?.close();
+      NativeLayerBatchProcess.instance.releaseWorkerScratch();
       await parser.close();
+      final leftover = workPath;
+      if (leftover != null) {
+        try {
+          final partial = File(leftover);
+          if (await partial.exists()) await partial.delete();
+        } catch (_) {}
+      }
     }
   } catch (e) {
     log('ERROR: $e');
@@ -1525,6 +2594,95 @@ Future<List<Uint8List>> _readRawLayerRange(
   return out;
 }
 
+/// Re-deflate the layer PNGs (`1.png` ... `[layerCount].png`) of the
+/// store-only plate at [fastPath] at [pngLevel] with [encodeJob], in
+/// batches of [chunkLayers] on [threads] native threads, and append them to
+/// [zip] in order. The pixels are not decoded again. A batch the native
+/// recompressor rejects keeps its fast bytes. Returns false when the plate
+/// cannot be read or [zip] refuses an entry.
+Future<bool> _recompressPlateLayers({
+  required String fastPath,
+  required NativeZipStream zip,
+  required int layerCount,
+  required int pngLevel,
+  required int encodeJob,
+  required int threads,
+  required int chunkLayers,
+  required void Function(String) log,
+}) async {
+  final recompressor = NativePngRecompress.instance;
+  final input = InputFileStream(fastPath);
+  try {
+    final plate = ZipDecoder().decodeStream(input);
+    recompressor.setBatchThreads(threads);
+    int kept = 0;
+    for (int start = 0; start < layerCount; start += chunkLayers) {
+      final end = math.min(start + chunkLayers, layerCount);
+      final chunk = <Uint8List>[];
+      for (int i = start; i < end; i++) {
+        final bytes = plate.findFile('${i + 1}.png')?.readBytes();
+        if (bytes == null) {
+          log('Fast plate is missing layer ${i + 1}.');
+          return false;
+        }
+        chunk.add(bytes);
+      }
+      var layers = recompressor.recompressBatch(
+        chunk,
+        level: pngLevel,
+        encodeJob: encodeJob,
+      );
+      if (layers == null || layers.length != chunk.length) {
+        kept += chunk.length;
+        layers = chunk;
+      }
+      for (int i = 0; i < layers.length; i++) {
+        if (!zip.addEntry('${start + i + 1}.png', layers[i])) return false;
+      }
+      // Let log messages and the caller's upload run between batches.
+      await Future<void>.delayed(Duration.zero);
+    }
+    if (kept > 0) {
+      log('$kept layers kept their fast encoding (recompress unavailable).');
+    }
+    return true;
+  } on Exception catch (e) {
+    log('Reading the fast plate failed: $e');
+    return false;
+  } finally {
+    input.closeSync();
+  }
+}
+
+/// Replace the printable plate at [outputPath] with the final one at
+/// [tmpPath] once the caller signals on [gate] that it is done uploading
+/// the printable one. Windows refuses the rename while another process
+/// still has the plate open, so retry for a few seconds; after that the
+/// fast plate stays and the caller reports it.
+Future<bool> _swapInFinalPlate(
+  String tmpPath,
+  String outputPath,
+  ReceivePort gate,
+  void Function(String) log,
+) async {
+  if (!await File(tmpPath).exists()) return false;
+  log('Final plate ready; waiting for the upload to finish before swapping.');
+  await gate.first;
+  const attempts = 6;
+  for (int attempt = 1; ; attempt++) {
+    try {
+      await File(tmpPath).rename(outputPath);
+      return true;
+    } on FileSystemException catch (e) {
+      if (attempt == attempts) {
+        log('Final plate could not replace the fast one (${e.message}).');
+        return false;
+      }
+      await Future<void>.delayed(const Duration(milliseconds: 500));
+    }
+  }
+}
+
 bool _envIsTruthy(String key) {
   final v = (Platform.environment[key] ?? '').toLowerCase();
   return v == '1' || v == 'true' || v == 'yes' || v == 'on';
@@ -1594,7 +2752,64 @@ String _processingEngineLabel(bool gpuActive, int backendCode) {
   }
 }
 
-bool _shouldRecompressLayers(List<Uint8List> pngs, void Function(String) log) {
+const _deflateStrategyNames = [
+  'default',
+  'filtered',
+  'huffman',
+  'rle',
+  'fixed',
+  'auto',
+];
+const _deflateStrategyAuto = 5;
+
+const _deflateEncoderNames = [
+  'zlib',
+  'builtin',
+  'zlib-ng',
+  'libdeflate',
+  'auto',
+];
+const _deflateEncoderZlib = 0;
+const _deflateEncoderBuiltin = 1;
+const _deflateEncoderAuto = 4;
+
+/// Plate bytes per layer outside the PNGs (ZIP headers, info.json entry),
+/// held back from a compression plan's target size.
+const _planArchiveBytesPerLayer = 512;
+
+/// Native encoder code for a setting given by name or number; zlib when
+/// unset or unknown.
+int _deflateEncoderCode(String? value) {
+  if (value == null) return _deflateEncoderZlib;
+  final v = value.trim().toLowerCase();
+  final name = v == 'zlibng' || v == 'zlib_ng' ? 'zlib-ng' : v;
+  final byName = _deflateEncoderNames.indexOf(name);
+  if (byName >= 0) return byName;
+  final byNumber = int.tryParse(v);
+  return byNumber != null && byNumber >= 0 && byNumber <= _deflateEncoderAuto
+      ? byNumber
+      : _deflateEncoderZlib;
+}
+
+/// Native strategy code for a setting given by name or number; -1 (zlib's
+/// default) when unset or unknown.
+int _deflateStrategyCode(String? value) {
+  if (value == null) return -1;
+  final v = value.trim().toLowerCase();
+  final name = v == 'huffman_only' ? 'huffman' : v;
+  final byName = _deflateStrategyNames.indexOf(name);
+  if (byName >= 0) return byName;
+  final byNumber = int.tryParse(v);
+  return byNumber != null && byNumber >= 0 && byNumber <= _deflateStrategyAuto
+      ? byNumber
+      : -1;
+}
+
+bool _shouldRecompressLayers(
+  List<Uint8List> pngs,
+  int encodeJob,
+  void Function(String) log,
+) {
   if (pngs.isEmpty) return false;
 
   // Tiny files are usually the 1x1 blank PNG fast-path; no need to recompress.
@@ -1612,7 +2827,7 @@ bool _shouldRecompressLayers(List<Uint8List> pngs, void Function(String) log) {
       continue;
     }
 
-    final recompressed = recompressPng(original);
+    final recompressed = recompressPng(original, encodeJob: encodeJob);
     sampleOriginalTotal += original.length;
     sampleRecompressedTotal += recompressed.length;
     candidateCount++;
@@ -142,10 +142,19 @@ class CtbToNanoDlpConverter {
   ///
   /// The entire conversion runs in a background isolate. Only small
   /// progress / log messages are sent back to the UI thread.
+  ///
+  /// With [ConversionOptions.latencyFirst] and the latency-first setting
+  /// on, the future completes with the fast plate
+  /// ([ConversionResult.finalPending]) and [onFinal] receives the result
+  /// once the recompressed plate has replaced it. The swap waits for
+  /// [swapFinalAfter], so a caller still uploading the fast plate never
+  /// reads a file that is being replaced underneath it.
   Future<ConversionResult> convert(
     String ctbPath, {
     ConversionOptions? options,
     void Function(ConversionProgress)? onProgress,
+    void Function(ConversionResult)? onFinal,
+    Future<void>? swapFinalAfter,
   }) async {
     options ??= ConversionOptions();
     final receivePort = ReceivePort();
@@ -153,8 +162,32 @@ class CtbToNanoDlpConverter {
     AnalyticsBus.enabled.value = settings.postProcessing.analyticsMode;
     final completer = Completer<ConversionResult>();
 
+    // The worker isolate cannot resolve platform directories itself.
+    String? layerCacheDir;
+    if (settings.postProcessing.layerCache) {
+      try {
+        final dir = await AppSettings.layerCacheDirectory();
+        await dir.create(recursive: true);
+        layerCacheDir = dir.path;
+      } catch (_) {
+        layerCacheDir = null;
+      }
+    }
+    String? jobCacheDir;
+    if (settings.postProcessing.jobCache) {
+      try {
+        final dir = await AppSettings.jobCacheDirectory();
+        await dir.create(recursive: true);
+        jobCacheDir = dir.path;
+      } catch (_) {
+        jobCacheDir = null;
+      }
+    }
+
     receivePort.listen((message) {
       if (message is WorkerProgress) {
+        // Background recompress progress is not reported to the caller.
+        if (completer.isCompleted) return;
         onProgress?.call(
           ConversionProgress(
             message.current,
@@ -205,8 +238,22 @@ class CtbToNanoDlpConverter {
           if (current.capturedAt != report.capturedAt) return;
           AnalyticsBus.update(current.withCpuName(name));
         });
-      } else if (message is WorkerDone) {
+      } else if (message is WorkerPrintable) {
         completer.complete(message.result);
+        final gate = message.swapGate;
+        if (swapFinalAfter == null) {
+          gate.send(true);
+        } else {
+          swapFinalAfter
+              .catchError((Object _) {})
+              .whenComplete(() => gate.send(true));
+        }
+      } else if (message is WorkerDone) {
+        if (completer.isCompleted) {
+          onFinal?.call(message.result);
+        } else {
+          completer.complete(message.result);
+        }
         receivePort.close();
       }
     });
@@ -219,7 +266,12 @@ class CtbToNanoDlpConverter {
         maxZHeightOverride: options.maxZHeightOverride,
         outputDirectory: options.outputDirectory,
         outputFileName: options.outputFileName,
-        postProcessingSettings: settings.postProcessing.toJson(),
+        postProcessingSettings: {
+          ...settings.postProcessing.toJson(),
+          if (!options.latencyFirst) 'latencyFirst': false,
+          if (layerCacheDir != null) 'layerCacheDir': layerCacheDir,
+          if (jobCacheDir != null) 'jobCacheDir': jobCacheDir,
+        },
         benchmarkCache: settings.benchmarkCache.map(
           (key, value) => MapEntry(key, value.toJson()),
         ),
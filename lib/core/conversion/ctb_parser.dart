@@ -87,6 +87,18 @@ class CtbParser {
 
   CtbParser._();
 
+  /// True for CTBv4E, whose settings block is AES-encrypted and can only be
+  /// read here (native readers need the header fields passed in).
+  bool get hasEncryptedSettings => magic == _magicCtbV4Encrypted;
+
+  /// File offset of each layer's raw RLE payload (for native readers).
+  List<int> get layerDataOffsets =>
+      [for (final d in _layerDefs) d.dataOffset];
+
+  /// Byte length of each layer's raw RLE payload.
+  List<int> get layerDataLengths =>
+      [for (final d in _layerDefs) d.dataLength];
+
   /// Open and parse a CTB file. Returns the parser with header info loaded.
   static Future<CtbParser> open(String path) async {
     final parser = CtbParser._();
@@ -430,6 +442,7 @@ class CtbParser {
     final pointerData = await _readBytes(layerCount * 16);
     final pd = ByteData.sublistView(pointerData);
 
+    int spanStart = 0x7FFFFFFF, spanEnd = 0, defBytes = 0;
     for (int i = 0; i < layerCount; i++) {
       final layerDefOffset = pd.getUint32(i * 16, Endian.little);
       final tableSize = pd.getUint32(i * 16 + 8, Endian.little);
@@ -439,10 +452,35 @@ class CtbParser {
           'Invalid layer pointer at index $i: offset=$layerDefOffset, tableSize=$tableSize'
         );
       }
+      if (layerDefOffset < spanStart) spanStart = layerDefOffset;
+      if (layerDefOffset + tableSize > spanEnd) {
+        spanEnd = layerDefOffset + tableSize;
+      }
+      defBytes += tableSize;
+    }
+
+    // When the slicer packs the LayerDefs together (ahead of the layer
+    // data), fetch them with one read instead of a seek + read per layer.
+    // Interleaved layouts keep the per-layer reads.
+    Uint8List? span;
+    if (spanEnd - spanStart <= defBytes * 2 + 65536) {
+      await _raf.setPosition(spanStart);
+      span = await _readBytes(spanEnd - spanStart);
+    }
+
+    for (int i = 0; i < layerCount; i++) {
+      final layerDefOffset = pd.getUint32(i * 16, Endian.little);
+      final tableSize = pd.getUint32(i * 16 + 8, Endian.little);
 
       // Read the 88-byte LayerDef at the pointer target
-      await _raf.setPosition(layerDefOffset);
-      final entry = await _readBytes(tableSize);
+      late final Uint8List entry;
+      if (span != null) {
+        final start = layerDefOffset - spanStart;
+        entry = Uint8List.sublistView(span, start, start + tableSize);
+      } else {
+        await _raf.setPosition(layerDefOffset);
+        entry = await _readBytes(tableSize);
+      }
       final ld = ByteData.sublistView(entry);
 
       // CTBv4 LayerDef layout (88 bytes):
@@ -470,9 +508,10 @@ class CtbParser {
   /// Read legacy (CBDDLP/CTBv2/v3) layer table with 36-byte direct entries.
   Future<void> _readLayerTableLegacy() async {
     await _raf.setPosition(layerTableOffset);
+    final table = await _readBytes(layerCount * 36);
 
     for (int i = 0; i < layerCount; i++) {
-      final entry = await _readBytes(36);
+      final entry = Uint8List.sublistView(table, i * 36, i * 36 + 36);
       if (entry.length < 36) {
         throw FormatException(
           'Truncated layer definition at index $i: '
@@ -0,0 +1,160 @@
+import 'dart:io';
+import 'dart:isolate';
+
+import 'package:archive/archive_io.dart';
+
+import '../models/models.dart';
+import 'native_layer_batch_process.dart';
+
+/// Whole-job result cache: finished `.nanodlp` plates kept under the
+/// content hash of the source file plus everything else that shapes the
+/// plate (source file name, size and modification time, target profile,
+/// Z override, output settings).
+///
+/// A repeat conversion is served by copying the stored plate to the output
+/// path instead of converting again. Plates are always copied in and out,
+/// never linked, so changing an output cannot change a cached plate.
+/// Entries past [maxBytes] are evicted least recently used first.
+class JobResultCache {
+  /// Bump when converter changes would make stored plates differ.
+  static const _keyVersion = 2;
+  static const _extension = '.nanodlp';
+
+  final Directory directory;
+  final int maxBytes;
+
+  JobResultCache(String dir, this.maxBytes) : directory = Directory(dir);
+
+  /// Content hash of [path] (32 hex digits), computed natively on a
+  /// separate isolate so the caller can parse the header meanwhile. Null if
+  /// the file cannot be read or the native library is unavailable.
+  static Future<String?> digestFile(String path) {
+    return Isolate.run(() => NativeLayerBatchProcess.instance.hashFile(path));
+  }
+
+  /// Cache key for a conversion of a file with content [digest].
+  ///
+  /// [sourceStat] is the source file's stat taken before hashing; its size
+  /// and modification time are part of the key, so a file rewritten with
+  /// other content can never reach an entry even if the hashes collided.
+  /// [outputSettings] holds the resolved settings that change the plate's
+  /// bytes (PNG levels, island stats); speed-only settings are left out.
+  static String keyFor({
+    required String digest,
+    required String sourceFileName,
+    required FileStat sourceStat,
+    required PrinterProfile targetProfile,
+    required double? maxZHeightOverride,
+    required Map<String, Object?> outputSettings,
+  }) {
+    final settingKeys = outputSettings.keys.toList()..sort();
+    final options = [
+      'v$_keyVersion',
+      sourceFileName,
+      '${sourceStat.size}',
+      '${sourceStat.modified.microsecondsSinceEpoch}',
+      targetProfile.name,
+      targetProfile.board.name,
+      '${targetProfile.resolutionX}x${targetProfile.resolutionY}',
+      '${targetProfile.displayWidth}x${targetProfile.displayHeight}',
+      '${targetProfile.pngOutputWidth}',
+      '${targetProfile.maxZHeight}',
+      '${maxZHeightOverride ?? ''}',
+      for (final k in settingKeys) '$k=${outputSettings[k]}',
+    ].join('\u0000');
+    return '$digest-${_fnv1a64(options)}';
+  }
+
+  File _entry(String key) =>
+      File('${directory.path}${Platform.pathSeparator}$key$_extension');
+
+  /// Place the plate stored under [key] at [outputPath]. Returns false on a
+  /// miss. An entry that does not hold exactly [layerCount] layer PNGs
+  /// (truncated or from another conversion) is deleted and counts as a miss.
+  Future<bool> restore(
+    String key,
+    String outputPath, {
+    required int layerCount,
+  }) async {
+    final entry = _entry(key);
+    if (!await entry.exists()) return false;
+    if (_countLayerEntries(entry.path) != layerCount) {
+      try {
+        await entry.delete();
+      } catch (_) {}
+      return false;
+    }
+    await File(outputPath).parent.create(recursive: true);
+    if (!NativeLayerBatchProcess.instance.copyFile(entry.path, outputPath)) {
+      return false;
+    }
+    try {
+      await entry.setLastModified(DateTime.now());
+    } catch (_) {}
+    return true;
+  }
+
+  /// Keep the finished plate at [outputPath] under [key], then evict past
+  /// the size limit. Best effort.
+  Future<void> store(String key, String outputPath) async {
+    try {
+      await directory.create(recursive: true);
+      if (!NativeLayerBatchProcess.instance.copyFile(
+        outputPath,
+        _entry(key).path,
+      )) {
+        return;
+      }
+      await _evict();
+    } catch (_) {}
+  }
+
+  /// Number of `<n>.png` layer entries in the plate at [path], read from its
+  /// central directory; -1 when it is not a readable ZIP.
+  static int _countLayerEntries(String path) {
+    final input = InputFileStream(path);
+    try {
+      final plate = ZipDecoder().decodeStream(input);
+      return plate.files
+          .where((f) => _layerEntryName.hasMatch(f.name))
+          .length;
+    } catch (_) {
+      return -1;
+    } finally {
+      input.closeSync();
+    }
+  }
+
+  static final _layerEntryName = RegExp(r'^[0-9]+\.png$');
+
+  /// Delete the least recently used plates until the cache is 10% under
+  /// [maxBytes].
+  Future<void> _evict() async {
+    final entries = <(File, FileStat)>[];
+    var total = 0;
+    await for (final e in directory.list()) {
+      if (e is! File || !e.path.endsWith(_extension)) continue;
+      final stat = await e.stat();
+      entries.add((e, stat));
+      total += stat.size;
+    }
+    if (total <= maxBytes) return;
+    final target = maxBytes - maxBytes ~/ 10;
+    entries.sort((a, b) => a.$2.modified.compareTo(b.$2.modified));
+    for (final (file, stat) in entries) {
+      if (total <= target) break;
+      try {
+        await file.delete();
+        total -= stat.size;
+      } catch (_) {}
+    }
+  }
+
+  static String _fnv1a64(String s) {
+    var h = 0xcbf29ce484222325;
+    for (final unit in s.codeUnits) {
+      h = (h ^ unit) * 0x100000001b3;
+    }
+    return h.toUnsigned(64).toRadixString(16).padLeft(16, '0');
+  }
+}
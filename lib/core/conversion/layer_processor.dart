@@ -895,10 +895,15 @@ Uint8List _encodePngGreyscale(
 /// Parses the known PNG structure (signature + IHDR + IDAT + IEND),
 /// decompresses the IDAT payload, then recompresses at max level.
 /// Returns the rebuilt PNG. If anything goes wrong, returns the
-/// original bytes unchanged.
-Uint8List recompressPng(Uint8List pngBytes, {int level = 7}) {
+/// original bytes unchanged. The native path uses the stream settings of
+/// [encodeJob] (0 for zlib's defaults).
+Uint8List recompressPng(Uint8List pngBytes, {int level = 7, int encodeJob = 0}) {
   final safeLevel = level.clamp(0, 9);
-  final native = NativePngRecompress.instance.recompress(pngBytes, level: safeLevel);
+  final native = NativePngRecompress.instance.recompress(
+    pngBytes,
+    level: safeLevel,
+    encodeJob: encodeJob,
+  );
   if (native != null) {
     return native;
   }
@@ -962,10 +967,28 @@ Uint8List recompressPng(Uint8List pngBytes, {int level = 7}) {
   }
 }
 
-/// Recompress a list of PNGs in parallel using isolates.
+/// zlib level used for the final PNG pass of a job with [layerCount] layers.
+///
+/// Larger jobs trade a little size for throughput. Honours
+/// VOXELSHIFT_RECOMPRESS_LEVEL when set.
+int recompressLevelForLayerCount(int layerCount) {
+  final recompressLevelEnv = int.tryParse(
+    (Platform.environment['VOXELSHIFT_RECOMPRESS_LEVEL'] ?? '').trim(),
+  );
+  if (recompressLevelEnv != null) return recompressLevelEnv.clamp(0, 9);
+  return layerCount >= 1200
+      ? 4
+      : layerCount >= 500
+          ? 5
+          : 7;
+}
+
+/// Recompress a list of PNGs in parallel using isolates, with the stream
+/// settings of [encodeJob] on the native path.
 Future<List<Uint8List>> recompressPngsParallel({
   required List<Uint8List> pngs,
   required int maxConcurrency,
+  int encodeJob = 0,
   void Function(int completed, int total)? onProgress,
   void Function(int workers)? onWorkersReady,
 }) async {
@@ -978,16 +1001,7 @@ Future<List<Uint8List>> recompressPngsParallel({
       math.max(1, maxConcurrency),
     );
 
-    final recompressLevelEnv = int.tryParse(
-      (Platform.environment['VOXELSHIFT_RECOMPRESS_LEVEL'] ?? '').trim(),
-    );
-    final defaultLevel = pngs.length >= 1200
-      ? 4
-      : pngs.length >= 500
-        ? 5
-        : 7;
-    final recompressLevel =
-      (recompressLevelEnv == null ? defaultLevel : recompressLevelEnv.clamp(0, 9));
+    final recompressLevel = recompressLevelForLayerCount(pngs.length);
 
     // Native recompress now owns multithreading internally.
     NativePngRecompress.instance.setBatchThreads(nativeThreads);
@@ -1018,6 +1032,7 @@ Future<List<Uint8List>> recompressPngsParallel({
       final result = NativePngRecompress.instance.recompressBatch(
         chunk,
         level: recompressLevel,
+        encodeJob: encodeJob,
       );
 
       if (result == null || result.length != chunk.length) {
@@ -1043,16 +1058,7 @@ Future<List<Uint8List>> recompressPngsParallel({
     math.max(1, maxConcurrency),
   );
 
-  final recompressLevelEnv = int.tryParse(
-    (Platform.environment['VOXELSHIFT_RECOMPRESS_LEVEL'] ?? '').trim(),
-  );
-  final defaultLevel = pngs.length >= 1200
-      ? 4
-      : pngs.length >= 500
-          ? 5
-          : 7;
-  final recompressLevel =
-      (recompressLevelEnv == null ? defaultLevel : recompressLevelEnv.clamp(0, 9));
+  final recompressLevel = recompressLevelForLayerCount(pngs.length);
 
   onWorkersReady?.call(concurrency);
   onProgress?.call(0, pngs.length);
@@ -1068,7 +1074,13 @@ Future<List<Uint8List>> recompressPngsParallel({
   void launchOne() {
     if (nextIdx >= pngs.length || completer.isCompleted) return;
     final idx = nextIdx++;
-    Isolate.run(() => recompressPng(pngs[idx], level: recompressLevel)).then((result) {
+    Isolate.run(
+      () => recompressPng(
+        pngs[idx],
+        level: recompressLevel,
+        encodeJob: encodeJob,
+      ),
+    ).then((result) {
       results[idx] = result;
       completed++;
       final now = DateTime.now();
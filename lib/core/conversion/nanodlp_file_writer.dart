@@ -26,47 +26,12 @@ class NanoDlpFileWriter {
       await dir.create(recursive: true);
     }
 
-    // Compute area stats
-    double totalSolidArea = 0;
-    if (layerAreaInfos != null && layerAreaInfos.isNotEmpty) {
-      double avgArea = 0;
-      for (final info in layerAreaInfos) {
-        avgArea += info.totalSolidArea;
-      }
-      avgArea /= layerAreaInfos.length;
-      totalSolidArea = (avgArea * metadata.layerHeightMm * metadata.layerCount) / 1000;
-    }
-
-    // Compute bounding box
-    double xMin = 0, xMax = 0, yMin = 0, yMax = 0;
-    if (layerAreaInfos != null && layerAreaInfos.isNotEmpty) {
-      final halfW = metadata.displayWidthMm / 2;
-      final halfH = metadata.displayHeightMm / 2;
-      int pixMinX = 0x7FFFFFFF, pixMinY = 0x7FFFFFFF;
-      int pixMaxX = 0, pixMaxY = 0;
-      for (final info in layerAreaInfos) {
-        if (info.areaCount == 0) continue;
-        if (info.minX < pixMinX) pixMinX = info.minX;
-        if (info.minY < pixMinY) pixMinY = info.minY;
-        if (info.maxX > pixMaxX) pixMaxX = info.maxX;
-        if (info.maxY > pixMaxY) pixMaxY = info.maxY;
-      }
-      xMin = pixMinX * metadata.xPixelSizeMm - halfW;
-      xMax = (pixMaxX + 1) * metadata.xPixelSizeMm - halfW;
-      yMin = pixMinY * metadata.yPixelSizeMm - halfH;
-      yMax = (pixMaxY + 1) * metadata.yPixelSizeMm - halfH;
-    }
-
-    final zMax = double.parse(
-      (metadata.layerCount * metadata.layerHeightMm).toStringAsFixed(4)
-    );
-
     // ── Build JSON blobs once (shared by native and fallback paths) ──
-    final plateJson = _encodeJson(_buildPlateJson(
-      totalSolidArea: totalSolidArea,
+    final plateJson = _buildPlateJsonBytes(
+      metadata,
       layersCount: layers.length,
-      xMin: xMin, xMax: xMax, yMin: yMin, yMax: yMax, zMax: zMax,
-    ));
+      layerAreaInfos: layerAreaInfos,
+    );
 
     final profileJson = _encodeJson(_buildProfileJson(metadata));
 
@@ -165,6 +130,161 @@ class NanoDlpFileWriter {
     await tempFile.rename(outputPath);
   }
 
+  /// Streaming variant of [writeAsync] for jobs too large to hold in RAM.
+  ///
+  /// Opens the archive up front, writes the static entries, then lets
+  /// [writeLayers] append the layer PNGs (`1.png`, `2.png`, ...) directly to
+  /// the open [NativeZipStream]. `plate.json` and `info.json` depend on every
+  /// layer's area stats, so they are written last from the list returned by
+  /// [writeLayers].
+  ///
+  /// Returns false without leaving a partial file behind when the native ZIP
+  /// writer is unavailable or [writeLayers] returns null.
+  Future<bool> writeStreamingAsync(
+    String outputPath,
+    NanoDlpPlateMetadata metadata, {
+    required Future<List<LayerAreaInfo>?> Function(NativeZipStream zip)
+        writeLayers,
+  }) async {
+    final dir = File(outputPath).parent;
+    if (!await dir.exists()) {
+      await dir.create(recursive: true);
+    }
+
+    final zip = NativeZipWriter.instance.openStream(outputPath);
+    if (zip == null) return false;
+
+    try {
+      for (final entry in buildHeadEntries(metadata)) {
+        if (!zip.addEntry(entry.name, entry.data)) {
+          return _abortStream(zip, outputPath);
+        }
+      }
+
+      final layerAreaInfos = await writeLayers(zip);
+      if (layerAreaInfos == null) return _abortStream(zip, outputPath);
+
+      return finishStreamingAsync(zip, outputPath, metadata, layerAreaInfos);
+    } catch (_) {
+      return _abortStream(zip, outputPath);
+    }
+  }
+
+  /// Entries that precede the layer PNGs in a streamed archive.
+  List<NativeZipEntry> buildHeadEntries(NanoDlpPlateMetadata metadata) {
+    return [
+      NativeZipEntry(
+        name: 'profile.json',
+        data: _encodeJson(_buildProfileJson(metadata)),
+      ),
+      NativeZipEntry(
+        name: 'options.json',
+        data: _encodeJson(_buildOptionsJson(metadata)),
+      ),
+      if (metadata.thumbnailPng != null && metadata.thumbnailPng!.isNotEmpty)
+        NativeZipEntry(name: '3d.png', data: metadata.thumbnailPng!),
+    ];
+  }
+
+  /// Append `plate.json` / `info.json` to an archive whose head entries and
+  /// layers are already written, then close it.
+  ///
+  /// Used by [writeStreamingAsync] and by the native single-call converter,
+  /// which hands back its still-open archive. On failure the archive is
+  /// aborted and the partial file removed.
+  Future<bool> finishStreamingAsync(
+    NativeZipStream zip,
+    String outputPath,
+    NanoDlpPlateMetadata metadata,
+    List<LayerAreaInfo> layerAreaInfos,
+  ) async {
+    Future<bool> fail() => _abortStream(zip, outputPath);
+
+    try {
+      final plateJson = _buildPlateJsonBytes(
+        metadata,
+        layersCount: layerAreaInfos.length,
+        layerAreaInfos: layerAreaInfos,
+      );
+      if (!zip.addEntry('plate.json', plateJson)) return fail();
+      if (layerAreaInfos.isNotEmpty &&
+          !zip.addEntry(
+            'info.json',
+            _encodeJson(layerAreaInfos.map((a) => a.toJson()).toList()),
+          )) {
+        return fail();
+      }
+
+      if (!zip.close()) return fail();
+      return true;
+    } catch (_) {
+      return fail();
+    }
+  }
+
+  Future<bool> _abortStream(NativeZipStream zip, String outputPath) async {
+    zip.abort();
+    try {
+      final partial = File(outputPath);
+      if (await partial.exists()) await partial.delete();
+    } catch (_) {}
+    return false;
+  }
+
+  /// Encode plate.json, deriving TotalSolidArea and the XY bounding box
+  /// from the per-layer area stats.
+  Uint8List _buildPlateJsonBytes(
+    NanoDlpPlateMetadata metadata, {
+    required int layersCount,
+    List<LayerAreaInfo>? layerAreaInfos,
+  }) {
+    // Compute area stats
+    double totalSolidArea = 0;
+    if (layerAreaInfos != null && layerAreaInfos.isNotEmpty) {
+      double avgArea = 0;
+      for (final info in layerAreaInfos) {
+        avgArea += info.totalSolidArea;
+      }
+      avgArea /= layerAreaInfos.length;
+      totalSolidArea = (avgArea * metadata.layerHeightMm * metadata.layerCount) / 1000;
+    }
+
+    // Compute bounding box
+    double xMin = 0, xMax = 0, yMin = 0, yMax = 0;
+    if (layerAreaInfos != null && layerAreaInfos.isNotEmpty) {
+      final halfW = metadata.displayWidthMm / 2;
+      final halfH = metadata.displayHeightMm / 2;
+      int pixMinX = 0x7FFFFFFF, pixMinY = 0x7FFFFFFF;
+      int pixMaxX = 0, pixMaxY = 0;
+      for (final info in layerAreaInfos) {
+        // Keyed on solid pixels, not areaCount: the island fields are zero
+        // when island stats are off.
+        if (info.totalSolidArea <= 0) continue;
+        if (info.minX < pixMinX) pixMinX = info.minX;
+        if (info.minY < pixMinY) pixMinY = info.minY;
+        if (info.maxX > pixMaxX) pixMaxX = info.maxX;
+        if (info.maxY > pixMaxY) pixMaxY = info.maxY;
+      }
+      // A plate with no solid pixels keeps the zero box.
+      if (pixMinX != 0x7FFFFFFF) {
+        xMin = pixMinX * metadata.xPixelSizeMm - halfW;
+        xMax = (pixMaxX + 1) * metadata.xPixelSizeMm - halfW;
+        yMin = pixMinY * metadata.yPixelSizeMm - halfH;
+        yMax = (pixMaxY + 1) * metadata.yPixelSizeMm - halfH;
+      }
+    }
+
+    final zMax = double.parse(
+      (metadata.layerCount * metadata.layerHeightMm).toStringAsFixed(4)
+    );
+
+    return _encodeJson(_buildPlateJson(
+      totalSolidArea: totalSolidArea,
+      layersCount: layersCount,
+      xMin: xMin, xMax: xMax, yMin: yMin, yMax: yMax, zMax: zMax,
+    ));
+  }
+
   Uint8List _encodeJson(Object data) {
     final jsonStr = const JsonEncoder.withIndent('  ').convert(data);
     return Uint8List.fromList(utf8.encode(jsonStr));
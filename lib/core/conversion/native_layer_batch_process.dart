@@ -5,6 +5,8 @@ import 'dart:typed_data';
 import 'package:ffi/ffi.dart';
 
 import '../models/layer_area_info.dart';
+import 'native_layer_source.dart';
+import 'native_zip_writer.dart';
 
 final class _NativeAreaStatsResult extends ffi.Struct {
   @ffi.Double()
@@ -47,6 +49,10 @@ typedef _NativeProcessLayersBatch = ffi.Int32 Function(
   ffi.Double xPixelSizeMm,
   ffi.Double yPixelSizeMm,
   ffi.Int32 pngLevel,
+  ffi.Int64 compressPlan,
+  ffi.Int64 encodeJob,
+  ffi.Int64 layerCache,
+  ffi.Int32 areaMode,
   ffi.Int32 threadCount,
   ffi.Pointer<ffi.Pointer<ffi.Uint8>> outBlob,
   ffi.Pointer<ffi.Int32> outBlobLen,
@@ -70,6 +76,10 @@ typedef _DartProcessLayersBatch = int Function(
   double xPixelSizeMm,
   double yPixelSizeMm,
   int pngLevel,
+  int compressPlan,
+  int encodeJob,
+  int layerCache,
+  int areaMode,
   int threadCount,
   ffi.Pointer<ffi.Pointer<ffi.Uint8>> outBlob,
   ffi.Pointer<ffi.Int32> outBlobLen,
@@ -78,9 +88,64 @@ typedef _DartProcessLayersBatch = int Function(
   ffi.Pointer<ffi.Pointer<_NativeAreaStatsResult>> outAreas,
 );
 
+// ── Streaming batch (PNGs written straight into a native ZIP) ───────────────
+
+typedef _NativeProcessLayersBatchToZip = ffi.Int32 Function(
+  ffi.Int64 zipHandle,
+  ffi.Pointer<ffi.Uint8> inputBlob,
+  ffi.Int32 inputBlobLen,
+  ffi.Pointer<ffi.Int32> inputOffsets,
+  ffi.Pointer<ffi.Int32> inputLengths,
+  ffi.Int32 count,
+  ffi.Int32 layerIndexBase,
+  ffi.Int32 encryptionKey,
+  ffi.Int32 srcWidth,
+  ffi.Int32 height,
+  ffi.Int32 outWidth,
+  ffi.Int32 channels,
+  ffi.Double xPixelSizeMm,
+  ffi.Double yPixelSizeMm,
+  ffi.Int32 pngLevel,
+  ffi.Int64 compressPlan,
+  ffi.Int64 encodeJob,
+  ffi.Int64 layerCache,
+  ffi.Int32 areaMode,
+  ffi.Int32 threadCount,
+  ffi.Int32 maxInFlight,
+  ffi.Pointer<_NativeAreaStatsResult> outAreas,
+);
+
+typedef _DartProcessLayersBatchToZip = int Function(
+  int zipHandle,
+  ffi.Pointer<ffi.Uint8> inputBlob,
+  int inputBlobLen,
+  ffi.Pointer<ffi.Int32> inputOffsets,
+  ffi.Pointer<ffi.Int32> inputLengths,
+  int count,
+  int layerIndexBase,
+  int encryptionKey,
+  int srcWidth,
+  int height,
+  int outWidth,
+  int channels,
+  double xPixelSizeMm,
+  double yPixelSizeMm,
+  int pngLevel,
+  int compressPlan,
+  int encodeJob,
+  int layerCache,
+  int areaMode,
+  int threadCount,
+  int maxInFlight,
+  ffi.Pointer<_NativeAreaStatsResult> outAreas,
+);
+
 typedef _NativeSetProcessBatchThreads = ffi.Void Function(ffi.Int32 threads);
 typedef _DartSetProcessBatchThreads = void Function(int threads);
 
+typedef _NativeReleasePoolScratch = ffi.Void Function();
+typedef _DartReleasePoolScratch = void Function();
+
 typedef _NativeSetProcessBatchAnalytics = ffi.Void Function(ffi.Int32 enabled);
 typedef _DartSetProcessBatchAnalytics = void Function(int enabled);
 
@@ -99,6 +164,102 @@ typedef _DartGetProcessLastGpuFallbacks = int Function();
 typedef _NativeGetProcessLastCudaError = ffi.Int32 Function();
 typedef _DartGetProcessLastCudaError = int Function();
 
+typedef _NativeGetProcessLastDedupHits = ffi.Int32 Function();
+typedef _DartGetProcessLastDedupHits = int Function();
+
+typedef _NativeLayerCacheOpen = ffi.Int64 Function(
+  ffi.Pointer<Utf8> dir,
+  ffi.Int64 maxBytes,
+);
+typedef _DartLayerCacheOpen = int Function(ffi.Pointer<Utf8> dir, int maxBytes);
+
+typedef _NativeLayerCacheClose = ffi.Void Function(ffi.Int64 cache);
+typedef _DartLayerCacheClose = void Function(int cache);
+
+typedef _NativeHashFile = ffi.Int32 Function(
+  ffi.Pointer<Utf8> path,
+  ffi.Pointer<ffi.Uint64> outHash,
+);
+typedef _DartHashFile = int Function(
+  ffi.Pointer<Utf8> path,
+  ffi.Pointer<ffi.Uint64> outHash,
+);
+
+typedef _NativeCopyFile = ffi.Int32 Function(
+  ffi.Pointer<Utf8> src,
+  ffi.Pointer<Utf8> dst,
+);
+typedef _DartCopyFile = int Function(
+  ffi.Pointer<Utf8> src,
+  ffi.Pointer<Utf8> dst,
+);
+
+typedef _NativeEncodeJobOpen = ffi.Int64 Function(
+  ffi.Int32 windowBits,
+  ffi.Int32 memLevel,
+  ffi.Int32 strategy,
+  ffi.Int32 encoder,
+  ffi.Int32 split,
+);
+typedef _DartEncodeJobOpen = int Function(
+  int windowBits,
+  int memLevel,
+  int strategy,
+  int encoder,
+  int split,
+);
+
+typedef _NativeEncodeJobClose = ffi.Void Function(ffi.Int64 job);
+typedef _DartEncodeJobClose = void Function(int job);
+
+typedef _NativeEncodeJobSetBackground = ffi.Void Function(
+  ffi.Int64 job,
+  ffi.Int32 background,
+);
+typedef _DartEncodeJobSetBackground = void Function(int job, int background);
+
+typedef _NativeGetDeflateEncoder = ffi.Int32 Function(
+  ffi.Int64 job,
+  ffi.Int32 level,
+);
+typedef _DartGetDeflateEncoder = int Function(int job, int level);
+
+typedef _NativeGetDeflateAutoChoice = ffi.Int32 Function(
+  ffi.Int64 job,
+  ffi.Int32 level,
+  ffi.Pointer<ffi.Int32> outStrategy,
+  ffi.Pointer<ffi.Int32> outLevel,
+);
+typedef _DartGetDeflateAutoChoice = int Function(
+  int job,
+  int level,
+  ffi.Pointer<ffi.Int32> outStrategy,
+  ffi.Pointer<ffi.Int32> outLevel,
+);
+
+typedef _NativeCompressPlanOpen = ffi.Int64 Function(
+  ffi.Int32 layerCount,
+  ffi.Int64 budgetMs,
+  ffi.Int64 targetBytes,
+);
+typedef _DartCompressPlanOpen = int Function(
+  int layerCount,
+  int budgetMs,
+  int targetBytes,
+);
+
+typedef _NativeCompressPlanHandle = ffi.Void Function(ffi.Int64 plan);
+typedef _DartCompressPlanHandle = void Function(int plan);
+
+typedef _NativeCompressPlanReportFn = ffi.Int32 Function(
+  ffi.Int64 plan,
+  ffi.Pointer<_NativeCompressPlanReport> out,
+);
+typedef _DartCompressPlanReportFn = int Function(
+  int plan,
+  ffi.Pointer<_NativeCompressPlanReport> out,
+);
+
 typedef _NativeGetProcessLastThreadCount = ffi.Int32 Function();
 typedef _DartGetProcessLastThreadCount = int Function();
 
@@ -121,6 +282,20 @@ typedef _DartGetProcessLastThreadStats = void Function(
   int maxCount,
 );
 
+typedef _NativeGetProcessLastCostCount = ffi.Int32 Function();
+typedef _DartGetProcessLastCostCount = int Function();
+
+typedef _NativeGetProcessLastCostSamples = ffi.Void Function(
+  ffi.Pointer<ffi.Int64> outPredicted,
+  ffi.Pointer<ffi.Int64> outActualNs,
+  ffi.Int32 maxCount,
+);
+typedef _DartGetProcessLastCostSamples = void Function(
+  ffi.Pointer<ffi.Int64> outPredicted,
+  ffi.Pointer<ffi.Int64> outActualNs,
+  int maxCount,
+);
+
 typedef _NativeGetProcessLastGpuBatchOk = ffi.Int32 Function();
 typedef _DartGetProcessLastGpuBatchOk = int Function();
 
@@ -141,6 +316,8 @@ typedef _NativeProcessLayersBatchPhased = ffi.Int32 Function(
   ffi.Double xPixelSizeMm,
   ffi.Double yPixelSizeMm,
   ffi.Int32 pngLevel,
+  ffi.Int64 encodeJob,
+  ffi.Int32 areaMode,
   ffi.Int32 threadCount,
   ffi.Int32 useGpuBatch,
   ffi.Pointer<ffi.Pointer<ffi.Uint8>> outBlob,
@@ -165,6 +342,8 @@ typedef _DartProcessLayersBatchPhased = int Function(
   double xPixelSizeMm,
   double yPixelSizeMm,
   int pngLevel,
+  int encodeJob,
+  int areaMode,
   int threadCount,
   int useGpuBatch,
   ffi.Pointer<ffi.Pointer<ffi.Uint8>> outBlob,
@@ -174,6 +353,187 @@ typedef _DartProcessLayersBatchPhased = int Function(
   ffi.Pointer<ffi.Pointer<_NativeAreaStatsResult>> outAreas,
 );
 
+// ── Single-call CTB conversion ──────────────────────────────────────────────
+
+final class _NativeConvertOptions extends ffi.Struct {
+  @ffi.Int32()
+  external int outWidth;
+
+  @ffi.Int32()
+  external int channels;
+
+  @ffi.Double()
+  external double xPixelSizeMm;
+
+  @ffi.Double()
+  external double yPixelSizeMm;
+
+  @ffi.Int32()
+  external int pngLevel;
+
+  @ffi.Int64()
+  external int compressPlan;
+
+  @ffi.Int64()
+  external int encodeJob;
+
+  @ffi.Int64()
+  external int layerCache;
+
+  @ffi.Int32()
+  external int threadCount;
+
+  @ffi.Int32()
+  external int maxInFlight;
+
+  @ffi.Int32()
+  external int chunkLayers;
+
+  @ffi.Int32()
+  external int inputBackend;
+
+  @ffi.Int32()
+  external int areaMode;
+
+  @ffi.Int32()
+  external int headerOverride;
+
+  @ffi.Int64()
+  external int layerTableOffset;
+
+  @ffi.Int32()
+  external int layerCount;
+
+  @ffi.Int32()
+  external int resolutionX;
+
+  @ffi.Int32()
+  external int resolutionY;
+
+  @ffi.Int32()
+  external int encryptionKey;
+
+  @ffi.Int32()
+  external int headEntryCount;
+
+  external ffi.Pointer<ffi.Pointer<Utf8>> headEntryNames;
+
+  external ffi.Pointer<ffi.Pointer<ffi.Uint8>> headEntryData;
+
+  external ffi.Pointer<ffi.Int32> headEntryLengths;
+}
+
+final class _NativeConvertResult extends ffi.Struct {
+  @ffi.Int64()
+  external int zipHandle;
+
+  external ffi.Pointer<_NativeAreaStatsResult> areas;
+
+  @ffi.Int32()
+  external int layerCount;
+
+  @ffi.Int32()
+  external int layersDone;
+
+  @ffi.Int32()
+  external int resolutionX;
+
+  @ffi.Int32()
+  external int resolutionY;
+
+  @ffi.Int32()
+  external int error;
+
+  @ffi.Int32()
+  external int backend;
+
+  @ffi.Int32()
+  external int gpuAttempts;
+
+  @ffi.Int32()
+  external int gpuSuccesses;
+
+  @ffi.Int32()
+  external int gpuFallbacks;
+
+  @ffi.Int32()
+  external int inputBackend;
+
+  @ffi.Int64()
+  external int readNs;
+
+  @ffi.Int64()
+  external int processNs;
+
+  @ffi.Int32()
+  external int dedupHits;
+
+  @ffi.Int32()
+  external int cacheHits;
+}
+
+final class _NativeCompressPlanReport extends ffi.Struct {
+  @ffi.Int64()
+  external int budgetMs;
+
+  @ffi.Int64()
+  external int targetBytes;
+
+  @ffi.Int64()
+  external int plannedBytes;
+
+  @ffi.Int64()
+  external int plannedMs;
+
+  @ffi.Int64()
+  external int actualBytes;
+
+  @ffi.Int64()
+  external int actualMs;
+
+  @ffi.Int32()
+  external int layersDone;
+
+  @ffi.Int32()
+  external int layersReused;
+
+  @ffi.Int32()
+  external int replans;
+
+  @ffi.Int32()
+  external int probes;
+
+  @ffi.Int32()
+  external int unreachable;
+
+  @ffi.Array(3)
+  external ffi.Array<ffi.Int32> levels;
+
+  @ffi.Array(3)
+  external ffi.Array<ffi.Int32> levelLayers;
+
+  @ffi.Array(3)
+  external ffi.Array<ffi.Int32> plannedLayers;
+}
+
+typedef _NativeConvertProgress = ffi.Void Function(ffi.Int32 done, ffi.Int32 total);
+
+typedef _NativeConvertFile = ffi.Int32 Function(
+  ffi.Pointer<Utf8> ctbPath,
+  ffi.Pointer<Utf8> outPath,
+  ffi.Pointer<_NativeConvertOptions> options,
+  ffi.Pointer<ffi.NativeFunction<_NativeConvertProgress>> progressCb,
+  ffi.Pointer<_NativeConvertResult> outResult,
+);
+
+typedef _DartConvertFile = int Function(
+  ffi.Pointer<Utf8> ctbPath,
+  ffi.Pointer<Utf8> outPath,
+  ffi.Pointer<_NativeConvertOptions> options,
+  ffi.Pointer<ffi.NativeFunction<_NativeConvertProgress>> progressCb,
+  ffi.Pointer<_NativeConvertResult> outResult,
+);
+
 // ── CUDA device info ────────────────────────────────────────────────────────
 
 typedef _NativeGpuCudaInit = ffi.Int32 Function();
@@ -225,6 +585,138 @@ class NativeThreadStats {
   });
 }
 
+/// Area statistics computed per layer by native batches (VS_AREA_MODE_*).
+///
+/// Cheaper modes leave the fields they skip at zero: [bbox] fills the total
+/// area and bounding box, [total] only the total area.
+class NativeAreaMode {
+  static const int full = 0;
+  static const int bbox = 1;
+  static const int total = 2;
+  static const int none = 3;
+}
+
+/// Per-layer scheduler cost samples from the last native batch: the
+/// predicted cost (encoded input bytes) and the measured time, in layer order.
+class NativeCostSamples {
+  final List<int> predicted;
+  final List<int> actualNs;
+
+  const NativeCostSamples({required this.predicted, required this.actualNs});
+
+  static const empty = NativeCostSamples(predicted: [], actualNs: []);
+
+  int get length => predicted.length;
+}
+
+/// Outcome of [NativeLayerBatchProcess.convertFile].
+///
+/// On success [zipHandle] is an archive that is still open: the caller
+/// appends the metadata derived from [areas] and closes it.
+class NativeConvertResult {
+  final int error;
+  final int zipHandle;
+  final List<LayerAreaInfo> areas;
+  final int layersDone;
+  final int backendCode;
+  final int gpuAttempts;
+  final int gpuSuccesses;
+  final int gpuFallbacks;
+  final int inputBackend;
+  final Duration readTime;
+  final Duration processTime;
+
+  /// Layers whose output was copied from an identical earlier layer.
+  final int dedupHits;
+
+  /// Layers read back from the layer cache.
+  final int cacheHits;
+
+  const NativeConvertResult({
+    required this.error,
+    this.zipHandle = 0,
+    this.areas = const [],
+    this.layersDone = 0,
+    this.backendCode = 0,
+    this.gpuAttempts = 0,
+    this.gpuSuccesses = 0,
+    this.gpuFallbacks = 0,
+    this.inputBackend = 0,
+    this.readTime = Duration.zero,
+    this.processTime = Duration.zero,
+    this.dedupHits = 0,
+    this.cacheHits = 0,
+  });
+
+  bool get ok => error == 0 && zipHandle != 0;
+
+  String get errorName {
+    switch (error) {
+      case 0:
+        return 'ok';
+      case 1:
+        return 'invalid arguments';
+      case 2:
+        return 'cannot read input';
+      case 3:
+        return 'unsupported CTB header';
+      case 4:
+        return 'invalid layer table';
+      case 5:
+        return 'out of memory';
+      case 6:
+        return 'cannot write output';
+      case 7:
+        return 'layer processing failed';
+      default:
+        return 'error $error';
+    }
+  }
+}
+
+/// Projection and progress of a compression plan, see
+/// [NativeLayerBatchProcess.openCompressPlan].
+class NativeCompressPlanReport {
+  final Duration? budget;
+  final int? targetBytes;
+
+  /// Output size and job time projected once an eighth of the layers were
+  /// done (zero before that).
+  final int plannedBytes;
+  final Duration plannedTime;
+  final int actualBytes;
+  final Duration actualTime;
+  final int layersDone;
+
+  /// Layers finished without an encode (blank, repeated or cached).
+  final int layersReused;
+  final int replans;
+  final int probes;
+
+  /// The last plan could not meet the budget or target.
+  final bool unreachable;
+
+  /// zlib level -> layers encoded at it / projected for it.
+  final Map<int, int> levelLayers;
+  final Map<int, int> plannedLayers;
+
+  const NativeCompressPlanReport({
+    required this.budget,
+    required this.targetBytes,
+    required this.plannedBytes,
+    required this.plannedTime,
+    required this.actualBytes,
+    required this.actualTime,
+    required this.layersDone,
+    required this.layersReused,
+    required this.replans,
+    required this.probes,
+    required this.unreachable,
+    required this.levelLayers,
+    required this.plannedLayers,
+  });
+}
+
 class NativeLayerBatchProcess {
   NativeLayerBatchProcess._();
 
@@ -241,8 +733,28 @@ class NativeLayerBatchProcess {
   _DartGetProcessLastCudaError? _getLastCudaError;
   _DartGetProcessLastThreadCount? _getLastThreadCount;
   _DartGetProcessLastThreadStats? _getLastThreadStats;
+  _DartGetProcessLastCostCount? _getLastCostCount;
+  _DartGetProcessLastCostSamples? _getLastCostSamples;
   _DartGetProcessLastGpuBatchOk? _getLastGpuBatchOk;
   _DartProcessLayersBatchPhased? _processBatchPhased;
+  _DartProcessLayersBatchToZip? _processBatchToZip;
+  _DartConvertFile? _convertFile;
+  _DartReleasePoolScratch? _releasePoolScratch;
+  _DartReleasePoolScratch? _releaseLayerCaches;
+  _DartGetProcessLastDedupHits? _getLastDedupHits;
+  _DartGetProcessLastDedupHits? _getLastCacheHits;
+  _DartLayerCacheOpen? _layerCacheOpen;
+  _DartLayerCacheClose? _layerCacheClose;
+  _DartHashFile? _hashFile;
+  _DartCopyFile? _copyFile;
+  _DartEncodeJobOpen? _encodeJobOpen;
+  _DartEncodeJobClose? _encodeJobClose;
+  _DartEncodeJobSetBackground? _encodeJobSetBackground;
+  _DartGetDeflateEncoder? _getDeflateEncoder;
+  _DartGetDeflateAutoChoice? _getDeflateAutoChoice;
+  _DartCompressPlanOpen? _compressPlanOpen;
+  _DartCompressPlanReportFn? _compressPlanReport;
+  _DartCompressPlanHandle? _compressPlanClose;
   _DartGpuCudaInit? _cudaInit;
   _DartGpuCudaDeviceName? _cudaDeviceName;
   _DartGpuCudaVram? _cudaVram;
@@ -272,6 +784,17 @@ class NativeLayerBatchProcess {
     } catch (_) {}
   }
 
+  /// Free the per-thread buffers the native worker pool keeps between
+  /// batches, and the layers remembered for reuse across batches. Call once
+  /// a conversion is done; safe to call at any time.
+  void releaseWorkerScratch() {
+    _ensureInit();
+    try {
+      _releasePoolScratch?.call();
+      _releaseLayerCaches?.call();
+    } catch (_) {}
+  }
+
   void setAnalyticsEnabled(bool enabled) {
     _ensureInit();
     final fn = _setBatchAnalytics;
@@ -292,8 +815,10 @@ class NativeLayerBatchProcess {
     }
   }
 
-  String get lastBackendName {
-    switch (lastBackendCode) {
+  String get lastBackendName => backendNameFor(lastBackendCode);
+
+  static String backendNameFor(int code) {
+    switch (code) {
       case 1:
         return 'GPU OpenCL';
       case 2:
@@ -393,6 +918,35 @@ class NativeLayerBatchProcess {
     }
   }
 
+  NativeCostSamples getLastCostSamples() {
+    _ensureInit();
+    final countFn = _getLastCostCount;
+    final samplesFn = _getLastCostSamples;
+    if (countFn == null || samplesFn == null) return NativeCostSamples.empty;
+    int count = 0;
+    try {
+      count = countFn();
+    } catch (_) {
+      return NativeCostSamples.empty;
+    }
+    if (count <= 0) return NativeCostSamples.empty;
+
+    final predictedPtr = malloc<ffi.Int64>(count);
+    final actualPtr = malloc<ffi.Int64>(count);
+    try {
+      samplesFn(predictedPtr, actualPtr, count);
+      return NativeCostSamples(
+        predicted: List<int>.of(predictedPtr.asTypedList(count)),
+        actualNs: List<int>.of(actualPtr.asTypedList(count)),
+      );
+    } catch (_) {
+      return NativeCostSamples.empty;
+    } finally {
+      malloc.free(predictedPtr);
+      malloc.free(actualPtr);
+    }
+  }
+
   int get lastCudaError {
     _ensureInit();
     final fn = _getLastCudaError;
@@ -404,6 +958,245 @@ class NativeLayerBatchProcess {
     }
   }
 
+  /// Open the layer cache in [dir] (which must exist) for one job, capped
+  /// at [maxBytes], so later conversions reuse unchanged layers. Returns a
+  /// handle to pass as `layerCache` to the job's batches, or 0 when the
+  /// cache cannot be used.
+  int openLayerCache(String dir, int maxBytes) {
+    _ensureInit();
+    final fn = _layerCacheOpen;
+    if (fn == null) return 0;
+    final dirPtr = dir.toNativeUtf8();
+    try {
+      return fn(dirPtr, maxBytes);
+    } catch (_) {
+      return 0;
+    } finally {
+      malloc.free(dirPtr);
+    }
+  }
+
+  /// Free [cache]; no batch may still be using it.
+  void closeLayerCache(int cache) {
+    _ensureInit();
+    final fn = _layerCacheClose;
+    if (fn == null || cache == 0) return;
+    try {
+      fn(cache);
+    } catch (_) {}
+  }
+
+  /// 128-bit content hash of the file at [path] as 32 hex digits, or null
+  /// if it cannot be read.
+  String? hashFile(String path) {
+    _ensureInit();
+    final fn = _hashFile;
+    if (fn == null) return null;
+    final pathPtr = path.toNativeUtf8();
+    final out = malloc<ffi.Uint64>(2);
+    try {
+      if (fn(pathPtr, out) == 0) return null;
+      return out[0].toUnsigned(64).toRadixString(16).padLeft(16, '0') +
+          out[1].toUnsigned(64).toRadixString(16).padLeft(16, '0');
+    } catch (_) {
+      return null;
+    } finally {
+      malloc.free(pathPtr);
+      malloc.free(out);
+    }
+  }
+
+  /// Copy [src] to [dst], replacing [dst] only once the copy is complete.
+  /// Returns false on failure or when the native library is unavailable.
+  bool copyFile(String src, String dst) {
+    _ensureInit();
+    final fn = _copyFile;
+    if (fn == null) return false;
+    final srcPtr = src.toNativeUtf8();
+    final dstPtr = dst.toNativeUtf8();
+    try {
+      return fn(srcPtr, dstPtr) != 0;
+    } catch (_) {
+      return false;
+    } finally {
+      malloc.free(srcPtr);
+      malloc.free(dstPtr);
+    }
+  }
+
+  /// Open a job's PNG deflate settings: window bits (9..15), memLevel
+  /// (1..9) and strategy (0 default, 1 filtered, 2 Huffman only, 3 RLE,
+  /// 4 fixed, 5 auto). Out-of-range values, e.g. -1, keep zlib's default for
+  /// that parameter. [encoder] picks what writes the streams: 0 zlib, 1 the
+  /// built-in encoder for layer masks (faster than zlib level 1, typically
+  /// smaller than level 6; ignores level, memLevel and strategy), 2 zlib-ng,
+  /// 3 libdeflate (whole layers only), 4 auto (benchmarks the loaded
+  /// backends per level, for this job only). [splitDeflate] lets layers be
+  /// deflated in parallel row bands when a batch has fewer layers than
+  /// threads; output then depends on the thread count. Returns a handle to
+  /// pass as `encodeJob` to the job's batches and recompression, or 0 (zlib
+  /// with its defaults) when the library lacks it.
+  int openEncodeJob(
+    int windowBits,
+    int memLevel,
+    int strategy,
+    int encoder, {
+    bool splitDeflate = true,
+  }) {
+    _ensureInit();
+    final fn = _encodeJobOpen;
+    if (fn == null) return 0;
+    try {
+      return fn(windowBits, memLevel, strategy, encoder, splitDeflate ? 1 : 0);
+    } catch (_) {
+      return 0;
+    }
+  }
+
+  /// Free [job]; no batch may still be using it.
+  void closeEncodeJob(int job) {
+    _ensureInit();
+    final fn = _encodeJobClose;
+    if (fn == null || job == 0) return;
+    try {
+      fn(job);
+    } catch (_) {}
+  }
+
+  /// Run [job]'s later batches with their native worker threads below
+  /// normal priority (Windows only), e.g. for a background recompress pass.
+  /// Other jobs sharing the worker pool keep normal priority.
+  void setEncodeJobBackground(int job, bool enabled) {
+    _ensureInit();
+    final fn = _encodeJobSetBackground;
+    if (fn == null || job == 0) return;
+    try {
+      fn(job, enabled ? 1 : 0);
+    } catch (_) {}
+  }
+
+  /// The encoder code (0..3) that writes streams for batches of [job]
+  /// requested at [level], after fallback to zlib and the auto encoder's
+  /// benchmark, or null without the native library.
+  int? deflateEncoder(int job, int level) {
+    _ensureInit();
+    final fn = _getDeflateEncoder;
+    if (fn == null) return null;
+    try {
+      return fn(job, level);
+    } catch (_) {
+      return null;
+    }
+  }
+
+  /// Open a per-layer compression plan for a job of [layerCount] layers:
+  /// the smallest output that finishes within [budget], or the fastest
+  /// whose PNGs total at most [targetBytes]. Returns a handle to pass as
+  /// `compressPlan` to the job's batches, or 0 when neither is given or the
+  /// library lacks the planner.
+  int openCompressPlan(
+    int layerCount, {
+    Duration? budget,
+    int? targetBytes,
+  }) {
+    _ensureInit();
+    final fn = _compressPlanOpen;
+    if (fn == null) return 0;
+    try {
+      return fn(layerCount, budget?.inMilliseconds ?? 0, targetBytes ?? 0);
+    } catch (_) {
+      return 0;
+    }
+  }
+
+
+  NativeCompressPlanReport? compressPlanReport(int plan) {
+    _ensureInit();
+    final fn = _compressPlanReport;
+    if (fn == null || plan == 0) return null;
+    final out = calloc<_NativeCompressPlanReport>();
+    try {
+      if (fn(plan, out) == 0) return null;
+      final r = out.ref;
+      final levelLayers = <int, int>{};
+      final plannedLayers = <int, int>{};
+      for (var k = 0; k < 3; k++) {
+        levelLayers[r.levels[k]] = r.levelLayers[k];
+        plannedLayers[r.levels[k]] = r.plannedLayers[k];
+      }
+      return NativeCompressPlanReport(
+        budget: r.budgetMs > 0 ? Duration(milliseconds: r.budgetMs) : null,
+        targetBytes: r.targetBytes > 0 ? r.targetBytes : null,
+        plannedBytes: r.plannedBytes,
+        plannedTime: Duration(milliseconds: r.plannedMs),
+        actualBytes: r.actualBytes,
+        actualTime: Duration(milliseconds: r.actualMs),
+        layersDone: r.layersDone,
+        layersReused: r.layersReused,
+        replans: r.replans,
+        probes: r.probes,
+        unreachable: r.unreachable != 0,
+        levelLayers: levelLayers,
+        plannedLayers: plannedLayers,
+      );
+    } catch (_) {
+      return null;
+    } finally {
+      calloc.free(out);
+    }
+  }
+
+  /// Free [plan]. No batch using it may still be running.
+  void closeCompressPlan(int plan) {
+    _ensureInit();
+    final fn = _compressPlanClose;
+    if (fn == null || plan == 0) return;
+    try {
+      fn(plan);
+    } catch (_) {}
+  }
+
+  /// The zlib strategy and level the auto strategy chose for batches of
+  /// [job] requested at [level], or null before its trials are complete.
+  (int strategy, int level)? deflateAutoChoice(int job, int level) {
+    _ensureInit();
+    final fn = _getDeflateAutoChoice;
+    if (fn == null) return null;
+    final out = malloc<ffi.Int32>(2);
+    try {
+      if (fn(job, level, out, out + 1) == 0) return null;
+      return (out[0], out[1]);
+    } catch (_) {
+      return null;
+    } finally {
+      malloc.free(out);
+    }
+  }
+
+  /// Layers in the last batch read back from the layer cache.
+  int get lastCacheHits {
+    _ensureInit();
+    final fn = _getLastCacheHits;
+    if (fn == null) return 0;
+    try {
+      return fn();
+    } catch (_) {
+      return 0;
+    }
+  }
+
+  /// Layers in the last batch that reused an identical layer's output.
+  int get lastDedupHits {
+    _ensureInit();
+    final fn = _getLastDedupHits;
+    if (fn == null) return 0;
+    try {
+      return fn();
+    } catch (_) {
+      return 0;
+    }
+  }
+
   int get lastGpuBatchOk {
     _ensureInit();
     final fn = _getLastGpuBatchOk;
@@ -423,6 +1216,16 @@ class NativeLayerBatchProcess {
         _freeAreaBuffer != null;
   }
 
+  bool get streamAvailable {
+    _ensureInit();
+    return _processBatchToZip != null;
+  }
+
+  bool get convertFileAvailable {
+    _ensureInit();
+    return _convertFile != null;
+  }
+
   // ── CUDA device info ──────────────────────────────────────────────────
 
   bool cudaInit() {
@@ -512,7 +1315,8 @@ class NativeLayerBatchProcess {
   }
 
   List<NativeBatchLayerResult>? processBatch({
-    required List<Uint8List> rawLayers,
+    List<Uint8List> rawLayers = const [],
+    NativeLayerChunk? input,
     required int layerIndexBase,
     required int encryptionKey,
     required int srcWidth,
@@ -522,6 +1326,10 @@ class NativeLayerBatchProcess {
     required double xPixelSizeMm,
     required double yPixelSizeMm,
     int pngLevel = 1,
+    int compressPlan = 0,
+    int encodeJob = 0,
+    int layerCache = 0,
+    int areaMode = NativeAreaMode.full,
     int threadCount = 0,
   }) {
     _ensureInit();
@@ -532,17 +1340,12 @@ class NativeLayerBatchProcess {
     if (fn == null || freeBytes == null || freeInts == null || freeAreas == null) {
       return null;
     }
-    if (rawLayers.isEmpty) return const <NativeBatchLayerResult>[];
-
-    final count = rawLayers.length;
-    var inputBlobLen = 0;
-    for (final l in rawLayers) {
-      inputBlobLen += l.length;
+    if (input == null && rawLayers.isEmpty) {
+      return const <NativeBatchLayerResult>[];
     }
 
-    final inputBlobPtr = malloc<ffi.Uint8>(inputBlobLen);
-    final inputOffsetsPtr = malloc<ffi.Int32>(count);
-    final inputLengthsPtr = malloc<ffi.Int32>(count);
+    final chunk = input ?? NativeLayerChunk.copyOf(rawLayers);
+    final count = chunk.count;
 
     final outBlobPtr = malloc<ffi.Pointer<ffi.Uint8>>();
     final outBlobLenPtr = malloc<ffi.Int32>();
@@ -551,16 +1354,6 @@ class NativeLayerBatchProcess {
     final outAreasPtr = malloc<ffi.Pointer<_NativeAreaStatsResult>>();
 
     try {
-      final inputBlob = inputBlobPtr.asTypedList(inputBlobLen);
-      var cursor = 0;
-      for (var i = 0; i < count; i++) {
-        final layer = rawLayers[i];
-        inputOffsetsPtr[i] = cursor;
-        inputLengthsPtr[i] = layer.length;
-        inputBlob.setAll(cursor, layer);
-        cursor += layer.length;
-      }
-
       outBlobPtr.value = ffi.nullptr;
       outBlobLenPtr.value = 0;
       outOffsetsPtr.value = ffi.nullptr;
@@ -568,10 +1361,10 @@ class NativeLayerBatchProcess {
       outAreasPtr.value = ffi.nullptr;
 
       final ok = fn(
-        inputBlobPtr,
-        inputBlobLen,
-        inputOffsetsPtr,
-        inputLengthsPtr,
+        chunk.blob,
+        chunk.blobLength,
+        chunk.offsets,
+        chunk.lengths,
         count,
         layerIndexBase,
         encryptionKey,
@@ -582,6 +1375,10 @@ class NativeLayerBatchProcess {
         xPixelSizeMm,
         yPixelSizeMm,
         pngLevel,
+        compressPlan,
+        encodeJob,
+        layerCache,
+        areaMode,
         threadCount,
         outBlobPtr,
         outBlobLenPtr,
@@ -653,9 +1450,7 @@ class NativeLayerBatchProcess {
       if (outAreas != ffi.nullptr) freeAreas(outAreas);
       return null;
     } finally {
-      malloc.free(inputBlobPtr);
-      malloc.free(inputOffsetsPtr);
-      malloc.free(inputLengthsPtr);
+      if (input == null) chunk.release();
       malloc.free(outBlobPtr);
       malloc.free(outBlobLenPtr);
       malloc.free(outOffsetsPtr);
@@ -664,13 +1459,263 @@ class NativeLayerBatchProcess {
     }
   }
 
+  /// Process layers and append each PNG directly to [zipHandle] as
+  /// `<layerIndexBase + i + 1>.png`.
+  ///
+  /// Only the per-layer area stats come back to Dart; PNG bytes never leave
+  /// native memory. At most [maxInFlight] finished layers are buffered while
+  /// waiting for their turn to be written (0 = 2x thread count). A non-zero
+  /// [compressPlan] ([openCompressPlan]) picks each layer's level in place
+  /// of [pngLevel]; [encodeJob] ([openEncodeJob]) carries the job's stream
+  /// settings and [layerCache] ([openLayerCache]) its layer cache.
+  ///
+  /// Returns null on failure, in which case the archive is incomplete and
+  /// should be aborted.
+  List<LayerAreaInfo>? processBatchToZip({
+    required int zipHandle,
+    List<Uint8List> rawLayers = const [],
+    NativeLayerChunk? input,
+    required int layerIndexBase,
+    required int encryptionKey,
+    required int srcWidth,
+    required int height,
+    required int outWidth,
+    required int channels,
+    required double xPixelSizeMm,
+    required double yPixelSizeMm,
+    int pngLevel = 1,
+    int compressPlan = 0,
+    int encodeJob = 0,
+    int layerCache = 0,
+    int areaMode = NativeAreaMode.full,
+    int threadCount = 0,
+    int maxInFlight = 0,
+  }) {
+    _ensureInit();
+    final fn = _processBatchToZip;
+    if (fn == null || zipHandle == 0) return null;
+    if (input == null && rawLayers.isEmpty) return const <LayerAreaInfo>[];
+
+    final chunk = input ?? NativeLayerChunk.copyOf(rawLayers);
+    final count = chunk.count;
+    final outAreasPtr = malloc<_NativeAreaStatsResult>(count);
+
+    try {
+      final ok = fn(
+        zipHandle,
+        chunk.blob,
+        chunk.blobLength,
+        chunk.offsets,
+        chunk.lengths,
+        count,
+        layerIndexBase,
+        encryptionKey,
+        srcWidth,
+        height,
+        outWidth,
+        channels,
+        xPixelSizeMm,
+        yPixelSizeMm,
+        pngLevel,
+        compressPlan,
+        encodeJob,
+        layerCache,
+        areaMode,
+        threadCount,
+        maxInFlight,
+        outAreasPtr,
+      );
+      if (ok == 0) return null;
+
+      final result = <LayerAreaInfo>[];
+      for (var i = 0; i < count; i++) {
+        final area = outAreasPtr[i];
+        result.add(LayerAreaInfo(
+          totalSolidArea: area.totalSolidArea,
+          largestArea: area.largestArea,
+          smallestArea: area.smallestArea,
+          minX: area.minX, minY: area.minY,
+          maxX: area.maxX, maxY: area.maxY,
+          areaCount: area.areaCount,
+        ));
+      }
+      return result;
+    } catch (_) {
+      return null;
+    } finally {
+      if (input == null) chunk.release();
+      malloc.free(outAreasPtr);
+    }
+  }
+
+  /// Convert a whole CTB file in one native call.
+  ///
+  /// Native code parses the header and layer table, reads layer data in
+  /// bounded chunks and writes [headEntries] followed by every layer PNG
+  /// to [outputPath]. [onProgress] is invoked synchronously on this isolate
+  /// while the call runs. Pass [headerOverride] for CTBv4E, whose settings
+  /// block can only be decrypted by the Dart parser, [compressPlan] to
+  /// let a plan from [openCompressPlan] pick each layer's level, and
+  /// [encodeJob] for the job's stream settings ([openEncodeJob]) and
+  /// [layerCache] for its layer cache ([openLayerCache]).
+  ///
+  /// Returns null when the native entry point is unavailable.
+  NativeConvertResult? convertFile({
+    required String ctbPath,
+    required String outputPath,
+    required List<NativeZipEntry> headEntries,
+    required int outWidth,
+    required int channels,
+    required double xPixelSizeMm,
+    required double yPixelSizeMm,
+    int pngLevel = 1,
+    int compressPlan = 0,
+    int encodeJob = 0,
+    int layerCache = 0,
+    int areaMode = NativeAreaMode.full,
+    int threadCount = 0,
+    int maxInFlight = 0,
+    int chunkLayers = 0,
+    int inputBackend = NativeLayerSource.backendAuto,
+    ({
+      int layerTableOffset,
+      int layerCount,
+      int resolutionX,
+      int resolutionY,
+      int encryptionKey,
+    })? headerOverride,
+    void Function(int done, int total)? onProgress,
+  }) {
+    _ensureInit();
+    final fn = _convertFile;
+    final freeAreas = _freeAreaBuffer;
+    if (fn == null || freeAreas == null) return null;
+
+    final ctbPathPtr = ctbPath.toNativeUtf8();
+    final outPathPtr = outputPath.toNativeUtf8();
+    final optionsPtr = calloc<_NativeConvertOptions>();
+    final resultPtr = calloc<_NativeConvertResult>();
+    final headCount = headEntries.length;
+    final namesPtr = calloc<ffi.Pointer<Utf8>>(headCount == 0 ? 1 : headCount);
+    final dataPtr = calloc<ffi.Pointer<ffi.Uint8>>(headCount == 0 ? 1 : headCount);
+    final lengthsPtr = calloc<ffi.Int32>(headCount == 0 ? 1 : headCount);
+    ffi.NativeCallable<_NativeConvertProgress>? progressCallable;
+
+    try {
+      for (var i = 0; i < headCount; i++) {
+        final entry = headEntries[i];
+        namesPtr[i] = entry.name.toNativeUtf8();
+        final bytes = malloc<ffi.Uint8>(entry.data.isEmpty ? 1 : entry.data.length);
+        bytes.asTypedList(entry.data.length).setAll(0, entry.data);
+        dataPtr[i] = bytes;
+        lengthsPtr[i] = entry.data.length;
+      }
+
+      final options = optionsPtr.ref
+        ..outWidth = outWidth
+        ..channels = channels
+        ..xPixelSizeMm = xPixelSizeMm
+        ..yPixelSizeMm = yPixelSizeMm
+        ..pngLevel = pngLevel
+        ..compressPlan = compressPlan
+        ..encodeJob = encodeJob
+        ..layerCache = layerCache
+        ..areaMode = areaMode
+        ..threadCount = threadCount
+        ..maxInFlight = maxInFlight
+        ..chunkLayers = chunkLayers
+        ..inputBackend = inputBackend
+        ..headEntryCount = headCount
+        ..headEntryNames = namesPtr
+        ..headEntryData = dataPtr
+        ..headEntryLengths = lengthsPtr;
+      if (headerOverride != null) {
+        options
+          ..headerOverride = 1
+          ..layerTableOffset = headerOverride.layerTableOffset
+          ..layerCount = headerOverride.layerCount
+          ..resolutionX = headerOverride.resolutionX
+          ..resolutionY = headerOverride.resolutionY
+          ..encryptionKey = headerOverride.encryptionKey;
+      }
+
+      if (onProgress != null) {
+        progressCallable = ffi.NativeCallable<_NativeConvertProgress>.isolateLocal(
+          (int done, int total) => onProgress(done, total),
+        );
+      }
+
+      final ok = fn(
+        ctbPathPtr,
+        outPathPtr,
+        optionsPtr,
+        progressCallable?.nativeFunction ?? ffi.nullptr,
+        resultPtr,
+      );
+
+      final r = resultPtr.ref;
+      if (ok == 0) {
+        return NativeConvertResult(
+          error: r.error == 0 ? -1 : r.error,
+          layersDone: r.layersDone,
+        );
+      }
+
+      final areas = <LayerAreaInfo>[];
+      for (var i = 0; i < r.layerCount; i++) {
+        final area = r.areas[i];
+        areas.add(LayerAreaInfo(
+          totalSolidArea: area.totalSolidArea,
+          largestArea: area.largestArea,
+          smallestArea: area.smallestArea,
+          minX: area.minX, minY: area.minY,
+          maxX: area.maxX, maxY: area.maxY,
+          areaCount: area.areaCount,
+        ));
+      }
+      freeAreas(r.areas);
+
+      return NativeConvertResult(
+        error: 0,
+        zipHandle: r.zipHandle,
+        areas: areas,
+        layersDone: r.layersDone,
+        backendCode: r.backend,
+        gpuAttempts: r.gpuAttempts,
+        gpuSuccesses: r.gpuSuccesses,
+        gpuFallbacks: r.gpuFallbacks,
+        inputBackend: r.inputBackend,
+        readTime: Duration(microseconds: r.readNs ~/ 1000),
+        processTime: Duration(microseconds: r.processNs ~/ 1000),
+        dedupHits: r.dedupHits,
+        cacheHits: r.cacheHits,
+      );
+    } catch (_) {
+      return null;
+    } finally {
+      progressCallable?.close();
+      for (var i = 0; i < headCount; i++) {
+        if (namesPtr[i] != ffi.nullptr) malloc.free(namesPtr[i]);
+        if (dataPtr[i] != ffi.nullptr) malloc.free(dataPtr[i]);
+      }
+      calloc.free(namesPtr);
+      calloc.free(dataPtr);
+      calloc.free(lengthsPtr);
+      calloc.free(optionsPtr);
+      calloc.free(resultPtr);
+      malloc.free(ctbPathPtr);
+      malloc.free(outPathPtr);
+    }
+  }
+
   /// Process layers using the PHASED pipeline (CPU+GPU hybrid).
   ///
   /// Phase 1: Parallel CPU decode + area stats
   /// Phase 2: GPU mega-batch scanlines (or CPU fallback)
   /// Phase 3: Parallel CPU compress + PNG wrap
   List<NativeBatchLayerResult>? processBatchPhased({
-    required List<Uint8List> rawLayers,
+    List<Uint8List> rawLayers = const [],
+    NativeLayerChunk? input,
     required int layerIndexBase,
     required int encryptionKey,
     required int srcWidth,
@@ -680,6 +1725,8 @@ class NativeLayerBatchProcess {
     required double xPixelSizeMm,
     required double yPixelSizeMm,
     int pngLevel = 1,
+    int encodeJob = 0,
+    int areaMode = NativeAreaMode.full,
     int threadCount = 0,
     bool useGpuBatch = true,
   }) {
@@ -691,17 +1738,12 @@ class NativeLayerBatchProcess {
     if (fn == null || freeBytes == null || freeInts == null || freeAreas == null) {
       return null;
     }
-    if (rawLayers.isEmpty) return const <NativeBatchLayerResult>[];
-
-    final count = rawLayers.length;
-    var inputBlobLen = 0;
-    for (final l in rawLayers) {
-      inputBlobLen += l.length;
+    if (input == null && rawLayers.isEmpty) {
+      return const <NativeBatchLayerResult>[];
     }
 
-    final inputBlobPtr = malloc<ffi.Uint8>(inputBlobLen);
-    final inputOffsetsPtr = malloc<ffi.Int32>(count);
-    final inputLengthsPtr = malloc<ffi.Int32>(count);
+    final chunk = input ?? NativeLayerChunk.copyOf(rawLayers);
+    final count = chunk.count;
     final outBlobPtr = malloc<ffi.Pointer<ffi.Uint8>>();
     final outBlobLenPtr = malloc<ffi.Int32>();
     final outOffsetsPtr = malloc<ffi.Pointer<ffi.Int32>>();
@@ -709,16 +1751,6 @@ class NativeLayerBatchProcess {
     final outAreasPtr = malloc<ffi.Pointer<_NativeAreaStatsResult>>();
 
     try {
-      final inputBlob = inputBlobPtr.asTypedList(inputBlobLen);
-      var cursor = 0;
-      for (var i = 0; i < count; i++) {
-        final layer = rawLayers[i];
-        inputOffsetsPtr[i] = cursor;
-        inputLengthsPtr[i] = layer.length;
-        inputBlob.setAll(cursor, layer);
-        cursor += layer.length;
-      }
-
       outBlobPtr.value = ffi.nullptr;
       outBlobLenPtr.value = 0;
       outOffsetsPtr.value = ffi.nullptr;
@@ -726,10 +1758,10 @@ class NativeLayerBatchProcess {
       outAreasPtr.value = ffi.nullptr;
 
       final ok = fn(
-        inputBlobPtr,
-        inputBlobLen,
-        inputOffsetsPtr,
-        inputLengthsPtr,
+        chunk.blob,
+        chunk.blobLength,
+        chunk.offsets,
+        chunk.lengths,
         count,
         layerIndexBase,
         encryptionKey,
@@ -740,6 +1772,8 @@ class NativeLayerBatchProcess {
         xPixelSizeMm,
         yPixelSizeMm,
         pngLevel,
+        encodeJob,
+        areaMode,
         threadCount,
         useGpuBatch ? 1 : 0,
         outBlobPtr,
@@ -800,9 +1834,7 @@ class NativeLayerBatchProcess {
       if (outAreas != ffi.nullptr) freeAreas(outAreas);
       return null;
     } finally {
-      malloc.free(inputBlobPtr);
-      malloc.free(inputOffsetsPtr);
-      malloc.free(inputLengthsPtr);
+      if (input == null) chunk.release();
       malloc.free(outBlobPtr);
       malloc.free(outBlobLenPtr);
       malloc.free(outOffsetsPtr);
@@ -871,6 +1903,125 @@ class NativeLayerBatchProcess {
         _processBatchPhased = null;
       }
 
+      try {
+        _processBatchToZip = _lib!.lookupFunction<
+            _NativeProcessLayersBatchToZip,
+            _DartProcessLayersBatchToZip>('process_layers_batch_to_zip');
+      } catch (_) {
+        _processBatchToZip = null;
+      }
+
+      try {
+        _convertFile = _lib!.lookupFunction<
+            _NativeConvertFile,
+            _DartConvertFile>('vs_convert_file');
+      } catch (_) {
+        _convertFile = null;
+      }
+
+      try {
+        _releasePoolScratch = _lib!.lookupFunction<
+            _NativeReleasePoolScratch,
+            _DartReleasePoolScratch>('vs_worker_pool_release_scratch');
+      } catch (_) {
+        _releasePoolScratch = null;
+      }
+
+      try {
+        _getLastDedupHits = _lib!.lookupFunction<
+            _NativeGetProcessLastDedupHits,
+            _DartGetProcessLastDedupHits>('process_layers_last_dedup_hits');
+        _releaseLayerCaches = _lib!.lookupFunction<
+            _NativeReleasePoolScratch,
+            _DartReleasePoolScratch>('process_layers_release_caches');
+      } catch (_) {
+        _getLastDedupHits = null;
+        _releaseLayerCaches = null;
+      }
+
+      try {
+        _layerCacheOpen = _lib!.lookupFunction<
+            _NativeLayerCacheOpen,
+            _DartLayerCacheOpen>('vs_layer_cache_open');
+        _layerCacheClose = _lib!.lookupFunction<
+            _NativeLayerCacheClose,
+            _DartLayerCacheClose>('vs_layer_cache_close');
+        _getLastCacheHits = _lib!.lookupFunction<
+            _NativeGetProcessLastDedupHits,
+            _DartGetProcessLastDedupHits>('process_layers_last_cache_hits');
+      } catch (_) {
+        _layerCacheOpen = null;
+        _layerCacheClose = null;
+        _getLastCacheHits = null;
+      }
+
+      try {
+        _hashFile = _lib!.lookupFunction<_NativeHashFile, _DartHashFile>(
+          'hash_file',
+        );
+        _copyFile = _lib!.lookupFunction<_NativeCopyFile, _DartCopyFile>(
+          'copy_file',
+        );
+      } catch (_) {
+        _hashFile = null;
+        _copyFile = null;
+      }
+
+      try {
+        _encodeJobOpen = _lib!.lookupFunction<_NativeEncodeJobOpen,
+            _DartEncodeJobOpen>('vs_encode_job_open');
+        _encodeJobClose = _lib!.lookupFunction<_NativeEncodeJobClose,
+            _DartEncodeJobClose>('vs_encode_job_close');
+        _getDeflateAutoChoice = _lib!.lookupFunction<
+            _NativeGetDeflateAutoChoice,
+            _DartGetDeflateAutoChoice>('get_deflate_auto_choice');
+      } catch (_) {
+        _encodeJobOpen = null;
+        _encodeJobClose = null;
+        _getDeflateAutoChoice = null;
+      }
+
+      try {
+        _encodeJobSetBackground = _lib!.lookupFunction<
+            _NativeEncodeJobSetBackground,
+            _DartEncodeJobSetBackground>('vs_encode_job_set_background');
+      } catch (_) {
+        _encodeJobSetBackground = null;
+      }
+
+      try {
+        _getDeflateEncoder = _lib!.lookupFunction<_NativeGetDeflateEncoder,
+            _DartGetDeflateEncoder>('get_deflate_encoder');
+      } catch (_) {
+        _getDeflateEncoder = null;
+      }
+
+      try {
+        _compressPlanOpen = _lib!.lookupFunction<_NativeCompressPlanOpen,
+            _DartCompressPlanOpen>('vs_compress_plan_open');
+        _compressPlanReport = _lib!.lookupFunction<
+            _NativeCompressPlanReportFn,
+            _DartCompressPlanReportFn>('vs_compress_plan_report');
+        _compressPlanClose = _lib!.lookupFunction<_NativeCompressPlanHandle,
+            _DartCompressPlanHandle>('vs_compress_plan_close');
+      } catch (_) {
+        _compressPlanOpen = null;
+        _compressPlanReport = null;
+        _compressPlanClose = null;
+      }
+
+      try {
+        _getLastCostCount = _lib!.lookupFunction<
+            _NativeGetProcessLastCostCount,
+            _DartGetProcessLastCostCount>('process_layers_last_cost_count');
+        _getLastCostSamples = _lib!.lookupFunction<
+            _NativeGetProcessLastCostSamples,
+            _DartGetProcessLastCostSamples>('process_layers_last_cost_samples');
+      } catch (_) {
+        _getLastCostCount = null;
+        _getLastCostSamples = null;
+      }
+
         try {
         _cudaInit = _lib!.lookupFunction<
           _NativeGpuCudaInit, _DartGpuCudaInit>('gpu_cuda_info_init');
@@ -917,6 +2068,24 @@ class NativeLayerBatchProcess {
       _freeAreaBuffer = null;
       _getLastGpuBatchOk = null;
       _processBatchPhased = null;
+      _processBatchToZip = null;
+      _convertFile = null;
+      _releasePoolScratch = null;
+      _releaseLayerCaches = null;
+      _getLastDedupHits = null;
+      _layerCacheOpen = null;
+      _layerCacheClose = null;
+      _getLastCacheHits = null;
+      _encodeJobOpen = null;
+      _encodeJobClose = null;
+      _encodeJobSetBackground = null;
+      _getDeflateEncoder = null;
+      _getDeflateAutoChoice = null;
+      _compressPlanOpen = null;
+      _compressPlanReport = null;
+      _compressPlanClose = null;
+      _getLastCostCount = null;
+      _getLastCostSamples = null;
       _cudaInit = null;
       _cudaDeviceName = null;
       _cudaVram = null;
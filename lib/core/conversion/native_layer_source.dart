@@ -0,0 +1,277 @@
+import 'dart:ffi' as ffi;
+import 'dart:io';
+import 'dart:typed_data';
+
+import 'package:ffi/ffi.dart';
+
+typedef _NativeLayerSourceOpen = ffi.Int64 Function(
+  ffi.Pointer<Utf8> path,
+  ffi.Pointer<ffi.Uint32> layerOffsets,
+  ffi.Pointer<ffi.Uint32> layerLengths,
+  ffi.Int32 layerCount,
+  ffi.Int32 backend,
+);
+typedef _DartLayerSourceOpen = int Function(
+  ffi.Pointer<Utf8> path,
+  ffi.Pointer<ffi.Uint32> layerOffsets,
+  ffi.Pointer<ffi.Uint32> layerLengths,
+  int layerCount,
+  int backend,
+);
+
+typedef _NativeLayerSourceBackend = ffi.Int32 Function(ffi.Int64 source);
+typedef _DartLayerSourceBackend = int Function(int source);
+
+typedef _NativeLayerSourceFetch = ffi.Int32 Function(
+  ffi.Int64 source,
+  ffi.Int32 start,
+  ffi.Int32 end,
+  ffi.Pointer<ffi.Pointer<ffi.Uint8>> outBlob,
+  ffi.Pointer<ffi.Int32> outBlobLen,
+  ffi.Pointer<ffi.Pointer<ffi.Int32>> outOffsets,
+  ffi.Pointer<ffi.Pointer<ffi.Int32>> outLengths,
+);
+typedef _DartLayerSourceFetch = int Function(
+  int source,
+  int start,
+  int end,
+  ffi.Pointer<ffi.Pointer<ffi.Uint8>> outBlob,
+  ffi.Pointer<ffi.Int32> outBlobLen,
+  ffi.Pointer<ffi.Pointer<ffi.Int32>> outOffsets,
+  ffi.Pointer<ffi.Pointer<ffi.Int32>> outLengths,
+);
+
+typedef _NativeLayerSourceClose = ffi.Void Function(ffi.Int64 source);
+typedef _DartLayerSourceClose = void Function(int source);
+
+/// Raw layer input for the native batch entry points: one blob plus
+/// per-layer offsets/lengths into it.
+///
+/// Chunks from [NativeLayerSource.fetch] point at native-owned memory and
+/// are only valid until the next fetch; chunks from [NativeLayerChunk.copyOf]
+/// own their memory and must be [release]d.
+class NativeLayerChunk {
+  final ffi.Pointer<ffi.Uint8> blob;
+  final int blobLength;
+  final ffi.Pointer<ffi.Int32> offsets;
+  final ffi.Pointer<ffi.Int32> lengths;
+  final int count;
+  final bool _owned;
+
+  NativeLayerChunk._(
+    this.blob,
+    this.blobLength,
+    this.offsets,
+    this.lengths,
+    this.count,
+    this._owned,
+  );
+
+  /// Pack Dart-held layers into a freshly allocated native chunk.
+  factory NativeLayerChunk.copyOf(List<Uint8List> layers) {
+    final count = layers.length;
+    var blobLength = 0;
+    for (final l in layers) {
+      blobLength += l.length;
+    }
+
+    final blob = malloc<ffi.Uint8>(blobLength == 0 ? 1 : blobLength);
+    final offsets = malloc<ffi.Int32>(count == 0 ? 1 : count);
+    final lengths = malloc<ffi.Int32>(count == 0 ? 1 : count);
+    final view = blob.asTypedList(blobLength);
+    var cursor = 0;
+    for (var i = 0; i < count; i++) {
+      final layer = layers[i];
+      offsets[i] = cursor;
+      lengths[i] = layer.length;
+      view.setAll(cursor, layer);
+      cursor += layer.length;
+    }
+    return NativeLayerChunk._(blob, blobLength, offsets, lengths, count, true);
+  }
+
+  void release() {
+    if (!_owned) return;
+    malloc.free(blob);
+    malloc.free(offsets);
+    malloc.free(lengths);
+  }
+}
+
+/// Native reader for raw CTB layer payloads (`vs_layer_source_*`).
+///
+/// The file is either memory-mapped (chunks are zero-copy views into the
+/// mapping, with the next chunk pre-faulted) or read with positional reads
+/// into a double buffer that a background thread fills one chunk ahead.
+/// Either way the read of chunk N+1 overlaps the processing of chunk N.
+class NativeLayerSource {
+  static const int backendAuto = 0;
+  static const int backendMmap = 1;
+  static const int backendPread = 2;
+
+  final int _handle;
+  final _DartLayerSourceFetch _fetch;
+  final _DartLayerSourceClose _close;
+  final ffi.Pointer<ffi.Pointer<ffi.Uint8>> _outBlob =
+      malloc<ffi.Pointer<ffi.Uint8>>();
+  final ffi.Pointer<ffi.Int32> _outBlobLen = malloc<ffi.Int32>();
+  final ffi.Pointer<ffi.Pointer<ffi.Int32>> _outOffsets =
+      malloc<ffi.Pointer<ffi.Int32>>();
+  final ffi.Pointer<ffi.Pointer<ffi.Int32>> _outLengths =
+      malloc<ffi.Pointer<ffi.Int32>>();
+  bool _closed = false;
+
+  /// Backend actually in use ([backendMmap] or [backendPread]).
+  final int backend;
+
+  NativeLayerSource._(this._handle, this._fetch, this._close, this.backend);
+
+  String get backendName => backend == backendMmap ? 'mmap' : 'pread';
+
+  static ffi.DynamicLibrary? _lib;
+  static _DartLayerSourceOpen? _openFn;
+  static _DartLayerSourceBackend? _backendFn;
+  static _DartLayerSourceFetch? _fetchFn;
+  static _DartLayerSourceClose? _closeFn;
+  static bool _initTried = false;
+
+  static bool get available {
+    _ensureInit();
+    return _openFn != null &&
+        _backendFn != null &&
+        _fetchFn != null &&
+        _closeFn != null;
+  }
+
+  /// Open [path] with the given layer table. Returns null when the native
+  /// library is unavailable or the file/table cannot be used.
+  static NativeLayerSource? open(
+    String path, {
+    required List<int> layerOffsets,
+    required List<int> layerLengths,
+    int backend = backendAuto,
+  }) {
+    _ensureInit();
+    final openFn = _openFn;
+    final backendFn = _backendFn;
+    final fetchFn = _fetchFn;
+    final closeFn = _closeFn;
+    if (openFn == null || backendFn == null || fetchFn == null || closeFn == null) {
+      return null;
+    }
+    final count = layerOffsets.length;
+    if (count == 0 || layerLengths.length != count) return null;
+
+    final pathPtr = path.toNativeUtf8();
+    final offsetsPtr = malloc<ffi.Uint32>(count);
+    final lengthsPtr = malloc<ffi.Uint32>(count);
+    try {
+      offsetsPtr.asTypedList(count).setAll(0, layerOffsets);
+      lengthsPtr.asTypedList(count).setAll(0, layerLengths);
+      final handle = openFn(pathPtr, offsetsPtr, lengthsPtr, count, backend);
+      if (handle == 0) return null;
+      return NativeLayerSource._(handle, fetchFn, closeFn, backendFn(handle));
+    } catch (_) {
+      return null;
+    } finally {
+      malloc.free(pathPtr);
+      malloc.free(offsetsPtr);
+      malloc.free(lengthsPtr);
+    }
+  }
+
+  /// Layers [start, end) as a native chunk, valid until the next fetch.
+  NativeLayerChunk? fetch(int start, int end) {
+    if (_closed) return null;
+    final ok = _fetch(
+      _handle,
+      start,
+      end,
+      _outBlob,
+      _outBlobLen,
+      _outOffsets,
+      _outLengths,
+    );
+    if (ok == 0) return null;
+    return NativeLayerChunk._(
+      _outBlob.value,
+      _outBlobLen.value,
+      _outOffsets.value,
+      _outLengths.value,
+      end - start,
+      false,
+    );
+  }
+
+  void close() {
+    if (_closed) return;
+    _closed = true;
+    _close(_handle);
+    malloc.free(_outBlob);
+    malloc.free(_outBlobLen);
+    malloc.free(_outOffsets);
+    malloc.free(_outLengths);
+  }
+
+  static void _ensureInit() {
+    if (_initTried) return;
+    _initTried = true;
+
+    try {
+      _lib = _openLibrary();
+      if (_lib == null) return;
+
+      _openFn = _lib!.lookupFunction<_NativeLayerSourceOpen, _DartLayerSourceOpen>(
+          'vs_layer_source_open');
+      _backendFn = _lib!.lookupFunction<
+          _NativeLayerSourceBackend,
+          _DartLayerSourceBackend>('vs_layer_source_backend');
+      _fetchFn = _lib!.lookupFunction<
+          _NativeLayerSourceFetch,
+          _DartLayerSourceFetch>('vs_layer_source_fetch');
+      _closeFn = _lib!.lookupFunction<
+          _NativeLayerSourceClose,
+          _DartLayerSourceClose>('vs_layer_source_close');
+    } catch (_) {
+      _openFn = null;
+      _backendFn = null;
+      _fetchFn = null;
+      _closeFn = null;
+    }
+  }
+
+  static ffi.DynamicLibrary? _openLibrary() {
+    final exePath = File(Platform.resolvedExecutable).absolute.path;
+    final exeDir = File(exePath).parent.path;
+
+    if (Platform.isWindows) {
+      final candidate = '$exeDir${Platform.pathSeparator}area_stats.dll';
+      if (File(candidate).existsSync()) {
+        return ffi.DynamicLibrary.open(candidate);
+      }
+      return ffi.DynamicLibrary.open('area_stats.dll');
+    }
+
+    if (Platform.isLinux) {
+      final libDir = '$exeDir${Platform.pathSeparator}lib';
+      final candidate = '$libDir${Platform.pathSeparator}libarea_stats.so';
+      if (File(candidate).existsSync()) {
+        return ffi.DynamicLibrary.open(candidate);
+      }
+      return ffi.DynamicLibrary.open('libarea_stats.so');
+    }
+
+    if (Platform.isMacOS) {
+      final frameworksDir =
+          '$exeDir${Platform.pathSeparator}..${Platform.pathSeparator}Frameworks';
+      final candidate =
+          '$frameworksDir${Platform.pathSeparator}libarea_stats.dylib';
+      if (File(candidate).existsSync()) {
+        return ffi.DynamicLibrary.open(candidate);
+      }
+      return ffi.DynamicLibrary.open('libarea_stats.dylib');
+    }
+
+    return null;
+  }
+}
@@ -114,6 +114,12 @@ typedef _DartDecodeBuildAndArea = int Function(
   int outLen,
 );
 
+typedef _NativeSetSimdLevel = ffi.Void Function(ffi.Int32 level);
+typedef _DartSetSimdLevel = void Function(int level);
+
+typedef _NativeSimdLevel = ffi.Int32 Function();
+typedef _DartSimdLevel = int Function();
+
 class NativeDecodeScanlineResult {
   final Uint8List greyPixels;
   final Uint8List scanlines;
@@ -143,6 +149,8 @@ class NativePngEncode {
   _DartBuildScanlines? _build;
   _DartDecodeAndBuildScanlines? _decodeAndBuild;
   _DartDecodeBuildAndArea? _decodeBuildAndArea;
+  _DartSetSimdLevel? _setSimdLevel;
+  _DartSimdLevel? _simdLevel;
   bool _initTried = false;
 
   bool get available {
@@ -160,6 +168,28 @@ class NativePngEncode {
     return _decodeBuildAndArea != null;
   }
 
+  /// SIMD level the native kernels use: 0 scalar reference, 1 SSE2/NEON,
+  /// 2 AVX2. Null without the native library.
+  int? get simdLevel {
+    _ensureInit();
+    final fn = _simdLevel;
+    if (fn == null) return null;
+    try {
+      return fn();
+    } catch (_) {
+      return null;
+    }
+  }
+
+  /// Cap the SIMD level of the native kernels (-1 = best detected, 0 =
+  /// scalar reference). Outputs are identical at every level.
+  void setSimdLevel(int level) {
+    _ensureInit();
+    try {
+      _setSimdLevel?.call(level);
+    } catch (_) {}
+  }
+
   Uint8List? buildRgbScanlines(
     Uint8List greyPixels,
     int srcWidth,
@@ -355,6 +385,17 @@ class NativePngEncode {
       _decodeAndBuild = null;
       _decodeBuildAndArea = null;
     }
+
+    if (_lib == null) return;
+    try {
+      _setSimdLevel = _lib!.lookupFunction<_NativeSetSimdLevel,
+          _DartSetSimdLevel>('set_native_simd_level');
+      _simdLevel =
+          _lib!.lookupFunction<_NativeSimdLevel, _DartSimdLevel>('native_simd_level');
+    } catch (_) {
+      _setSimdLevel = null;
+      _simdLevel = null;
+    }
   }
 
   ffi.DynamicLibrary? _openLibrary() {
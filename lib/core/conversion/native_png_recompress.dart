@@ -8,6 +8,7 @@ typedef _NativeRecompressPngIdat = ffi.Int32 Function(
   ffi.Pointer<ffi.Uint8> pngData,
   ffi.Int32 pngLen,
   ffi.Int32 level,
+  ffi.Int64 encodeJob,
   ffi.Pointer<ffi.Pointer<ffi.Uint8>> outData,
   ffi.Pointer<ffi.Int32> outLen,
 );
@@ -16,6 +17,7 @@ typedef _DartRecompressPngIdat = int Function(
   ffi.Pointer<ffi.Uint8> pngData,
   int pngLen,
   int level,
+  int encodeJob,
   ffi.Pointer<ffi.Pointer<ffi.Uint8>> outData,
   ffi.Pointer<ffi.Int32> outLen,
 );
@@ -30,6 +32,7 @@ typedef _NativeRecompressPngBatch = ffi.Int32 Function(
   ffi.Pointer<ffi.Int32> inputLengths,
   ffi.Int32 count,
   ffi.Int32 level,
+  ffi.Int64 encodeJob,
   ffi.Pointer<ffi.Pointer<ffi.Uint8>> outBlob,
   ffi.Pointer<ffi.Int32> outBlobLen,
   ffi.Pointer<ffi.Pointer<ffi.Int32>> outOffsets,
@@ -43,6 +46,7 @@ typedef _DartRecompressPngBatch = int Function(
   ffi.Pointer<ffi.Int32> inputLengths,
   int count,
   int level,
+  int encodeJob,
   ffi.Pointer<ffi.Pointer<ffi.Uint8>> outBlob,
   ffi.Pointer<ffi.Int32> outBlobLen,
   ffi.Pointer<ffi.Pointer<ffi.Int32>> outOffsets,
@@ -87,7 +91,13 @@ class NativePngRecompress {
     } catch (_) {}
   }
 
-  Uint8List? recompress(Uint8List pngBytes, {int level = 7}) {
+  /// Recompress one PNG at [level] with the stream settings of [encodeJob]
+  /// (NativeLayerBatchProcess.openEncodeJob; 0 for zlib's defaults).
+  Uint8List? recompress(
+    Uint8List pngBytes, {
+    int level = 7,
+    int encodeJob = 0,
+  }) {
     _ensureInit();
     final fn = _recompress;
     final freeFn = _freeBuffer;
@@ -106,6 +116,7 @@ class NativePngRecompress {
         inPtr,
         pngBytes.length,
         level,
+        encodeJob,
         outDataPtr,
         outLenPtr,
       );
@@ -131,7 +142,11 @@ class NativePngRecompress {
     }
   }
 
-  List<Uint8List>? recompressBatch(List<Uint8List> pngs, {int level = 7}) {
+  List<Uint8List>? recompressBatch(
+    List<Uint8List> pngs, {
+    int level = 7,
+    int encodeJob = 0,
+  }) {
     _ensureInit();
     final fn = _recompressBatch;
     final freeBytesFn = _freeBuffer;
@@ -176,6 +191,7 @@ class NativePngRecompress {
         inLengthsPtr,
         count,
         level,
+        encodeJob,
         outBlobPtr,
         outBlobLenPtr,
         outOffsetsPtr,
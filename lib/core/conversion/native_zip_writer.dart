@@ -33,6 +33,48 @@ typedef _DartZipClose = int Function(int handle);
 typedef _NativeZipAbort = ffi.Void Function(ffi.Int64 handle);
 typedef _DartZipAbort = void Function(int handle);
 
+/// An archive opened with [NativeZipWriter.openStream].
+///
+/// Entries are appended as they are produced; the raw [handle] can also be
+/// passed to native producers (e.g. `process_layers_batch_to_zip`) that
+/// write entries without routing the bytes through Dart.
+class NativeZipStream {
+  final int handle;
+  final _DartZipAddFile _addFile;
+  final _DartZipClose _close;
+  final _DartZipAbort _abort;
+  bool _finished = false;
+
+  NativeZipStream._(this.handle, this._addFile, this._close, this._abort);
+
+  bool addEntry(String name, Uint8List data) {
+    if (_finished) return false;
+    final namePtr = name.toNativeUtf8();
+    final dataPtr = malloc<ffi.Uint8>(data.isEmpty ? 1 : data.length);
+    try {
+      dataPtr.asTypedList(data.length).setAll(0, data);
+      return _addFile(handle, namePtr, dataPtr, data.length) != 0;
+    } finally {
+      malloc.free(namePtr);
+      malloc.free(dataPtr);
+    }
+  }
+
+  /// Write the central directory and close the file.
+  bool close() {
+    if (_finished) return false;
+    _finished = true;
+    return _close(handle) != 0;
+  }
+
+  /// Release the writer without finalizing the archive.
+  void abort() {
+    if (_finished) return;
+    _finished = true;
+    _abort(handle);
+  }
+}
+
 class NativeZipWriter {
   NativeZipWriter._();
 
@@ -50,6 +92,38 @@ class NativeZipWriter {
     return _open != null && _addFile != null && _close != null && _abort != null;
   }
 
+  /// Open an archive for incremental writing, or null when unavailable.
+  NativeZipStream? openStream(String outputPath) {
+    _ensureInit();
+    final openFn = _open;
+    final addFn = _addFile;
+    final closeFn = _close;
+    final abortFn = _abort;
+    if (openFn == null || addFn == null || closeFn == null || abortFn == null) {
+      return null;
+    }
+
+    final outputPathPtr = outputPath.toNativeUtf8();
+    final handle = openFn(outputPathPtr);
+    malloc.free(outputPathPtr);
+    if (handle == 0) return null;
+
+    return NativeZipStream._(handle, addFn, closeFn, abortFn);
+  }
+
+  /// Wrap an archive that native code opened (e.g. `vs_convert_file`) so
+  /// the remaining entries can be appended from Dart.
+  NativeZipStream? adoptStream(int handle) {
+    _ensureInit();
+    final addFn = _addFile;
+    final closeFn = _close;
+    final abortFn = _abort;
+    if (handle == 0 || addFn == null || closeFn == null || abortFn == null) {
+      return null;
+    }
+    return NativeZipStream._(handle, addFn, closeFn, abortFn);
+  }
+
   Future<bool> writeArchive(
     String outputPath,
     List<NativeZipEntry> entries, {
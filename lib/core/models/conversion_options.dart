@@ -17,11 +17,16 @@ class ConversionOptions {
   /// Use GPU packing when available (default true).
   bool useGpuPacking;
 
+  /// Allow the latency-first setting: hand back a fast plate as soon as it
+  /// is written and recompress it in the background (post-processor mode).
+  bool latencyFirst;
+
   ConversionOptions({
     this.targetProfile,
     this.maxZHeightOverride,
     this.outputDirectory,
     this.outputFileName,
     this.useGpuPacking = true,
+    this.latencyFirst = false,
   });
 }
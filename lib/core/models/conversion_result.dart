@@ -12,6 +12,18 @@ class ConversionResult {
   final int outputFileSizeBytes;
   final Duration duration;
 
+  /// Time until a printable plate existed, when latency-first mode wrote a
+  /// fast plate before the final one; null otherwise.
+  final Duration? timeToPrintable;
+
+  /// [outputPath] holds the fast plate; the final plate replaces it when
+  /// the background recompress pass finishes.
+  final bool finalPending;
+
+  /// Latency-first mode could not replace the fast plate (the background
+  /// pass failed or the plate stayed locked); [outputPath] still holds it.
+  final bool fastPlateKept;
+
   const ConversionResult({
     required this.success,
     this.errorMessage,
@@ -21,5 +33,8 @@ class ConversionResult {
     required this.layerCount,
     required this.outputFileSizeBytes,
     required this.duration,
+    this.timeToPrintable,
+    this.finalPending = false,
+    this.fastPlateKept = false,
   });
 }
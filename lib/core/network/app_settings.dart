@@ -12,7 +12,19 @@ class PostProcessingSettings {
   bool analyticsMode;
   bool disableNativeAcceleration;
   String recompressMode;
+  bool latencyFirst; // post-processor: upload a fast plate, recompress later
+  String streamingMode;
+  bool islandStats; // per-layer island fields in info.json
+  bool layerCache; // reuse finished layers across conversions
+  int? layerCacheMaxMb;
+  bool jobCache; // reuse whole plates for repeat conversions
+  int? jobCacheMaxMb;
   int? processPngLevel;
+  String deflateStrategy; // zlib strategy name, or 'auto' to pick by trial
+  String deflateEncoder; // zlib, zlib-ng, libdeflate, builtin or auto
+  bool splitDeflate; // deflate lone layers in parallel row bands
+  int? compressDeadlineSec; // per-layer levels planned to finish in time
+  int? compressTargetMb; // per-layer levels planned to fit this size
   int? gpuHostWorkers;
   int? cpuHostWorkers;
   int? cudaHostWorkers;
@@ -26,7 +38,19 @@ class PostProcessingSettings {
     this.analyticsMode = false,
     this.disableNativeAcceleration = false,
     this.recompressMode = 'adaptive',
+    this.latencyFirst = false,
+    this.streamingMode = 'auto',
+    this.islandStats = true,
+    this.layerCache = true,
+    this.layerCacheMaxMb,
+    this.jobCache = true,
+    this.jobCacheMaxMb,
     this.processPngLevel,
+    this.deflateStrategy = 'default',
+    this.deflateEncoder = 'zlib',
+    this.splitDeflate = true,
+    this.compressDeadlineSec,
+    this.compressTargetMb,
     this.gpuHostWorkers,
     this.cpuHostWorkers,
     this.cudaHostWorkers,
@@ -43,7 +67,19 @@ class PostProcessingSettings {
       disableNativeAcceleration:
           (json['disableNativeAcceleration'] as bool?) ?? false,
       recompressMode: (json['recompressMode'] as String?) ?? 'adaptive',
+      latencyFirst: (json['latencyFirst'] as bool?) ?? false,
+      streamingMode: (json['streamingMode'] as String?) ?? 'auto',
+      islandStats: (json['islandStats'] as bool?) ?? true,
+      layerCache: (json['layerCache'] as bool?) ?? true,
+      layerCacheMaxMb: json['layerCacheMaxMb'] as int?,
+      jobCache: (json['jobCache'] as bool?) ?? true,
+      jobCacheMaxMb: json['jobCacheMaxMb'] as int?,
       processPngLevel: json['processPngLevel'] as int?,
+      deflateStrategy: (json['deflateStrategy'] as String?) ?? 'default',
+      deflateEncoder: (json['deflateEncoder'] as String?) ?? 'zlib',
+      splitDeflate: (json['splitDeflate'] as bool?) ?? true,
+      compressDeadlineSec: json['compressDeadlineSec'] as int?,
+      compressTargetMb: json['compressTargetMb'] as int?,
       gpuHostWorkers: json['gpuHostWorkers'] as int?,
       cpuHostWorkers: json['cpuHostWorkers'] as int?,
       cudaHostWorkers: json['cudaHostWorkers'] as int?,
@@ -60,7 +96,19 @@ class PostProcessingSettings {
       'analyticsMode': analyticsMode,
       'disableNativeAcceleration': disableNativeAcceleration,
       'recompressMode': recompressMode,
+      'latencyFirst': latencyFirst,
+      'streamingMode': streamingMode,
+      'islandStats': islandStats,
+      'layerCache': layerCache,
+      'layerCacheMaxMb': layerCacheMaxMb,
+      'jobCache': jobCache,
+      'jobCacheMaxMb': jobCacheMaxMb,
       'processPngLevel': processPngLevel,
+      'deflateStrategy': deflateStrategy,
+      'deflateEncoder': deflateEncoder,
+      'splitDeflate': splitDeflate,
+      'compressDeadlineSec': compressDeadlineSec,
+      'compressTargetMb': compressTargetMb,
       'gpuHostWorkers': gpuHostWorkers,
       'cpuHostWorkers': cpuHostWorkers,
       'cudaHostWorkers': cudaHostWorkers,
@@ -109,6 +157,8 @@ class BenchmarkCacheEntry {
 /// Persists application settings/preferences.
 class AppSettings {
   static const _fileName = 'app_settings.json';
+  static const _layerCacheDirName = 'layer_cache';
+  static const _jobCacheDirName = 'job_cache';
 
   String? defaultMaterialProfileId;
   PostProcessingSettings postProcessing;
@@ -161,6 +211,20 @@ class AppSettings {
     return File('${dir.path}${Platform.pathSeparator}$_fileName');
   }
 
+  /// Directory holding the native per-layer output cache.
+  static Future<Directory> layerCacheDirectory() async {
+    final dir = await getApplicationSupportDirectory();
+    return Directory(
+      '${dir.path}${Platform.pathSeparator}$_layerCacheDirName',
+    );
+  }
+
+  /// Directory holding finished plates for the job result cache.
+  static Future<Directory> jobCacheDirectory() async {
+    final dir = await getApplicationSupportDirectory();
+    return Directory('${dir.path}${Platform.pathSeparator}$_jobCacheDirName');
+  }
+
   /// Load settings from disk.
   static Future<AppSettings> load() async {
     try {
@@ -1,5 +1,6 @@
 import 'dart:convert';
 import 'dart:io';
+import 'dart:math' as math;
 import 'dart:typed_data';
 import 'package:http/http.dart' as http;
 
@@ -170,6 +171,10 @@ class NanoDlpClient {
       return (success: false, message: 'File not found.', plateId: null);
     }
 
+    // The length sent as Content-Length and the bytes streamed come from
+    // one open handle, so a plate replaced on disk mid-upload (latency-first
+    // mode swaps in the final plate) cannot mix two files.
+    RandomAccessFile? source;
     try {
       final uri = Uri.parse('$baseUrl/plate/add');
       final host = uri.host.toLowerCase();
@@ -211,7 +216,8 @@ class NanoDlpClient {
           '\r\n',
         ));
         fileFooter = Uint8List.fromList(utf8.encode('\r\n'));
-        fileSize = await file.length();
+        source = await file.open();
+        fileSize = await source.length();
       }
 
       final closing = Uint8List.fromList(utf8.encode('--$boundary--\r\n'));
@@ -256,9 +262,15 @@ class NanoDlpClient {
           report(fileHeader.length);
           await Future.delayed(Duration.zero);
 
-          await for (final chunk in file.openRead()) {
+          var remaining = fileSize;
+          while (remaining > 0) {
+            final chunk = await source!.read(math.min(remaining, 64 * 1024));
+            if (chunk.isEmpty) {
+              throw const FileSystemException('Plate shrank during upload');
+            }
             request.add(chunk);
             report(chunk.length);
+            remaining -= chunk.length;
             await Future.delayed(Duration.zero);
           }
 
@@ -306,6 +318,8 @@ class NanoDlpClient {
       }
     } catch (e) {
       return (success: false, message: 'Upload failed: $e', plateId: null);
+    } finally {
+      await source?.close();
     }
   }
 
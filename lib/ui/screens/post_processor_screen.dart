@@ -59,6 +59,8 @@ class _PostProcessorScreenState extends State<PostProcessorScreen> {
   double? _pendingConversionRateLayersPerSec;
   String? _lastConversionPhase;
   Timer? _conversionUiTicker;
+  // Holds the final-plate swap until the fast plate has been uploaded.
+  Completer<void>? _uploadDone;
 
   DateTime? _uploadSampleAt;
   double _uploadSampleProgress = 0.0;
@@ -93,9 +95,16 @@ class _PostProcessorScreenState extends State<PostProcessorScreen> {
     _stopConversionUiTicker();
     _stopDeviceProcessingTicker();
     _converter.removeLogListener(_onLog);
+    _releaseFinalSwap();
     super.dispose();
   }
 
+  void _releaseFinalSwap() {
+    final done = _uploadDone;
+    _uploadDone = null;
+    if (done != null && !done.isCompleted) done.complete();
+  }
+
   void _startDeviceProcessingTicker() {
     _deviceProcessingTicker ??= Timer.periodic(const Duration(seconds: 1), (_) {
       if (!mounted) return;
@@ -1172,11 +1181,26 @@ class _PostProcessorScreenState extends State<PostProcessorScreen> {
       _lastConversionPhase = null;
     });
     _startConversionUiTicker();
+    _releaseFinalSwap();
+    final uploadDone = Completer<void>();
+    _uploadDone = uploadDone;
 
     try {
       final result = await _converter.convert(
         widget.ctbFilePath,
-        options: ConversionOptions(targetProfile: _selectedProfile),
+        // The upload can start from the fast plate; the recompressed one
+        // replaces it locally once the worker finishes.
+        options: ConversionOptions(
+          targetProfile: _selectedProfile,
+          latencyFirst: true,
+        ),
+        swapFinalAfter: uploadDone.future,
+        onFinal: (finalResult) {
+          if (!mounted || !finalResult.success) return;
+          setState(() {
+            _result = finalResult;
+          });
+        },
         onProgress: (p) {
           if (!mounted) return;
           _pendingConversionProgress = p;
@@ -1224,7 +1248,10 @@ class _PostProcessorScreenState extends State<PostProcessorScreen> {
         },
       );
 
-      if (!mounted) return;
+      if (!mounted) {
+        _releaseFinalSwap();
+        return;
+      }
       _stopConversionUiTicker();
 
       // Store result and go straight to upload (skip intermediate screen)
@@ -1237,12 +1264,14 @@ class _PostProcessorScreenState extends State<PostProcessorScreen> {
           _startUpload();
         }
       } else if (mounted) {
+        _releaseFinalSwap();
         // Failed: show converted phase with error
         setState(() {
           _phase = _Phase.converted;
         });
       }
     } catch (e) {
+      _releaseFinalSwap();
       _stopConversionUiTicker();
       setState(() {
         _errorMessage = 'Conversion failed: $e';
@@ -1252,6 +1281,14 @@ class _PostProcessorScreenState extends State<PostProcessorScreen> {
   }
 
   Future<void> _startUpload() async {
+    try {
+      await _uploadPlate();
+    } finally {
+      _releaseFinalSwap();
+    }
+  }
+
+  Future<void> _uploadPlate() async {
     if (_result == null || widget.activeDevice == null) return;
 
     final device = widget.activeDevice!;
@@ -1426,6 +1463,8 @@ class _PostProcessorScreenState extends State<PostProcessorScreen> {
           }
         },
       );
+      // The device has its copy; the final plate may replace ours now.
+      _releaseFinalSwap();
 
       int? plateId = uploadResult.plateId;
       if (plateId == null && plate != null) {
@@ -20,6 +20,10 @@ class _SettingsScreenState extends State<SettingsScreen> {
   final _cpuHostCtrl = TextEditingController();
   final _cudaHostCtrl = TextEditingController();
   final _workerMultiplierCtrl = TextEditingController();
+  final _layerCacheMbCtrl = TextEditingController();
+  final _jobCacheMbCtrl = TextEditingController();
+  final _compressDeadlineCtrl = TextEditingController();
+  final _compressTargetCtrl = TextEditingController();
 
   @override
   void initState() {
@@ -33,6 +37,10 @@ class _SettingsScreenState extends State<SettingsScreen> {
     _cpuHostCtrl.dispose();
     _cudaHostCtrl.dispose();
     _workerMultiplierCtrl.dispose();
+    _layerCacheMbCtrl.dispose();
+    _jobCacheMbCtrl.dispose();
+    _compressDeadlineCtrl.dispose();
+    _compressTargetCtrl.dispose();
     super.dispose();
   }
 
@@ -51,6 +59,10 @@ class _SettingsScreenState extends State<SettingsScreen> {
     _cpuHostCtrl.text = pp.cpuHostWorkers?.toString() ?? '';
     _cudaHostCtrl.text = pp.cudaHostWorkers?.toString() ?? '';
     _workerMultiplierCtrl.text = pp.workerMultiplierCap?.toString() ?? '';
+    _layerCacheMbCtrl.text = pp.layerCacheMaxMb?.toString() ?? '';
+    _jobCacheMbCtrl.text = pp.jobCacheMaxMb?.toString() ?? '';
+    _compressDeadlineCtrl.text = pp.compressDeadlineSec?.toString() ?? '';
+    _compressTargetCtrl.text = pp.compressTargetMb?.toString() ?? '';
   }
 
   int? _parseIntOrNull(String value) {
@@ -109,7 +121,19 @@ class _SettingsScreenState extends State<SettingsScreen> {
         analyticsMode: current.analyticsMode,
         disableNativeAcceleration: current.disableNativeAcceleration,
         recompressMode: current.recompressMode,
+        latencyFirst: current.latencyFirst,
+        streamingMode: current.streamingMode,
+        islandStats: current.islandStats,
+        layerCache: current.layerCache,
+        layerCacheMaxMb: current.layerCacheMaxMb,
+        jobCache: current.jobCache,
+        jobCacheMaxMb: current.jobCacheMaxMb,
         processPngLevel: current.processPngLevel,
+        deflateStrategy: current.deflateStrategy,
+        deflateEncoder: current.deflateEncoder,
+        splitDeflate: current.splitDeflate,
+        compressDeadlineSec: current.compressDeadlineSec,
+        compressTargetMb: current.compressTargetMb,
         gpuHostWorkers: current.gpuHostWorkers,
         cpuHostWorkers: current.cpuHostWorkers,
         cudaHostWorkers: current.cudaHostWorkers,
@@ -136,6 +160,18 @@ class _SettingsScreenState extends State<SettingsScreen> {
     _settings!.defaultMaterialProfileId = null;
     _settings!.benchmarkCache.clear();
     await _settings!.save();
+    try {
+      for (final cache in [
+        await AppSettings.layerCacheDirectory(),
+        await AppSettings.jobCacheDirectory(),
+      ]) {
+        if (await cache.exists()) {
+          await cache.delete(recursive: true);
+        }
+      }
+    } catch (_) {
+      // best-effort
+    }
     setState(() {});
 
     if (mounted) {
@@ -238,6 +274,55 @@ class _SettingsScreenState extends State<SettingsScreen> {
               onChanged: (v) =>
                   _updatePostProcessing((p) => p..processPngLevel = v),
             ),
+            _dropdown<String>(
+              label: 'Deflate strategy',
+              value: pp.deflateStrategy,
+              items: const [
+                'default',
+                'filtered',
+                'rle',
+                'huffman',
+                'fixed',
+                'auto',
+              ],
+              onChanged: (v) =>
+                  _updatePostProcessing((p) => p..deflateStrategy = v),
+            ),
+            _dropdown<String>(
+              label: 'PNG encoder',
+              value: pp.deflateEncoder,
+              items: const ['zlib', 'zlib-ng', 'libdeflate', 'builtin', 'auto'],
+              onChanged: (v) =>
+                  _updatePostProcessing((p) => p..deflateEncoder = v),
+            ),
+            _switchTile(
+              title: 'Split deflate',
+              subtitle: 'Compress single layers in parallel bands.',
+              value: pp.splitDeflate,
+              onChanged: (v) =>
+                  _updatePostProcessing((p) => p..splitDeflate = v),
+            ),
+            _intField(
+              label: 'Compression deadline (s)',
+              controller: _compressDeadlineCtrl,
+              hint: 'Off: one level for every layer. Set: smallest plate '
+                  'that converts in time',
+              onChanged: () => _updatePostProcessing(
+                (p) => p
+                  ..compressDeadlineSec =
+                      _parseIntOrNull(_compressDeadlineCtrl.text),
+              ),
+            ),
+            _intField(
+              label: 'Compression target size (MB)',
+              controller: _compressTargetCtrl,
+              hint: 'Off: one level for every layer. Set: fastest plate '
+                  'that fits',
+              onChanged: () => _updatePostProcessing(
+                (p) => p
+                  ..compressTargetMb = _parseIntOrNull(_compressTargetCtrl.text),
+              ),
+            ),
             _dropdown<String>(
               label: 'Recompress mode',
               value: pp.recompressMode,
@@ -245,6 +330,67 @@ class _SettingsScreenState extends State<SettingsScreen> {
               onChanged: (v) =>
                   _updatePostProcessing((p) => p..recompressMode = v),
             ),
+            _switchTile(
+              title: 'Print-start latency mode',
+              subtitle:
+                  'Post-processor: upload a fast plate first, recompress it '
+                  'in the background.',
+              value: pp.latencyFirst,
+              onChanged: (v) =>
+                  _updatePostProcessing((p) => p..latencyFirst = v),
+            ),
+            _dropdown<String>(
+              label: 'Streaming write',
+              value: pp.streamingMode,
+              items: const ['auto', 'on', 'off'],
+              onChanged: (v) =>
+                  _updatePostProcessing((p) => p..streamingMode = v),
+            ),
+            _switchTile(
+              title: 'Per-layer island stats',
+              subtitle:
+                  'Write island counts and sizes to info.json. Off skips '
+                  'island detection; plate area and bounds are unaffected.',
+              value: pp.islandStats,
+              onChanged: (v) =>
+                  _updatePostProcessing((p) => p..islandStats = v),
+            ),
+            _switchTile(
+              title: 'Layer cache',
+              subtitle:
+                  'Keep finished layers on disk so re-exports of a plate '
+                  'only convert the layers that changed.',
+              value: pp.layerCache,
+              onChanged: (v) =>
+                  _updatePostProcessing((p) => p..layerCache = v),
+            ),
+            if (pp.layerCache)
+              _intField(
+                label: 'Layer cache size (MB)',
+                controller: _layerCacheMbCtrl,
+                hint: 'Default: 2048 MB',
+                onChanged: () => _updatePostProcessing(
+                  (p) => p
+                    ..layerCacheMaxMb = _parseIntOrNull(_layerCacheMbCtrl.text),
+                ),
+              ),
+            _switchTile(
+              title: 'Job cache',
+              subtitle:
+                  'Keep finished plates so converting the same file with the '
+                  'same settings again reuses the previous result.',
+              value: pp.jobCache,
+              onChanged: (v) => _updatePostProcessing((p) => p..jobCache = v),
+            ),
+            if (pp.jobCache)
+              _intField(
+                label: 'Job cache size (MB)',
+                controller: _jobCacheMbCtrl,
+                hint: 'Default: 4096 MB',
+                onChanged: () => _updatePostProcessing(
+                  (p) => p..jobCacheMaxMb = _parseIntOrNull(_jobCacheMbCtrl.text),
+                ),
+              ),
           ],
         ),
         _section(
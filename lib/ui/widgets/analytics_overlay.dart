@@ -98,6 +98,14 @@ class _AnalyticsOverlayState extends State<AnalyticsOverlay> {
                     crossAxisAlignment: CrossAxisAlignment.start,
                     children: [
                       _kv('Engine', widget.analytics.processingEngine),
+                      if ((widget.analytics.compressor ?? '').isNotEmpty)
+                        _kv('Compressor', widget.analytics.compressor!),
+                      if (widget.analytics.timeToPrintable != null)
+                        _kv(
+                          'Printable / final',
+                          '${_fmtDuration(widget.analytics.timeToPrintable!)} / '
+                          '${_fmtDuration(widget.analytics.timeToFinal ?? Duration.zero)}',
+                        ),
                       _kv(
                         'Workers',
                         '${widget.analytics.workers} '
@@ -113,6 +121,20 @@ class _AnalyticsOverlayState extends State<AnalyticsOverlay> {
                           '(${(widget.analytics.gpuSuccesses * 100 / widget.analytics.gpuAttempts).toStringAsFixed(1)}%) '
                           'fallbacks ${widget.analytics.gpuFallbacks}',
                         ),
+                      if (widget.analytics.dedup != null)
+                        _kv(
+                          'Reused layers',
+                          '${widget.analytics.dedup!.hits}/'
+                          '${widget.analytics.dedup!.layers} '
+                          '(${(widget.analytics.dedup!.hitRate * 100).toStringAsFixed(1)}%)',
+                        ),
+                      if (widget.analytics.layerCache != null)
+                        _kv(
+                          'Layer cache',
+                          '${widget.analytics.layerCache!.hits}/'
+                          '${widget.analytics.layerCache!.layers} '
+                          '(${(widget.analytics.layerCache!.hitRate * 100).toStringAsFixed(1)}%)',
+                        ),
                       const SizedBox(height: 8),
                       _sectionTitle('Stages'),
                       LayoutBuilder(
@@ -2,166 +2,277 @@
  * @file area_stats.c
  * @brief Native connected-component area statistics for greyscale layers.
  *
- * Implements an 8-connected flood fill to compute total solid area,
- * smallest/largest island, and bounding box of all solids in a layer.
- * This mirrors the Dart logic but avoids per-layer overhead in Dart.
+ * Labels 8-connected islands to compute total solid area, smallest/largest
+ * island, and bounding box of all solids in a layer. This mirrors the Dart
+ * logic but avoids per-layer overhead in Dart.
+ *
+ * Islands are found in one pass over horizontal runs of solid pixels: each
+ * run is joined (union-find) to the runs it touches in the row above, so
+ * memory scales with the number of runs rather than the frame size. Large
+ * layers can be split into row bands labelled in parallel and stitched
+ * along the band seams.
+ *
+ * Callers that only need the total area (and optionally the bounding box)
+ * can skip labelling: compute_layer_area_stats_mode counts solid pixels
+ * with SSE2/AVX2/NEON kernels (see cpu_features.h) in a single pass.
  */
 #include "voxelshift_native.h"
+#include "cpu_features.h"
+#include "worker_pool.h"
 
 #include <stdlib.h>
+#include <string.h>
 
-/**
- * @brief Bitset helper: test if a pixel index was already visited.
- * @param visited Bitset array of visited flags.
- * @param idx Linear pixel index.
- * @return Non-zero if visited, zero otherwise.
- */
-static int is_visited(const uint32_t* visited, int idx) {
-  return (visited[idx >> 5] & (1u << (idx & 31))) != 0;
+#if defined(VS_ARCH_X64)
+  #include <emmintrin.h>
+  #include <immintrin.h>
+#elif defined(VS_ARCH_ARM64)
+  #include <arm_neon.h>
+#endif
+
+/// Runs of solid pixels seen so far; parent/size are indexed by run id.
+typedef struct RunForest {
+  int32_t* parent;
+  int32_t* size;       // pixel count, valid on roots
+  int32_t count;
+  int32_t cap;
+} RunForest;
+
+/// One row's runs as [start, end) columns plus their run ids.
+typedef struct RowRuns {
+  int32_t* start;
+  int32_t* end;
+  int32_t* id;
+  int32_t count;
+} RowRuns;
+
+static int32_t _find_root(RunForest* f, int32_t r) {
+  while (f->parent[r] != r) {
+    f->parent[r] = f->parent[f->parent[r]]; // path halving
+    r = f->parent[r];
+  }
+  return r;
 }
 
 /**
- * @brief Bitset helper: mark a pixel index as visited.
- * @param visited Bitset array of visited flags.
- * @param idx Linear pixel index.
+ * @brief Merge the islands of runs a and b.
+ *
+ * The lower run id always becomes the root, so each island's root is its
+ * first run in raster order, i.e. the run holding the pixel a raster-order
+ * flood fill would have started from.
  */
-static void mark_visited(uint32_t* visited, int idx) {
-  visited[idx >> 5] |= (1u << (idx & 31));
+static void _union_runs(RunForest* f, int32_t a, int32_t b) {
+  a = _find_root(f, a);
+  b = _find_root(f, b);
+  if (a == b) return;
+  if (b < a) {
+    const int32_t t = a;
+    a = b;
+    b = t;
+  }
+  f->parent[b] = a;
+  f->size[a] += f->size[b];
+}
+
+static int _add_run(RunForest* f, int32_t length, int32_t* out_id) {
+  if (f->count >= f->cap) {
+    const int32_t new_cap = f->cap == 0 ? 4096 : f->cap * 2;
+    int32_t* parent =
+        (int32_t*)realloc(f->parent, (size_t)new_cap * sizeof(int32_t));
+    if (!parent) return 0;
+    f->parent = parent;
+    int32_t* size = (int32_t*)realloc(f->size, (size_t)new_cap * sizeof(int32_t));
+    if (!size) return 0;
+    f->size = size;
+    f->cap = new_cap;
+  }
+  const int32_t id = f->count++;
+  f->parent[id] = id;
+  f->size[id] = length;
+  *out_id = id;
+  return 1;
 }
 
 /**
- * @brief Compute 8-connected island statistics for a greyscale layer.
- *
- * The algorithm scans for unvisited solid pixels, performs a stack-based
- * flood-fill, counts pixels per island, and accumulates totals and bounds.
+ * @brief Next column at or after x whose "is solid" state equals [solid].
  *
- * @return 1 on success, 0 on failure.
+ * Skips eight bytes at a time while the whole word is empty (or, when
+ * looking for the end of a run, while it has no zero byte).
  */
-int compute_layer_area_stats(
-    const uint8_t* pixels,
-    int32_t width,
-    int32_t height,
-    double x_pixel_size_mm,
-    double y_pixel_size_mm,
-    AreaStatsResult* out_result) {
-  if (!pixels || !out_result || width <= 0 || height <= 0) {
-    return 0;
+static int32_t _scan_row(const uint8_t* row, int32_t x, int32_t width, int solid) {
+  const uint64_t ones = 0x0101010101010101ull;
+  const uint64_t highs = 0x8080808080808080ull;
+  while (x + 8 <= width) {
+    uint64_t v;
+    memcpy(&v, row + x, 8);
+    const int has_zero = ((v - ones) & ~v & highs) != 0;
+    if (solid ? v != 0 : has_zero) break;
+    x += 8;
   }
+  while (x < width && (row[x] != 0) != solid) x++;
+  return x;
+}
 
-  const int32_t pixel_count = width * height;
-  const int32_t visited_words = (pixel_count + 31) >> 5;
+static void _free_row_runs(RowRuns* r) {
+  free(r->start);
+  free(r->end);
+  free(r->id);
+}
 
-  uint32_t* visited = (uint32_t*)calloc((size_t)visited_words, sizeof(uint32_t));
-  if (!visited) {
-    return 0;
-  }
+static int _alloc_row_runs(RowRuns* r, int32_t max_runs) {
+  if (max_runs < 1) max_runs = 1;
+  r->start = (int32_t*)malloc((size_t)max_runs * sizeof(int32_t));
+  r->end = (int32_t*)malloc((size_t)max_runs * sizeof(int32_t));
+  r->id = (int32_t*)malloc((size_t)max_runs * sizeof(int32_t));
+  r->count = 0;
+  return r->start && r->end && r->id;
+}
 
-  int32_t* stack = NULL;
-  int32_t stack_cap = 0;
-  int32_t stack_len = 0;
+/**
+ * @brief Join every run in [cur] to the runs of [prev] (the row above) that
+ * it overlaps or touches diagonally. Run ids are offset by the given bases.
+ */
+static void _join_rows(
+    RunForest* f,
+    const RowRuns* prev,
+    int32_t prev_base,
+    const RowRuns* cur,
+    int32_t cur_base) {
+  int32_t p = 0;
+  for (int32_t c = 0; c < cur->count; c++) {
+    const int32_t first = cur->start[c];
+    const int32_t last = cur->end[c];
+    // Runs ending left of first - 1 can't touch this run or any later one.
+    while (p < prev->count && prev->end[p] < first - 1) p++;
+    for (int32_t q = p; q < prev->count && prev->start[q] <= last + 1; q++) {
+      _union_runs(f, cur_base + cur->id[c], prev_base + prev->id[q]);
+    }
+  }
+}
 
-  int min_x = width;
-  int min_y = height;
-  int max_x = 0;
-  int max_y = 0;
+/// Labels for rows [y0, y1): local run forest, edge rows and solid bounds.
+typedef struct BandLabels {
+  RunForest forest;
+  RowRuns first;     // runs of row y0
+  RowRuns last;      // runs of row y1 - 1
+  int32_t min_x;
+  int32_t min_y;
+  int32_t max_x;
+  int32_t max_y;
+  int ok;
+} BandLabels;
 
-  double total_area = 0.0;
-  double largest_area = 0.0;
-  double smallest_area = 0.0;
-  int area_count = 0;
+static void _free_band(BandLabels* b) {
+  free(b->forest.parent);
+  free(b->forest.size);
+  _free_row_runs(&b->first);
+  _free_row_runs(&b->last);
+}
 
-  const double pixel_area = x_pixel_size_mm * y_pixel_size_mm;
+/**
+ * @brief Label rows [y0, y1) of a layer into [b].
+ *
+ * Run ids are local to the band and follow raster order. When [keep_edges]
+ * is set the first and last rows' runs are kept for stitching.
+ */
+static int _label_band(
+    const uint8_t* pixels,
+    int32_t width,
+    int32_t y0,
+    int32_t y1,
+    int keep_edges,
+    BandLabels* b) {
+  memset(b, 0, sizeof(*b));
+  b->min_x = width;
+  b->min_y = y1;
 
-  const int dx_offsets[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
-  const int dy_offsets[8] = {-1, -1, -1, 0, 0, 1, 1, 1};
+  const int32_t max_row_runs = width / 2 + 1;
+  RowRuns rows[2];
+  memset(rows, 0, sizeof(rows));
+  int ok = _alloc_row_runs(&rows[0], max_row_runs) &&
+      _alloc_row_runs(&rows[1], max_row_runs);
 
-  for (int y = 0; y < height; y++) {
-    const int row_offset = y * width;
-    for (int x = 0; x < width; x++) {
-      const int root_idx = row_offset + x;
-      if (pixels[root_idx] == 0 || is_visited(visited, root_idx)) {
-        continue;
-      }
+  for (int32_t y = y0; y < y1 && ok; y++) {
+    const uint8_t* row = pixels + (size_t)y * width;
+    RowRuns* prev = &rows[(y + 1) & 1];
+    RowRuns* cur = &rows[y & 1];
+    cur->count = 0;
 
-      int island_pixels = 0;
-
-      if (stack_len >= stack_cap) {
-        const int32_t new_cap = stack_cap == 0 ? 4096 : stack_cap * 2;
-        int32_t* new_stack =
-            (int32_t*)realloc(stack, (size_t)new_cap * sizeof(int32_t));
-        if (!new_stack) {
-          free(stack);
-          free(visited);
-          return 0;
-        }
-        stack = new_stack;
-        stack_cap = new_cap;
+    int32_t x = _scan_row(row, 0, width, 1);
+    while (x < width) {
+      const int32_t run_end = _scan_row(row, x, width, 0);
+      int32_t id = 0;
+      if (!_add_run(&b->forest, run_end - x, &id)) {
+        ok = 0;
+        break;
       }
+      cur->start[cur->count] = x;
+      cur->end[cur->count] = run_end - 1;
+      cur->id[cur->count] = id;
+      cur->count++;
+      x = _scan_row(row, run_end, width, 1);
+    }
+    if (!ok) break;
 
-      stack[stack_len++] = (y << 16) | (x & 0xFFFF);
-      mark_visited(visited, root_idx);
-      island_pixels++;
-
-      if (x < min_x) min_x = x;
-      if (x > max_x) max_x = x;
-      if (y < min_y) min_y = y;
-      if (y > max_y) max_y = y;
-
-      while (stack_len > 0) {
-        const int packed = stack[--stack_len];
-        const int cy = (packed >> 16) & 0xFFFF;
-        const int cx = packed & 0xFFFF;
-
-        for (int i = 0; i < 8; i++) {
-          const int nx = cx + dx_offsets[i];
-          const int ny = cy + dy_offsets[i];
-
-          if (nx < 0 || nx >= width || ny < 0 || ny >= height) {
-            continue;
-          }
-
-          const int n_idx = ny * width + nx;
-          if (pixels[n_idx] == 0 || is_visited(visited, n_idx)) {
-            continue;
-          }
-
-          mark_visited(visited, n_idx);
-
-          if (stack_len >= stack_cap) {
-            const int32_t new_cap = stack_cap == 0 ? 4096 : stack_cap * 2;
-            int32_t* new_stack =
-                (int32_t*)realloc(stack, (size_t)new_cap * sizeof(int32_t));
-            if (!new_stack) {
-              free(stack);
-              free(visited);
-              return 0;
-            }
-            stack = new_stack;
-            stack_cap = new_cap;
-          }
-
-          stack[stack_len++] = (ny << 16) | (nx & 0xFFFF);
-          island_pixels++;
-
-          if (nx < min_x) min_x = nx;
-          if (nx > max_x) max_x = nx;
-          if (ny < min_y) min_y = ny;
-          if (ny > max_y) max_y = ny;
-        }
-      }
+    if (y > y0) _join_rows(&b->forest, prev, 0, cur, 0);
+    if (cur->count > 0) {
+      if (cur->start[0] < b->min_x) b->min_x = cur->start[0];
+      if (cur->end[cur->count - 1] > b->max_x) b->max_x = cur->end[cur->count - 1];
+      if (y < b->min_y) b->min_y = y;
+      b->max_y = y;
+    }
 
-      const double island_area = island_pixels * pixel_area;
-      total_area += island_area;
-      if (island_area > largest_area) largest_area = island_area;
-      if (area_count == 0 || island_area < smallest_area) {
-        smallest_area = island_area;
-      }
-      area_count++;
+    if (keep_edges && y == y0) {
+      const int32_t n = cur->count;
+      ok = _alloc_row_runs(&b->first, n);
+      if (!ok) break;
+      memcpy(b->first.start, cur->start, (size_t)n * sizeof(int32_t));
+      memcpy(b->first.end, cur->end, (size_t)n * sizeof(int32_t));
+      memcpy(b->first.id, cur->id, (size_t)n * sizeof(int32_t));
+      b->first.count = n;
     }
   }
 
-  free(stack);
-  free(visited);
+  if (ok && keep_edges) {
+    // The last row's runs are already in their ring slot; take it over.
+    b->last = rows[(y1 - 1) & 1];
+    memset(&rows[(y1 - 1) & 1], 0, sizeof(RowRuns));
+  }
+  _free_row_runs(&rows[0]);
+  _free_row_runs(&rows[1]);
+  b->ok = ok;
+  return ok;
+}
+
+/**
+ * @brief Total the islands of a labelled layer into [out_result].
+ *
+ * Roots in increasing run id are islands in the order a raster-order flood
+ * fill would have found them, which keeps the floating-point sums identical.
+ */
+static void _finish_area_stats(
+    const RunForest* f,
+    int32_t min_x,
+    int32_t min_y,
+    int32_t max_x,
+    int32_t max_y,
+    double pixel_area,
+    AreaStatsResult* out_result) {
+  int64_t total_pixels = 0;
+  double largest_area = 0.0;
+  double smallest_area = 0.0;
+  int area_count = 0;
+
+  for (int32_t r = 0; r < f->count; r++) {
+    if (f->parent[r] != r) continue;
+    const double island_area = f->size[r] * pixel_area;
+    total_pixels += f->size[r];
+    if (island_area > largest_area) largest_area = island_area;
+    if (area_count == 0 || island_area < smallest_area) {
+      smallest_area = island_area;
+    }
+    area_count++;
+  }
 
   if (area_count == 0) {
     out_result->total_solid_area = 0.0;
@@ -172,10 +283,12 @@ int compute_layer_area_stats(
     out_result->max_x = 0;
     out_result->max_y = 0;
     out_result->area_count = 0;
-    return 1;
+    return;
   }
 
-  out_result->total_solid_area = total_area;
+  // From the pixel count, as the bbox and total modes do, so the plate
+  // totals do not depend on the area mode.
+  out_result->total_solid_area = (double)total_pixels * pixel_area;
   out_result->largest_area = largest_area;
   out_result->smallest_area = smallest_area;
   out_result->min_x = min_x;
@@ -183,5 +296,347 @@ int compute_layer_area_stats(
   out_result->max_x = max_x;
   out_result->max_y = max_y;
   out_result->area_count = area_count;
+}
+
+typedef struct AreaBandWork {
+  const uint8_t* pixels;
+  int32_t width;
+  int32_t height;
+  int32_t band_rows;
+  BandLabels* bands;
+  VsWorkQueue queue;
+} AreaBandWork;
+
+static void _area_band_task(void* ctx, int32_t worker_index, void** scratch) {
+  AreaBandWork* w = (AreaBandWork*)ctx;
+  (void)scratch;
+  int32_t start, end;
+  while (vs_queue_take(&w->queue, worker_index, &start, &end)) {
+    for (int32_t i = start; i < end; i++) {
+      const int32_t y0 = i * w->band_rows;
+      int32_t y1 = y0 + w->band_rows;
+      if (y1 > w->height) y1 = w->height;
+      if (!_label_band(w->pixels, w->width, y0, y1, 1, &w->bands[i])) {
+        vs_queue_cancel(&w->queue);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Compute 8-connected island statistics for a greyscale layer.
+ *
+ * Each row is split into runs of non-zero pixels. A run is joined to every
+ * run in the previous row that overlaps it or touches it diagonally
+ * (prev.start <= cur.end + 1 && cur.start <= prev.end + 1). Island areas
+ * are then summed in order of their first pixel, which keeps the
+ * floating-point totals identical to a raster-order flood fill.
+ *
+ * @return 1 on success, 0 on failure.
+ */
+int compute_layer_area_stats(
+    const uint8_t* pixels,
+    int32_t width,
+    int32_t height,
+    double x_pixel_size_mm,
+    double y_pixel_size_mm,
+    AreaStatsResult* out_result) {
+  if (!pixels || !out_result || width <= 0 || height <= 0) {
+    return 0;
+  }
+
+  BandLabels band;
+  if (!_label_band(pixels, width, 0, height, 0, &band)) {
+    _free_band(&band);
+    return 0;
+  }
+  _finish_area_stats(
+      &band.forest, band.min_x, band.min_y, band.max_x, band.max_y,
+      x_pixel_size_mm * y_pixel_size_mm, out_result);
+  _free_band(&band);
   return 1;
 }
+
+// Bands thinner than this are not worth a thread.
+#define VS_AREA_MIN_BAND_ROWS 256
+
+/**
+ * @brief compute_layer_area_stats using up to [thread_count] threads.
+ *
+ * The layer is cut into row bands labelled in parallel on the worker pool.
+ * Called from inside a batch task, the bands go to the calling worker and
+ * whichever pool workers are idle; no threads are created per layer.
+ * Band forests are then concatenated in band order, which keeps run ids in
+ * raster order, and each seam is stitched by joining the last row of one
+ * band to the first row of the next. Results are identical to the
+ * single-threaded call.
+ *
+ * @return 1 on success, 0 on failure.
+ */
+int compute_layer_area_stats_mt(
+    const uint8_t* pixels,
+    int32_t width,
+    int32_t height,
+    double x_pixel_size_mm,
+    double y_pixel_size_mm,
+    int32_t thread_count,
+    AreaStatsResult* out_result) {
+  if (!pixels || !out_result || width <= 0 || height <= 0) {
+    return 0;
+  }
+
+  int32_t band_count = thread_count;
+  if (band_count > height / VS_AREA_MIN_BAND_ROWS) {
+    band_count = height / VS_AREA_MIN_BAND_ROWS;
+  }
+  if (band_count < 2) {
+    return compute_layer_area_stats(
+        pixels, width, height, x_pixel_size_mm, y_pixel_size_mm, out_result);
+  }
+
+  AreaBandWork work;
+  memset(&work, 0, sizeof(work));
+  work.pixels = pixels;
+  work.width = width;
+  work.height = height;
+  work.band_rows = (height + band_count - 1) / band_count;
+  band_count = (height + work.band_rows - 1) / work.band_rows;
+  work.bands = (BandLabels*)calloc((size_t)band_count, sizeof(BandLabels));
+  if (!work.bands) return 0;
+  if (!vs_queue_init(&work.queue, band_count, band_count, 1, 0)) {
+    free(work.bands);
+    return 0;
+  }
+
+  const int32_t ran = vs_pool_run(
+      band_count, VS_POOL_NO_SCRATCH, NULL, _area_band_task, &work);
+  int ok = ran > 0 && !vs_queue_cancelled(&work.queue);
+  vs_queue_destroy(&work.queue);
+
+  // Concatenate the band forests; local ids shift by the band's base.
+  RunForest forest;
+  memset(&forest, 0, sizeof(forest));
+  int32_t* bases = (int32_t*)malloc((size_t)band_count * sizeof(int32_t));
+  int64_t total = 0;
+  for (int32_t b = 0; b < band_count && ok; b++) {
+    total += work.bands[b].forest.count;
+  }
+  if (ok && bases && total <= INT32_MAX) {
+    const size_t n = total > 0 ? (size_t)total : 1;
+    forest.parent = (int32_t*)malloc(n * sizeof(int32_t));
+    forest.size = (int32_t*)malloc(n * sizeof(int32_t));
+    ok = forest.parent && forest.size;
+  } else {
+    ok = 0;
+  }
+
+  int32_t min_x = width;
+  int32_t min_y = height;
+  int32_t max_x = 0;
+  int32_t max_y = 0;
+  for (int32_t b = 0; b < band_count && ok; b++) {
+    const BandLabels* band = &work.bands[b];
+    const int32_t base = forest.count;
+    bases[b] = base;
+    for (int32_t i = 0; i < band->forest.count; i++) {
+      forest.parent[base + i] = band->forest.parent[i] + base;
+      forest.size[base + i] = band->forest.size[i];
+    }
+    forest.count += band->forest.count;
+    if (band->forest.count > 0) {
+      if (band->min_x < min_x) min_x = band->min_x;
+      if (band->min_y < min_y) min_y = band->min_y;
+      if (band->max_x > max_x) max_x = band->max_x;
+      if (band->max_y > max_y) max_y = band->max_y;
+    }
+    if (b > 0) {
+      _join_rows(&forest, &work.bands[b - 1].last, bases[b - 1],
+                 &band->first, base);
+    }
+  }
+
+  if (ok) {
+    _finish_area_stats(
+        &forest, min_x, min_y, max_x, max_y,
+        x_pixel_size_mm * y_pixel_size_mm, out_result);
+  }
+
+  for (int32_t b = 0; b < band_count; b++) _free_band(&work.bands[b]);
+  free(work.bands);
+  free(bases);
+  free(forest.parent);
+  free(forest.size);
+  return ok;
+}
+
+/// Number of zero bytes in row[0..count).
+typedef int32_t (*count_zero_fn)(const uint8_t* row, int32_t count);
+
+static int32_t _count_zero_scalar(const uint8_t* row, int32_t count) {
+  int32_t zeros = 0;
+  for (int32_t i = 0; i < count; i++) zeros += row[i] == 0;
+  return zeros;
+}
+
+// The vector kernels subtract the 0xFF compare mask from per-byte counters
+// and fold them with a horizontal sum before any byte lane can reach 256.
+#if defined(VS_ARCH_X64)
+static int32_t _count_zero_sse2(const uint8_t* row, int32_t count) {
+  const __m128i zero = _mm_setzero_si128();
+  int64_t zeros = 0;
+  int32_t i = 0;
+  while (i + 16 <= count) {
+    __m128i acc = zero;
+    for (int32_t k = 0; k < 255 && i + 16 <= count; k++, i += 16) {
+      const __m128i v = _mm_loadu_si128((const __m128i*)(row + i));
+      acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(v, zero));
+    }
+    const __m128i sum = _mm_sad_epu8(acc, zero);
+    zeros += _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+  }
+  return (int32_t)zeros + _count_zero_scalar(row + i, count - i);
+}
+
+static VS_TARGET_AVX2 int32_t _count_zero_avx2(const uint8_t* row, int32_t count) {
+  const __m256i zero = _mm256_setzero_si256();
+  int64_t zeros = 0;
+  int32_t i = 0;
+  while (i + 32 <= count) {
+    __m256i acc = zero;
+    for (int32_t k = 0; k < 255 && i + 32 <= count; k++, i += 32) {
+      const __m256i v = _mm256_loadu_si256((const __m256i*)(row + i));
+      acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(v, zero));
+    }
+    const __m256i sum = _mm256_sad_epu8(acc, zero);
+    zeros += _mm256_extract_epi64(sum, 0) + _mm256_extract_epi64(sum, 1) +
+        _mm256_extract_epi64(sum, 2) + _mm256_extract_epi64(sum, 3);
+  }
+  return (int32_t)zeros + _count_zero_sse2(row + i, count - i);
+}
+#elif defined(VS_ARCH_ARM64)
+static int32_t _count_zero_neon(const uint8_t* row, int32_t count) {
+  int64_t zeros = 0;
+  int32_t i = 0;
+  while (i + 16 <= count) {
+    uint8x16_t acc = vdupq_n_u8(0);
+    for (int32_t k = 0; k < 255 && i + 16 <= count; k++, i += 16) {
+      acc = vsubq_u8(acc, vceqzq_u8(vld1q_u8(row + i)));
+    }
+    zeros += vaddlvq_u8(acc);
+  }
+  return (int32_t)zeros + _count_zero_scalar(row + i, count - i);
+}
+#endif
+
+static count_zero_fn _count_zero_kernel(void) {
+  const int32_t level = vs_simd_level();
+#if defined(VS_ARCH_X64)
+  if (level >= VS_SIMD_AVX2) return _count_zero_avx2;
+  if (level >= VS_SIMD_SSE2) return _count_zero_sse2;
+#elif defined(VS_ARCH_ARM64)
+  if (level >= VS_SIMD_NEON) return _count_zero_neon;
+#else
+  (void)level;
+#endif
+  return _count_zero_scalar;
+}
+
+/// Last solid column of a row that has at least one solid pixel.
+static int32_t _last_solid(const uint8_t* row, int32_t width) {
+  int32_t x = width;
+  while (x >= 8) {
+    uint64_t v;
+    memcpy(&v, row + x - 8, 8);
+    if (v != 0) break;
+    x -= 8;
+  }
+  while (x > 0 && row[x - 1] == 0) x--;
+  return x - 1;
+}
+
+/**
+ * @brief Total solid area, and the bounding box when [with_bbox] is set,
+ * without labelling islands.
+ *
+ * The total is the solid pixel count times the pixel area, so it can
+ * differ in the last bits from the full mode's per-island sum.
+ */
+static void _area_summary(
+    const uint8_t* pixels,
+    int32_t width,
+    int32_t height,
+    double pixel_area,
+    int with_bbox,
+    AreaStatsResult* out_result) {
+  const count_zero_fn count_zero = _count_zero_kernel();
+  int64_t solid = 0;
+  int32_t min_x = width;
+  int32_t min_y = height;
+  int32_t max_x = 0;
+  int32_t max_y = 0;
+
+  for (int32_t y = 0; y < height; y++) {
+    const uint8_t* row = pixels + (size_t)y * width;
+    const int32_t n = width - count_zero(row, width);
+    if (n == 0) continue;
+    solid += n;
+    if (!with_bbox) continue;
+    const int32_t first = _scan_row(row, 0, width, 1);
+    const int32_t last = _last_solid(row, width);
+    if (first < min_x) min_x = first;
+    if (last > max_x) max_x = last;
+    if (y < min_y) min_y = y;
+    max_y = y;
+  }
+
+  memset(out_result, 0, sizeof(*out_result));
+  if (solid == 0) return;
+  out_result->total_solid_area = (double)solid * pixel_area;
+  if (with_bbox) {
+    out_result->min_x = min_x;
+    out_result->min_y = min_y;
+    out_result->max_x = max_x;
+    out_result->max_y = max_y;
+  }
+}
+
+/**
+ * @brief Compute only the area statistics selected by [area_mode].
+ *
+ * VS_AREA_MODE_FULL is compute_layer_area_stats_mt. BBOX and TOTAL make a
+ * single counting pass and leave the island fields zero; NONE only clears
+ * [out_result].
+ *
+ * @return 1 on success, 0 on failure.
+ */
+int compute_layer_area_stats_mode(
+    const uint8_t* pixels,
+    int32_t width,
+    int32_t height,
+    double x_pixel_size_mm,
+    double y_pixel_size_mm,
+    int32_t area_mode,
+    int32_t thread_count,
+    AreaStatsResult* out_result) {
+  if (!pixels || !out_result || width <= 0 || height <= 0) {
+    return 0;
+  }
+
+  switch (area_mode) {
+    case VS_AREA_MODE_FULL:
+      return compute_layer_area_stats_mt(
+          pixels, width, height, x_pixel_size_mm, y_pixel_size_mm,
+          thread_count, out_result);
+    case VS_AREA_MODE_BBOX:
+    case VS_AREA_MODE_TOTAL:
+      _area_summary(
+          pixels, width, height, x_pixel_size_mm * y_pixel_size_mm,
+          area_mode == VS_AREA_MODE_BBOX, out_result);
+      return 1;
+    case VS_AREA_MODE_NONE:
+      memset(out_result, 0, sizeof(*out_result));
+      return 1;
+    default:
+      return 0;
+  }
+}
@@ -0,0 +1,554 @@
+/**
+ * @file compress_plan.c
+ * @brief Per-layer zlib level planner for a time budget or a size target.
+ *
+ * Without a plan every layer of a job is deflated at one level. With a plan
+ * passed to the job's batches each layer gets level 1, 6 or 9, chosen so
+ * the job meets a wall-clock budget with the smallest output, or a target
+ * size in the least time.
+ *
+ * Layers are grouped into density classes by the log2 of their RLE payload
+ * size, which tracks the edge count and so both the deflate cost and what a
+ * higher level saves. Per class and level the planner keeps the measured
+ * PNG bytes and encode time per RLE byte. The first layers of each class
+ * with enough layers are probes spread over the three levels (under a
+ * budget, only while their extra cost stays within 1/16 of it); a class
+ * missing a level borrows it from its own other levels, scaled by typical
+ * level ratios, or from the nearest measured class.
+ *
+ * Every few finished layers the rest of the job is re-planned. Remaining
+ * time is the measured non-encode cost per layer plus the modelled encode
+ * cost, divided by the parallelism achieved so far (busy time over wall
+ * time), so thread count and I/O stalls are measured rather than modelled.
+ * Starting from level 1 everywhere, level steps are taken in order of bytes
+ * saved per nanosecond (each class's steps follow its lower convex hull)
+ * until the budget is spent or the target is met. The last step may cover
+ * only part of its class; those upgrades are spread evenly over the class's
+ * remaining layers. Under a budget alone, a step that saves less than 1/64
+ * of its class's bytes is not taken: level 9 goes to layers where it pays.
+ */
+#include "voxelshift_native.h"
+#include "compress_plan.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+typedef CRITICAL_SECTION vs_mutex;
+static void vs_mutex_init(vs_mutex* m) { InitializeCriticalSection(m); }
+static void vs_mutex_destroy(vs_mutex* m) { DeleteCriticalSection(m); }
+static void vs_mutex_lock(vs_mutex* m) { EnterCriticalSection(m); }
+static void vs_mutex_unlock(vs_mutex* m) { LeaveCriticalSection(m); }
+static uint64_t _now_ns(void) {
+  static LARGE_INTEGER freq;
+  static int initialized = 0;
+  if (!initialized) {
+    QueryPerformanceFrequency(&freq);
+    initialized = 1;
+  }
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return (uint64_t)((counter.QuadPart * 1000000000ULL) / freq.QuadPart);
+}
+#else
+#include <pthread.h>
+#include <time.h>
+typedef pthread_mutex_t vs_mutex;
+static void vs_mutex_init(vs_mutex* m) { pthread_mutex_init(m, NULL); }
+static void vs_mutex_destroy(vs_mutex* m) { pthread_mutex_destroy(m); }
+static void vs_mutex_lock(vs_mutex* m) { pthread_mutex_lock(m); }
+static void vs_mutex_unlock(vs_mutex* m) { pthread_mutex_unlock(m); }
+static uint64_t _now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+#define VS_PLAN_CLASSES 16
+#define VS_PLAN_CLASS_MIN_BITS 8     // class 0: payloads up to 256 bytes
+#define VS_PLAN_PROBES 2             // layers per class probed at each level
+#define VS_PLAN_PROBE_MIN_LAYERS 16  // smaller classes are not probed
+#define VS_PLAN_PROBE_BUDGET_SHIFT 4 // probes may add 1/16 of a budget
+#define VS_PLAN_MIN_GAIN_SHIFT 6     // budget steps must save 1/64 of the bytes
+#define VS_PLAN_MIN_PARALLELISM 0.25
+#define VS_PLAN_DEFAULT_LEVEL 1      // level index used before the first plan
+#define VS_PLAN_STEPS (VS_PLAN_CLASSES * (VS_COMPRESS_PLAN_LEVELS - 1))
+
+static const int32_t kPlanLevels[VS_COMPRESS_PLAN_LEVELS] = {1, 6, 9};
+// Typical size and encode time of each level relative to level 1 on layer
+// masks; only used to fill in levels a class has not been measured at.
+static const double kPriorSize[VS_COMPRESS_PLAN_LEVELS] = {1.0, 0.8, 0.76};
+static const double kPriorCost[VS_COMPRESS_PLAN_LEVELS] = {1.0, 2.5, 6.0};
+
+enum { PLAN_PENDING = 0, PLAN_STARTED = 1, PLAN_DONE = 2 };
+
+typedef struct PlanCell {
+  int64_t in_bytes;          // RLE bytes of the layers measured
+  int64_t out_bytes;         // their PNG bytes
+  uint64_t ns;               // their encode time
+  int32_t layers;
+  int32_t probes;            // probes handed out
+} PlanCell;
+
+typedef struct PlanClass {
+  PlanCell cells[VS_COMPRESS_PLAN_LEVELS];
+  int32_t layers;            // layers with a size in this class
+  int32_t pending;           // of those, not started yet
+  int64_t pending_bytes;
+  int32_t level;             // level index of the class's layers
+  int32_t next;              // level index of a [frac] share of them
+  double frac;
+  double spread;             // error diffusion of [frac] over layers
+} PlanClass;
+
+struct VsCompressPlan {
+  vs_mutex lock;
+  int32_t count;
+  int64_t budget_ns;         // 0: no budget
+  int64_t target_bytes;      // 0: no target
+  uint64_t open_ns;
+  uint64_t first_ns;         // first layer started, 0 before
+  int32_t* size;             // RLE bytes per layer, -1 until noted
+  uint8_t* state;            // PLAN_*
+  int8_t* level_index;       // level index a layer was started at, or -1
+  int32_t* estimate;         // modelled PNG bytes of a started layer
+  PlanClass classes[VS_PLAN_CLASSES];
+  int32_t started;
+  int32_t unknown_pending;   // layers not started and without a size
+  int64_t inflight_bytes;    // modelled bytes of started, unfinished layers
+  int32_t inflight_layers[VS_COMPRESS_PLAN_LEVELS];
+  int32_t done;
+  int32_t reused;
+  int64_t done_bytes;
+  uint64_t busy_ns;          // summed per-layer time
+  uint64_t encode_ns;        // of that, encoding
+  int32_t since_replan;
+  int32_t replan_every;
+  int32_t replans;
+  int32_t probes;
+  double probe_ns;           // modelled encode time probes added over level 1
+  int32_t unreachable;
+  int32_t level_layers[VS_COMPRESS_PLAN_LEVELS];
+  int32_t projected;         // planned_* taken
+  int64_t planned_bytes;
+  int64_t planned_ns;
+  int32_t planned_layers[VS_COMPRESS_PLAN_LEVELS];
+};
+
+typedef struct PlanStep {
+  int32_t cls;
+  int32_t to;
+  double bytes;              // saved by taking the step for the whole class
+  double ns;                 // spent, in busy time
+} PlanStep;
+
+static int32_t _class_of(int64_t size) {
+  int32_t c = 0;
+  for (int64_t s = size >> VS_PLAN_CLASS_MIN_BITS;
+       s > 0 && c < VS_PLAN_CLASSES - 1; s >>= 1) {
+    c++;
+  }
+  return c;
+}
+
+/**
+ * @brief PNG bytes and encode ns per RLE byte of class [c] at level index
+ * [k], from its own measurements. Returns 0 when it has none.
+ */
+static int _class_estimate(
+    const PlanClass* c,
+    int32_t k,
+    double* ratio,
+    double* cost) {
+  int32_t j = -1;
+  for (int32_t d = 0; d < VS_COMPRESS_PLAN_LEVELS && j < 0; d++) {
+    if (k - d >= 0 && c->cells[k - d].layers > 0) j = k - d;
+    else if (k + d < VS_COMPRESS_PLAN_LEVELS && c->cells[k + d].layers > 0) j = k + d;
+  }
+  if (j < 0) return 0;
+  const PlanCell* cell = &c->cells[j];
+  const double in = cell->in_bytes > 0 ? (double)cell->in_bytes : 1.0;
+  *ratio = (double)cell->out_bytes / in * kPriorSize[k] / kPriorSize[j];
+  *cost = (double)cell->ns / in * kPriorCost[k] / kPriorCost[j];
+  return 1;
+}
+
+/**
+ * @brief Model for class [cls] at level index [k], borrowing from the
+ * nearest measured class; the priors alone before anything is measured.
+ */
+static void _estimate(
+    const VsCompressPlan* p,
+    int32_t cls,
+    int32_t k,
+    double* ratio,
+    double* cost) {
+  for (int32_t d = 0; d < VS_PLAN_CLASSES; d++) {
+    if (cls - d >= 0 && _class_estimate(&p->classes[cls - d], k, ratio, cost)) return;
+    if (d > 0 && cls + d < VS_PLAN_CLASSES &&
+        _class_estimate(&p->classes[cls + d], k, ratio, cost)) {
+      return;
+    }
+  }
+  *ratio = kPriorSize[k];
+  *cost = kPriorCost[k];
+}
+
+static int32_t _level_index(int32_t level) {
+  for (int32_t k = 0; k < VS_COMPRESS_PLAN_LEVELS; k++) {
+    if (kPlanLevels[k] == level) return k;
+  }
+  return -1;
+}
+
+/**
+ * @brief Move [layer] out of the pending counts.
+ */
+static void _start_layer(VsCompressPlan* p, int32_t layer) {
+  p->state[layer] = PLAN_STARTED;
+  p->started += 1;
+  if (!p->first_ns) p->first_ns = _now_ns();
+  if (p->size[layer] < 0) {
+    p->unknown_pending -= 1;
+    return;
+  }
+  PlanClass* c = &p->classes[_class_of(p->size[layer])];
+  c->pending -= 1;
+  c->pending_bytes -= p->size[layer];
+}
+
+/**
+ * @brief Re-plan the layers not started yet from the measurements so far.
+ */
+static void _replan(VsCompressPlan* p) {
+  p->since_replan = 0;
+  const uint64_t now = _now_ns();
+  const double elapsed = (double)(now - p->open_ns);
+  const double active = p->first_ns ? (double)(now - p->first_ns) : 0.0;
+  double parallel = active > 0.0 ? (double)p->busy_ns / active : 1.0;
+  if (parallel < VS_PLAN_MIN_PARALLELISM) parallel = VS_PLAN_MIN_PARALLELISM;
+  const int32_t pending = p->count - p->started;
+  const double other_ns = p->done > 0
+      ? (double)(p->busy_ns - p->encode_ns) / (double)p->done : 0.0;
+
+  // Layers whose size is not known yet are assumed to look like the rest.
+  int32_t known = 0;
+  for (int32_t c = 0; c < VS_PLAN_CLASSES; c++) known += p->classes[c].pending;
+  const double scale = known > 0
+      ? (double)(known + p->unknown_pending) / (double)known : 1.0;
+
+  double ratio[VS_PLAN_CLASSES][VS_COMPRESS_PLAN_LEVELS];
+  double cost[VS_PLAN_CLASSES][VS_COMPRESS_PLAN_LEVELS];
+  double mass[VS_PLAN_CLASSES];
+  double busy = (double)pending * other_ns;
+  double bytes = (double)p->done_bytes + (double)p->inflight_bytes;
+  for (int32_t c = 0; c < VS_PLAN_CLASSES; c++) {
+    PlanClass* pc = &p->classes[c];
+    pc->level = 0;
+    pc->next = 0;
+    pc->frac = 0.0;
+    pc->spread = 0.0;
+    mass[c] = (double)pc->pending_bytes * scale;
+    for (int32_t k = 0; k < VS_COMPRESS_PLAN_LEVELS; k++) {
+      _estimate(p, c, k, &ratio[c][k], &cost[c][k]);
+    }
+    busy += mass[c] * cost[c][0];
+    bytes += mass[c] * ratio[c][0];
+  }
+
+  // Each class's steps along its lower hull, best bytes-per-ns first.
+  PlanStep steps[VS_PLAN_STEPS];
+  int32_t n = 0;
+  const int gain_floor = p->target_bytes <= 0;
+  for (int32_t c = 0; c < VS_PLAN_CLASSES; c++) {
+    if (mass[c] <= 0.0) continue;
+    int32_t cur = 0;
+    for (;;) {
+      int32_t best = -1;
+      double best_eff = 0.0;
+      for (int32_t j = cur + 1; j < VS_COMPRESS_PLAN_LEVELS; j++) {
+        const double saved = ratio[c][cur] - ratio[c][j];
+        if (saved <= 0.0) continue;
+        const double spent = cost[c][j] - cost[c][cur];
+        const double eff = spent > 0.0 ? saved / spent : 1e300;
+        if (eff > best_eff) {
+          best = j;
+          best_eff = eff;
+        }
+      }
+      if (best < 0) break;
+      const double saved = ratio[c][cur] - ratio[c][best];
+      if (gain_floor &&
+          saved < ratio[c][cur] / (double)(1 << VS_PLAN_MIN_GAIN_SHIFT)) {
+        break;
+      }
+      const double spent = cost[c][best] - cost[c][cur];
+      PlanStep s;
+      s.cls = c;
+      s.to = best;
+      s.bytes = mass[c] * saved;
+      s.ns = spent > 0.0 ? mass[c] * spent : 0.0;
+      // Insertion keeps equal-efficiency steps of one class in hull order.
+      int32_t at = n++;
+      while (at > 0 &&
+             steps[at - 1].bytes * s.ns < s.bytes * steps[at - 1].ns) {
+        steps[at] = steps[at - 1];
+        at--;
+      }
+      steps[at] = s;
+      cur = best;
+    }
+  }
+
+  double spare = p->budget_ns > 0
+      ? ((double)p->budget_ns - elapsed) * parallel - busy : 1e300;
+  double excess = p->target_bytes > 0 ? bytes - (double)p->target_bytes : 0.0;
+  p->unreachable = spare < 0.0;
+  for (int32_t i = 0; i < n; i++) {
+    if (p->target_bytes > 0 && excess <= 0.0) break;
+    if (spare <= 0.0) break;
+    const PlanStep* s = &steps[i];
+    double f = 1.0;
+    if (p->target_bytes > 0 && excess < s->bytes) f = excess / s->bytes;
+    if (s->ns > spare * f && s->ns > 0.0) f = spare / s->ns;
+    PlanClass* pc = &p->classes[s->cls];
+    if (f >= 1.0) {
+      pc->level = s->to;
+    } else {
+      pc->next = s->to;
+      pc->frac = f;
+    }
+    busy += s->ns * f;
+    bytes -= s->bytes * f;
+    spare -= s->ns * f;
+    excess -= s->bytes * f;
+    if (f < 1.0) break;
+  }
+  if (p->target_bytes > 0 && excess >= 1.0) p->unreachable = 1;
+
+  p->replans += 1;
+  if (!p->projected && p->done * 8 >= p->count) {
+    // The projection reported as "planned": the first plan with probes in.
+    p->projected = 1;
+    p->planned_bytes = (int64_t)bytes;
+    p->planned_ns = (int64_t)(elapsed + busy / parallel);
+    for (int32_t k = 0; k < VS_COMPRESS_PLAN_LEVELS; k++) {
+      double layers = (double)(p->level_layers[k] + p->inflight_layers[k]);
+      for (int32_t c = 0; c < VS_PLAN_CLASSES; c++) {
+        const PlanClass* pc = &p->classes[c];
+        const double share = (pc->level == k ? 1.0 - pc->frac : 0.0) +
+                             (pc->frac > 0.0 && pc->next == k ? pc->frac : 0.0);
+        layers += (double)pc->pending * scale * share;
+      }
+      p->planned_layers[k] = (int32_t)(layers + 0.5);
+    }
+  }
+}
+
+// ── Library-internal hooks ──────────────────────────────────────────────────
+
+void vs_compress_plan_note_size(VsCompressPlan* p, int32_t layer, int64_t size) {
+  if (!p || layer < 0 || layer >= p->count || size < 0) return;
+  vs_mutex_lock(&p->lock);
+  if (p->size[layer] < 0) {
+    p->size[layer] = size > INT32_MAX ? INT32_MAX : (int32_t)size;
+    PlanClass* c = &p->classes[_class_of(p->size[layer])];
+    c->layers += 1;
+    if (p->state[layer] == PLAN_PENDING) {
+      c->pending += 1;
+      c->pending_bytes += p->size[layer];
+      p->unknown_pending -= 1;
+    }
+  }
+  vs_mutex_unlock(&p->lock);
+}
+
+int32_t vs_compress_plan_level(VsCompressPlan* p, int32_t layer) {
+  if (!p || layer < 0 || layer >= p->count) {
+    return kPlanLevels[VS_PLAN_DEFAULT_LEVEL];
+  }
+  vs_mutex_lock(&p->lock);
+  if (p->state[layer] != PLAN_PENDING) {
+    // Encoded again (e.g. a preview of a layer of the running job).
+    const int32_t k = p->level_index[layer];
+    vs_mutex_unlock(&p->lock);
+    return kPlanLevels[k >= 0 ? k : VS_PLAN_DEFAULT_LEVEL];
+  }
+  _start_layer(p, layer);
+  const int64_t size = p->size[layer] > 0 ? p->size[layer] : 0;
+  const int32_t cls = _class_of(size);
+  PlanClass* c = &p->classes[cls];
+  int32_t k = -1;
+  if (c->layers >= VS_PLAN_PROBE_MIN_LAYERS) {
+    for (int32_t j = 0; j < VS_COMPRESS_PLAN_LEVELS && k < 0; j++) {
+      if (c->cells[j].probes < VS_PLAN_PROBES) {
+        if (p->budget_ns > 0 && j > 0) {
+          // A tight budget cannot pay for measuring slow levels.
+          double ratio, cost0, cost;
+          _estimate(p, cls, 0, &ratio, &cost0);
+          _estimate(p, cls, j, &ratio, &cost);
+          const double extra = (double)size * (cost - cost0);
+          if (p->probe_ns + extra >
+              (double)(p->budget_ns >> VS_PLAN_PROBE_BUDGET_SHIFT)) {
+            break;
+          }
+          p->probe_ns += extra;
+        }
+        c->cells[j].probes += 1;
+        p->probes += 1;
+        k = j;
+      }
+    }
+  }
+  if (k < 0) {
+    k = c->level;
+    if (c->frac > 0.0) {
+      c->spread += c->frac;
+      if (c->spread >= 1.0) {
+        c->spread -= 1.0;
+        k = c->next;
+      }
+    }
+  }
+  double ratio, cost;
+  _estimate(p, cls, k, &ratio, &cost);
+  const double estimate = (double)size * ratio;
+  p->estimate[layer] = estimate > INT32_MAX ? INT32_MAX : (int32_t)estimate;
+  p->inflight_bytes += p->estimate[layer];
+  p->inflight_layers[k] += 1;
+  p->level_index[layer] = (int8_t)k;
+  vs_mutex_unlock(&p->lock);
+  return kPlanLevels[k];
+}
+
+void vs_compress_plan_record(
+    VsCompressPlan* p,
+    int32_t layer,
+    int32_t level,
+    int64_t png_bytes,
+    uint64_t encode_ns,
+    uint64_t total_ns) {
+  if (!p || layer < 0 || layer >= p->count) return;
+  vs_mutex_lock(&p->lock);
+  if (p->state[layer] == PLAN_DONE) {
+    vs_mutex_unlock(&p->lock);
+    return;
+  }
+  if (p->state[layer] == PLAN_PENDING) _start_layer(p, layer);
+  p->state[layer] = PLAN_DONE;
+  p->done += 1;
+  p->done_bytes += png_bytes;
+  p->busy_ns += total_ns;
+
+  const int32_t k = p->level_index[layer];
+  if (k >= 0) {
+    p->inflight_bytes -= p->estimate[layer];
+    p->inflight_layers[k] -= 1;
+  }
+  if (k < 0 || _level_index(level) != k) {
+    p->reused += 1;
+  } else {
+    p->encode_ns += encode_ns;
+    p->level_layers[k] += 1;
+    if (p->size[layer] > 0) {
+      PlanCell* cell = &p->classes[_class_of(p->size[layer])].cells[k];
+      cell->in_bytes += p->size[layer];
+      cell->out_bytes += png_bytes;
+      cell->ns += encode_ns;
+      cell->layers += 1;
+    }
+  }
+
+  if (++p->since_replan >= p->replan_every && p->started < p->count) {
+    _replan(p);
+  }
+  vs_mutex_unlock(&p->lock);
+}
+
+// ── FFI surface ─────────────────────────────────────────────────────────────
+
+/**
+ * @brief Open a plan for a job of [layer_count] layers.
+ */
+int64_t vs_compress_plan_open(
+    int32_t layer_count,
+    int64_t budget_ms,
+    int64_t target_bytes) {
+  if (layer_count <= 0 || (budget_ms <= 0 && target_bytes <= 0)) return 0;
+  VsCompressPlan* p = (VsCompressPlan*)calloc(1, sizeof(VsCompressPlan));
+  if (!p) return 0;
+  p->size = (int32_t*)malloc((size_t)layer_count * sizeof(int32_t));
+  p->state = (uint8_t*)calloc((size_t)layer_count, sizeof(uint8_t));
+  p->level_index = (int8_t*)malloc((size_t)layer_count * sizeof(int8_t));
+  p->estimate = (int32_t*)calloc((size_t)layer_count, sizeof(int32_t));
+  if (!p->size || !p->state || !p->level_index || !p->estimate) {
+    free(p->size);
+    free(p->state);
+    free(p->level_index);
+    free(p->estimate);
+    free(p);
+    return 0;
+  }
+  for (int32_t i = 0; i < layer_count; i++) {
+    p->size[i] = -1;
+    p->level_index[i] = -1;
+  }
+  for (int32_t c = 0; c < VS_PLAN_CLASSES; c++) {
+    p->classes[c].level = VS_PLAN_DEFAULT_LEVEL;
+  }
+  p->count = layer_count;
+  p->unknown_pending = layer_count;
+  p->budget_ns = budget_ms > 0 ? budget_ms * 1000000 : 0;
+  p->target_bytes = target_bytes > 0 ? target_bytes : 0;
+  p->replan_every = layer_count / 64;
+  if (p->replan_every < 4) p->replan_every = 4;
+  if (p->replan_every > 64) p->replan_every = 64;
+  vs_mutex_init(&p->lock);
+  p->open_ns = _now_ns();
+  return (int64_t)(intptr_t)p;
+}
+
+/**
+ * @brief Copy the plan's projection and progress into [out].
+ */
+int32_t vs_compress_plan_report(int64_t plan, VsCompressPlanReport* out) {
+  VsCompressPlan* p = (VsCompressPlan*)(intptr_t)plan;
+  if (!p || !out) return 0;
+  vs_mutex_lock(&p->lock);
+  memset(out, 0, sizeof(*out));
+  out->budget_ms = p->budget_ns / 1000000;
+  out->target_bytes = p->target_bytes;
+  out->planned_bytes = p->planned_bytes;
+  out->planned_ms = p->planned_ns / 1000000;
+  out->actual_bytes = p->done_bytes;
+  out->actual_ms = (int64_t)((_now_ns() - p->open_ns) / 1000000);
+  out->layers_done = p->done;
+  out->layers_reused = p->reused;
+  out->replans = p->replans;
+  out->probes = p->probes;
+  out->unreachable = p->unreachable;
+  for (int32_t k = 0; k < VS_COMPRESS_PLAN_LEVELS; k++) {
+    out->levels[k] = kPlanLevels[k];
+    out->level_layers[k] = p->level_layers[k];
+    out->planned_layers[k] = p->planned_layers[k];
+  }
+  vs_mutex_unlock(&p->lock);
+  return 1;
+}
+
+/**
+ * @brief Free a plan.
+ */
+void vs_compress_plan_close(int64_t plan) {
+  VsCompressPlan* p = (VsCompressPlan*)(intptr_t)plan;
+  if (!p) return;
+  vs_mutex_destroy(&p->lock);
+  free(p->size);
+  free(p->state);
+  free(p->level_index);
+  free(p->estimate);
+  free(p);
+}
@@ -0,0 +1,34 @@
+/**
+ * @file compress_plan.h
+ * @brief Library-internal hooks for the per-layer compression planner.
+ *
+ * Not part of the FFI surface; see compress_plan.c for the cost model. A
+ * plan is opened with vs_compress_plan_open() and passed explicitly to the
+ * layer batches of its job, so other jobs never pick it up.
+ */
+#ifndef VOXELSHIFT_COMPRESS_PLAN_H
+#define VOXELSHIFT_COMPRESS_PLAN_H
+
+#include <stdint.h>
+
+typedef struct VsCompressPlan VsCompressPlan;
+
+/// Note the encoded (RLE) size of [layer]; it sets the layer's density
+/// class. Sizes already noted are kept.
+void vs_compress_plan_note_size(VsCompressPlan* plan, int32_t layer, int64_t size);
+
+/// zlib level for [layer], called when its encode starts.
+int32_t vs_compress_plan_level(VsCompressPlan* plan, int32_t layer);
+
+/// Report a finished layer. [level] is what vs_compress_plan_level returned,
+/// or -1 when the layer was not encoded (blank, repeated or cached);
+/// [encode_ns] covers the encode and [total_ns] the whole layer.
+void vs_compress_plan_record(
+    VsCompressPlan* plan,
+    int32_t layer,
+    int32_t level,
+    int64_t png_bytes,
+    uint64_t encode_ns,
+    uint64_t total_ns);
+
+#endif // VOXELSHIFT_COMPRESS_PLAN_H
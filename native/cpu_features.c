@@ -0,0 +1,97 @@
+/**
+ * @file cpu_features.c
+ * @brief Runtime CPU feature detection used to pick SIMD kernels.
+ *
+ * Detects AVX2 (with OS support for YMM state) on x86-64 via CPUID/XGETBV.
+ * SSE2 and NEON are architectural baselines and need no probing. The level
+ * can be capped at runtime, e.g. to force the scalar reference kernels when
+ * checking SIMD output for bit-exactness.
+ */
+#include "voxelshift_native.h"
+#include "cpu_features.h"
+#include "worker_pool.h"
+
+#include <stddef.h>
+
+#if defined(VS_ARCH_X64)
+  #if defined(_MSC_VER)
+    #include <intrin.h>
+    #include <immintrin.h>
+  #else
+    #include <cpuid.h>
+  #endif
+#endif
+
+static volatile int32_t g_detected_level = -1;
+static volatile int32_t g_level_cap = -1;
+
+#if defined(VS_ARCH_X64)
+static int _os_saves_ymm(void) {
+#if defined(_MSC_VER)
+  return (_xgetbv(0) & 0x6) == 0x6;
+#else
+  uint32_t eax, edx;
+  __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  (void)edx;
+  return (eax & 0x6) == 0x6;
+#endif
+}
+
+static int _has_avx2(void) {
+#if defined(_MSC_VER)
+  int regs[4];
+  __cpuid(regs, 0);
+  if (regs[0] < 7) return 0;
+  __cpuid(regs, 1);
+  const int osxsave = (regs[2] >> 27) & 1;
+  const int avx = (regs[2] >> 28) & 1;
+  if (!osxsave || !avx || !_os_saves_ymm()) return 0;
+  __cpuidex(regs, 7, 0);
+  return (regs[1] >> 5) & 1;
+#else
+  unsigned int a, b, c, d;
+  if (__get_cpuid_max(0, NULL) < 7) return 0;
+  if (!__get_cpuid(1, &a, &b, &c, &d)) return 0;
+  const int osxsave = (c >> 27) & 1;
+  const int avx = (c >> 28) & 1;
+  if (!osxsave || !avx || !_os_saves_ymm()) return 0;
+  __cpuid_count(7, 0, a, b, c, d);
+  return (b >> 5) & 1;
+#endif
+}
+#endif
+
+static int32_t _detect_level(void) {
+#if defined(VS_ARCH_X64)
+  return _has_avx2() ? VS_SIMD_AVX2 : VS_SIMD_SSE2;
+#elif defined(VS_ARCH_ARM64)
+  return VS_SIMD_NEON;
+#else
+  return VS_SIMD_SCALAR;
+#endif
+}
+
+int32_t vs_simd_level(void) {
+  int32_t level = vs_atomic_load32(&g_detected_level);
+  if (level < 0) {
+    // Idempotent; concurrent first callers store the same value.
+    level = _detect_level();
+    vs_atomic_store32(&g_detected_level, level);
+  }
+  const int32_t cap = vs_atomic_load32(&g_level_cap);
+  return (cap >= 0 && cap < level) ? cap : level;
+}
+
+/**
+ * @brief Cap the SIMD level used by native kernels (-1 restores auto).
+ */
+void set_native_simd_level(int32_t level) {
+  vs_atomic_store32(&g_level_cap, level < 0 ? -1 : level);
+}
+
+/**
+ * @brief SIMD level currently in use (0 scalar, 1 SSE2/NEON, 2 AVX2).
+ */
+int32_t native_simd_level(void) {
+  return vs_simd_level();
+}
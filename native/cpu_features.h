@@ -0,0 +1,47 @@
+/**
+ * @file cpu_features.h
+ * @brief Internal runtime CPU feature detection for SIMD kernel dispatch.
+ *
+ * Not part of the FFI surface. x86-64 always has SSE2 and AArch64 always
+ * has NEON; AVX2 is detected at runtime. Kernels that need more than the
+ * baseline are compiled with VS_TARGET_AVX2 and only called when
+ * vs_simd_level() reports VS_SIMD_AVX2.
+ */
+#ifndef VOXELSHIFT_CPU_FEATURES_H
+#define VOXELSHIFT_CPU_FEATURES_H
+
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+  #define VS_ARCH_X64 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+  #define VS_ARCH_ARM64 1
+#endif
+
+#if defined(VS_ARCH_X64) && (defined(__GNUC__) || defined(__clang__))
+  #define VS_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+  #define VS_TARGET_AVX2
+#endif
+
+/// SIMD levels, ordered: each level implies the ones below it on its ISA.
+#define VS_SIMD_SCALAR 0
+#define VS_SIMD_SSE2 1   // x86-64 baseline
+#define VS_SIMD_NEON 1   // AArch64 baseline
+#define VS_SIMD_AVX2 2
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Highest usable SIMD level, capped by set_native_simd_level().
+ * Detection runs once; the result is cached.
+ */
+int32_t vs_simd_level(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VOXELSHIFT_CPU_FEATURES_H
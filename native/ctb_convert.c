@@ -0,0 +1,390 @@
+/**
+ * @file ctb_convert.c
+ * @brief Single-call CTB → NanoDLP conversion entry point.
+ *
+ * Parses the CTB header and layer table, streams raw layer data from disk
+ * in bounded chunks (via a layer source, so reads overlap processing)
+ * through the layer pipeline, and writes the resulting PNGs straight into
+ * the output archive. The Dart layer only supplies the
+ * metadata entries and reports progress.
+ */
+#include "voxelshift_native.h"
+#include "compress_plan.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+static int _file_seek(FILE* f, int64_t offset) {
+  return _fseeki64(f, offset, SEEK_SET) == 0;
+}
+static int64_t _file_size(FILE* f) {
+  if (_fseeki64(f, 0, SEEK_END) != 0) return -1;
+  return (int64_t)_ftelli64(f);
+}
+static uint64_t _now_ns(void) {
+  static LARGE_INTEGER freq;
+  static int initialized = 0;
+  if (!initialized) {
+    QueryPerformanceFrequency(&freq);
+    initialized = 1;
+  }
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return (uint64_t)((counter.QuadPart * 1000000000ULL) / freq.QuadPart);
+}
+#else
+#include <sys/types.h>
+#include <time.h>
+static int _file_seek(FILE* f, int64_t offset) {
+  return fseeko(f, (off_t)offset, SEEK_SET) == 0;
+}
+static int64_t _file_size(FILE* f) {
+  if (fseeko(f, 0, SEEK_END) != 0) return -1;
+  return (int64_t)ftello(f);
+}
+static uint64_t _now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+#define CTB_MAGIC_CBDDLP 0x12FD0066u
+#define CTB_MAGIC_CTB 0x12FD0086u
+#define CTB_MAGIC_V4 0x12FD0106u
+#define CTB_MAGIC_V4_ENCRYPTED 0x12FD0107u
+
+#define CTB_MAX_LAYERS 100000
+#define CTB_LEGACY_LAYER_DEF_SIZE 36
+#define CTB_V4_POINTER_SIZE 16
+#define CTB_V4_LAYER_DEF_MIN_SIZE 28
+
+// Chunk bounds: enough layers to keep every worker busy, but never more raw
+// input than fits comfortably in memory (or in the int32 blob length).
+#define CONVERT_DEFAULT_CHUNK_LAYERS 96
+#define CONVERT_MAX_CHUNK_BYTES (256 * 1024 * 1024)
+
+/**
+ * @brief Header fields the converter needs from a CTB file.
+ */
+typedef struct CtbHeader {
+  uint32_t magic;
+  uint32_t layer_table_offset;
+  int32_t layer_count;
+  int32_t resolution_x;
+  int32_t resolution_y;
+  int32_t encryption_key;
+} CtbHeader;
+
+static uint32_t _read_u32_le(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+         ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int _read_at(FILE* f, int64_t offset, uint8_t* out, size_t len) {
+  if (!_file_seek(f, offset)) return 0;
+  return fread(out, 1, len, f) == len;
+}
+
+/**
+ * @brief Parse the regular (unencrypted) CTB header.
+ *
+ * CTBv4E keeps its settings AES-encrypted, so those files need the caller
+ * to supply the fields through VsConvertOptions.header_override.
+ */
+static int _read_ctb_header(
+    FILE* f,
+    const VsConvertOptions* options,
+    CtbHeader* out) {
+  uint8_t hdr[96];
+  if (!_read_at(f, 0, hdr, sizeof(hdr))) return 0;
+
+  out->magic = _read_u32_le(hdr);
+  if (out->magic != CTB_MAGIC_CBDDLP && out->magic != CTB_MAGIC_CTB &&
+      out->magic != CTB_MAGIC_V4 && out->magic != CTB_MAGIC_V4_ENCRYPTED) {
+    return 0;
+  }
+
+  if (options->header_override) {
+    out->layer_table_offset = (uint32_t)options->layer_table_offset;
+    out->layer_count = options->layer_count;
+    out->resolution_x = options->resolution_x;
+    out->resolution_y = options->resolution_y;
+    out->encryption_key = options->encryption_key;
+  } else {
+    if (out->magic == CTB_MAGIC_V4_ENCRYPTED) return 0;
+    out->layer_table_offset = _read_u32_le(hdr + 52);
+    out->layer_count = (int32_t)_read_u32_le(hdr + 56);
+    out->resolution_x = (int32_t)_read_u32_le(hdr + 60);
+    out->resolution_y = (int32_t)_read_u32_le(hdr + 64);
+    out->encryption_key = (int32_t)_read_u32_le(hdr + 88);
+  }
+
+  return out->layer_table_offset > 0 && out->layer_count > 0 &&
+         out->layer_count <= CTB_MAX_LAYERS && out->resolution_x > 0 &&
+         out->resolution_y > 0;
+}
+
+/**
+ * @brief Resolve every layer's data offset/length from the layer table.
+ *
+ * CTBv4/v4E use a table of 16-byte pointers to LayerDef records
+ * (DataOffset @16, DataLength @24); older formats store 36-byte LayerDefs
+ * inline (DataOffset @4, DataLength @8).
+ */
+static int _read_ctb_layer_table(
+    FILE* f,
+    const CtbHeader* hdr,
+    int64_t file_size,
+    uint32_t* out_offsets,
+    uint32_t* out_lengths) {
+  const int32_t count = hdr->layer_count;
+  const int v4 = hdr->magic == CTB_MAGIC_V4 ||
+                 hdr->magic == CTB_MAGIC_V4_ENCRYPTED;
+  const size_t entry_size = v4 ? CTB_V4_POINTER_SIZE : CTB_LEGACY_LAYER_DEF_SIZE;
+
+  uint8_t* table = (uint8_t*)malloc((size_t)count * entry_size);
+  if (!table) return 0;
+  if (!_read_at(f, hdr->layer_table_offset, table, (size_t)count * entry_size)) {
+    free(table);
+    return 0;
+  }
+
+  int ok = 1;
+  for (int32_t i = 0; i < count && ok; i++) {
+    const uint8_t* e = table + (size_t)i * entry_size;
+    if (v4) {
+      const uint32_t def_offset = _read_u32_le(e);
+      const uint32_t def_size = _read_u32_le(e + 8);
+      uint8_t def[CTB_V4_LAYER_DEF_MIN_SIZE];
+      if (def_offset == 0 || def_size < CTB_V4_LAYER_DEF_MIN_SIZE ||
+          !_read_at(f, def_offset, def, sizeof(def))) {
+        ok = 0;
+        break;
+      }
+      out_offsets[i] = _read_u32_le(def + 16);
+      out_lengths[i] = _read_u32_le(def + 24);
+    } else {
+      out_offsets[i] = _read_u32_le(e + 4);
+      out_lengths[i] = _read_u32_le(e + 8);
+    }
+
+    if (out_lengths[i] == 0 || out_lengths[i] > CONVERT_MAX_CHUNK_BYTES ||
+        (int64_t)out_offsets[i] + out_lengths[i] > file_size) {
+      ok = 0;
+    }
+  }
+
+  free(table);
+  return ok;
+}
+
+/**
+ * @brief Write the caller-supplied entries that precede the layer PNGs.
+ */
+static int _write_head_entries(int64_t zip, const VsConvertOptions* options) {
+  for (int32_t i = 0; i < options->head_entry_count; i++) {
+    if (!options->head_entry_names || !options->head_entry_data ||
+        !options->head_entry_lengths ||
+        !vs_zip_add_file(
+            zip,
+            options->head_entry_names[i],
+            options->head_entry_data[i],
+            options->head_entry_lengths[i])) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void _convert_fail(VsConvertResult* r, int32_t error) {
+  r->error = error;
+  if (r->areas) {
+    free_native_area_buffer(r->areas);
+    r->areas = NULL;
+  }
+  r->layer_count = 0;
+}
+
+/**
+ * @brief Convert a CTB file into an open NanoDLP archive in one call.
+ */
+int vs_convert_file(
+    const char* ctb_path,
+    const char* out_path,
+    const VsConvertOptions* options,
+    vs_convert_progress_fn progress_cb,
+    VsConvertResult* out_result) {
+  if (!out_result) return 0;
+  memset(out_result, 0, sizeof(*out_result));
+  if (!ctb_path || !out_path || !options || options->out_width <= 0 ||
+      (options->channels != 1 && options->channels != 3)) {
+    out_result->error = VS_CONVERT_ERROR_ARGS;
+    return 0;
+  }
+
+  FILE* f = fopen(ctb_path, "rb");
+  if (!f) {
+    out_result->error = VS_CONVERT_ERROR_INPUT;
+    return 0;
+  }
+
+  const uint64_t read_start = _now_ns();
+  CtbHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  const int64_t file_size = _file_size(f);
+  if (file_size <= 0 || !_read_ctb_header(f, options, &hdr)) {
+    fclose(f);
+    out_result->error = VS_CONVERT_ERROR_HEADER;
+    return 0;
+  }
+
+  const int32_t count = hdr.layer_count;
+  uint32_t* layer_offsets = (uint32_t*)calloc((size_t)count, sizeof(uint32_t));
+  uint32_t* layer_lengths = (uint32_t*)calloc((size_t)count, sizeof(uint32_t));
+  if (!layer_offsets || !layer_lengths ||
+      !_read_ctb_layer_table(f, &hdr, file_size, layer_offsets, layer_lengths)) {
+    free(layer_offsets);
+    free(layer_lengths);
+    fclose(f);
+    out_result->error = VS_CONVERT_ERROR_LAYER_TABLE;
+    return 0;
+  }
+  fclose(f);
+
+  // The whole table is known up front, so a compression plan can class
+  // every layer before the first batch instead of batch by batch.
+  VsCompressPlan* plan = (VsCompressPlan*)(intptr_t)options->compress_plan;
+  for (int32_t i = 0; plan && i < count; i++) {
+    vs_compress_plan_note_size(plan, i, layer_lengths[i]);
+  }
+
+  const int64_t source = vs_layer_source_open(
+      ctb_path, layer_offsets, layer_lengths, count, options->input_backend);
+  uint64_t read_ns = _now_ns() - read_start;
+  if (!source) {
+    free(layer_offsets);
+    free(layer_lengths);
+    out_result->error = VS_CONVERT_ERROR_INPUT;
+    return 0;
+  }
+  out_result->input_backend = vs_layer_source_backend(source);
+
+  int32_t chunk_layers = options->chunk_layers > 0 ?
+      options->chunk_layers : CONVERT_DEFAULT_CHUNK_LAYERS;
+  if (chunk_layers > count) chunk_layers = count;
+
+  out_result->areas =
+      (AreaStatsResult*)calloc((size_t)count, sizeof(AreaStatsResult));
+  if (!out_result->areas) {
+    vs_layer_source_close(source);
+    free(layer_offsets);
+    free(layer_lengths);
+    _convert_fail(out_result, VS_CONVERT_ERROR_MEMORY);
+    return 0;
+  }
+
+  const int64_t zip = vs_zip_open(out_path);
+  int32_t error = 0;
+  if (!zip) {
+    error = VS_CONVERT_ERROR_OUTPUT;
+  } else if (!_write_head_entries(zip, options)) {
+    error = VS_CONVERT_ERROR_OUTPUT;
+  }
+
+  uint64_t process_ns = 0;
+  int32_t done = 0;
+  if (progress_cb && !error) progress_cb(0, count);
+  while (!error && done < count) {
+    // Grow the chunk until the layer or byte budget is reached.
+    int32_t end = done;
+    int64_t bytes = 0;
+    while (end < count && end - done < chunk_layers &&
+           (end == done ||
+            bytes + layer_lengths[end] <= CONVERT_MAX_CHUNK_BYTES)) {
+      bytes += layer_lengths[end];
+      end++;
+    }
+
+    // With read-ahead this normally returns data prepared while the
+    // previous chunk was being processed.
+    const uint8_t* blob = NULL;
+    int32_t blob_len = 0;
+    const int32_t* offsets = NULL;
+    const int32_t* lengths = NULL;
+    const uint64_t chunk_read_start = _now_ns();
+    if (!vs_layer_source_fetch(
+            source, done, end, &blob, &blob_len, &offsets, &lengths)) {
+      error = VS_CONVERT_ERROR_INPUT;
+      break;
+    }
+    const uint64_t chunk_process_start = _now_ns();
+    read_ns += chunk_process_start - chunk_read_start;
+
+    if (!process_layers_batch_to_zip(
+            zip,
+            blob,
+            blob_len,
+            offsets,
+            lengths,
+            end - done,
+            done,
+            hdr.encryption_key,
+            hdr.resolution_x,
+            hdr.resolution_y,
+            options->out_width,
+            options->channels,
+            options->x_pixel_size_mm,
+            options->y_pixel_size_mm,
+            options->png_level,
+            options->compress_plan,
+            options->encode_job,
+            options->layer_cache,
+            options->area_mode,
+            options->thread_count,
+            options->max_in_flight,
+            out_result->areas + done)) {
+      error = VS_CONVERT_ERROR_PROCESS;
+      break;
+    }
+    process_ns += _now_ns() - chunk_process_start;
+
+    const int32_t backend = process_layers_last_backend();
+    if (backend > out_result->backend) out_result->backend = backend;
+    out_result->gpu_attempts += process_layers_last_gpu_attempts();
+    out_result->gpu_successes += process_layers_last_gpu_successes();
+    out_result->gpu_fallbacks += process_layers_last_gpu_fallbacks();
+    out_result->dedup_hits += process_layers_last_dedup_hits();
+    out_result->cache_hits += process_layers_last_cache_hits();
+
+    done = end;
+    if (progress_cb) progress_cb(done, count);
+  }
+
+  vs_layer_source_close(source);
+  free(layer_offsets);
+  free(layer_lengths);
+
+  out_result->read_ns = (int64_t)read_ns;
+  out_result->process_ns = (int64_t)process_ns;
+  out_result->layers_done = done;
+
+  if (error) {
+    if (zip) {
+      vs_zip_abort(zip);
+      remove(out_path);
+    }
+    _convert_fail(out_result, error);
+    return 0;
+  }
+
+  out_result->zip_handle = zip;
+  out_result->layer_count = count;
+  out_result->resolution_x = hdr.resolution_x;
+  out_result->resolution_y = hdr.resolution_y;
+  return 1;
+}
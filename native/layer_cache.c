@@ -0,0 +1,377 @@
+/**
+ * @file layer_cache.c
+ * @brief Persistent per-layer output cache for re-converting edited jobs.
+ *
+ * Finished layers (PNG bytes plus area statistics) are kept on disk, one
+ * file per layer, keyed by the hash of the layer's decrypted RLE payload
+ * (hash_layer_rle) and the output profile it was produced with. When a
+ * re-exported plate is converted again, unchanged layers are read back
+ * instead of being decoded and encoded.
+ *
+ * Each file is a fixed header followed by the PNG. The header repeats the
+ * full key, so a name collision or a file from an older format reads as a
+ * miss. Files are written under a temporary name and renamed into place.
+ *
+ * A job opens the cache for its conversion (vs_layer_cache_open) and hands
+ * the handle to its batches, so jobs with different directories or limits
+ * can run side by side. Each handle is size-capped with least-recently-used
+ * eviction: hits refresh the file's modification time, and when the size
+ * the handle tracks passes the cap the oldest files are deleted until it is
+ * 10% below it.
+ *
+ * copy_file is also here: the job result cache uses it to store finished
+ * plates and hand them out again as copies.
+ */
+#include "voxelshift_native.h"
+#include "layer_cache.h"
+#include "worker_pool.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <sys/utime.h>
+typedef CRITICAL_SECTION vs_mutex;
+static void vs_mutex_init(vs_mutex* m) { InitializeCriticalSection(m); }
+static void vs_mutex_destroy(vs_mutex* m) { DeleteCriticalSection(m); }
+static void vs_mutex_lock(vs_mutex* m) { EnterCriticalSection(m); }
+static void vs_mutex_unlock(vs_mutex* m) { LeaveCriticalSection(m); }
+#else
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <utime.h>
+typedef pthread_mutex_t vs_mutex;
+static void vs_mutex_init(vs_mutex* m) { pthread_mutex_init(m, NULL); }
+static void vs_mutex_destroy(vs_mutex* m) { pthread_mutex_destroy(m); }
+static void vs_mutex_lock(vs_mutex* m) { pthread_mutex_lock(m); }
+static void vs_mutex_unlock(vs_mutex* m) { pthread_mutex_unlock(m); }
+#endif
+
+#define VS_LAYER_CACHE_MAGIC 0x434C5356u  // "VSLC"
+// Bump when the stored bytes would differ for the same key.
+#define VS_LAYER_CACHE_VERSION 3
+#define VS_LAYER_CACHE_PATH_MAX 1024
+#define VS_LAYER_CACHE_NAME_LEN 36  // 32 hex digits + ".vsl"
+
+/// On-disk entry header; the PNG follows it.
+typedef struct LayerCacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  VsLayerProfile profile;
+  uint64_t hash[2];
+  int32_t input_len;
+  int32_t png_len;
+  AreaStatsResult area;
+} LayerCacheHeader;
+
+/// One cache file seen by a directory scan.
+typedef struct LayerCacheFile {
+  char name[VS_LAYER_CACHE_NAME_LEN + 1];
+  int64_t size;
+  int64_t mtime;
+} LayerCacheFile;
+
+struct VsLayerCache {
+  char dir[VS_LAYER_CACHE_PATH_MAX];
+  int64_t max_bytes;
+  vs_mutex lock;   // guards bytes
+  int64_t bytes;   // tracked size of the entries
+};
+
+static volatile int32_t g_cache_tmp_seq = 0;
+
+/**
+ * @brief FNV-1a over the profile, folded into the file name.
+ */
+static uint64_t _profile_digest(const VsLayerProfile* profile) {
+  const uint8_t* p = (const uint8_t*)profile;
+  uint64_t h = 0xCBF29CE484222325ull;
+  for (size_t i = 0; i < sizeof(VsLayerProfile); i++) {
+    h = (h ^ p[i]) * 0x100000001B3ull;
+  }
+  return h;
+}
+
+static int _is_entry_name(const char* name) {
+  if (strlen(name) != VS_LAYER_CACHE_NAME_LEN) return 0;
+  for (int i = 0; i < 32; i++) {
+    const char c = name[i];
+    if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) return 0;
+  }
+  return strcmp(name + 32, ".vsl") == 0;
+}
+
+static int _entry_path(
+    const char* dir,
+    const VsLayerProfile* profile,
+    const uint64_t* hash,
+    char* out,
+    size_t cap) {
+  const int n = snprintf(out, cap, "%s/%016llx%016llx.vsl", dir,
+                         (unsigned long long)(hash[0] ^ _profile_digest(profile)),
+                         (unsigned long long)hash[1]);
+  return n > 0 && (size_t)n < cap;
+}
+
+/// Growable list of scanned entries.
+typedef struct LayerCacheScan {
+  LayerCacheFile* files;
+  int32_t count;
+  int32_t cap;
+  int64_t total;
+} LayerCacheScan;
+
+static void _scan_add(LayerCacheScan* scan, const char* name, int64_t size, int64_t mtime) {
+  if (!_is_entry_name(name)) return;
+  if (scan->count == scan->cap) {
+    const int32_t cap = scan->cap ? scan->cap * 2 : 256;
+    LayerCacheFile* grown = (LayerCacheFile*)realloc(
+        scan->files, (size_t)cap * sizeof(LayerCacheFile));
+    if (!grown) return;  // the entry is left out of this pass
+    scan->files = grown;
+    scan->cap = cap;
+  }
+  LayerCacheFile* f = &scan->files[scan->count++];
+  memcpy(f->name, name, VS_LAYER_CACHE_NAME_LEN + 1);
+  f->size = size;
+  f->mtime = mtime;
+  scan->total += size;
+}
+
+/**
+ * @brief List the entries in [dir]; returns 0 if it cannot be read.
+ *
+ * scan->files is malloc'd (NULL when empty).
+ */
+static int _scan_dir(const char* dir, LayerCacheScan* scan) {
+  memset(scan, 0, sizeof(*scan));
+#ifdef _WIN32
+  char pattern[VS_LAYER_CACHE_PATH_MAX + 8];
+  snprintf(pattern, sizeof(pattern), "%s/*.vsl", dir);
+  WIN32_FIND_DATAA fd;
+  HANDLE find = FindFirstFileA(pattern, &fd);
+  if (find == INVALID_HANDLE_VALUE) {
+    // An empty directory has no matches; a missing one is an error.
+    const DWORD attrs = GetFileAttributesA(dir);
+    return attrs != INVALID_FILE_ATTRIBUTES && (attrs & FILE_ATTRIBUTE_DIRECTORY);
+  }
+  do {
+    if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+    _scan_add(scan, fd.cFileName,
+              ((int64_t)fd.nFileSizeHigh << 32) | fd.nFileSizeLow,
+              ((int64_t)fd.ftLastWriteTime.dwHighDateTime << 32) |
+                  fd.ftLastWriteTime.dwLowDateTime);
+  } while (FindNextFileA(find, &fd));
+  FindClose(find);
+#else
+  DIR* d = opendir(dir);
+  if (!d) return 0;
+  struct dirent* ent;
+  while ((ent = readdir(d)) != NULL) {
+    if (!_is_entry_name(ent->d_name)) continue;
+    char path[VS_LAYER_CACHE_PATH_MAX + VS_LAYER_CACHE_NAME_LEN + 2];
+    snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+    _scan_add(scan, ent->d_name, (int64_t)st.st_size, (int64_t)st.st_mtime);
+  }
+  closedir(d);
+#endif
+  return 1;
+}
+
+static int _older_first(const void* a, const void* b) {
+  const int64_t ma = ((const LayerCacheFile*)a)->mtime;
+  const int64_t mb = ((const LayerCacheFile*)b)->mtime;
+  return (ma > mb) - (ma < mb);
+}
+
+/**
+ * @brief Re-measure the cache and delete the least recently used entries
+ * until it is 10% under the cap. Caller holds [cache]'s lock.
+ */
+static void _evict_locked(VsLayerCache* cache) {
+  LayerCacheScan scan;
+  if (!_scan_dir(cache->dir, &scan)) return;
+  if (scan.total > cache->max_bytes) {
+    const int64_t target = cache->max_bytes - cache->max_bytes / 10;
+    qsort(scan.files, (size_t)scan.count, sizeof(LayerCacheFile), _older_first);
+    for (int32_t k = 0; k < scan.count && scan.total > target; k++) {
+      char path[VS_LAYER_CACHE_PATH_MAX + VS_LAYER_CACHE_NAME_LEN + 2];
+      snprintf(path, sizeof(path), "%s/%s", cache->dir, scan.files[k].name);
+      // Files still open elsewhere (Windows) stay; the next pass retries.
+      if (remove(path) == 0) scan.total -= scan.files[k].size;
+    }
+  }
+  cache->bytes = scan.total;
+  free(scan.files);
+}
+
+/**
+ * @brief Open the layer cache in [dir], capped at [max_bytes], evicting
+ * down to the cap if the directory is already over it.
+ */
+int64_t vs_layer_cache_open(const char* dir, int64_t max_bytes) {
+  LayerCacheScan scan;
+  if (!dir || !dir[0] || max_bytes <= 0 ||
+      strlen(dir) >= VS_LAYER_CACHE_PATH_MAX - VS_LAYER_CACHE_NAME_LEN - 16 ||
+      !_scan_dir(dir, &scan)) {
+    return 0;
+  }
+  free(scan.files);
+  VsLayerCache* cache = (VsLayerCache*)calloc(1, sizeof(VsLayerCache));
+  if (!cache) return 0;
+  strcpy(cache->dir, dir);
+  cache->max_bytes = max_bytes;
+  cache->bytes = scan.total;
+  vs_mutex_init(&cache->lock);
+  if (cache->bytes > cache->max_bytes) _evict_locked(cache);
+  return (int64_t)(intptr_t)cache;
+}
+
+void vs_layer_cache_close(int64_t cache) {
+  VsLayerCache* c = (VsLayerCache*)(intptr_t)cache;
+  if (!c) return;
+  vs_mutex_destroy(&c->lock);
+  free(c);
+}
+
+int vs_layer_cache_lookup(
+    VsLayerCache* cache,
+    const VsLayerProfile* profile,
+    const uint64_t* hash,
+    int32_t input_len,
+    uint8_t** out_png,
+    int32_t* out_png_len,
+    AreaStatsResult* out_area) {
+  char path[VS_LAYER_CACHE_PATH_MAX + VS_LAYER_CACHE_NAME_LEN + 2];
+  if (!cache || !_entry_path(cache->dir, profile, hash, path, sizeof(path))) {
+    return 0;
+  }
+
+  FILE* f = fopen(path, "rb");
+  if (!f) return 0;
+  LayerCacheHeader h;
+  uint8_t* png = NULL;
+  int ok = fread(&h, sizeof(h), 1, f) == 1 &&
+      h.magic == VS_LAYER_CACHE_MAGIC &&
+      h.version == VS_LAYER_CACHE_VERSION &&
+      memcmp(&h.profile, profile, sizeof(VsLayerProfile)) == 0 &&
+      h.hash[0] == hash[0] && h.hash[1] == hash[1] &&
+      h.input_len == input_len && h.png_len > 0;
+  if (ok) {
+    png = (uint8_t*)malloc((size_t)h.png_len);
+    ok = png && fread(png, 1, (size_t)h.png_len, f) == (size_t)h.png_len;
+  }
+  fclose(f);
+  if (!ok) {
+    free(png);
+    return 0;
+  }
+
+  // Refresh the entry's position in the LRU order.
+#ifdef _WIN32
+  _utime(path, NULL);
+#else
+  utime(path, NULL);
+#endif
+  *out_png = png;
+  *out_png_len = h.png_len;
+  *out_area = h.area;
+  return 1;
+}
+
+void vs_layer_cache_store(
+    VsLayerCache* cache,
+    const VsLayerProfile* profile,
+    const uint64_t* hash,
+    int32_t input_len,
+    const uint8_t* png,
+    int32_t png_len,
+    const AreaStatsResult* area) {
+  char path[VS_LAYER_CACHE_PATH_MAX + VS_LAYER_CACHE_NAME_LEN + 2];
+  char tmp[VS_LAYER_CACHE_PATH_MAX + VS_LAYER_CACHE_NAME_LEN + 24];
+  if (!cache || !png || png_len <= 0 ||
+      !_entry_path(cache->dir, profile, hash, path, sizeof(path))) {
+    return;
+  }
+
+  // Only misses are stored, so an existing file is stale or corrupt and
+  // the rename replaces it.
+  LayerCacheHeader h;
+  memset(&h, 0, sizeof(h));
+  h.magic = VS_LAYER_CACHE_MAGIC;
+  h.version = VS_LAYER_CACHE_VERSION;
+  h.profile = *profile;
+  h.hash[0] = hash[0];
+  h.hash[1] = hash[1];
+  h.input_len = input_len;
+  h.png_len = png_len;
+  h.area = *area;
+
+  snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path,
+           (int)vs_atomic_fetch_add32(&g_cache_tmp_seq, 1));
+  FILE* f = fopen(tmp, "wb");
+  if (!f) return;
+  int ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+      fwrite(png, 1, (size_t)png_len, f) == (size_t)png_len;
+  ok = (fclose(f) == 0) && ok;
+#ifdef _WIN32
+  ok = ok && MoveFileExA(tmp, path, MOVEFILE_REPLACE_EXISTING);
+#else
+  ok = ok && rename(tmp, path) == 0;
+#endif
+  if (!ok) {
+    remove(tmp);
+    return;
+  }
+
+  vs_mutex_lock(&cache->lock);
+  cache->bytes += (int64_t)sizeof(h) + png_len;
+  if (cache->bytes > cache->max_bytes) _evict_locked(cache);
+  vs_mutex_unlock(&cache->lock);
+}
+
+/**
+ * @brief Copy [src] to [dst] through a temporary file and a rename, so an
+ * existing [dst] is replaced only by a complete copy.
+ *
+ * Copies rather than links: a cached plate and an output never share a
+ * file, so neither can change the other.
+ *
+ * Returns 1 on success, 0 on failure.
+ */
+int copy_file(const char* src, const char* dst) {
+  if (!src || !dst || !src[0] || !dst[0]) return 0;
+  char tmp[VS_LAYER_CACHE_PATH_MAX + 24];
+  const int n = snprintf(tmp, sizeof(tmp), "%s.%d.tmp", dst,
+                         (int)vs_atomic_fetch_add32(&g_cache_tmp_seq, 1));
+  if (n <= 0 || (size_t)n >= sizeof(tmp)) return 0;
+  FILE* in = fopen(src, "rb");
+  if (!in) return 0;
+  FILE* out = fopen(tmp, "wb");
+  if (!out) {
+    fclose(in);
+    return 0;
+  }
+  uint8_t buf[64 * 1024];
+  size_t got;
+  int ok = 1;
+  while (ok && (got = fread(buf, 1, sizeof(buf), in)) > 0) {
+    ok = fwrite(buf, 1, got, out) == got;
+  }
+  ok = ok && !ferror(in);
+  fclose(in);
+  ok = (fclose(out) == 0) && ok;
+#ifdef _WIN32
+  ok = ok && MoveFileExA(tmp, dst, MOVEFILE_REPLACE_EXISTING);
+#else
+  ok = ok && rename(tmp, dst) == 0;
+#endif
+  if (!ok) remove(tmp);
+  return ok;
+}
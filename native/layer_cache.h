@@ -0,0 +1,61 @@
+/**
+ * @file layer_cache.h
+ * @brief Library-internal interface to the persistent per-layer cache.
+ *
+ * Not part of the FFI surface; see layer_cache.c for the on-disk format
+ * and eviction. A job opens the cache with vs_layer_cache_open() and passes
+ * the handle to its batches.
+ */
+#ifndef VOXELSHIFT_LAYER_CACHE_H
+#define VOXELSHIFT_LAYER_CACHE_H
+
+#include "voxelshift_native.h"
+
+#include <stdint.h>
+
+/// Output settings a finished layer was produced with. Layers are only
+/// reused under an identical profile; keep it free of padding, it is
+/// compared and hashed bytewise.
+typedef struct VsLayerProfile {
+  int32_t src_width;
+  int32_t height;
+  int32_t out_width;
+  int32_t channels;
+  int32_t level;
+  int32_t window_bits;
+  int32_t mem_level;
+  int32_t strategy;
+  int32_t area_mode;
+  int32_t encoder;   // also keeps the doubles aligned without padding
+  double x_pixel_size_mm;
+  double y_pixel_size_mm;
+} VsLayerProfile;
+
+/// One job's view of a cache directory (vs_layer_cache_open). Every
+/// function taking one treats NULL as no cache.
+typedef struct VsLayerCache VsLayerCache;
+
+/// Look up the layer whose decrypted input hashes to [hash] (see
+/// hash_layer_rle). On a hit the PNG is returned as a malloc'd copy, the
+/// entry is marked recently used and 1 is returned.
+int vs_layer_cache_lookup(
+    VsLayerCache* cache,
+    const VsLayerProfile* profile,
+    const uint64_t* hash,
+    int32_t input_len,
+    uint8_t** out_png,
+    int32_t* out_png_len,
+    AreaStatsResult* out_area);
+
+/// Store a finished layer, evicting least recently used entries when the
+/// cache grows past its size limit. Best effort: I/O errors are ignored.
+void vs_layer_cache_store(
+    VsLayerCache* cache,
+    const VsLayerProfile* profile,
+    const uint64_t* hash,
+    int32_t input_len,
+    const uint8_t* png,
+    int32_t png_len,
+    const AreaStatsResult* area);
+
+#endif // VOXELSHIFT_LAYER_CACHE_H
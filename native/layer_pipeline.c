@@ -7,8 +7,14 @@
  * scanline construction, zlib compression, and PNG wrapping.
  */
 #include "voxelshift_native.h"
+#include "compress_plan.h"
+#include "layer_cache.h"
+#include "mask_deflate.h"
+#include "worker_pool.h"
+#include "zlib_stream.h"
 
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -19,13 +25,17 @@ static void vs_mutex_init(vs_mutex* m) { InitializeCriticalSection(m); }
 static void vs_mutex_lock(vs_mutex* m) { EnterCriticalSection(m); }
 static void vs_mutex_unlock(vs_mutex* m) { LeaveCriticalSection(m); }
 static void vs_mutex_destroy(vs_mutex* m) { DeleteCriticalSection(m); }
+typedef CONDITION_VARIABLE vs_cond;
+static void vs_cond_init(vs_cond* c) { InitializeConditionVariable(c); }
+static void vs_cond_wait(vs_cond* c, vs_mutex* m) { SleepConditionVariableCS(c, m, INFINITE); }
+static void vs_cond_broadcast(vs_cond* c) { WakeAllConditionVariable(c); }
+static void vs_cond_destroy(vs_cond* c) { (void)c; }
 static int32_t _cpu_threads(void) {
   DWORD n = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
   if (n == 0) n = 1;
   return (int32_t)n;
 }
 #else
-#include <dlfcn.h>
 #include <pthread.h>
 #include <time.h>
 #include <unistd.h>
@@ -34,18 +44,18 @@ static void vs_mutex_init(vs_mutex* m) { pthread_mutex_init(m, NULL); }
 static void vs_mutex_lock(vs_mutex* m) { pthread_mutex_lock(m); }
 static void vs_mutex_unlock(vs_mutex* m) { pthread_mutex_unlock(m); }
 static void vs_mutex_destroy(vs_mutex* m) { pthread_mutex_destroy(m); }
+typedef pthread_cond_t vs_cond;
+static void vs_cond_init(vs_cond* c) { pthread_cond_init(c, NULL); }
+static void vs_cond_wait(vs_cond* c, vs_mutex* m) { pthread_cond_wait(c, m); }
+static void vs_cond_broadcast(vs_cond* c) { pthread_cond_broadcast(c); }
+static void vs_cond_destroy(vs_cond* c) { pthread_cond_destroy(c); }
 static int32_t _cpu_threads(void) {
   long n = sysconf(_SC_NPROCESSORS_ONLN);
   if (n < 1) n = 1;
   return (int32_t)n;
 }
-typedef void* vs_lib_handle;
-static vs_lib_handle vs_dlopen(const char* name) { return dlopen(name, RTLD_LAZY); }
-static void* vs_dlsym(vs_lib_handle h, const char* sym) { return dlsym(h, sym); }
 #endif
 
-typedef int (*compress2_fn)(unsigned char*, unsigned long*, const unsigned char*, unsigned long, int);
-
 int gpu_opencl_build_scanlines(
   const uint8_t* grey_pixels,
   int32_t src_width,
@@ -85,19 +95,14 @@ int32_t gpu_cuda_tensor_max_concurrent_layers(
     int32_t src_width, int32_t height,
     int32_t out_width, int32_t channels);
 
-typedef struct ZlibApi {
-  int loaded;
-  int available;
-  compress2_fn compress2_ptr;
-} ZlibApi;
-
-static ZlibApi g_zlib = {0, 0, NULL};
 static int32_t g_process_layers_batch_threads = 0;
 static int32_t g_last_process_layers_backend = 0; // 0 CPU, 1 OpenCL, 2 Metal, 3 CUDA/Tensor
 static int32_t g_last_process_layers_gpu_attempts = 0;
 static int32_t g_last_process_layers_gpu_successes = 0;
 static int32_t g_last_process_layers_gpu_fallbacks = 0;
 static int32_t g_last_process_layers_cuda_error = 0;
+static int32_t g_last_process_layers_dedup_hits = 0;
+static int32_t g_last_process_layers_cache_hits = 0;
 static int32_t g_process_layers_analytics_enabled = 0;
 static int32_t g_last_process_layers_thread_count = 0;
 
@@ -113,6 +118,12 @@ typedef struct ProcessThreadMetrics {
 static ProcessThreadMetrics* g_last_thread_metrics = NULL;
 static int32_t g_last_thread_capacity = 0;
 
+// Per-layer cost model samples (analytics only): predicted cost is the
+// layer's encoded input size, actual is its measured processing time.
+static int64_t* g_last_cost_predicted = NULL;
+static int64_t* g_last_cost_actual_ns = NULL;
+static int32_t g_last_cost_count = 0;
+
 #ifdef _WIN32
 static uint64_t _now_ns(void) {
   static LARGE_INTEGER freq;
@@ -177,6 +188,23 @@ void process_layers_last_thread_stats(
   }
 }
 
+int32_t process_layers_last_cost_count(void) {
+  return g_last_cost_count;
+}
+
+void process_layers_last_cost_samples(
+    int64_t* out_predicted,
+    int64_t* out_actual_ns,
+    int32_t max_count) {
+  if (!out_predicted || !out_actual_ns || max_count <= 0) return;
+  if (!g_last_cost_predicted || !g_last_cost_actual_ns) return;
+  const int32_t n = g_last_cost_count < max_count ? g_last_cost_count : max_count;
+  for (int32_t i = 0; i < n; i++) {
+    out_predicted[i] = g_last_cost_predicted[i];
+    out_actual_ns[i] = g_last_cost_actual_ns[i];
+  }
+}
+
 /**
  * @brief Backend used by the most recent batch call.
  */
@@ -212,36 +240,18 @@ int32_t process_layers_last_cuda_error(void) {
   return g_last_process_layers_cuda_error;
 }
 
-static void _init_zlib(void) {
-  if (g_zlib.loaded) return;
-  g_zlib.loaded = 1;
-
-  const char* candidates[] = {
-#ifdef _WIN32
-      "zlib1.dll", "zlib.dll",
-#elif __APPLE__
-      "libz.1.dylib", "libz.dylib",
-#else
-      "libz.so.1", "libz.so",
-#endif
-  };
+/**
+ * @brief Layers of the last batch reused from an identical layer.
+ */
+int32_t process_layers_last_dedup_hits(void) {
+  return g_last_process_layers_dedup_hits;
+}
 
-  for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
-#ifdef _WIN32
-    HMODULE h = LoadLibraryA(candidates[i]);
-    if (!h) continue;
-    compress2_fn c2 = (compress2_fn)GetProcAddress(h, "compress2");
-#else
-    vs_lib_handle h = vs_dlopen(candidates[i]);
-    if (!h) continue;
-    compress2_fn c2 = (compress2_fn)vs_dlsym(h, "compress2");
-#endif
-    if (c2) {
-      g_zlib.compress2_ptr = c2;
-      g_zlib.available = 1;
-      return;
-    }
-  }
+/**
+ * @brief Layers of the last batch read back from the layer cache.
+ */
+int32_t process_layers_last_cache_hits(void) {
+  return g_last_process_layers_cache_hits;
 }
 
 static uint32_t _crc32_table[256];
@@ -287,16 +297,17 @@ static void _write_u32_be(uint8_t* p, uint32_t v) {
   p[3] = (uint8_t)(v & 0xFFu);
 }
 
+#define VS_PNG_HEADER_LEN 33  // signature + IHDR chunk
+#define VS_PNG_TRAILER_LEN 16 // IDAT CRC + IEND chunk
+
 /**
- * @brief Build a full PNG file from an IDAT payload.
+ * @brief Write the PNG signature and IHDR chunk; returns bytes written.
  */
-static uint8_t* _build_png_from_idat(
+static size_t _write_png_header(
+    uint8_t* out,
     int32_t width,
     int32_t height,
-    int32_t channels,
-    const uint8_t* idat,
-    size_t idat_len,
-    int32_t* out_png_len) {
+    int32_t channels) {
   const uint8_t sig[8] = {0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A};
   const uint8_t color_type = channels == 3 ? 2 : 0;
 
@@ -309,10 +320,6 @@ static uint8_t* _build_png_from_idat(
   ihdr[11] = 0;
   ihdr[12] = 0;
 
-  const size_t out_size = 8 + (12 + 13) + (12 + idat_len) + 12;
-  uint8_t* out = (uint8_t*)malloc(out_size);
-  if (!out) return NULL;
-
   size_t w = 0;
   memcpy(out + w, sig, 8); w += 8;
 
@@ -324,14 +331,21 @@ static uint8_t* _build_png_from_idat(
     _write_u32_be(out + w, _crc32_type_and_data(t, ihdr, 13));
     w += 4;
   }
+  return w;
+}
 
+/**
+ * @brief Close an IDAT chunk whose payload sits at out + VS_PNG_HEADER_LEN + 8
+ * and append IEND; returns the total PNG length.
+ */
+static size_t _finish_png_idat(uint8_t* out, size_t idat_len) {
+  size_t w = VS_PNG_HEADER_LEN;
   _write_u32_be(out + w, (uint32_t)idat_len); w += 4;
   out[w++] = 'I'; out[w++] = 'D'; out[w++] = 'A'; out[w++] = 'T';
-  memcpy(out + w, idat, idat_len); w += idat_len;
   {
     const uint8_t t[4] = {'I','D','A','T'};
-    _write_u32_be(out + w, _crc32_type_and_data(t, idat, idat_len));
-    w += 4;
+    _write_u32_be(out + w + idat_len, _crc32_type_and_data(t, out + w, idat_len));
+    w += idat_len + 4;
   }
 
   _write_u32_be(out + w, 0); w += 4;
@@ -341,11 +355,683 @@ static uint8_t* _build_png_from_idat(
     _write_u32_be(out + w, _crc32_bytes(t, 4));
     w += 4;
   }
+  return w;
+}
 
-  *out_png_len = (int32_t)w;
+/**
+ * @brief Build a full PNG file from an IDAT payload.
+ */
+static uint8_t* _build_png_from_idat(
+    int32_t width,
+    int32_t height,
+    int32_t channels,
+    const uint8_t* idat,
+    size_t idat_len,
+    int32_t* out_png_len) {
+  const size_t out_size = VS_PNG_HEADER_LEN + 8 + idat_len + VS_PNG_TRAILER_LEN;
+  uint8_t* out = (uint8_t*)malloc(out_size);
+  if (!out) return NULL;
+
+  _write_png_header(out, width, height, channels);
+  memcpy(out + VS_PNG_HEADER_LEN + 8, idat, idat_len);
+  *out_png_len = (int32_t)_finish_png_idat(out, idat_len);
   return out;
 }
 
+#define VS_ZERO_UNIT_COUNT 9  // pre-deflated blocks of 1, 2, 4 ... 256 zero rows
+
+/// Deflated all-zero scanlines for one output geometry and stream setup.
+///
+/// Each unit is a raw deflate stream for 2^k Up-filtered zero rows, ended
+/// with a sync flush: it is byte-aligned, not final and has no back
+/// references, so units can be spliced between other deflate blocks.
+typedef struct ZeroRowCache {
+  int32_t out_width;
+  int32_t channels;
+  int32_t height;
+  VsDeflateParams params;
+  int32_t refs;                       // batches using it; guarded by g_layer_cache_lock
+  uint8_t* units[VS_ZERO_UNIT_COUNT];
+  size_t unit_lens[VS_ZERO_UNIT_COUNT];
+  uint8_t* blank_png;                 // PNG of a layer with no lit pixels
+  int32_t blank_png_len;
+} ZeroRowCache;
+
+// Cache for the most recent profile. A replaced cache is freed by the last
+// batch that still holds it.
+static ZeroRowCache* g_zero_rows = NULL;
+static vs_mutex g_layer_cache_lock;  // guards the zero-row and dedup caches
+
+#ifdef _WIN32
+static INIT_ONCE g_layer_cache_once = INIT_ONCE_STATIC_INIT;
+static BOOL CALLBACK _layer_cache_init_once(PINIT_ONCE once, PVOID param, PVOID* ctx) {
+  (void)once; (void)param; (void)ctx;
+  vs_mutex_init(&g_layer_cache_lock);
+  return TRUE;
+}
+static void _layer_cache_init(void) {
+  InitOnceExecuteOnce(&g_layer_cache_once, _layer_cache_init_once, NULL, NULL);
+}
+#else
+static pthread_once_t g_layer_cache_once = PTHREAD_ONCE_INIT;
+static void _layer_cache_init_once(void) {
+  vs_mutex_init(&g_layer_cache_lock);
+}
+static void _layer_cache_init(void) {
+  pthread_once(&g_layer_cache_once, _layer_cache_init_once);
+}
+#endif
+
+/**
+ * @brief Append bytes to a PNG under construction, keeping room for the
+ * trailer. Returns 0 on allocation failure.
+ */
+static int _png_out_append(
+    uint8_t** out,
+    size_t* cap,
+    size_t* used,
+    const uint8_t* data,
+    size_t len) {
+  size_t want = *cap;
+  while (want - *used - VS_PNG_TRAILER_LEN < len) want *= 2;
+  if (want != *cap) {
+    uint8_t* grown = (uint8_t*)realloc(*out, want);
+    if (!grown) return 0;
+    *out = grown;
+    *cap = want;
+  }
+  memcpy(*out + *used, data, len);
+  *used += len;
+  return 1;
+}
+
+/**
+ * @brief Append the deflated form of [rows] zero scanlines from [zero].
+ */
+static int _png_out_zero_rows(
+    const ZeroRowCache* zero,
+    uint8_t** out,
+    size_t* cap,
+    size_t* used,
+    int32_t rows) {
+  const int32_t top_unit = VS_ZERO_UNIT_COUNT - 1;
+  for (; rows >= (1 << top_unit); rows -= 1 << top_unit) {
+    if (!_png_out_append(out, cap, used, zero->units[top_unit],
+                         zero->unit_lens[top_unit])) {
+      return 0;
+    }
+  }
+  for (int32_t k = top_unit - 1; k >= 0; k--) {
+    if ((rows & (1 << k)) &&
+        !_png_out_append(out, cap, used, zero->units[k], zero->unit_lens[k])) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @brief _deflate_rows_to_png for the built-in encoder.
+ *
+ * Rows outside [top, bottom) are handed to the encoder as zero rows, which
+ * it merges into long matches itself, so no cached units are spliced.
+ */
+static uint8_t* _mask_rows_to_png(
+    const uint8_t* pixels,
+    int32_t src_width,
+    int32_t height,
+    int32_t out_width,
+    int32_t channels,
+    const VsDeflateParams* params,
+    VsMaskDeflater* md,
+    int32_t top,
+    int32_t bottom,
+    uint8_t* rows,
+    size_t size_hint,
+    int32_t* out_png_len) {
+  const int32_t bytes_per_row = out_width * channels;
+  const int32_t scanline_size = 1 + bytes_per_row;
+  const size_t payload_at = VS_PNG_HEADER_LEN + 8;
+  size_t cap = size_hint;
+  if (cap < payload_at + VS_PNG_TRAILER_LEN + 4096) {
+    cap = payload_at + VS_PNG_TRAILER_LEN + 4096;
+  }
+  uint8_t* out = (uint8_t*)malloc(cap);
+  if (!out) return NULL;
+  _write_png_header(out, out_width, height, channels);
+  const uint16_t header = vs_zlib_header(params);
+  out[payload_at] = (uint8_t)(header >> 8);
+  out[payload_at + 1] = (uint8_t)(header & 0xFFu);
+
+  VsMaskDeflater local;
+  memset(&local, 0, sizeof(local));
+  VsMaskDeflater* e = md ? md : &local;
+  if (!vs_mask_deflate_begin(e, scanline_size, params->window_bits, out, cap,
+                             payload_at + 2, VS_PNG_TRAILER_LEN, 1)) {
+    free(out);
+    vs_mask_deflater_free(&local);
+    return NULL;
+  }
+  int ok = vs_mask_deflate_zero_rows(e, top);
+  uint8_t* ring[2] = {rows, rows + bytes_per_row};
+  uint8_t* scanline = rows + 2 * bytes_per_row;
+  for (int32_t y = top; y < bottom && ok; y++) {
+    build_png_scanline_row(
+        pixels + (size_t)y * src_width,
+        src_width,
+        out_width,
+        channels,
+        y > top ? ring[(y - 1) & 1] : NULL,
+        ring[y & 1],
+        scanline);
+    ok = vs_mask_deflate_row(e, scanline);
+  }
+  ok = ok && vs_mask_deflate_zero_rows(e, height - bottom) &&
+       vs_mask_deflate_finish(e);
+  // The encoder may have grown the buffer.
+  out = e->out;
+  cap = e->cap;
+  const size_t idat_len = e->used - payload_at;
+  e->out = NULL;
+  vs_mask_deflater_free(&local);
+  if (!ok) {
+    free(out);
+    return NULL;
+  }
+
+  const size_t png_len = _finish_png_idat(out, idat_len);
+  if (cap - png_len > (cap >> 2)) {
+    uint8_t* shrunk = (uint8_t*)realloc(out, png_len);
+    if (shrunk) out = shrunk;
+  }
+  *out_png_len = (int32_t)png_len;
+  return out;
+}
+
+/**
+ * @brief Encode a decoded layer straight to PNG, one scanline at a time.
+ *
+ * Each source row is packed and Up-filtered against the previous packed row
+ * (a two-row ring in [rows]) and fed to the warm raw deflate stream [d],
+ * which deflates directly into the PNG's IDAT payload, so no full-frame
+ * scanline or compressed buffer is needed. The zlib header and Adler-32 are
+ * written here around it. [rows] holds 3 * bytes_per_row + 1 bytes.
+ * [size_hint] is the initial output capacity; the buffer doubles when
+ * deflate runs out of room.
+ *
+ * With a [zero] cache only rows [top, bottom) are packed and deflated; the
+ * all-zero rows around them are spliced in from the cache. Row [bottom] - 1
+ * must be the row after the last lit one when that exists, as its Up filter
+ * still sees the lit row. top == bottom encodes a blank layer.
+ * The built-in encoder uses [md] (or a temporary one when NULL) instead of
+ * [d]. With [threads] > 1 a large enough band is packed whole and deflated
+ * in parallel bands instead (vs_deflate_split). Returns NULL on failure.
+ */
+static uint8_t* _deflate_rows_to_png(
+    const uint8_t* pixels,
+    int32_t src_width,
+    int32_t height,
+    int32_t out_width,
+    int32_t channels,
+    const VsDeflateParams* params,
+    VsDeflater* d,
+    VsMaskDeflater* md,
+    const ZeroRowCache* zero,
+    int32_t top,
+    int32_t bottom,
+    uint8_t* rows,
+    size_t size_hint,
+    int32_t threads,
+    int32_t* out_png_len) {
+  const int32_t bytes_per_row = out_width * channels;
+  const int32_t scanline_size = 1 + bytes_per_row;
+  const size_t payload_at = VS_PNG_HEADER_LEN + 8;
+  const int banded = zero != NULL && (top > 0 || bottom < height);
+  if (!banded) {
+    top = 0;
+    bottom = height;
+  }
+  if (params->encoder == VS_DEFLATE_ENCODER_BUILTIN) {
+    return _mask_rows_to_png(pixels, src_width, height, out_width, channels,
+                             params, md, top, bottom, rows, size_hint,
+                             out_png_len);
+  }
+  size_t cap = size_hint;
+  if (cap < payload_at + VS_PNG_TRAILER_LEN + 4096) {
+    cap = payload_at + VS_PNG_TRAILER_LEN + 4096;
+  }
+  uint8_t* out = (uint8_t*)malloc(cap);
+  if (!out) return NULL;
+  _write_png_header(out, out_width, height, channels);
+
+  size_t used = payload_at;
+  uint32_t adler = 1;
+  const uint16_t header = vs_zlib_header(params);
+  out[used++] = (uint8_t)(header >> 8);
+  out[used++] = (uint8_t)(header & 0xFFu);
+  int ok = 1;
+  if (banded) {
+    ok = _png_out_zero_rows(zero, &out, &cap, &used, top);
+    adler = vs_adler32_zero_rows(adler, scanline_size, top);
+  }
+
+  const size_t band_len = (size_t)(bottom - top) * (size_t)scanline_size;
+  const int32_t bands = vs_deflate_split_bands(params, band_len, threads);
+  if (ok && top < bottom && bands > 1) {
+    uint8_t* band = (uint8_t*)malloc(band_len);
+    if (!band) {
+      free(out);
+      return NULL;
+    }
+    uint8_t* ring[2] = {rows, rows + bytes_per_row};
+    for (int32_t y = top; y < bottom; y++) {
+      build_png_scanline_row(
+          pixels + (size_t)y * src_width,
+          src_width,
+          out_width,
+          channels,
+          y > top ? ring[(y - 1) & 1] : NULL,
+          ring[y & 1],
+          band + (size_t)(y - top) * (size_t)scanline_size);
+    }
+    ok = vs_deflate_split(params, band, band_len, (size_t)scanline_size, bands,
+                          bottom == height, &out, &cap, &used,
+                          VS_PNG_TRAILER_LEN, &adler);
+    free(band);
+  } else if (ok && top < bottom) {
+    if (!vs_deflater_begin(d, params)) {
+      free(out);
+      return NULL;
+    }
+    vs_deflater_set_output(d, out + used, cap - used - VS_PNG_TRAILER_LEN);
+
+    uint8_t* ring[2] = {rows, rows + bytes_per_row};
+    uint8_t* scanline = rows + 2 * bytes_per_row;
+    for (int32_t y = top; y < bottom && ok; y++) {
+      build_png_scanline_row(
+          pixels + (size_t)y * src_width,
+          src_width,
+          out_width,
+          channels,
+          y > top ? ring[(y - 1) & 1] : NULL,
+          ring[y & 1],
+          scanline);
+      adler = vs_zlib_adler32(adler, scanline, (size_t)scanline_size);
+      // A band that stops short of the last row leaves the stream open and
+      // byte-aligned for the trailing zero rows.
+      const int flush = y < bottom - 1 ? VS_Z_NO_FLUSH
+                        : bottom == height ? VS_Z_FINISH
+                                           : VS_Z_SYNC_FLUSH;
+      ok = vs_deflater_feed(d, scanline, (size_t)scanline_size, flush,
+                            &out, &cap, VS_PNG_TRAILER_LEN);
+    }
+    used = (size_t)(vs_deflater_next_out(d) - out);
+  }
+
+  if (ok && banded && (top == bottom || bottom < height)) {
+    // Empty final stored block.
+    static const uint8_t final_block[5] = {0x01, 0x00, 0x00, 0xFF, 0xFF};
+    ok = _png_out_zero_rows(zero, &out, &cap, &used, height - bottom) &&
+         _png_out_append(&out, &cap, &used, final_block, sizeof(final_block));
+    adler = vs_adler32_zero_rows(adler, scanline_size, height - bottom);
+  }
+  uint8_t trailer[4];
+  _write_u32_be(trailer, adler);
+  ok = ok && _png_out_append(&out, &cap, &used, trailer, sizeof(trailer));
+
+  const size_t idat_len = used - payload_at;
+  if (!ok) {
+    free(out);
+    return NULL;
+  }
+
+  const size_t png_len = _finish_png_idat(out, idat_len);
+  if (cap - png_len > (cap >> 2)) {
+    uint8_t* shrunk = (uint8_t*)realloc(out, png_len);
+    if (shrunk) out = shrunk;
+  }
+  *out_png_len = (int32_t)png_len;
+  return out;
+}
+
+/**
+ * @brief Deflate a full-frame scanline buffer as a zlib stream.
+ *
+ * Uses the built-in encoder [md] when selected, else the worker's warm
+ * deflater [d], split over [threads] when the layer is large enough; zlib
+ * builds without the stream API fall back to compress2. Returns 0 on
+ * failure.
+ */
+static int _deflate_scanlines(
+    VsDeflater* d,
+    VsMaskDeflater* md,
+    const VsDeflateParams* params,
+    int32_t scanline_size,
+    const uint8_t* scanlines,
+    size_t len,
+    int32_t threads,
+    uint8_t* out,
+    size_t cap,
+    size_t* out_len) {
+  if (params->encoder == VS_DEFLATE_ENCODER_BUILTIN) {
+    return vs_mask_deflate_zlib(md, scanlines, len, scanline_size,
+                                params->window_bits, vs_zlib_header(params),
+                                out, cap, out_len);
+  }
+  const int32_t bands = vs_deflate_split_bands(params, len, threads);
+  if (bands > 1) {
+    size_t split_cap = len / 4 + 4096;
+    uint8_t* split = (uint8_t*)malloc(split_cap);
+    if (!split) return 0;
+    const uint16_t header = vs_zlib_header(params);
+    split[0] = (uint8_t)(header >> 8);
+    split[1] = (uint8_t)(header & 0xFFu);
+    size_t used = 2;
+    uint32_t adler = 1;
+    int ok = vs_deflate_split(params, scanlines, len, (size_t)scanline_size,
+                              bands, 1, &split, &split_cap, &used, 4, &adler);
+    ok = ok && used + 4 <= cap;
+    if (ok) {
+      _write_u32_be(split + used, adler);
+      memcpy(out, split, used + 4);
+      *out_len = used + 4;
+    }
+    free(split);
+    return ok;
+  }
+  if (vs_deflate_available(params)) {
+    return vs_deflate_zlib(d, params, scanlines, len, out, cap, out_len);
+  }
+  const VsZlib* z = vs_zlib();
+  unsigned long comp_len = (unsigned long)cap;
+  if (z->compress2(out, &comp_len, scanlines, (unsigned long)len,
+                   params->level) != 0 || comp_len == 0) {
+    return 0;
+  }
+  *out_len = (size_t)comp_len;
+  return 1;
+}
+
+static void _zero_rows_free(ZeroRowCache* c) {
+  if (!c) return;
+  for (int32_t k = 0; k < VS_ZERO_UNIT_COUNT; k++) free(c->units[k]);
+  free(c->blank_png);
+  free(c);
+}
+
+/**
+ * @brief Deflate [rows] zero scanlines into a standalone, sync-flushed unit.
+ */
+static uint8_t* _deflate_zero_unit(
+    const uint8_t* zero_scanline,
+    int32_t scanline_size,
+    int32_t rows,
+    VsDeflater* d,
+    const VsDeflateParams* params,
+    size_t* out_len) {
+  size_t cap = (size_t)rows * (size_t)(scanline_size / 128 + 16) + 256;
+  uint8_t* out = (uint8_t*)malloc(cap);
+  if (!out) return NULL;
+
+  if (!vs_deflater_begin(d, params)) {
+    free(out);
+    return NULL;
+  }
+  vs_deflater_set_output(d, out, cap);
+  int ok = 1;
+  for (int32_t y = 0; y < rows && ok; y++) {
+    ok = vs_deflater_feed(d, zero_scanline, (size_t)scanline_size,
+                          y < rows - 1 ? VS_Z_NO_FLUSH : VS_Z_SYNC_FLUSH,
+                          &out, &cap, 0);
+  }
+  *out_len = (size_t)(vs_deflater_next_out(d) - out);
+  if (!ok) {
+    free(out);
+    return NULL;
+  }
+  return out;
+}
+
+static ZeroRowCache* _zero_rows_build(
+    int32_t out_width,
+    int32_t channels,
+    int32_t height,
+    const VsDeflateParams* params) {
+  ZeroRowCache* c = (ZeroRowCache*)calloc(1, sizeof(ZeroRowCache));
+  const int32_t scanline_size = 1 + out_width * channels;
+  uint8_t* zero_scanline = (uint8_t*)calloc(1, (size_t)scanline_size);
+  if (!c || !zero_scanline) {
+    free(c);
+    free(zero_scanline);
+    return NULL;
+  }
+  c->out_width = out_width;
+  c->channels = channels;
+  c->height = height;
+  c->params = *params;
+  zero_scanline[0] = 2;  // Up filter type
+
+  // Units must use the batch's window size: the zlib header written around
+  // the spliced stream declares it. libdeflate cannot stream, so its blank
+  // PNG is spliced from units a streaming backend writes. The built-in
+  // encoder needs none.
+  VsDeflater d;
+  memset(&d, 0, sizeof(d));
+  VsDeflateParams unit_params;
+  int ok = 1;
+  const int units = params->encoder != VS_DEFLATE_ENCODER_BUILTIN;
+  if (units) ok = vs_deflate_stream_params(params, &unit_params);
+  for (int32_t k = 0; k < VS_ZERO_UNIT_COUNT && ok && units; k++) {
+    c->units[k] = _deflate_zero_unit(zero_scanline, scanline_size, 1 << k,
+                                     &d, &unit_params, &c->unit_lens[k]);
+    ok = c->units[k] != NULL;
+  }
+  vs_deflater_end(&d);
+  free(zero_scanline);
+  if (ok) {
+    c->blank_png = _deflate_rows_to_png(
+        NULL, 0, height, out_width, channels, params, NULL, NULL, c, height,
+        height, NULL, 0, 1, &c->blank_png_len);
+    ok = c->blank_png != NULL;
+  }
+  if (!ok) {
+    _zero_rows_free(c);
+    return NULL;
+  }
+  return c;
+}
+
+/**
+ * @brief Get the zero-row cache for a batch's output profile.
+ *
+ * Built on first use of a profile and shared by concurrent batches.
+ * Returns NULL (fast paths off) when no streaming backend is loaded and
+ * the built-in encoder is not selected, or on allocation failure. Pair
+ * with _zero_rows_release.
+ */
+static ZeroRowCache* _zero_rows_acquire(
+    int32_t out_width,
+    int32_t channels,
+    int32_t height,
+    const VsDeflateParams* params) {
+  VsDeflateParams unit_params;
+  if (params->encoder != VS_DEFLATE_ENCODER_BUILTIN &&
+      !vs_deflate_stream_params(params, &unit_params)) {
+    return NULL;
+  }
+  _layer_cache_init();
+  vs_mutex_lock(&g_layer_cache_lock);
+  ZeroRowCache* c = g_zero_rows;
+  if (!c || c->out_width != out_width || c->channels != channels ||
+      c->height != height ||
+      memcmp(&c->params, params, sizeof(VsDeflateParams)) != 0) {
+    c = _zero_rows_build(out_width, channels, height, params);
+    if (c) {
+      if (g_zero_rows && g_zero_rows->refs == 0) _zero_rows_free(g_zero_rows);
+      g_zero_rows = c;
+    }
+  }
+  if (c) c->refs += 1;
+  vs_mutex_unlock(&g_layer_cache_lock);
+  return c;
+}
+
+static void _zero_rows_release(ZeroRowCache* c) {
+  if (!c) return;
+  vs_mutex_lock(&g_layer_cache_lock);
+  if (--c->refs == 0 && c != g_zero_rows) _zero_rows_free(c);
+  vs_mutex_unlock(&g_layer_cache_lock);
+}
+
+#define VS_DEDUP_CARRY 4  // distinct layers a batch hands on to the next one
+
+/// A finished layer from the end of a batch, keyed by its input hash and
+/// confirmed against a copy of its input.
+typedef struct DedupEntry {
+  uint64_t hash[2];
+  int32_t input_len;
+  uint8_t* input;             // RLE payload as read, for layer_rle_equal
+  int32_t layer_index;
+  int32_t encryption_key;
+  uint8_t* png;
+  int32_t png_len;
+  AreaStatsResult area;
+} DedupEntry;
+
+// Runs of identical layers usually straddle batch boundaries, so the last
+// few distinct layers of each batch are kept for the next one. Guarded by
+// g_layer_cache_lock; cleared when the profile changes.
+static VsLayerProfile g_dedup_profile;
+static DedupEntry g_dedup_carry[VS_DEDUP_CARRY];
+static int32_t g_dedup_next = 0;
+
+static void _dedup_carry_clear_locked(void) {
+  for (int32_t k = 0; k < VS_DEDUP_CARRY; k++) {
+    free(g_dedup_carry[k].input);
+    free(g_dedup_carry[k].png);
+    memset(&g_dedup_carry[k], 0, sizeof(DedupEntry));
+  }
+  g_dedup_next = 0;
+}
+
+/// Whether carried-over [e] holds the layer with [hash] and payload [input].
+static int _dedup_entry_matches(
+    const DedupEntry* e,
+    const uint64_t* hash,
+    const uint8_t* input,
+    int32_t input_len,
+    int32_t layer_index,
+    int32_t encryption_key) {
+  return e->png && e->input_len == input_len &&
+         e->hash[0] == hash[0] && e->hash[1] == hash[1] &&
+         layer_rle_equal(e->input, e->layer_index, e->encryption_key,
+                         input, layer_index, encryption_key, input_len);
+}
+
+/**
+ * @brief Copy out a carried-over layer matching [hash] whose input is
+ * byte-identical to [input]; returns 1 on a hit.
+ */
+static int _dedup_carry_lookup(
+    const VsLayerProfile* profile,
+    const uint64_t* hash,
+    const uint8_t* input,
+    int32_t input_len,
+    int32_t layer_index,
+    int32_t encryption_key,
+    uint8_t** out_png,
+    int32_t* out_png_len,
+    AreaStatsResult* out_area) {
+  int hit = 0;
+  _layer_cache_init();
+  vs_mutex_lock(&g_layer_cache_lock);
+  if (memcmp(profile, &g_dedup_profile, sizeof(VsLayerProfile)) == 0) {
+    for (int32_t k = 0; k < VS_DEDUP_CARRY && !hit; k++) {
+      const DedupEntry* e = &g_dedup_carry[k];
+      if (!_dedup_entry_matches(e, hash, input, input_len, layer_index,
+                                encryption_key)) {
+        continue;
+      }
+      uint8_t* png = (uint8_t*)malloc((size_t)e->png_len);
+      if (!png) break;
+      memcpy(png, e->png, (size_t)e->png_len);
+      *out_png = png;
+      *out_png_len = e->png_len;
+      *out_area = e->area;
+      hit = 1;
+    }
+  }
+  vs_mutex_unlock(&g_layer_cache_lock);
+  return hit;
+}
+
+/**
+ * @brief Keep a copy of a finished layer for the next batch.
+ *
+ * Best effort: allocation failure just leaves the layer out.
+ */
+static void _dedup_carry_store(
+    const VsLayerProfile* profile,
+    const uint64_t* hash,
+    const uint8_t* input,
+    int32_t input_len,
+    int32_t layer_index,
+    int32_t encryption_key,
+    const uint8_t* png,
+    int32_t png_len,
+    const AreaStatsResult* area) {
+  _layer_cache_init();
+  vs_mutex_lock(&g_layer_cache_lock);
+  if (memcmp(profile, &g_dedup_profile, sizeof(VsLayerProfile)) != 0) {
+    _dedup_carry_clear_locked();
+    g_dedup_profile = *profile;
+  }
+  int known = 0;
+  for (int32_t k = 0; k < VS_DEDUP_CARRY && !known; k++) {
+    known = _dedup_entry_matches(&g_dedup_carry[k], hash, input, input_len,
+                                 layer_index, encryption_key);
+  }
+  uint8_t* copy = known ? NULL : (uint8_t*)malloc((size_t)png_len);
+  uint8_t* input_copy = copy ? (uint8_t*)malloc((size_t)input_len) : NULL;
+  if (copy && !input_copy) {
+    free(copy);
+    copy = NULL;
+  }
+  if (copy) {
+    DedupEntry* e = &g_dedup_carry[g_dedup_next];
+    free(e->input);
+    free(e->png);
+    memcpy(copy, png, (size_t)png_len);
+    memcpy(input_copy, input, (size_t)input_len);
+    e->hash[0] = hash[0];
+    e->hash[1] = hash[1];
+    e->input_len = input_len;
+    e->input = input_copy;
+    e->layer_index = layer_index;
+    e->encryption_key = encryption_key;
+    e->png = copy;
+    e->png_len = png_len;
+    e->area = *area;
+    g_dedup_next = (g_dedup_next + 1) % VS_DEDUP_CARRY;
+  }
+  vs_mutex_unlock(&g_layer_cache_lock);
+}
+
+/**
+ * @brief Drop the carried-over layers and an idle zero-row cache.
+ */
+void process_layers_release_caches(void) {
+  _layer_cache_init();
+  vs_mutex_lock(&g_layer_cache_lock);
+  _dedup_carry_clear_locked();
+  memset(&g_dedup_profile, 0, sizeof(g_dedup_profile));
+  if (g_zero_rows && g_zero_rows->refs == 0) {
+    _zero_rows_free(g_zero_rows);
+    g_zero_rows = NULL;
+  }
+  vs_mutex_unlock(&g_layer_cache_lock);
+}
+
 /**
  * @brief Build scanlines using GPU when available, otherwise CPU.
  *
@@ -415,6 +1101,55 @@ static int _build_scanlines_auto(
       scanlines_len);
 }
 
+/**
+ * @brief Area stats for one decoded layer at [area_mode].
+ *
+ * Full mode labels islands on the pixels. The cheaper modes only depend on
+ * where the lit runs are, so they come from the RLE stream at O(runs)
+ * instead of another pass over the frame; the result is the same as
+ * compute_layer_area_stats_mode on the decoded pixels. [known] is an
+ * analyze_layer_rle result the caller already has, or NULL.
+ */
+static int _layer_area_stats(
+    const uint8_t* rle,
+    int32_t rle_len,
+    int32_t layer_index,
+    int32_t encryption_key,
+    const uint8_t* pixels,
+    int32_t width,
+    int32_t height,
+    double x_pixel_size_mm,
+    double y_pixel_size_mm,
+    int32_t area_mode,
+    int32_t threads,
+    const RleLayerStats* known,
+    AreaStatsResult* out) {
+  if (area_mode != VS_AREA_MODE_BBOX && area_mode != VS_AREA_MODE_TOTAL) {
+    return compute_layer_area_stats_mode(
+        pixels, width, height, x_pixel_size_mm, y_pixel_size_mm,
+        area_mode, threads, out);
+  }
+
+  RleLayerStats stats;
+  if (known) {
+    stats = *known;
+  } else if (!analyze_layer_rle(rle, rle_len, layer_index, encryption_key,
+                                width, height, &stats, NULL, NULL, NULL)) {
+    return 0;
+  }
+  memset(out, 0, sizeof(*out));
+  if (stats.lit_pixels == 0) return 1;
+  out->total_solid_area =
+      (double)stats.lit_pixels * (x_pixel_size_mm * y_pixel_size_mm);
+  if (area_mode == VS_AREA_MODE_BBOX) {
+    out->min_x = stats.min_x;
+    out->min_y = stats.min_y;
+    out->max_x = stats.max_x;
+    out->max_y = stats.max_y;
+  }
+  return 1;
+}
+
 typedef struct ProcessBatchWork {
   const uint8_t* input_blob;
   int32_t input_blob_len;
@@ -430,7 +1165,29 @@ typedef struct ProcessBatchWork {
   double x_pixel_size_mm;
   double y_pixel_size_mm;
   int32_t png_level;
+  VsDeflateParams deflate;    // png_level plus the job's stream settings
+  VsEncodeJob* job;           // encode_job arg, or NULL for the defaults
+  VsLayerCache* cache;        // layer_cache arg, or NULL
   int32_t allow_gpu;
+  int32_t row_stream;         // CPU rows deflated as they are built
+  VsCompressPlan* plan;       // per-layer levels (compress_plan arg), or NULL
+  ZeroRowCache* zero_rows;    // blank-layer / empty-row fast paths, or NULL
+
+  // Layer dedup (see _plan_layer_dedup); all NULL when it is off.
+  uint64_t* hashes;           // two words per layer
+  int32_t* dup_of;            // first copy in the batch, -1, or VS_DEDUP_UNHASHED
+  int32_t* dup_next;          // next repeat of the same layer, or -1
+  uint8_t** reuse_png;        // carried over from the previous batch or the layer cache
+  int32_t* reuse_len;
+  VsLayerProfile profile;     // key for reuse across batches and jobs
+  int32_t dedup_hits;         // repeats of a layer in this or the previous batch
+  int32_t cache_hits;         // layers read back from the layer cache
+  int32_t area_mode;          // VS_AREA_MODE_*
+  int32_t area_threads;       // threads per layer for area labelling
+  int32_t deflate_threads;    // threads per layer for split deflate
+  int32_t decode_threads;     // threads per layer for the RLE decode
+  int32_t threads;            // workers running the batch
+  volatile int32_t idle_workers;  // workers left with no layer to claim
   int32_t used_gpu;
   int32_t gpu_attempts;
   int32_t gpu_successes;
@@ -441,86 +1198,457 @@ typedef struct ProcessBatchWork {
   int32_t* out_sizes;
   AreaStatsResult* out_areas;
 
-  int32_t next_index;
-  int32_t failed;
+  VsWorkQueue queue;          // cancelled on the first failure
   vs_mutex lock;
 
+  // Streaming mode (zip_handle != 0): finished PNGs are appended to the
+  // archive in index order instead of being collected into out_items.
+  // At most `window` layers may be claimed ahead of the next one to emit.
+  int64_t zip_handle;
+  int32_t window;
+  volatile int32_t next_emit;
+  int32_t emitting;
+  vs_cond emit_cond;
+
   int32_t analytics_enabled;
+  int64_t* layer_ns;           // per-layer processing time (analytics only)
   ProcessThreadMetrics* thread_metrics;
   int32_t thread_metrics_count;
 } ProcessBatchWork;
 
+// Per-worker buffers, kept in the worker pool's VS_POOL_SLOT_PROCESS slot and
+// reused across batches; they only grow when the layer dimensions do.
+// Row-streaming batches only need the decoded frame and a few rows; the
+// full-frame scanline/compressed buffers are for GPU-built scanlines.
 typedef struct ProcessThreadScratch {
   uint8_t* pixels;
+  uint8_t* rows;
   uint8_t* scanlines;
   uint8_t* compressed;
-  unsigned long compressed_cap;
+  size_t pixels_cap;
+  size_t rows_cap;
+  size_t scanlines_cap;
+  size_t compressed_cap;
+  size_t png_hint;             // output capacity to start the next layer with
+  VsDeflater deflater;         // reset, not rebuilt, between layers
+  VsMaskDeflater mask_deflater;
 } ProcessThreadScratch;
 
+static int _process_failed(ProcessBatchWork* w) {
+  return vs_queue_cancelled(&w->queue);
+}
+
 static int _take_process_range(
     ProcessBatchWork* w,
-    int32_t claim,
+    int32_t worker,
     int32_t* out_start,
     int32_t* out_end) {
-  int ok = 0;
-  vs_mutex_lock(&w->lock);
-  if (!w->failed && w->next_index < w->count) {
-    const int32_t start = w->next_index;
-    int32_t end = start + claim;
-    if (end > w->count) end = w->count;
-    w->next_index = end;
-    *out_start = start;
-    *out_end = end;
-    ok = 1;
+  if (!vs_queue_take(&w->queue, worker, out_start, out_end)) return 0;
+  if (!w->zip_handle) return 1;
+
+  // Back-pressure: don't run further ahead than the reorder window. Streaming
+  // claims are single layers in index order, so the layer at next_emit is
+  // never the one waiting here.
+  if (*out_end > vs_atomic_load32(&w->next_emit) + w->window) {
+    vs_mutex_lock(&w->lock);
+    while (!_process_failed(w) && *out_end > w->next_emit + w->window) {
+      vs_cond_wait(&w->emit_cond, &w->lock);
+    }
+    vs_mutex_unlock(&w->lock);
   }
-  vs_mutex_unlock(&w->lock);
-  return ok;
+  return !_process_failed(w);
 }
 
 static void _set_process_failed(ProcessBatchWork* w) {
+  vs_queue_cancel(&w->queue);
+  if (!w->zip_handle) return;
   vs_mutex_lock(&w->lock);
-  w->failed = 1;
+  vs_cond_broadcast(&w->emit_cond);
   vs_mutex_unlock(&w->lock);
 }
 
-static int _init_process_thread_scratch(
+/**
+ * @brief Threads for one layer's RLE decode.
+ *
+ * The batch's per-layer share, or, at the tail of a batch, the layer's
+ * share of the workers that found nothing left to claim, so the last large
+ * layers do not decode on one core while the rest sit idle.
+ */
+static int32_t _layer_decode_threads(ProcessBatchWork* w) {
+  const int32_t idle = vs_atomic_load32(&w->idle_workers);
+  const int32_t busy = w->threads - idle;
+  const int32_t tail = busy > 0 ? 1 + idle / busy : 1;
+  return tail > w->decode_threads ? tail : w->decode_threads;
+}
+
+/**
+ * @brief Hand a finished layer to the streaming writer.
+ *
+ * Stores the PNG in its slot and, if no other thread is currently draining,
+ * writes every contiguous ready layer to the archive. The archive write runs
+ * outside the lock so other workers can keep publishing meanwhile.
+ */
+static void _publish_stream_layer(
     ProcessBatchWork* w,
-    ProcessThreadScratch* s) {
+    int32_t i,
+    uint8_t* png,
+    int32_t png_len) {
+  vs_mutex_lock(&w->lock);
+  w->out_items[i] = png;
+  w->out_sizes[i] = png_len;
+  if (!w->emitting) {
+    w->emitting = 1;
+    while (!_process_failed(w) && w->next_emit < w->count &&
+           w->out_items[w->next_emit]) {
+      const int32_t idx = w->next_emit;
+      uint8_t* item = w->out_items[idx];
+      const int32_t item_len = w->out_sizes[idx];
+      w->out_items[idx] = NULL;
+      vs_mutex_unlock(&w->lock);
+
+      char name[32];
+      snprintf(name, sizeof(name), "%d.png", w->layer_index_base + idx + 1);
+      const int ok = vs_zip_add_file(w->zip_handle, name, item, item_len);
+      free(item);
+
+      vs_mutex_lock(&w->lock);
+      if (!ok) vs_queue_cancel(&w->queue);
+      vs_atomic_store32(&w->next_emit, idx + 1);
+      vs_cond_broadcast(&w->emit_cond);
+    }
+    w->emitting = 0;
+  }
+  vs_mutex_unlock(&w->lock);
+}
+
+static void _free_process_thread_scratch(void* p) {
+  ProcessThreadScratch* s = (ProcessThreadScratch*)p;
+  if (!s) return;
+  free(s->pixels);
+  free(s->rows);
+  free(s->scanlines);
+  free(s->compressed);
+  vs_deflater_end(&s->deflater);
+  vs_mask_deflater_free(&s->mask_deflater);
+  free(s);
+}
+
+/**
+ * @brief Get the worker's scratch from its pool slot, sized for this batch.
+ *
+ * Buffers are only reallocated when they are too small. Returns NULL on
+ * allocation failure (the slot is then left empty).
+ */
+static ProcessThreadScratch* _acquire_process_thread_scratch(
+    ProcessBatchWork* w,
+    void** slot) {
   const int32_t pixel_count = w->src_width * w->height;
   const int32_t bytes_per_row = w->out_width * w->channels;
   const int32_t scanline_size = 1 + bytes_per_row;
   const int32_t scanlines_len = scanline_size * w->height;
 
-  if (pixel_count <= 0 || scanlines_len <= 0) return 0;
+  if (!slot || pixel_count <= 0 || scanlines_len <= 0) return NULL;
 
-  s->pixels = (uint8_t*)malloc((size_t)pixel_count);
-  s->scanlines = (uint8_t*)malloc((size_t)scanlines_len);
-  s->compressed_cap =
-      (unsigned long)scanlines_len + ((unsigned long)scanlines_len / 1000u) + 64u;
-  s->compressed = (uint8_t*)malloc((size_t)s->compressed_cap);
+  ProcessThreadScratch* s = (ProcessThreadScratch*)*slot;
+  if (!s) {
+    s = (ProcessThreadScratch*)calloc(1, sizeof(ProcessThreadScratch));
+    if (!s) return NULL;
+    *slot = s;
+  }
 
-  if (!s->pixels || !s->scanlines || !s->compressed) {
+  if (s->pixels_cap < (size_t)pixel_count) {
     free(s->pixels);
+    s->pixels = (uint8_t*)malloc((size_t)pixel_count);
+    s->pixels_cap = s->pixels ? (size_t)pixel_count : 0;
+  }
+
+  if (w->row_stream) {
+    const size_t rows_len = (size_t)bytes_per_row * 3 + 1;
+    if (s->rows_cap < rows_len) {
+      free(s->rows);
+      s->rows = (uint8_t*)malloc(rows_len);
+      s->rows_cap = s->rows ? rows_len : 0;
+    }
+    if (!s->pixels || !s->rows) {
+      _free_process_thread_scratch(s);
+      *slot = NULL;
+      return NULL;
+    }
+    return s;
+  }
+
+  const size_t compressed_cap = vs_deflate_bound(&w->deflate, (size_t)scanlines_len);
+  if (s->scanlines_cap < (size_t)scanlines_len) {
     free(s->scanlines);
+    s->scanlines = (uint8_t*)malloc((size_t)scanlines_len);
+    s->scanlines_cap = s->scanlines ? (size_t)scanlines_len : 0;
+  }
+  if (s->compressed_cap < compressed_cap) {
     free(s->compressed);
-    s->pixels = NULL;
-    s->scanlines = NULL;
-    s->compressed = NULL;
-    s->compressed_cap = 0;
-    return 0;
+    s->compressed = (uint8_t*)malloc(compressed_cap);
+    s->compressed_cap = s->compressed ? compressed_cap : 0;
+  }
+
+  if (!s->pixels || !s->scanlines || !s->compressed) {
+    _free_process_thread_scratch(s);
+    *slot = NULL;
+    return NULL;
+  }
+  return s;
+}
+
+#define VS_DEDUP_UNHASHED (-2)  // dup_of value for inputs that could not be hashed
+#define VS_PROFILE_LEVEL_PLANNED (-1)  // profile level of layers a compression plan encodes
+
+typedef struct HashLayersWork {
+  ProcessBatchWork* w;
+  volatile int32_t next;
+  volatile int32_t hits;
+} HashLayersWork;
+
+static void _hash_layers_task(void* ctx, int32_t worker_index, void** scratch) {
+  HashLayersWork* h = (HashLayersWork*)ctx;
+  ProcessBatchWork* w = h->w;
+  (void)worker_index;
+  (void)scratch;
+  for (;;) {
+    const int32_t i = vs_atomic_fetch_add32(&h->next, 1);
+    if (i >= w->count) return;
+    const int32_t off = w->input_offsets[i];
+    const int32_t len = w->input_lengths[i];
+    if (off < 0 || len <= 0 || off + len > w->input_blob_len ||
+        !hash_layer_rle(w->input_blob + off, len, w->layer_index_base + i,
+                        w->encryption_key, w->hashes + 2 * i)) {
+      w->dup_of[i] = VS_DEDUP_UNHASHED;
+    }
+  }
+}
+
+static void _cache_lookup_task(void* ctx, int32_t worker_index, void** scratch) {
+  HashLayersWork* h = (HashLayersWork*)ctx;
+  ProcessBatchWork* w = h->w;
+  (void)worker_index;
+  (void)scratch;
+  for (;;) {
+    const int32_t i = vs_atomic_fetch_add32(&h->next, 1);
+    if (i >= w->count) return;
+    if (w->dup_of[i] != -1 || w->reuse_png[i]) continue;
+    if (vs_layer_cache_lookup(w->cache, &w->profile, w->hashes + 2 * i,
+                              w->input_lengths[i], &w->reuse_png[i],
+                              &w->reuse_len[i], &w->out_areas[i])) {
+      vs_atomic_fetch_add32(&h->hits, 1);
+    }
+  }
+}
+
+static void _free_layer_dedup(ProcessBatchWork* w) {
+  if (w->reuse_png) {
+    for (int32_t i = 0; i < w->count; i++) free(w->reuse_png[i]);
+  }
+  free(w->hashes);
+  free(w->dup_of);
+  free(w->dup_next);
+  free(w->reuse_png);
+  free(w->reuse_len);
+  w->hashes = NULL;
+  w->dup_of = NULL;
+  w->dup_next = NULL;
+  w->reuse_png = NULL;
+  w->reuse_len = NULL;
+}
+
+/// Whether layers [i] and [j] of the batch have identical decrypted input.
+static int _same_layer_input(const ProcessBatchWork* w, int32_t i, int32_t j) {
+  return layer_rle_equal(
+      w->input_blob + w->input_offsets[i], w->layer_index_base + i, w->encryption_key,
+      w->input_blob + w->input_offsets[j], w->layer_index_base + j, w->encryption_key,
+      w->input_lengths[i]);
+}
+
+/**
+ * @brief Find repeated layers before the batch runs.
+ *
+ * Every input is hashed (in parallel), then each repeat is linked to the
+ * first layer of the batch with the same hash, length and bytes (a hash
+ * match alone is not trusted): dup_of points
+ * back to it and dup_next chains its repeats. First copies that the
+ * previous batch carried over, or failing that the layer cache holds, are
+ * fetched into reuse_png. Dedup is only an optimisation; without memory for
+ * it the batch runs as before.
+ */
+static void _plan_layer_dedup(ProcessBatchWork* w, int32_t threads) {
+  const int32_t n = w->count;
+  w->dedup_hits = 0;
+  w->cache_hits = 0;
+  memset(&w->profile, 0, sizeof(w->profile));
+  w->profile.src_width = w->src_width;
+  w->profile.height = w->height;
+  w->profile.out_width = w->out_width;
+  w->profile.channels = w->channels;
+  w->profile.level = w->plan ? VS_PROFILE_LEVEL_PLANNED : w->deflate.level;
+  w->profile.window_bits = w->deflate.window_bits;
+  w->profile.mem_level = w->deflate.mem_level;
+  w->profile.strategy = w->deflate.strategy;
+  w->profile.encoder = w->deflate.encoder;
+  w->profile.area_mode = w->area_mode;
+  w->profile.x_pixel_size_mm = w->x_pixel_size_mm;
+  w->profile.y_pixel_size_mm = w->y_pixel_size_mm;
+
+  int32_t table_size = 16;
+  while (table_size < 2 * n) table_size <<= 1;
+  w->hashes = (uint64_t*)malloc((size_t)n * 2 * sizeof(uint64_t));
+  w->dup_of = (int32_t*)malloc((size_t)n * sizeof(int32_t));
+  w->dup_next = (int32_t*)malloc((size_t)n * sizeof(int32_t));
+  w->reuse_png = (uint8_t**)calloc((size_t)n, sizeof(uint8_t*));
+  w->reuse_len = (int32_t*)calloc((size_t)n, sizeof(int32_t));
+  int32_t* table = (int32_t*)malloc((size_t)table_size * sizeof(int32_t));
+  if (!w->hashes || !w->dup_of || !w->dup_next || !w->reuse_png ||
+      !w->reuse_len || !table) {
+    free(table);
+    _free_layer_dedup(w);
+    return;
+  }
+  for (int32_t i = 0; i < n; i++) {
+    w->dup_of[i] = -1;
+    w->dup_next[i] = -1;
+  }
+
+  HashLayersWork hw;
+  hw.w = w;
+  hw.next = 0;
+  hw.hits = 0;
+  if (vs_pool_run(threads, VS_POOL_NO_SCRATCH, NULL, _hash_layers_task, &hw) <= 0) {
+    free(table);
+    _free_layer_dedup(w);
+    return;
+  }
+
+  memset(table, 0xFF, (size_t)table_size * sizeof(int32_t));
+  const uint32_t mask = (uint32_t)table_size - 1;
+  for (int32_t i = 0; i < n; i++) {
+    if (w->dup_of[i] == VS_DEDUP_UNHASHED) continue;
+    const uint64_t* h = w->hashes + 2 * i;
+    for (uint32_t slot = (uint32_t)h[0] & mask;; slot = (slot + 1) & mask) {
+      const int32_t j = table[slot];
+      if (j < 0) {
+        table[slot] = i;
+        break;
+      }
+      const uint64_t* hj = w->hashes + 2 * j;
+      if (h[0] == hj[0] && h[1] == hj[1] &&
+          w->input_lengths[i] == w->input_lengths[j] &&
+          _same_layer_input(w, i, j)) {
+        w->dup_of[i] = j;
+        w->dup_next[i] = w->dup_next[j];
+        w->dup_next[j] = i;
+        w->dedup_hits += 1;
+        break;
+      }
+    }
+  }
+  free(table);
+
+  for (int32_t i = 0; i < n; i++) {
+    if (w->dup_of[i] == -1 &&
+        _dedup_carry_lookup(&w->profile, w->hashes + 2 * i,
+                            w->input_blob + w->input_offsets[i],
+                            w->input_lengths[i], w->layer_index_base + i,
+                            w->encryption_key, &w->reuse_png[i],
+                            &w->reuse_len[i], &w->out_areas[i])) {
+      w->dedup_hits += 1;
+    }
+  }
+
+  // The layer cache is read in parallel; the reads are independent files.
+  if (w->cache) {
+    hw.next = 0;
+    if (vs_pool_run(threads, VS_POOL_NO_SCRATCH, NULL, _cache_lookup_task, &hw) > 0) {
+      w->cache_hits = hw.hits;
+    }
   }
+}
 
+/**
+ * @brief Give each repeat of layer [i] its own copy of the PNG and area.
+ *
+ * Also offers the layer to the next batch when it or one of its repeats
+ * sits in the last VS_DEDUP_CARRY slots, and writes [fresh] (newly encoded)
+ * layers to the layer cache. Call before [png] is published, as a
+ * streaming batch may free it as soon as it is. Returns 0 on allocation
+ * failure.
+ */
+static int _share_layer_result(
+    ProcessBatchWork* w,
+    int32_t i,
+    const uint8_t* png,
+    int32_t png_len,
+    int fresh) {
+  if (!w->dup_of) return 1;
+  int32_t last = i;
+  for (int32_t d = w->dup_next[i]; d >= 0; d = w->dup_next[d]) {
+    uint8_t* copy = (uint8_t*)malloc((size_t)png_len);
+    if (!copy) return 0;
+    memcpy(copy, png, (size_t)png_len);
+    w->out_areas[d] = w->out_areas[i];
+    if (w->plan) {
+      vs_compress_plan_record(w->plan, w->layer_index_base + d, -1, png_len, 0, 0);
+    }
+    if (w->zip_handle) {
+      _publish_stream_layer(w, d, copy, png_len);
+    } else {
+      w->out_items[d] = copy;
+      w->out_sizes[d] = png_len;
+    }
+    if (d > last) last = d;
+  }
+  if (w->dup_of[i] == -1 && last >= w->count - VS_DEDUP_CARRY) {
+    _dedup_carry_store(&w->profile, w->hashes + 2 * i,
+                       w->input_blob + w->input_offsets[i], w->input_lengths[i],
+                       w->layer_index_base + i, w->encryption_key,
+                       png, png_len, &w->out_areas[i]);
+  }
+  if (fresh && w->dup_of[i] == -1 && w->cache) {
+    vs_layer_cache_store(w->cache, &w->profile, w->hashes + 2 * i, w->input_lengths[i],
+                         png, png_len, &w->out_areas[i]);
+  }
   return 1;
 }
 
-static void _free_process_thread_scratch(ProcessThreadScratch* s) {
-  free(s->pixels);
-  free(s->scanlines);
-  free(s->compressed);
-  s->pixels = NULL;
-  s->scanlines = NULL;
-  s->compressed = NULL;
-  s->compressed_cap = 0;
+/**
+ * @brief Row-stream a layer claimed as an auto-strategy trial sample.
+ *
+ * The layer is encoded once per candidate setting and the sample recorded;
+ * candidate 0, the batch's own setting, runs last and its PNG is returned,
+ * so trial layers keep the bytes the batch profile describes.
+ */
+static uint8_t* _deflate_rows_trial(
+    ProcessBatchWork* w,
+    ProcessThreadScratch* s,
+    const uint8_t* pixels,
+    int32_t top,
+    int32_t bottom,
+    int32_t* out_png_len) {
+  VsDeflateParams c[VS_DEFLATE_AUTO_MAX_CANDIDATES];
+  uint64_t ns[VS_DEFLATE_AUTO_MAX_CANDIDATES];
+  size_t bytes[VS_DEFLATE_AUTO_MAX_CANDIDATES];
+  const int32_t n = vs_deflate_auto_candidates(w->job, w->png_level, c);
+  uint8_t* png = NULL;
+  int32_t png_len = 0;
+  for (int32_t k = n - 1; k >= 0; k--) {
+    if (!vs_deflater_begin(&s->deflater, &c[k])) return NULL;
+    const uint64_t t0 = _now_ns();
+    png = _deflate_rows_to_png(
+        pixels, w->src_width, w->height, w->out_width, w->channels,
+        &c[k], &s->deflater, &s->mask_deflater, w->zero_rows, top, bottom,
+        s->rows, s->png_hint, 1, &png_len);
+    ns[k] = _now_ns() - t0;
+    if (!png) return NULL;
+    bytes[k] = (size_t)png_len;
+    if (k > 0) free(png);
+  }
+  vs_deflate_auto_record(w->job, w->png_level, ns, bytes, n);
+  *out_png_len = png_len;
+  return png;
 }
 
 static void _process_one_layer(
@@ -537,7 +1665,8 @@ static void _process_one_layer(
   uint64_t t_scanline = 0;
   uint64_t t_compress = 0;
   uint64_t t_png = 0;
-  if (analytics) t_start = _now_ns();
+  uint64_t t_encode = 0;       // planned layers only
+  if (analytics || w->plan) t_start = _now_ns();
   const int32_t off = w->input_offsets[i];
   const int32_t len = w->input_lengths[i];
 
@@ -558,116 +1687,221 @@ static void _process_one_layer(
   uint8_t* pixels = s->pixels;
   uint8_t* scanlines = s->scanlines;
   uint8_t* compressed = s->compressed;
-  if (!pixels || !scanlines || !compressed || s->compressed_cap == 0) {
+  if (!pixels || (w->row_stream ? !s->rows :
+                  (!scanlines || !compressed || s->compressed_cap == 0))) {
     _set_process_failed(w);
     return;
   }
 
+  int32_t png_len = 0;
+  uint8_t* png = NULL;
   uint64_t t0 = 0;
   if (analytics) t0 = _now_ns();
-  const int ok_decode = decrypt_and_decode_layer(
+
+  int fresh = 1;
+  int32_t plan_level = -1;
+  VsDeflateParams params = w->deflate;
+  if (w->reuse_png && w->reuse_png[i]) {
+    // Carried over or cached; the area is already in place.
+    png = w->reuse_png[i];
+    png_len = w->reuse_len[i];
+    w->reuse_png[i] = NULL;
+    fresh = 0;
+    goto publish;
+  }
+
+  // With the zero-row cache the runs are summarised first: a blank layer
+  // needs no decode or encode, and only rows near lit ones are deflated.
+  RleLayerStats rle_stats;
+  const RleLayerStats* known = NULL;
+  int32_t band_top = 0;
+  int32_t band_bottom = w->height;
+  if (w->zero_rows) {
+    if (!analyze_layer_rle(w->input_blob + off, len, w->layer_index_base + i,
+                           w->encryption_key, w->src_width, w->height,
+                           &rle_stats, NULL, NULL, NULL)) {
+      _set_process_failed(w);
+      return;
+    }
+    known = &rle_stats;
+    if (rle_stats.lit_pixels == 0) {
+      memset(&w->out_areas[i], 0, sizeof(AreaStatsResult));
+      png_len = w->zero_rows->blank_png_len;
+      png = (uint8_t*)malloc((size_t)png_len);
+      if (!png) {
+        _set_process_failed(w);
+        return;
+      }
+      memcpy(png, w->zero_rows->blank_png, (size_t)png_len);
+      if (analytics) t_png += (_now_ns() - t0);
+      goto publish;
+    }
+    band_top = rle_stats.min_y;
+    band_bottom = rle_stats.max_y + 2 < w->height ? rle_stats.max_y + 2
+                                                  : w->height;
+  }
+
+  const int ok_decode = decrypt_and_decode_layer_mt(
       w->input_blob + off,
       len,
       w->layer_index_base + i,
       w->encryption_key,
       pixel_count,
+      _layer_decode_threads(w),
       pixels);
   if (!ok_decode) {
     _set_process_failed(w);
     return;
   }
 
-  if (!compute_layer_area_stats(
+  if (!_layer_area_stats(
+          w->input_blob + off,
+          len,
+          w->layer_index_base + i,
+          w->encryption_key,
           pixels,
           w->src_width,
           w->height,
           w->x_pixel_size_mm,
           w->y_pixel_size_mm,
+          w->area_mode,
+          w->area_threads,
+          known,
           &w->out_areas[i])) {
     _set_process_failed(w);
     return;
   }
   if (analytics) t_decode += (_now_ns() - t0);
 
-  int32_t backend_used = 0;
-  int32_t gpu_attempted = 0;
-  int32_t gpu_succeeded = 0;
+  if (w->plan) {
+    plan_level = vs_compress_plan_level(w->plan, w->layer_index_base + i);
+    params.level = plan_level;
+  }
 
-  if (analytics) t0 = _now_ns();
-  if (!_build_scanlines_auto(
+  if (w->row_stream) {
+    // Packing, Up filter and deflate are interleaved row by row, so the whole
+    // encode is accounted as compress time.
+    if (analytics || w->plan) t0 = _now_ns();
+    if (!w->plan && vs_deflate_auto_claim(w->job, w->png_level)) {
+      png = _deflate_rows_trial(w, s, pixels, band_top, band_bottom, &png_len);
+    } else {
+      png = _deflate_rows_to_png(
           pixels,
           w->src_width,
           w->height,
           w->out_width,
           w->channels,
-          w->allow_gpu,
-          scanlines,
-          scanlines_len,
-          &backend_used,
-          &gpu_attempted,
-          &gpu_succeeded)) {
-    _set_process_failed(w);
-    return;
-  }
-  if (analytics) t_scanline += (_now_ns() - t0);
-
-  if (backend_used == 1 || backend_used == 3 || gpu_attempted) {
-    vs_mutex_lock(&w->lock);
-    if (backend_used == 1 || backend_used == 3) {
-      w->used_gpu = backend_used;
+          &params,
+          &s->deflater,
+          &s->mask_deflater,
+          w->zero_rows,
+          band_top,
+          band_bottom,
+          s->rows,
+          s->png_hint,
+          w->deflate_threads,
+          &png_len);
+    }
+    if (!png || png_len <= 0) {
+      free(png);
+      _set_process_failed(w);
+      return;
+    }
+    s->png_hint = (size_t)png_len + ((size_t)png_len >> 2);
+    if (analytics || w->plan) t_encode = _now_ns() - t0;
+    t_compress += t_encode;
+  } else {
+    int32_t backend_used = 0;
+    int32_t gpu_attempted = 0;
+    int32_t gpu_succeeded = 0;
+
+    if (analytics) t0 = _now_ns();
+    if (!_build_scanlines_auto(
+            pixels,
+            w->src_width,
+            w->height,
+            w->out_width,
+            w->channels,
+            w->allow_gpu,
+            scanlines,
+            scanlines_len,
+            &backend_used,
+            &gpu_attempted,
+            &gpu_succeeded)) {
+      _set_process_failed(w);
+      return;
     }
-    w->gpu_attempts += gpu_attempted;
-    w->gpu_successes += gpu_succeeded;
-    if (gpu_attempted && !gpu_succeeded) {
-      w->gpu_fallbacks += 1;
-      if (backend_used == 0) {
-        const int32_t err = gpu_cuda_tensor_last_error_code();
-        if (err != 0) {
-          w->last_cuda_error = err;
+    if (analytics) t_scanline += (_now_ns() - t0);
+
+    if (backend_used == 1 || backend_used == 3 || gpu_attempted) {
+      vs_mutex_lock(&w->lock);
+      if (backend_used == 1 || backend_used == 3) {
+        w->used_gpu = backend_used;
+      }
+      w->gpu_attempts += gpu_attempted;
+      w->gpu_successes += gpu_succeeded;
+      if (gpu_attempted && !gpu_succeeded) {
+        w->gpu_fallbacks += 1;
+        if (backend_used == 0) {
+          const int32_t err = gpu_cuda_tensor_last_error_code();
+          if (err != 0) {
+            w->last_cuda_error = err;
+          }
         }
       }
+      vs_mutex_unlock(&w->lock);
     }
-    vs_mutex_unlock(&w->lock);
-  }
-
-  int32_t level = w->png_level;
-  if (level < 0) level = 0;
-  if (level > 9) level = 9;
 
-  if (analytics) t0 = _now_ns();
-  unsigned long comp_len = s->compressed_cap;
-  const int ok_comp = g_zlib.compress2_ptr(
-      compressed,
-      &comp_len,
-      scanlines,
-      (unsigned long)scanlines_len,
-      level);
-
-  if (ok_comp != 0 || comp_len == 0) {
-    _set_process_failed(w);
-    return;
+    if (analytics || w->plan) t0 = _now_ns();
+    size_t comp_len = 0;
+    const int deflated = !w->plan && vs_deflate_auto_claim(w->job, w->png_level)
+        ? vs_deflate_zlib_trial(&s->deflater, w->job, w->png_level, scanlines,
+                                (size_t)scanlines_len, compressed,
+                                s->compressed_cap, &comp_len)
+        : _deflate_scanlines(&s->deflater, &s->mask_deflater, &params,
+                             1 + w->out_width * w->channels, scanlines,
+                             (size_t)scanlines_len, w->deflate_threads,
+                             compressed, s->compressed_cap, &comp_len);
+    if (!deflated) {
+      _set_process_failed(w);
+      return;
+    }
+    if (analytics || w->plan) t_encode = _now_ns() - t0;
+    t_compress += t_encode;
+
+    if (analytics) t0 = _now_ns();
+    png = _build_png_from_idat(
+        w->out_width,
+        w->height,
+        w->channels,
+        compressed,
+        comp_len,
+        &png_len);
+
+    if (!png || png_len <= 0) {
+      free(png);
+      _set_process_failed(w);
+      return;
+    }
+    if (analytics) t_png += (_now_ns() - t0);
   }
-  if (analytics) t_compress += (_now_ns() - t0);
-
-  int32_t png_len = 0;
-  if (analytics) t0 = _now_ns();
-  uint8_t* png = _build_png_from_idat(
-      w->out_width,
-      w->height,
-      w->channels,
-      compressed,
-      (size_t)comp_len,
-      &png_len);
 
-  if (!png || png_len <= 0) {
+publish:
+  if (w->plan) {
+    vs_compress_plan_record(w->plan, w->layer_index_base + i, plan_level,
+                            png_len, t_encode, _now_ns() - t_start);
+  }
+  if (!_share_layer_result(w, i, png, png_len, fresh)) {
     free(png);
     _set_process_failed(w);
     return;
   }
-  if (analytics) t_png += (_now_ns() - t0);
-
-  w->out_items[i] = png;
-  w->out_sizes[i] = png_len;
+  if (w->zip_handle) {
+    _publish_stream_layer(w, i, png, png_len);
+  } else {
+    w->out_items[i] = png;
+    w->out_sizes[i] = png_len;
+  }
 
   if (analytics) {
     ProcessThreadMetrics* m = &w->thread_metrics[thread_index];
@@ -677,62 +1911,131 @@ static void _process_one_layer(
     m->scanline_ns += t_scanline;
     m->compress_ns += t_compress;
     m->png_ns += t_png;
+    if (w->layer_ns) w->layer_ns[i] = (int64_t)(_now_ns() - t_start);
   }
 }
 
-#ifdef _WIN32
-typedef struct ProcessThreadParams {
-  ProcessBatchWork* work;
-  int32_t thread_index;
-} ProcessThreadParams;
-
-static DWORD WINAPI _process_batch_worker(LPVOID arg) {
-  ProcessThreadParams* p = (ProcessThreadParams*)arg;
-  ProcessBatchWork* w = p->work;
-  const int32_t thread_index = p->thread_index;
-  ProcessThreadScratch s = {0};
-  if (!_init_process_thread_scratch(w, &s)) {
+static void _process_batch_task(void* ctx, int32_t thread_index, void** scratch) {
+  ProcessBatchWork* w = (ProcessBatchWork*)ctx;
+  ProcessThreadScratch* s = _acquire_process_thread_scratch(w, scratch);
+  if (!s) {
     _set_process_failed(w);
-    return 0;
+    return;
   }
 
   int32_t start, end;
-  while (_take_process_range(w, 4, &start, &end)) {
-    for (int32_t idx = start; idx < end; idx++) {
-      _process_one_layer(w, idx, &s, thread_index);
+  while (_take_process_range(w, thread_index, &start, &end)) {
+    for (int32_t p = start; p < end; p++) {
+      const int32_t i = vs_queue_item(&w->queue, p);
+      if (w->dup_of && w->dup_of[i] >= 0) continue;  // filled in by its first copy
+      _process_one_layer(w, i, s, thread_index);
     }
   }
-
-  _free_process_thread_scratch(&s);
-  return 0;
+  vs_atomic_fetch_add32(&w->idle_workers, 1);
 }
-#else
-typedef struct ProcessThreadParams {
-  ProcessBatchWork* work;
-  int32_t thread_index;
-} ProcessThreadParams;
-
-static void* _process_batch_worker(void* arg) {
-  ProcessThreadParams* p = (ProcessThreadParams*)arg;
-  ProcessBatchWork* w = p->work;
-  const int32_t thread_index = p->thread_index;
-  ProcessThreadScratch s = {0};
-  if (!_init_process_thread_scratch(w, &s)) {
-    _set_process_failed(w);
-    return NULL;
+
+/**
+ * @brief Reset the per-thread analytics buffer for a new batch.
+ */
+static void _reset_thread_metrics(ProcessBatchWork* work, int32_t threads) {
+  if (!work->analytics_enabled) return;
+  if (g_last_thread_metrics) {
+    free(g_last_thread_metrics);
+    g_last_thread_metrics = NULL;
+    g_last_thread_capacity = 0;
+  }
+  g_last_thread_metrics = (ProcessThreadMetrics*)calloc(
+      (size_t)threads, sizeof(ProcessThreadMetrics));
+  if (g_last_thread_metrics) {
+    g_last_thread_capacity = threads;
+    work->thread_metrics = g_last_thread_metrics;
+    work->thread_metrics_count = threads;
   }
+}
 
-  int32_t start, end;
-  while (_take_process_range(w, 4, &start, &end)) {
-    for (int32_t idx = start; idx < end; idx++) {
-      _process_one_layer(w, idx, &s, thread_index);
-    }
+/**
+ * @brief Reset the per-layer cost samples for a new batch.
+ */
+static void _reset_cost_samples(ProcessBatchWork* work) {
+  if (!work->analytics_enabled) return;
+  free(g_last_cost_predicted);
+  free(g_last_cost_actual_ns);
+  g_last_cost_predicted = (int64_t*)malloc((size_t)work->count * sizeof(int64_t));
+  g_last_cost_actual_ns = (int64_t*)calloc((size_t)work->count, sizeof(int64_t));
+  g_last_cost_count = 0;
+  if (!g_last_cost_predicted || !g_last_cost_actual_ns) {
+    free(g_last_cost_predicted);
+    free(g_last_cost_actual_ns);
+    g_last_cost_predicted = NULL;
+    g_last_cost_actual_ns = NULL;
+    return;
+  }
+  for (int32_t i = 0; i < work->count; i++) {
+    g_last_cost_predicted[i] = work->input_lengths[i];
   }
+  g_last_cost_count = work->count;
+  work->layer_ns = g_last_cost_actual_ns;
+}
 
-  _free_process_thread_scratch(&s);
-  return NULL;
+/**
+ * @brief Run _process_one_layer over the whole batch on the shared pool.
+ *
+ * Returns the number of workers used, or 0 only when the run could not be
+ * started; per-layer failures cancel work->queue.
+ *
+ * Batches are scheduled by work stealing, longest layers first: a layer's
+ * encoded size tracks its run count and so its decode and deflate cost.
+ * Outputs still land in their index slots. Streaming batches instead hand
+ * out single layers in index order, which the reorder window relies on.
+ *
+ * CPU-only batches encode row by row (see _deflate_rows_to_png); the
+ * full-frame scanline path is kept for GPU-built scanlines, for
+ * libdeflate's whole-buffer API and for zlib builds without the stream
+ * API. Blank layers reuse the profile's cached
+ * blank PNG on either path, and row-streamed layers splice cached deflated
+ * zero rows above and below their lit rows (see ZeroRowCache).
+ */
+static int32_t _run_process_workers(ProcessBatchWork* work, int32_t threads) {
+  const int32_t prev_background =
+      vs_pool_set_background(vs_encode_job_background(work->job));
+  work->threads = threads;
+  work->idle_workers = 0;
+  work->deflate = vs_deflate_params(work->job, work->png_level);
+  work->row_stream =
+      (vs_deflate_can_stream(&work->deflate) ||
+       work->deflate.encoder == VS_DEFLATE_ENCODER_BUILTIN) &&
+      !(work->allow_gpu && gpu_acceleration_active());
+  if (work->deflate.encoder == VS_DEFLATE_ENCODER_BUILTIN) work->plan = NULL;
+  for (int32_t i = 0; work->plan && i < work->count; i++) {
+    vs_compress_plan_note_size(work->plan, work->layer_index_base + i,
+                               work->input_lengths[i]);
+  }
+  _plan_layer_dedup(work, threads);
+  g_last_process_layers_dedup_hits = work->dedup_hits;
+  g_last_process_layers_cache_hits = work->cache_hits;
+  work->zero_rows = _zero_rows_acquire(
+      work->out_width, work->channels, work->height, &work->deflate);
+  _reset_thread_metrics(work, threads);
+  _reset_cost_samples(work);
+  const int ordered = work->zip_handle != 0;
+  if (!vs_queue_init(&work->queue, work->count, threads, ordered ? 1 : 4,
+                     ordered ? VS_QUEUE_ORDERED : 0)) {
+    _zero_rows_release(work->zero_rows);
+    _free_layer_dedup(work);
+    vs_pool_set_background(prev_background);
+    return 0;
+  }
+  vs_queue_order_by_cost(&work->queue, work->input_lengths);
+  const int32_t ran = vs_pool_run(
+      threads, VS_POOL_SLOT_PROCESS, _free_process_thread_scratch,
+      _process_batch_task, work);
+  vs_queue_destroy(&work->queue);
+  _zero_rows_release(work->zero_rows);
+  work->zero_rows = NULL;
+  _free_layer_dedup(work);
+  vs_pool_set_background(prev_background);
+  return ran;
 }
-#endif
 
 /**
  * @brief Decode a CTB layer and build PNG scanlines in one call.
@@ -760,12 +2063,15 @@ int decode_and_build_png_scanlines(
     return 0;
   }
 
-  const int ok_decode = decrypt_and_decode_layer(
+  // Single-layer call: let the decode use every core.
+  const int ok_decode = decrypt_and_decode_layer_mt(
       data,
       data_len,
       layer_index,
       encryption_key,
       pixel_count,
+      g_process_layers_batch_threads > 0 ? g_process_layers_batch_threads
+                                         : _cpu_threads(),
       out_pixels);
   if (!ok_decode) {
     return 0;
@@ -819,24 +2125,30 @@ int decode_build_scanlines_and_area(
     return 0;
   }
 
-  const int ok_decode = decrypt_and_decode_layer(
+  // Single-layer call: let decode and area labelling use every core.
+  const int32_t threads = g_process_layers_batch_threads > 0
+                              ? g_process_layers_batch_threads
+                              : _cpu_threads();
+  const int ok_decode = decrypt_and_decode_layer_mt(
       data,
       data_len,
       layer_index,
       encryption_key,
       pixel_count,
+      threads,
       pixels);
   if (!ok_decode) {
     free(pixels);
     return 0;
   }
 
-  const int ok_area = compute_layer_area_stats(
+  const int ok_area = compute_layer_area_stats_mt(
       pixels,
       src_width,
       height,
       x_pixel_size_mm,
       y_pixel_size_mm,
+      threads,
       out_area);
   if (!ok_area) {
     free(pixels);
@@ -878,6 +2190,10 @@ int process_layers_batch(
     double x_pixel_size_mm,
     double y_pixel_size_mm,
     int32_t png_level,
+    int64_t compress_plan,
+    int64_t encode_job,
+    int64_t layer_cache,
+    int32_t area_mode,
     int32_t thread_count,
     uint8_t** out_blob,
     int32_t* out_blob_len,
@@ -891,8 +2207,7 @@ int process_layers_batch(
     return 0;
   }
 
-  _init_zlib();
-  if (!g_zlib.available) return 0;
+  if (!vs_zlib()->available) return 0;
 
   uint8_t** item_outputs = (uint8_t**)calloc((size_t)count, sizeof(uint8_t*));
   int32_t* item_sizes = (int32_t*)calloc((size_t)count, sizeof(int32_t));
@@ -920,25 +2235,38 @@ int process_layers_batch(
   work.x_pixel_size_mm = x_pixel_size_mm;
   work.y_pixel_size_mm = y_pixel_size_mm;
   work.png_level = png_level;
+  work.plan = (VsCompressPlan*)(intptr_t)compress_plan;
+  work.job = (VsEncodeJob*)(intptr_t)encode_job;
+  work.cache = (VsLayerCache*)(intptr_t)layer_cache;
+  work.area_mode = area_mode;
   work.out_items = item_outputs;
   work.out_sizes = item_sizes;
   work.out_areas = areas;
   work.allow_gpu = 0;
+  work.row_stream = 0;
   work.used_gpu = 0;
   work.gpu_attempts = 0;
   work.gpu_successes = 0;
   work.gpu_fallbacks = 0;
   work.last_cuda_error = 0;
-  work.next_index = 0;
-  work.failed = 0;
+  work.zip_handle = 0;
+  work.window = 0;
+  work.next_emit = 0;
+  work.emitting = 0;
   work.analytics_enabled = g_process_layers_analytics_enabled;
   work.thread_metrics = NULL;
   work.thread_metrics_count = 0;
+  work.layer_ns = NULL;
   vs_mutex_init(&work.lock);
 
   int32_t threads = thread_count > 0 ? thread_count :
       (g_process_layers_batch_threads > 0 ? g_process_layers_batch_threads : _cpu_threads());
   if (threads < 1) threads = 1;
+  // Fewer layers than threads: spare threads decode each layer in slices,
+  // label its islands and deflate it in bands.
+  work.area_threads = threads > count ? threads / count : 1;
+  work.deflate_threads = vs_deflate_split_threads(work.job, work.area_threads);
+  work.decode_threads = work.area_threads;
   if (threads > count) threads = count;
 
   // Hybrid mode: keep CPU decode/area/zlib multithreaded while GPU handles
@@ -946,132 +2274,16 @@ int process_layers_batch(
   // worker in most real jobs.
   work.allow_gpu = 1;
 
-  if (threads == 1) {
-    if (work.analytics_enabled) {
-      if (g_last_thread_metrics) {
-        free(g_last_thread_metrics);
-        g_last_thread_metrics = NULL;
-        g_last_thread_capacity = 0;
-      }
-      g_last_thread_metrics = (ProcessThreadMetrics*)calloc(
-          1, sizeof(ProcessThreadMetrics));
-      if (g_last_thread_metrics) {
-        g_last_thread_capacity = 1;
-        work.thread_metrics = g_last_thread_metrics;
-        work.thread_metrics_count = 1;
-      }
-    }
-    ProcessThreadScratch s = {0};
-    if (!_init_process_thread_scratch(&work, &s)) {
-      vs_mutex_destroy(&work.lock);
-      free(item_outputs); free(item_sizes); free(offs); free(lens); free(areas);
-      return 0;
-    }
-
-    for (int32_t i = 0; i < count; i++) {
-      _process_one_layer(&work, i, &s, 0);
-      if (work.failed) break;
-    }
-
-    _free_process_thread_scratch(&s);
-  } else {
-#ifdef _WIN32
-    HANDLE* hs = (HANDLE*)malloc((size_t)threads * sizeof(HANDLE));
-    ProcessThreadParams* params =
-        (ProcessThreadParams*)malloc((size_t)threads * sizeof(ProcessThreadParams));
-    if (!hs) {
-      vs_mutex_destroy(&work.lock);
-      free(item_outputs); free(item_sizes); free(offs); free(lens); free(areas);
-      return 0;
-    }
-    if (!params) {
-      free(hs);
-      vs_mutex_destroy(&work.lock);
-      free(item_outputs); free(item_sizes); free(offs); free(lens); free(areas);
-      return 0;
-    }
-    if (work.analytics_enabled) {
-      if (g_last_thread_metrics) {
-        free(g_last_thread_metrics);
-        g_last_thread_metrics = NULL;
-        g_last_thread_capacity = 0;
-      }
-      g_last_thread_metrics = (ProcessThreadMetrics*)calloc(
-          (size_t)threads, sizeof(ProcessThreadMetrics));
-      if (g_last_thread_metrics) {
-        g_last_thread_capacity = threads;
-        work.thread_metrics = g_last_thread_metrics;
-        work.thread_metrics_count = threads;
-      }
-    }
-    int32_t started = 0;
-    for (int32_t t = 0; t < threads; t++) {
-      params[t].work = &work;
-      params[t].thread_index = t;
-      hs[t] = CreateThread(NULL, 0, _process_batch_worker, &params[t], 0, NULL);
-      if (hs[t]) started++;
-    }
-    if (started == 0) {
-      free(hs);
-      vs_mutex_destroy(&work.lock);
-      free(item_outputs); free(item_sizes); free(offs); free(lens); free(areas);
-      return 0;
-    }
-    WaitForMultipleObjects((DWORD)started, hs, TRUE, INFINITE);
-    for (int32_t t = 0; t < threads; t++) if (hs[t]) CloseHandle(hs[t]);
-    free(hs);
-    free(params);
-#else
-    pthread_t* ts = (pthread_t*)malloc((size_t)threads * sizeof(pthread_t));
-    ProcessThreadParams* params =
-        (ProcessThreadParams*)malloc((size_t)threads * sizeof(ProcessThreadParams));
-    if (!ts) {
-      vs_mutex_destroy(&work.lock);
-      free(item_outputs); free(item_sizes); free(offs); free(lens); free(areas);
-      return 0;
-    }
-    if (!params) {
-      free(ts);
-      vs_mutex_destroy(&work.lock);
-      free(item_outputs); free(item_sizes); free(offs); free(lens); free(areas);
-      return 0;
-    }
-    if (work.analytics_enabled) {
-      if (g_last_thread_metrics) {
-        free(g_last_thread_metrics);
-        g_last_thread_metrics = NULL;
-        g_last_thread_capacity = 0;
-      }
-      g_last_thread_metrics = (ProcessThreadMetrics*)calloc(
-          (size_t)threads, sizeof(ProcessThreadMetrics));
-      if (g_last_thread_metrics) {
-        g_last_thread_capacity = threads;
-        work.thread_metrics = g_last_thread_metrics;
-        work.thread_metrics_count = threads;
-      }
-    }
-    int32_t started = 0;
-    for (int32_t t = 0; t < threads; t++) {
-      params[t].work = &work;
-      params[t].thread_index = t;
-      if (pthread_create(&ts[t], NULL, _process_batch_worker, &params[t]) == 0) started++;
-    }
-    if (started == 0) {
-      free(ts);
-      free(params);
-      vs_mutex_destroy(&work.lock);
-      free(item_outputs); free(item_sizes); free(offs); free(lens); free(areas);
-      return 0;
-    }
-    for (int32_t t = 0; t < started; t++) pthread_join(ts[t], NULL);
-    free(ts);
-    free(params);
-#endif
+  const int32_t ran = _run_process_workers(&work, threads);
+  if (!ran) {
+    vs_mutex_destroy(&work.lock);
+    free(item_outputs); free(item_sizes); free(offs); free(lens); free(areas);
+    return 0;
   }
 
   vs_mutex_destroy(&work.lock);
 
-  if (work.failed) {
+  if (_process_failed(&work)) {
     for (int32_t i = 0; i < count; i++) {
       if (item_outputs[i]) free(item_outputs[i]);
     }
@@ -1084,7 +2296,7 @@ int process_layers_batch(
   g_last_process_layers_gpu_successes = work.gpu_successes;
   g_last_process_layers_gpu_fallbacks = work.gpu_fallbacks;
   g_last_process_layers_cuda_error = work.last_cuda_error;
-  g_last_process_layers_thread_count = threads;
+  g_last_process_layers_thread_count = ran;
 
   int64_t total_len = 0;
   for (int32_t i = 0; i < count; i++) {
@@ -1133,6 +2345,118 @@ void free_native_area_buffer(AreaStatsResult* buffer) {
   free(buffer);
 }
 
+/**
+ * @brief Process layers and append each PNG straight to an open ZIP archive.
+ *
+ * Same per-layer work as process_layers_batch, but finished layers are
+ * written as "<layer_index_base + i + 1>.png" in index order as soon as they
+ * are ready. Workers may run at most `max_in_flight` layers ahead of the
+ * writer, so peak memory is bounded by the window rather than the batch.
+ * Area stats are written to the caller-provided `out_areas[count]`.
+ */
+int process_layers_batch_to_zip(
+    int64_t zip_handle,
+    const uint8_t* input_blob,
+    int32_t input_blob_len,
+    const int32_t* input_offsets,
+    const int32_t* input_lengths,
+    int32_t count,
+    int32_t layer_index_base,
+    int32_t encryption_key,
+    int32_t src_width,
+    int32_t height,
+    int32_t out_width,
+    int32_t channels,
+    double x_pixel_size_mm,
+    double y_pixel_size_mm,
+    int32_t png_level,
+    int64_t compress_plan,
+    int64_t encode_job,
+    int64_t layer_cache,
+    int32_t area_mode,
+    int32_t thread_count,
+    int32_t max_in_flight,
+    AreaStatsResult* out_areas) {
+  if (!zip_handle || !input_blob || input_blob_len <= 0 || !input_offsets ||
+      !input_lengths || count <= 0 || src_width <= 0 || height <= 0 ||
+      out_width <= 0 || (channels != 1 && channels != 3) || !out_areas) {
+    return 0;
+  }
+
+  if (!vs_zlib()->available) return 0;
+
+  int32_t threads = thread_count > 0 ? thread_count :
+      (g_process_layers_batch_threads > 0 ? g_process_layers_batch_threads : _cpu_threads());
+  if (threads < 1) threads = 1;
+  const int32_t area_threads = threads > count ? threads / count : 1;
+  if (threads > count) threads = count;
+
+  int32_t window = max_in_flight > 0 ? max_in_flight : threads * 2;
+  if (window < threads) window = threads;
+
+  // Slot pointers only; at most `window` of them are non-NULL at a time.
+  uint8_t** item_outputs = (uint8_t**)calloc((size_t)count, sizeof(uint8_t*));
+  int32_t* item_sizes = (int32_t*)calloc((size_t)count, sizeof(int32_t));
+  if (!item_outputs || !item_sizes) {
+    free(item_outputs); free(item_sizes);
+    return 0;
+  }
+
+  ProcessBatchWork work;
+  memset(&work, 0, sizeof(work));
+  work.input_blob = input_blob;
+  work.input_blob_len = input_blob_len;
+  work.input_offsets = input_offsets;
+  work.input_lengths = input_lengths;
+  work.count = count;
+  work.layer_index_base = layer_index_base;
+  work.encryption_key = encryption_key;
+  work.src_width = src_width;
+  work.height = height;
+  work.out_width = out_width;
+  work.channels = channels;
+  work.x_pixel_size_mm = x_pixel_size_mm;
+  work.y_pixel_size_mm = y_pixel_size_mm;
+  work.png_level = png_level;
+  work.plan = (VsCompressPlan*)(intptr_t)compress_plan;
+  work.job = (VsEncodeJob*)(intptr_t)encode_job;
+  work.cache = (VsLayerCache*)(intptr_t)layer_cache;
+  work.area_mode = area_mode;
+  work.out_items = item_outputs;
+  work.out_sizes = item_sizes;
+  work.out_areas = out_areas;
+  work.allow_gpu = 1;
+  work.area_threads = area_threads;
+  work.deflate_threads = vs_deflate_split_threads(work.job, area_threads);
+  work.decode_threads = area_threads;
+  work.zip_handle = zip_handle;
+  work.window = window;
+  work.analytics_enabled = g_process_layers_analytics_enabled;
+  vs_mutex_init(&work.lock);
+  vs_cond_init(&work.emit_cond);
+
+  const int32_t ran = _run_process_workers(&work, threads);
+
+  vs_cond_destroy(&work.emit_cond);
+  vs_mutex_destroy(&work.lock);
+
+  for (int32_t i = 0; i < count; i++) {
+    if (item_outputs[i]) free(item_outputs[i]);
+  }
+  free(item_outputs);
+  free(item_sizes);
+
+  if (!ran || _process_failed(&work) || work.next_emit != count) return 0;
+
+  g_last_process_layers_backend = work.used_gpu;
+  g_last_process_layers_gpu_attempts = work.gpu_attempts;
+  g_last_process_layers_gpu_successes = work.gpu_successes;
+  g_last_process_layers_gpu_fallbacks = work.gpu_fallbacks;
+  g_last_process_layers_cuda_error = work.last_cuda_error;
+  g_last_process_layers_thread_count = ran;
+  return 1;
+}
+
 // ═══════════════════════════════════════════════════════════════════════════
 // PHASED PIPELINE (CPU+GPU HYBRID)
 // ═══════════════════════════════════════════════════════════════════════════
@@ -1164,117 +2488,75 @@ typedef struct DecodePhaseWork {
   int32_t height;
   double x_pixel_size_mm;
   double y_pixel_size_mm;
+  int32_t area_mode;
+  int32_t decode_threads;       // threads per layer for the RLE decode
 
   uint8_t** out_pixels;         // pre-allocated pixel buffers
   AreaStatsResult* out_areas;
 
-  int32_t next_index;
-  int32_t failed;
-  vs_mutex lock;
+  VsWorkQueue queue;         // cancelled on the first failure
 } DecodePhaseWork;
 
-static int _take_decode_range(DecodePhaseWork* w, int32_t claim,
-                               int32_t* out_start, int32_t* out_end) {
-  int ok = 0;
-  vs_mutex_lock(&w->lock);
-  if (!w->failed && w->next_index < w->count) {
-    *out_start = w->next_index;
-    int32_t end = w->next_index + claim;
-    if (end > w->count) end = w->count;
-    w->next_index = end;
-    *out_end = end;
-    ok = 1;
-  }
-  vs_mutex_unlock(&w->lock);
-  return ok;
-}
-
 static void _decode_one_layer(DecodePhaseWork* w, int32_t i) {
   const int32_t off = w->input_offsets[i];
   const int32_t len = w->input_lengths[i];
   if (off < 0 || len <= 0 || off + len > w->input_blob_len) {
-    vs_mutex_lock(&w->lock); w->failed = 1; vs_mutex_unlock(&w->lock);
+    vs_queue_cancel(&w->queue);
     return;
   }
 
   const int32_t pixel_count = w->src_width * w->height;
-  if (!decrypt_and_decode_layer(
+  if (!decrypt_and_decode_layer_mt(
           w->input_blob + off, len,
           w->layer_index_base + i, w->encryption_key,
-          pixel_count, w->out_pixels[i])) {
-    vs_mutex_lock(&w->lock); w->failed = 1; vs_mutex_unlock(&w->lock);
+          pixel_count, w->decode_threads, w->out_pixels[i])) {
+    vs_queue_cancel(&w->queue);
     return;
   }
 
-  if (!compute_layer_area_stats(
+  if (!_layer_area_stats(
+          w->input_blob + off, len,
+          w->layer_index_base + i, w->encryption_key,
           w->out_pixels[i], w->src_width, w->height,
           w->x_pixel_size_mm, w->y_pixel_size_mm,
+          w->area_mode, 1,
+          NULL,
           &w->out_areas[i])) {
-    vs_mutex_lock(&w->lock); w->failed = 1; vs_mutex_unlock(&w->lock);
+    vs_queue_cancel(&w->queue);
     return;
   }
 }
 
-#ifdef _WIN32
-static DWORD WINAPI _decode_phase_worker(LPVOID arg) {
-  DecodePhaseWork* w = (DecodePhaseWork*)arg;
-  int32_t start, end;
-  while (_take_decode_range(w, 4, &start, &end)) {
-    for (int32_t i = start; i < end; i++) _decode_one_layer(w, i);
-  }
-  return 0;
-}
-#else
-static void* _decode_phase_worker(void* arg) {
-  DecodePhaseWork* w = (DecodePhaseWork*)arg;
+static void _decode_phase_task(void* ctx, int32_t worker_index, void** scratch) {
+  DecodePhaseWork* w = (DecodePhaseWork*)ctx;
+  (void)scratch;
   int32_t start, end;
-  while (_take_decode_range(w, 4, &start, &end)) {
-    for (int32_t i = start; i < end; i++) _decode_one_layer(w, i);
+  while (vs_queue_take(&w->queue, worker_index, &start, &end)) {
+    for (int32_t p = start; p < end; p++) {
+      _decode_one_layer(w, vs_queue_item(&w->queue, p));
+    }
   }
-  return NULL;
 }
-#endif
 
 static int _run_decode_phase(DecodePhaseWork* w, int32_t threads) {
-  vs_mutex_init(&w->lock);
-  w->next_index = 0;
-  w->failed = 0;
+  w->decode_threads = threads > w->count ? threads / w->count : 1;
+  if (threads > w->count) threads = w->count;
+  if (threads < 1) threads = 1;
+  if (!vs_queue_init(&w->queue, w->count, threads, 4, 0)) return 0;
+  vs_queue_order_by_cost(&w->queue, w->input_lengths);
 
-  if (threads <= 1 || w->count <= 1) {
-    for (int32_t i = 0; i < w->count && !w->failed; i++) {
+  int ran = 1;
+  if (threads == 1) {
+    for (int32_t i = 0; i < w->count && !vs_queue_cancelled(&w->queue); i++) {
       _decode_one_layer(w, i);
     }
   } else {
-    if (threads > w->count) threads = w->count;
-#ifdef _WIN32
-    HANDLE* hs = (HANDLE*)malloc((size_t)threads * sizeof(HANDLE));
-    if (!hs) { vs_mutex_destroy(&w->lock); return 0; }
-    int32_t started = 0;
-    for (int32_t t = 0; t < threads; t++) {
-      hs[t] = CreateThread(NULL, 0, _decode_phase_worker, w, 0, NULL);
-      if (hs[t]) started++;
-    }
-    if (started > 0)
-      WaitForMultipleObjects((DWORD)started, hs, TRUE, INFINITE);
-    for (int32_t t = 0; t < threads; t++) if (hs[t]) CloseHandle(hs[t]);
-    free(hs);
-    if (started == 0) { vs_mutex_destroy(&w->lock); return 0; }
-#else
-    pthread_t* ts = (pthread_t*)malloc((size_t)threads * sizeof(pthread_t));
-    if (!ts) { vs_mutex_destroy(&w->lock); return 0; }
-    int32_t started = 0;
-    for (int32_t t = 0; t < threads; t++) {
-      if (pthread_create(&ts[t], NULL, _decode_phase_worker, w) == 0) started++;
-    }
-    if (started > 0)
-      for (int32_t t = 0; t < started; t++) pthread_join(ts[t], NULL);
-    free(ts);
-    if (started == 0) { vs_mutex_destroy(&w->lock); return 0; }
-#endif
+    ran = vs_pool_run(threads, VS_POOL_NO_SCRATCH, NULL, _decode_phase_task, w) > 0;
   }
 
-  vs_mutex_destroy(&w->lock);
-  return w->failed ? 0 : 1;
+  const int ok = ran && !vs_queue_cancelled(&w->queue);
+  vs_queue_destroy(&w->queue);
+  return ok;
 }
 
 // ── Phase 3 worker: Compress + PNG Wrap ─────────────────────────────────────
@@ -1287,65 +2569,73 @@ typedef struct CompressPhaseWork {
   int32_t height;
   int32_t channels;
   int32_t png_level;
+  VsDeflateParams deflate;   // png_level plus the job's stream settings
+  VsEncodeJob* job;          // encode_job arg, or NULL for the defaults
+  int32_t deflate_threads;   // threads per layer for split deflate
 
   uint8_t** out_items;       // output PNG buffers
   int32_t* out_sizes;
+  const int32_t* costs;      // per-layer cost estimate (encoded input size)
 
-  int32_t next_index;
-  int32_t failed;
-  vs_mutex lock;
+  VsWorkQueue queue;         // cancelled on the first failure
 } CompressPhaseWork;
 
-static int _take_compress_range(CompressPhaseWork* w, int32_t claim,
-                                 int32_t* out_start, int32_t* out_end) {
-  int ok = 0;
-  vs_mutex_lock(&w->lock);
-  if (!w->failed && w->next_index < w->count) {
-    *out_start = w->next_index;
-    int32_t end = w->next_index + claim;
-    if (end > w->count) end = w->count;
-    w->next_index = end;
-    *out_end = end;
-    ok = 1;
-  }
-  vs_mutex_unlock(&w->lock);
-  return ok;
+// Per-worker deflate stream and output buffer, kept in the
+// VS_POOL_SLOT_COMPRESS slot.
+typedef struct CompressThreadScratch {
+  uint8_t* compressed;
+  size_t compressed_cap;
+  VsDeflater deflater;
+  VsMaskDeflater mask_deflater;
+} CompressThreadScratch;
+
+static void _free_compress_thread_scratch(void* p) {
+  CompressThreadScratch* s = (CompressThreadScratch*)p;
+  if (!s) return;
+  free(s->compressed);
+  vs_deflater_end(&s->deflater);
+  vs_mask_deflater_free(&s->mask_deflater);
+  free(s);
 }
 
-static void _compress_one_layer(CompressPhaseWork* w, int32_t i) {
-  int32_t level = w->png_level;
-  if (level < 0) level = 0;
-  if (level > 9) level = 9;
-
-  unsigned long comp_cap =
-      (unsigned long)w->scanlines_len +
-      ((unsigned long)w->scanlines_len / 1000u) + 64u;
-  uint8_t* compressed = (uint8_t*)malloc((size_t)comp_cap);
+static void _compress_one_layer(
+    CompressPhaseWork* w,
+    int32_t i,
+    CompressThreadScratch* s) {
+  const size_t comp_cap = vs_deflate_bound(&w->deflate, (size_t)w->scanlines_len);
+  if (s->compressed_cap < comp_cap) {
+    free(s->compressed);
+    s->compressed = (uint8_t*)malloc(comp_cap);
+    s->compressed_cap = s->compressed ? comp_cap : 0;
+  }
+  uint8_t* compressed = s->compressed;
   if (!compressed) {
-    vs_mutex_lock(&w->lock); w->failed = 1; vs_mutex_unlock(&w->lock);
+    vs_queue_cancel(&w->queue);
     return;
   }
 
-  unsigned long comp_len = comp_cap;
-  const int ok_comp = g_zlib.compress2_ptr(
-      compressed, &comp_len,
-      w->scanlines[i], (unsigned long)w->scanlines_len,
-      level);
-  if (ok_comp != 0 || comp_len == 0) {
-    free(compressed);
-    vs_mutex_lock(&w->lock); w->failed = 1; vs_mutex_unlock(&w->lock);
+  size_t comp_len = 0;
+  const int deflated = vs_deflate_auto_claim(w->job, w->png_level)
+      ? vs_deflate_zlib_trial(&s->deflater, w->job, w->png_level, w->scanlines[i],
+                              (size_t)w->scanlines_len, compressed,
+                              s->compressed_cap, &comp_len)
+      : _deflate_scanlines(&s->deflater, &s->mask_deflater, &w->deflate,
+                           1 + w->out_width * w->channels, w->scanlines[i],
+                           (size_t)w->scanlines_len, w->deflate_threads,
+                           compressed, s->compressed_cap, &comp_len);
+  if (!deflated) {
+    vs_queue_cancel(&w->queue);
     return;
   }
 
   int32_t png_len = 0;
   uint8_t* png = _build_png_from_idat(
       w->out_width, w->height, w->channels,
-      compressed, (size_t)comp_len, &png_len);
-  free(compressed);
+      compressed, comp_len, &png_len);
 
   if (!png || png_len <= 0) {
     free(png);
-    vs_mutex_lock(&w->lock); w->failed = 1; vs_mutex_unlock(&w->lock);
+    vs_queue_cancel(&w->queue);
     return;
   }
 
@@ -1353,66 +2643,41 @@ static void _compress_one_layer(CompressPhaseWork* w, int32_t i) {
   w->out_sizes[i] = png_len;
 }
 
-#ifdef _WIN32
-static DWORD WINAPI _compress_phase_worker(LPVOID arg) {
-  CompressPhaseWork* w = (CompressPhaseWork*)arg;
-  int32_t start, end;
-  while (_take_compress_range(w, 4, &start, &end)) {
-    for (int32_t i = start; i < end; i++) _compress_one_layer(w, i);
+static void _compress_phase_task(void* ctx, int32_t worker_index, void** scratch) {
+  CompressPhaseWork* w = (CompressPhaseWork*)ctx;
+  CompressThreadScratch* s = (CompressThreadScratch*)*scratch;
+  if (!s) {
+    s = (CompressThreadScratch*)calloc(1, sizeof(CompressThreadScratch));
+    if (!s) {
+      vs_queue_cancel(&w->queue);
+      return;
+    }
+    *scratch = s;
   }
-  return 0;
-}
-#else
-static void* _compress_phase_worker(void* arg) {
-  CompressPhaseWork* w = (CompressPhaseWork*)arg;
   int32_t start, end;
-  while (_take_compress_range(w, 4, &start, &end)) {
-    for (int32_t i = start; i < end; i++) _compress_one_layer(w, i);
+  while (vs_queue_take(&w->queue, worker_index, &start, &end)) {
+    for (int32_t p = start; p < end; p++) {
+      _compress_one_layer(w, vs_queue_item(&w->queue, p), s);
+    }
   }
-  return NULL;
 }
-#endif
 
 static int _run_compress_phase(CompressPhaseWork* w, int32_t threads) {
-  vs_mutex_init(&w->lock);
-  w->next_index = 0;
-  w->failed = 0;
+  w->deflate_threads =
+      vs_deflate_split_threads(w->job, threads > w->count ? threads / w->count : 1);
+  if (threads > w->count) threads = w->count;
+  if (threads < 1) threads = 1;
+  if (!vs_queue_init(&w->queue, w->count, threads, 4, 0)) return 0;
+  vs_queue_order_by_cost(&w->queue, w->costs);
 
-  if (threads <= 1 || w->count <= 1) {
-    for (int32_t i = 0; i < w->count && !w->failed; i++) {
-      _compress_one_layer(w, i);
-    }
-  } else {
-    if (threads > w->count) threads = w->count;
-#ifdef _WIN32
-    HANDLE* hs = (HANDLE*)malloc((size_t)threads * sizeof(HANDLE));
-    if (!hs) { vs_mutex_destroy(&w->lock); return 0; }
-    int32_t started = 0;
-    for (int32_t t = 0; t < threads; t++) {
-      hs[t] = CreateThread(NULL, 0, _compress_phase_worker, w, 0, NULL);
-      if (hs[t]) started++;
-    }
-    if (started > 0)
-      WaitForMultipleObjects((DWORD)started, hs, TRUE, INFINITE);
-    for (int32_t t = 0; t < threads; t++) if (hs[t]) CloseHandle(hs[t]);
-    free(hs);
-    if (started == 0) { vs_mutex_destroy(&w->lock); return 0; }
-#else
-    pthread_t* ts = (pthread_t*)malloc((size_t)threads * sizeof(pthread_t));
-    if (!ts) { vs_mutex_destroy(&w->lock); return 0; }
-    int32_t started = 0;
-    for (int32_t t = 0; t < threads; t++) {
-      if (pthread_create(&ts[t], NULL, _compress_phase_worker, w) == 0) started++;
-    }
-    if (started > 0)
-      for (int32_t t = 0; t < started; t++) pthread_join(ts[t], NULL);
-    free(ts);
-    if (started == 0) { vs_mutex_destroy(&w->lock); return 0; }
-#endif
-  }
+  // Serial runs go through the pool too so the caller's buffer is reused.
+  const int ran = vs_pool_run(
+      threads, VS_POOL_SLOT_COMPRESS, _free_compress_thread_scratch,
+      _compress_phase_task, w) > 0;
 
-  vs_mutex_destroy(&w->lock);
-  return w->failed ? 0 : 1;
+  const int ok = ran && !vs_queue_cancelled(&w->queue);
+  vs_queue_destroy(&w->queue);
+  return ok;
 }
 
 // ── Phase 2 helper: CPU scanline fallback ───────────────────────────────────
@@ -1426,96 +2691,44 @@ typedef struct ScanlinePhaseWork {
   int32_t channels;
   uint8_t** out_scanlines;
   int32_t scanlines_len;
-  int32_t next_index;
-  int32_t failed;
-  vs_mutex lock;
+  VsWorkQueue queue;         // cancelled on the first failure
 } ScanlinePhaseWork;
 
-static int _take_scanline_range(ScanlinePhaseWork* w, int32_t claim,
-                                 int32_t* out_start, int32_t* out_end) {
-  int ok = 0;
-  vs_mutex_lock(&w->lock);
-  if (!w->failed && w->next_index < w->count) {
-    *out_start = w->next_index;
-    int32_t end = w->next_index + claim;
-    if (end > w->count) end = w->count;
-    w->next_index = end;
-    *out_end = end;
-    ok = 1;
-  }
-  vs_mutex_unlock(&w->lock);
-  return ok;
-}
-
 static void _scanline_one_layer(ScanlinePhaseWork* w, int32_t i) {
   if (!build_png_scanlines(
           w->pixels[i], w->src_width, w->height,
           w->out_width, w->channels,
           w->out_scanlines[i], w->scanlines_len)) {
-    vs_mutex_lock(&w->lock); w->failed = 1; vs_mutex_unlock(&w->lock);
+    vs_queue_cancel(&w->queue);
   }
 }
 
-#ifdef _WIN32
-static DWORD WINAPI _scanline_phase_worker(LPVOID arg) {
-  ScanlinePhaseWork* w = (ScanlinePhaseWork*)arg;
-  int32_t start, end;
-  while (_take_scanline_range(w, 4, &start, &end)) {
-    for (int32_t i = start; i < end; i++) _scanline_one_layer(w, i);
-  }
-  return 0;
-}
-#else
-static void* _scanline_phase_worker(void* arg) {
-  ScanlinePhaseWork* w = (ScanlinePhaseWork*)arg;
+static void _scanline_phase_task(void* ctx, int32_t worker_index, void** scratch) {
+  ScanlinePhaseWork* w = (ScanlinePhaseWork*)ctx;
+  (void)scratch;
   int32_t start, end;
-  while (_take_scanline_range(w, 4, &start, &end)) {
+  while (vs_queue_take(&w->queue, worker_index, &start, &end)) {
     for (int32_t i = start; i < end; i++) _scanline_one_layer(w, i);
   }
-  return NULL;
 }
-#endif
 
 static int _run_scanline_phase_cpu(ScanlinePhaseWork* w, int32_t threads) {
-  vs_mutex_init(&w->lock);
-  w->next_index = 0;
-  w->failed = 0;
+  if (threads > w->count) threads = w->count;
+  if (threads < 1) threads = 1;
+  if (!vs_queue_init(&w->queue, w->count, threads, 4, 0)) return 0;
 
-  if (threads <= 1 || w->count <= 1) {
-    for (int32_t i = 0; i < w->count && !w->failed; i++) {
+  int ran = 1;
+  if (threads == 1) {
+    for (int32_t i = 0; i < w->count && !vs_queue_cancelled(&w->queue); i++) {
       _scanline_one_layer(w, i);
     }
   } else {
-    if (threads > w->count) threads = w->count;
-#ifdef _WIN32
-    HANDLE* hs = (HANDLE*)malloc((size_t)threads * sizeof(HANDLE));
-    if (!hs) { vs_mutex_destroy(&w->lock); return 0; }
-    int32_t started = 0;
-    for (int32_t t = 0; t < threads; t++) {
-      hs[t] = CreateThread(NULL, 0, _scanline_phase_worker, w, 0, NULL);
-      if (hs[t]) started++;
-    }
-    if (started > 0)
-      WaitForMultipleObjects((DWORD)started, hs, TRUE, INFINITE);
-    for (int32_t t = 0; t < threads; t++) if (hs[t]) CloseHandle(hs[t]);
-    free(hs);
-    if (started == 0) { vs_mutex_destroy(&w->lock); return 0; }
-#else
-    pthread_t* ts = (pthread_t*)malloc((size_t)threads * sizeof(pthread_t));
-    if (!ts) { vs_mutex_destroy(&w->lock); return 0; }
-    int32_t started = 0;
-    for (int32_t t = 0; t < threads; t++) {
-      if (pthread_create(&ts[t], NULL, _scanline_phase_worker, w) == 0) started++;
-    }
-    if (started > 0)
-      for (int32_t t = 0; t < started; t++) pthread_join(ts[t], NULL);
-    free(ts);
-    if (started == 0) { vs_mutex_destroy(&w->lock); return 0; }
-#endif
+    ran = vs_pool_run(threads, VS_POOL_NO_SCRATCH, NULL, _scanline_phase_task, w) > 0;
   }
 
-  vs_mutex_destroy(&w->lock);
-  return w->failed ? 0 : 1;
+  const int ok = ran && !vs_queue_cancelled(&w->queue);
+  vs_queue_destroy(&w->queue);
+  return ok;
 }
 
 // ── Phased batch entry point ────────────────────────────────────────────────
@@ -1548,6 +2761,8 @@ static int _phased_chunk(
     double x_pixel_size_mm,
     double y_pixel_size_mm,
     int32_t png_level,
+    VsEncodeJob* job,
+    int32_t area_mode,
     int32_t threads,
     int32_t use_gpu_batch,
     int32_t pixel_count,
@@ -1589,6 +2804,7 @@ static int _phased_chunk(
     dw.height = height;
     dw.x_pixel_size_mm = x_pixel_size_mm;
     dw.y_pixel_size_mm = y_pixel_size_mm;
+    dw.area_mode = area_mode;
     dw.out_pixels = pixels;
     dw.out_areas = areas;
 
@@ -1701,8 +2917,11 @@ static int _phased_chunk(
     cw.height = height;
     cw.channels = channels;
     cw.png_level = png_level;
+    cw.deflate = vs_deflate_params(job, png_level);
+    cw.job = job;
     cw.out_items = item_outputs;
     cw.out_sizes = item_sizes;
+    cw.costs = input_lengths;
 
     if (!_run_compress_phase(&cw, threads)) goto chunk_fail;
   }
@@ -1741,6 +2960,8 @@ int process_layers_batch_phased(
     double x_pixel_size_mm,
     double y_pixel_size_mm,
     int32_t png_level,
+    int64_t encode_job,
+    int32_t area_mode,
     int32_t thread_count,
     int32_t use_gpu_batch,
     uint8_t** out_blob,
@@ -1755,15 +2976,17 @@ int process_layers_batch_phased(
     return 0;
   }
 
-  _init_zlib();
-  if (!g_zlib.available) return 0;
+  if (!vs_zlib()->available) return 0;
 
   g_last_phased_gpu_batch_ok = 0;
+  g_last_cost_count = 0;  // phases are not timed per layer
   g_last_process_layers_backend = 0;
   g_last_process_layers_gpu_attempts = 0;
   g_last_process_layers_gpu_successes = 0;
   g_last_process_layers_gpu_fallbacks = 0;
   g_last_process_layers_cuda_error = 0;
+  g_last_process_layers_dedup_hits = 0;  // phases do not dedup
+  g_last_process_layers_cache_hits = 0;
 
   int32_t threads = thread_count > 0 ? thread_count :
       (g_process_layers_batch_threads > 0 ? g_process_layers_batch_threads : _cpu_threads());
@@ -1842,21 +3065,26 @@ int process_layers_batch_phased(
     if (chunk_count > max_chunk) chunk_count = max_chunk;
 
     int32_t chunk_gpu_ok = 0;
-    if (!_phased_chunk(
-            input_blob, input_blob_len,
-            input_offsets + start,
-            input_lengths + start,
-            chunk_count,
-            layer_index_base + start,
-            encryption_key,
-            src_width, height, out_width, channels,
-            x_pixel_size_mm, y_pixel_size_mm,
-            png_level, threads, use_gpu_batch,
-            pixel_count, scanlines_len,
-            item_outputs + start,
-            item_sizes + start,
-            areas + start,
-            &chunk_gpu_ok)) {
+    const int32_t prev_background = vs_pool_set_background(
+        vs_encode_job_background((VsEncodeJob*)(intptr_t)encode_job));
+    const int chunk_ok = _phased_chunk(
+        input_blob, input_blob_len,
+        input_offsets + start,
+        input_lengths + start,
+        chunk_count,
+        layer_index_base + start,
+        encryption_key,
+        src_width, height, out_width, channels,
+        x_pixel_size_mm, y_pixel_size_mm,
+        png_level, (VsEncodeJob*)(intptr_t)encode_job, area_mode,
+        threads, use_gpu_batch,
+        pixel_count, scanlines_len,
+        item_outputs + start,
+        item_sizes + start,
+        areas + start,
+        &chunk_gpu_ok);
+    vs_pool_set_background(prev_background);
+    if (!chunk_ok) {
       // Chunk failed — clean up everything
       for (int32_t i = 0; i < count; i++) {
         if (item_outputs[i]) free(item_outputs[i]);
@@ -0,0 +1,477 @@
+/**
+ * @file layer_source.c
+ * @brief Native layer input: reads raw CTB layer payloads straight from disk.
+ *
+ * A layer source is opened on the CTB file together with the layer
+ * offset/length table. Chunks of consecutive layers are then handed out as
+ * (blob, offsets, lengths) triples that process_layers_batch and friends
+ * consume directly, without the bytes ever passing through Dart.
+ *
+ * Two backends are available:
+ *   - mmap:  the file is mapped read-only; chunks point into the mapping
+ *            (zero-copy) and the next chunk is pre-faulted with
+ *            madvise(MADV_WILLNEED) while the current one is processed.
+ *   - pread: chunks are read with positional reads into a double buffer;
+ *            a read-ahead thread fills the next chunk in the background.
+ */
+#include "voxelshift_native.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE vs_file;
+#define VS_INVALID_FILE INVALID_HANDLE_VALUE
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+typedef int vs_file;
+#define VS_INVALID_FILE (-1)
+#endif
+
+/**
+ * @brief Where one chunk's bytes live and how to address each layer.
+ */
+typedef struct LayerChunkBuffer {
+  uint8_t* data;
+  int64_t capacity;
+  int32_t* offsets;
+  int32_t* lengths;
+  int32_t layer_capacity;
+} LayerChunkBuffer;
+
+/**
+ * @brief Opaque layer source context.
+ */
+typedef struct VsLayerSource {
+  int32_t backend;
+  vs_file file;
+  int64_t file_size;
+#ifdef _WIN32
+  HANDLE mapping;
+#endif
+  const uint8_t* map;
+
+  uint32_t* layer_offsets;
+  uint32_t* layer_lengths;
+  int32_t layer_count;
+
+  // Double buffer used by the pread backend (and by mmap chunks whose span
+  // doesn't fit the int32 blob length). `current` is the buffer handed out
+  // by the last fetch; read-ahead always targets the other one.
+  LayerChunkBuffer buffers[2];
+  int32_t current;
+
+  // Read-ahead state (pread backend).
+  int32_t ahead_start;
+  int32_t ahead_end;
+  int32_t ahead_ok;
+  int32_t ahead_running;
+#ifdef _WIN32
+  HANDLE ahead_thread;
+#else
+  pthread_t ahead_thread;
+#endif
+} VsLayerSource;
+
+static void _close_file(vs_file f) {
+#ifdef _WIN32
+  CloseHandle(f);
+#else
+  close(f);
+#endif
+}
+
+static vs_file _open_file(const char* path, int64_t* out_size) {
+#ifdef _WIN32
+  HANDLE f = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                         OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (f == INVALID_HANDLE_VALUE) return VS_INVALID_FILE;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(f, &size)) {
+    CloseHandle(f);
+    return VS_INVALID_FILE;
+  }
+  *out_size = (int64_t)size.QuadPart;
+  return f;
+#else
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0) return VS_INVALID_FILE;
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return VS_INVALID_FILE;
+  }
+  *out_size = (int64_t)st.st_size;
+  return fd;
+#endif
+}
+
+/**
+ * @brief Positional read of exactly `len` bytes; does not move a file cursor,
+ * so the read-ahead thread and the caller never race on it.
+ */
+static int _read_at(vs_file f, int64_t offset, uint8_t* out, int64_t len) {
+  while (len > 0) {
+#ifdef _WIN32
+    OVERLAPPED ov;
+    memset(&ov, 0, sizeof(ov));
+    ov.Offset = (DWORD)(offset & 0xFFFFFFFFu);
+    ov.OffsetHigh = (DWORD)((uint64_t)offset >> 32);
+    const DWORD want = len > 0x40000000 ? 0x40000000 : (DWORD)len;
+    DWORD got = 0;
+    if (!ReadFile(f, out, want, &got, &ov) || got == 0) return 0;
+#else
+    const size_t want = len > 0x40000000 ? 0x40000000 : (size_t)len;
+    const ssize_t got = pread(f, out, want, (off_t)offset);
+    if (got <= 0) return 0;
+#endif
+    out += got;
+    offset += got;
+    len -= got;
+  }
+  return 1;
+}
+
+static int _map_file(VsLayerSource* s) {
+  if (s->file_size <= 0 || (uint64_t)s->file_size > (uint64_t)SIZE_MAX) return 0;
+#ifdef _WIN32
+  s->mapping = CreateFileMappingA(s->file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (!s->mapping) return 0;
+  s->map = (const uint8_t*)MapViewOfFile(s->mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!s->map) {
+    CloseHandle(s->mapping);
+    s->mapping = NULL;
+    return 0;
+  }
+#else
+  void* p = mmap(NULL, (size_t)s->file_size, PROT_READ, MAP_PRIVATE, s->file, 0);
+  if (p == MAP_FAILED) return 0;
+  s->map = (const uint8_t*)p;
+  madvise(p, (size_t)s->file_size, MADV_SEQUENTIAL);
+#endif
+  return 1;
+}
+
+static void _unmap_file(VsLayerSource* s) {
+  if (!s->map) return;
+#ifdef _WIN32
+  UnmapViewOfFile(s->map);
+  CloseHandle(s->mapping);
+  s->mapping = NULL;
+#else
+  munmap((void*)s->map, (size_t)s->file_size);
+#endif
+  s->map = NULL;
+}
+
+/**
+ * @brief File byte range covered by layers [start, end) and their total size.
+ */
+static void _chunk_extent(
+    const VsLayerSource* s,
+    int32_t start,
+    int32_t end,
+    int64_t* out_lo,
+    int64_t* out_hi,
+    int64_t* out_total) {
+  int64_t lo = INT64_MAX, hi = 0, total = 0;
+  for (int32_t i = start; i < end; i++) {
+    const int64_t a = s->layer_offsets[i];
+    const int64_t b = a + s->layer_lengths[i];
+    if (a < lo) lo = a;
+    if (b > hi) hi = b;
+    total += s->layer_lengths[i];
+  }
+  *out_lo = lo;
+  *out_hi = hi;
+  *out_total = total;
+}
+
+/**
+ * @brief Layers are usually stored back to back; read them as one span when
+ * the gaps are small, otherwise pack them individually.
+ */
+static int _span_is_dense(int64_t lo, int64_t hi, int64_t total) {
+  return hi - lo <= total + total / 4 + 65536 && hi - lo <= INT32_MAX;
+}
+
+static int _ensure_buffer(LayerChunkBuffer* b, int64_t bytes, int32_t layers) {
+  if (bytes > b->capacity) {
+    uint8_t* grown = (uint8_t*)realloc(b->data, (size_t)bytes);
+    if (!grown) return 0;
+    b->data = grown;
+    b->capacity = bytes;
+  }
+  if (layers > b->layer_capacity) {
+    int32_t* o = (int32_t*)realloc(b->offsets, (size_t)layers * sizeof(int32_t));
+    if (!o) return 0;
+    b->offsets = o;
+    int32_t* l = (int32_t*)realloc(b->lengths, (size_t)layers * sizeof(int32_t));
+    if (!l) return 0;
+    b->lengths = l;
+    b->layer_capacity = layers;
+  }
+  return 1;
+}
+
+/**
+ * @brief Read layers [start, end) into buffer `b` (copying backend).
+ */
+static int _read_chunk_into(
+    VsLayerSource* s,
+    LayerChunkBuffer* b,
+    int32_t start,
+    int32_t end) {
+  int64_t lo, hi, total;
+  _chunk_extent(s, start, end, &lo, &hi, &total);
+  if (total > INT32_MAX) return 0;
+
+  const int dense = _span_is_dense(lo, hi, total);
+  if (!_ensure_buffer(b, dense ? hi - lo : total, end - start)) return 0;
+
+  if (dense) {
+    if (s->map) {
+      memcpy(b->data, s->map + lo, (size_t)(hi - lo));
+    } else if (!_read_at(s->file, lo, b->data, hi - lo)) {
+      return 0;
+    }
+    for (int32_t i = start; i < end; i++) {
+      b->offsets[i - start] = (int32_t)(s->layer_offsets[i] - lo);
+      b->lengths[i - start] = (int32_t)s->layer_lengths[i];
+    }
+    return 1;
+  }
+
+  int32_t pos = 0;
+  for (int32_t i = start; i < end; i++) {
+    const uint32_t len = s->layer_lengths[i];
+    if (s->map) {
+      memcpy(b->data + pos, s->map + s->layer_offsets[i], len);
+    } else if (!_read_at(s->file, s->layer_offsets[i], b->data + pos, len)) {
+      return 0;
+    }
+    b->offsets[i - start] = pos;
+    b->lengths[i - start] = (int32_t)len;
+    pos += (int32_t)len;
+  }
+  return 1;
+}
+
+static int64_t _chunk_blob_len(const LayerChunkBuffer* b, int32_t layers) {
+  int64_t len = 0;
+  for (int32_t i = 0; i < layers; i++) {
+    if ((int64_t)b->offsets[i] + b->lengths[i] > len) {
+      len = (int64_t)b->offsets[i] + b->lengths[i];
+    }
+  }
+  return len;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI _read_ahead_worker(LPVOID arg) {
+#else
+static void* _read_ahead_worker(void* arg) {
+#endif
+  VsLayerSource* s = (VsLayerSource*)arg;
+  s->ahead_ok = _read_chunk_into(
+      s, &s->buffers[1 - s->current], s->ahead_start, s->ahead_end);
+#ifdef _WIN32
+  return 0;
+#else
+  return NULL;
+#endif
+}
+
+static void _join_read_ahead(VsLayerSource* s) {
+  if (!s->ahead_running) return;
+#ifdef _WIN32
+  WaitForSingleObject(s->ahead_thread, INFINITE);
+  CloseHandle(s->ahead_thread);
+#else
+  pthread_join(s->ahead_thread, NULL);
+#endif
+  s->ahead_running = 0;
+}
+
+/**
+ * @brief Start reading layers [start, end) into the spare buffer.
+ */
+static void _start_read_ahead(VsLayerSource* s, int32_t start, int32_t end) {
+  s->ahead_start = start;
+  s->ahead_end = end;
+  s->ahead_ok = 0;
+#ifdef _WIN32
+  s->ahead_thread = CreateThread(NULL, 0, _read_ahead_worker, s, 0, NULL);
+  s->ahead_running = s->ahead_thread != NULL;
+#else
+  s->ahead_running = pthread_create(&s->ahead_thread, NULL, _read_ahead_worker, s) == 0;
+#endif
+  if (!s->ahead_running) s->ahead_end = s->ahead_start = 0;
+}
+
+/**
+ * @brief Ask the kernel to start paging in layers [start, end).
+ */
+static void _advise_will_need(VsLayerSource* s, int32_t start, int32_t end) {
+  if (start >= end) return;
+  int64_t lo, hi, total;
+  _chunk_extent(s, start, end, &lo, &hi, &total);
+#ifdef _WIN32
+  WIN32_MEMORY_RANGE_ENTRY range;
+  range.VirtualAddress = (PVOID)(s->map + lo);
+  range.NumberOfBytes = (SIZE_T)(hi - lo);
+  PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+  const int64_t page = (int64_t)sysconf(_SC_PAGESIZE);
+  const int64_t aligned = lo - (lo % page);
+  madvise((void*)(s->map + aligned), (size_t)(hi - aligned), MADV_WILLNEED);
+#endif
+}
+
+/**
+ * @brief Open a CTB file for native layer reads.
+ */
+int64_t vs_layer_source_open(
+    const char* path,
+    const uint32_t* layer_offsets,
+    const uint32_t* layer_lengths,
+    int32_t layer_count,
+    int32_t backend) {
+  if (!path || !layer_offsets || !layer_lengths || layer_count <= 0 ||
+      backend < VS_LAYER_SOURCE_AUTO || backend > VS_LAYER_SOURCE_PREAD) {
+    return 0;
+  }
+
+  VsLayerSource* s = (VsLayerSource*)calloc(1, sizeof(VsLayerSource));
+  if (!s) return 0;
+  s->file = _open_file(path, &s->file_size);
+  if (s->file == VS_INVALID_FILE) {
+    free(s);
+    return 0;
+  }
+
+  s->layer_count = layer_count;
+  s->layer_offsets = (uint32_t*)malloc((size_t)layer_count * sizeof(uint32_t));
+  s->layer_lengths = (uint32_t*)malloc((size_t)layer_count * sizeof(uint32_t));
+  if (!s->layer_offsets || !s->layer_lengths) {
+    vs_layer_source_close((int64_t)(intptr_t)s);
+    return 0;
+  }
+  for (int32_t i = 0; i < layer_count; i++) {
+    if ((int64_t)layer_offsets[i] + layer_lengths[i] > s->file_size) {
+      vs_layer_source_close((int64_t)(intptr_t)s);
+      return 0;
+    }
+    s->layer_offsets[i] = layer_offsets[i];
+    s->layer_lengths[i] = layer_lengths[i];
+  }
+
+  if (backend != VS_LAYER_SOURCE_PREAD && _map_file(s)) {
+    s->backend = VS_LAYER_SOURCE_MMAP;
+  } else if (backend == VS_LAYER_SOURCE_MMAP) {
+    vs_layer_source_close((int64_t)(intptr_t)s);
+    return 0;
+  } else {
+    s->backend = VS_LAYER_SOURCE_PREAD;
+  }
+
+  return (int64_t)(intptr_t)s;
+}
+
+/**
+ * @brief Backend actually in use (VS_LAYER_SOURCE_MMAP or _PREAD).
+ */
+int32_t vs_layer_source_backend(int64_t source) {
+  VsLayerSource* s = (VsLayerSource*)(intptr_t)source;
+  return s ? s->backend : 0;
+}
+
+/**
+ * @brief Hand out layers [start, end) as a blob + offset/length table.
+ *
+ * The returned pointers stay valid until the next fetch or close. The next
+ * chunk of the same size is prepared in the background before returning.
+ */
+int vs_layer_source_fetch(
+    int64_t source,
+    int32_t start,
+    int32_t end,
+    const uint8_t** out_blob,
+    int32_t* out_blob_len,
+    const int32_t** out_offsets,
+    const int32_t** out_lengths) {
+  VsLayerSource* s = (VsLayerSource*)(intptr_t)source;
+  if (!s || !out_blob || !out_blob_len || !out_offsets || !out_lengths ||
+      start < 0 || end <= start || end > s->layer_count) {
+    return 0;
+  }
+
+  _join_read_ahead(s);
+
+  const int32_t next_end =
+      end + (end - start) > s->layer_count ? s->layer_count : end + (end - start);
+  LayerChunkBuffer* b = NULL;
+  int64_t blob_len = 0;
+
+  if (s->backend == VS_LAYER_SOURCE_MMAP) {
+    int64_t lo, hi, total;
+    _chunk_extent(s, start, end, &lo, &hi, &total);
+    b = &s->buffers[0];
+    if (hi - lo <= INT32_MAX) {
+      // Zero-copy: point straight into the mapping.
+      if (!_ensure_buffer(b, 0, end - start)) return 0;
+      for (int32_t i = start; i < end; i++) {
+        b->offsets[i - start] = (int32_t)(s->layer_offsets[i] - lo);
+        b->lengths[i - start] = (int32_t)s->layer_lengths[i];
+      }
+      *out_blob = s->map + lo;
+      blob_len = hi - lo;
+    } else {
+      if (!_read_chunk_into(s, b, start, end)) return 0;
+      *out_blob = b->data;
+      blob_len = _chunk_blob_len(b, end - start);
+    }
+    _advise_will_need(s, end, next_end);
+  } else {
+    if (s->ahead_ok && s->ahead_start == start && s->ahead_end == end) {
+      s->current = 1 - s->current;
+    } else if (!_read_chunk_into(s, &s->buffers[s->current], start, end)) {
+      return 0;
+    }
+    s->ahead_ok = 0;
+    b = &s->buffers[s->current];
+    *out_blob = b->data;
+    blob_len = _chunk_blob_len(b, end - start);
+    if (next_end > end) _start_read_ahead(s, end, next_end);
+  }
+
+  *out_blob_len = (int32_t)blob_len;
+  *out_offsets = b->offsets;
+  *out_lengths = b->lengths;
+  return 1;
+}
+
+/**
+ * @brief Release the source, its buffers and any pending read-ahead.
+ */
+void vs_layer_source_close(int64_t source) {
+  VsLayerSource* s = (VsLayerSource*)(intptr_t)source;
+  if (!s) return;
+  _join_read_ahead(s);
+  _unmap_file(s);
+  if (s->file != VS_INVALID_FILE) _close_file(s->file);
+  for (int i = 0; i < 2; i++) {
+    free(s->buffers[i].data);
+    free(s->buffers[i].offsets);
+    free(s->buffers[i].lengths);
+  }
+  free(s->layer_offsets);
+  free(s->layer_lengths);
+  free(s);
+}
@@ -0,0 +1,753 @@
+/**
+ * @file mask_deflate.c
+ * @brief Built-in deflate encoder tuned for Up-filtered layer scanlines.
+ *
+ * Layer PNGs are masks: after the Up filter nearly every byte is zero, rows
+ * that repeat the row above are all zero, and the few nonzero bytes sit on
+ * shape edges. Instead of zlib's hash-chain search the encoder only tries
+ * the two matches that matter for such data, the byte before (runs) and
+ * the byte one row up, and lets consecutive matches at one distance merge,
+ * so a run of blank rows costs a handful of tokens and no byte scanning.
+ * Each block gets Huffman tables built from its own symbol counts, or the
+ * fixed tables when those are cheaper.
+ *
+ * The output is a standard deflate stream; with the zlib header written by
+ * the caller and the Adler-32 appended here it is an ordinary zlib stream.
+ */
+#include "mask_deflate.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define VS_MD_MIN_MATCH 3
+#define VS_MD_MAX_MATCH 258
+#define VS_MD_BLOCK_TOKENS 65536   // tokens per block before it is emitted
+#define VS_MD_MATCH_FLAG 0x80000000u
+#define VS_MD_LITLEN_CODES 286
+#define VS_MD_DIST_CODES 30
+#define VS_MD_ADLER_MOD 65521u
+#define VS_MD_ADLER_NMAX 5552
+
+static const uint16_t kLenBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t kLenExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t kDistBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129,
+    193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+    6145, 8193, 12289, 16385, 24577};
+static const uint8_t kDistExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+    6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const uint8_t kClOrder[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+static const uint8_t kClExtra[19] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 3, 7};
+
+static int32_t _bit_length(uint32_t v) {
+#ifdef _MSC_VER
+  unsigned long index;
+  return _BitScanReverse(&index, v) ? (int32_t)index + 1 : 0;
+#else
+  return v ? 32 - __builtin_clz(v) : 0;
+#endif
+}
+
+/// Length code (0..28, add 257 for the symbol) for a match of [len] bytes.
+static int32_t _len_code(int32_t len) {
+  const uint32_t x = (uint32_t)(len - VS_MD_MIN_MATCH);
+  if (x < 8) return (int32_t)x;
+  if (len == VS_MD_MAX_MATCH) return 28;
+  const int32_t extra = _bit_length(x) - 3;
+  return 4 * (extra + 1) + (int32_t)((x >> extra) & 3u);
+}
+
+static int32_t _dist_code(int32_t dist) {
+  const uint32_t x = (uint32_t)(dist - 1);
+  if (x < 4) return (int32_t)x;
+  const int32_t extra = _bit_length(x) - 2;
+  return 2 * (extra + 1) + (int32_t)((x >> extra) & 1u);
+}
+
+/**
+ * @brief Length of the common prefix of [a] and [b], up to [max] bytes.
+ *
+ * The ranges may overlap (b = a - 1 measures a run).
+ */
+static int32_t _match_len(const uint8_t* a, const uint8_t* b, int32_t max) {
+  int32_t k = 0;
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  while (k + 8 <= max) {
+    uint64_t x, y;
+    memcpy(&x, a + k, 8);
+    memcpy(&y, b + k, 8);
+    const uint64_t d = x ^ y;
+    if (d) {
+#ifdef _MSC_VER
+      unsigned long index;
+      _BitScanForward64(&index, d);
+      return k + (int32_t)(index >> 3);
+#else
+      return k + (__builtin_ctzll(d) >> 3);
+#endif
+    }
+    k += 8;
+  }
+#endif
+  while (k < max && a[k] == b[k]) k++;
+  return k;
+}
+
+// ── Adler-32 ────────────────────────────────────────────────────────────────
+
+uint32_t vs_adler32(uint32_t adler, const uint8_t* data, size_t len) {
+  uint32_t a = adler & 0xFFFFu;
+  uint32_t b = adler >> 16;
+  while (len > 0) {
+    size_t n = len < VS_MD_ADLER_NMAX ? len : VS_MD_ADLER_NMAX;
+    len -= n;
+    for (; n >= 4; n -= 4, data += 4) {
+      a += data[0];
+      b += a;
+      a += data[1];
+      b += a;
+      a += data[2];
+      b += a;
+      a += data[3];
+      b += a;
+    }
+    for (; n > 0; n--) {
+      a += *data++;
+      b += a;
+    }
+    a %= VS_MD_ADLER_MOD;
+    b %= VS_MD_ADLER_MOD;
+  }
+  return (b << 16) | a;
+}
+
+uint32_t vs_adler32_zero_rows(uint32_t adler, int32_t scanline_size, int32_t rows) {
+  uint32_t a = adler & 0xFFFFu;
+  uint32_t b = adler >> 16;
+  const uint64_t len = (uint64_t)scanline_size % VS_MD_ADLER_MOD;
+  for (int32_t y = 0; y < rows; y++) {
+    a = (a + 2u) % VS_MD_ADLER_MOD;  // filter byte; the rest of the row is zero
+    b = (uint32_t)((b + a * len) % VS_MD_ADLER_MOD);
+  }
+  return (b << 16) | a;
+}
+
+uint32_t vs_adler32_combine(uint32_t adler1, uint32_t adler2, size_t len2) {
+  const uint32_t rem = (uint32_t)(len2 % VS_MD_ADLER_MOD);
+  uint32_t a = adler1 & 0xFFFFu;
+  uint32_t b = (uint32_t)(((uint64_t)rem * a) % VS_MD_ADLER_MOD);
+  a += (adler2 & 0xFFFFu) + VS_MD_ADLER_MOD - 1;
+  b += (adler1 >> 16) + (adler2 >> 16) + VS_MD_ADLER_MOD - rem;
+  if (a >= VS_MD_ADLER_MOD) a -= VS_MD_ADLER_MOD;
+  if (a >= VS_MD_ADLER_MOD) a -= VS_MD_ADLER_MOD;
+  if (b >= 2 * VS_MD_ADLER_MOD) b -= 2 * VS_MD_ADLER_MOD;
+  if (b >= VS_MD_ADLER_MOD) b -= VS_MD_ADLER_MOD;
+  return (b << 16) | a;
+}
+
+// ── Huffman tables ──────────────────────────────────────────────────────────
+
+typedef struct HuffSym {
+  uint32_t key;  // frequency, then code length
+  uint16_t sym;
+} HuffSym;
+
+static int _huff_sym_cmp(const void* pa, const void* pb) {
+  const HuffSym* a = (const HuffSym*)pa;
+  const HuffSym* b = (const HuffSym*)pb;
+  if (a->key != b->key) return a->key < b->key ? -1 : 1;
+  return (int)a->sym - (int)b->sym;
+}
+
+/**
+ * @brief In-place minimum-redundancy code lengths (Moffat and Katajainen).
+ *
+ * [a] is sorted by ascending frequency; on return each key is the code
+ * length of that entry.
+ */
+static void _minimum_redundancy(HuffSym* a, int32_t n) {
+  int32_t root = 0;
+  int32_t leaf = 2;
+  a[0].key += a[1].key;
+  for (int32_t next = 1; next < n - 1; next++) {
+    if (leaf >= n || a[root].key < a[leaf].key) {
+      a[next].key = a[root].key;
+      a[root++].key = (uint32_t)next;
+    } else {
+      a[next].key = a[leaf++].key;
+    }
+    if (leaf >= n || (root < next && a[root].key < a[leaf].key)) {
+      a[next].key += a[root].key;
+      a[root++].key = (uint32_t)next;
+    } else {
+      a[next].key += a[leaf++].key;
+    }
+  }
+  a[n - 2].key = 0;
+  for (int32_t next = n - 3; next >= 0; next--) {
+    a[next].key = a[a[next].key].key + 1;
+  }
+  int32_t avail = 1;
+  int32_t used = 0;
+  uint32_t depth = 0;
+  root = n - 2;
+  int32_t next = n - 1;
+  while (avail > 0) {
+    while (root >= 0 && a[root].key == depth) {
+      used++;
+      root--;
+    }
+    while (avail > used) {
+      a[next--].key = depth;
+      avail--;
+    }
+    avail = 2 * used;
+    depth++;
+    used = 0;
+  }
+}
+
+/**
+ * @brief Code lengths of at most [max_len] bits for [n] symbols.
+ */
+static void _huff_lengths(const uint32_t* freq, int32_t n, int32_t max_len, uint8_t* lengths) {
+  HuffSym syms[VS_MD_LITLEN_CODES];
+  int32_t used = 0;
+  memset(lengths, 0, (size_t)n);
+  for (int32_t s = 0; s < n; s++) {
+    if (freq[s]) {
+      syms[used].key = freq[s];
+      syms[used].sym = (uint16_t)s;
+      used++;
+    }
+  }
+  if (used == 0) return;
+  if (used == 1) {
+    lengths[syms[0].sym] = 1;
+    return;
+  }
+  qsort(syms, (size_t)used, sizeof(HuffSym), _huff_sym_cmp);
+  _minimum_redundancy(syms, used);
+
+  // Limit the depth: fold longer codes into max_len, then lengthen the
+  // shortest codes that keep the Kraft sum at one.
+  int32_t count[33];
+  memset(count, 0, sizeof(count));
+  for (int32_t i = 0; i < used; i++) {
+    count[syms[i].key < 32 ? syms[i].key : 32]++;
+  }
+  for (int32_t i = max_len + 1; i <= 32; i++) count[max_len] += count[i];
+  uint32_t total = 0;
+  for (int32_t i = max_len; i > 0; i--) {
+    total += (uint32_t)count[i] << (max_len - i);
+  }
+  while (total != (1u << max_len)) {
+    count[max_len]--;
+    for (int32_t i = max_len - 1; i > 0; i--) {
+      if (count[i]) {
+        count[i]--;
+        count[i + 1] += 2;
+        break;
+      }
+    }
+    total--;
+  }
+  int32_t j = used;
+  for (int32_t len = 1; len <= max_len; len++) {
+    for (int32_t c = count[len]; c > 0; c--) {
+      lengths[syms[--j].sym] = (uint8_t)len;
+    }
+  }
+}
+
+/**
+ * @brief Canonical codes for [lengths], bit-reversed for LSB-first output.
+ */
+static void _huff_codes(const uint8_t* lengths, int32_t n, uint16_t* codes) {
+  uint32_t bl_count[16];
+  uint32_t next_code[16];
+  memset(bl_count, 0, sizeof(bl_count));
+  for (int32_t s = 0; s < n; s++) bl_count[lengths[s]]++;
+  bl_count[0] = 0;
+  uint32_t code = 0;
+  for (int32_t bits = 1; bits < 16; bits++) {
+    code = (code + bl_count[bits - 1]) << 1;
+    next_code[bits] = code;
+  }
+  for (int32_t s = 0; s < n; s++) {
+    const int32_t len = lengths[s];
+    codes[s] = 0;
+    if (!len) continue;
+    uint32_t c = next_code[len]++;
+    uint32_t r = 0;
+    for (int32_t k = 0; k < len; k++) {
+      r = (r << 1) | (c & 1u);
+      c >>= 1;
+    }
+    codes[s] = (uint16_t)r;
+  }
+}
+
+static void _fixed_lengths(uint8_t* lit, uint8_t* dist) {
+  for (int32_t s = 0; s < 288; s++) {
+    lit[s] = s < 144 ? 8 : s < 256 ? 9 : s < 280 ? 7 : 8;
+  }
+  for (int32_t s = 0; s < VS_MD_DIST_CODES; s++) dist[s] = 5;
+}
+
+// ── Output ──────────────────────────────────────────────────────────────────
+
+/**
+ * @brief Make room for [need] more bytes ahead of the reserved tail.
+ */
+static int _reserve_out(VsMaskDeflater* e, size_t need) {
+  if (e->cap >= e->used + e->tail + need) return 1;
+  if (!e->grow) return 0;
+  size_t want = e->cap ? e->cap : 4096;
+  while (want < e->used + e->tail + need) want *= 2;
+  uint8_t* grown = (uint8_t*)realloc(e->out, want);
+  if (!grown) return 0;
+  e->out = grown;
+  e->cap = want;
+  return 1;
+}
+
+/// Append [n] (at most 32) bits; the caller has reserved the room.
+static void _put_bits(VsMaskDeflater* e, uint32_t value, int32_t n) {
+  e->bit_buf |= (uint64_t)value << e->bit_count;
+  e->bit_count += n;
+  if (e->bit_count >= 32) {
+    uint8_t* p = e->out + e->used;
+    p[0] = (uint8_t)e->bit_buf;
+    p[1] = (uint8_t)(e->bit_buf >> 8);
+    p[2] = (uint8_t)(e->bit_buf >> 16);
+    p[3] = (uint8_t)(e->bit_buf >> 24);
+    e->used += 4;
+    e->bit_buf >>= 32;
+    e->bit_count -= 32;
+  }
+}
+
+/// Flush whole and partial bytes so the output is byte-aligned.
+static void _align_bits(VsMaskDeflater* e) {
+  while (e->bit_count > 0) {
+    e->out[e->used++] = (uint8_t)e->bit_buf;
+    e->bit_buf >>= 8;
+    e->bit_count -= 8;
+  }
+  e->bit_buf = 0;
+  e->bit_count = 0;
+}
+
+/**
+ * @brief Emit the pending tokens as one block with the cheaper of dynamic
+ * and fixed Huffman tables.
+ */
+static int _emit_block(VsMaskDeflater* e, int final) {
+  uint32_t lit_freq[VS_MD_LITLEN_CODES];
+  uint32_t dist_freq[VS_MD_DIST_CODES];
+  memset(lit_freq, 0, sizeof(lit_freq));
+  memset(dist_freq, 0, sizeof(dist_freq));
+  for (int32_t i = 0; i < e->token_count; i++) {
+    const uint32_t t = e->tokens[i];
+    if (t & VS_MD_MATCH_FLAG) {
+      lit_freq[257 + _len_code((int32_t)((t >> 16) & 0xFFu) + VS_MD_MIN_MATCH)]++;
+      dist_freq[_dist_code((int32_t)(t & 0x7FFFu) + 1)]++;
+    } else {
+      lit_freq[t]++;
+    }
+  }
+  lit_freq[256] = 1;
+  // Inflaters reject a lone code for some tables; keep at least two.
+  if (e->token_count == 0) lit_freq[0] = 1;
+  int32_t dist_used = 0;
+  for (int32_t s = 0; s < VS_MD_DIST_CODES; s++) dist_used += dist_freq[s] != 0;
+  if (dist_used < 2) {
+    if (!dist_freq[0]) dist_freq[0] = 1;
+    if (!dist_freq[1]) dist_freq[1] = 1;
+  }
+
+  uint8_t lit_len[288];
+  uint8_t dist_len[VS_MD_DIST_CODES];
+  _huff_lengths(lit_freq, VS_MD_LITLEN_CODES, 15, lit_len);
+  _huff_lengths(dist_freq, VS_MD_DIST_CODES, 15, dist_len);
+  int32_t hlit = VS_MD_LITLEN_CODES;
+  while (hlit > 257 && !lit_len[hlit - 1]) hlit--;
+  int32_t hdist = VS_MD_DIST_CODES;
+  while (hdist > 1 && !dist_len[hdist - 1]) hdist--;
+
+  // Run-length code the concatenated code lengths.
+  uint8_t all[VS_MD_LITLEN_CODES + VS_MD_DIST_CODES];
+  memcpy(all, lit_len, (size_t)hlit);
+  memcpy(all + hlit, dist_len, (size_t)hdist);
+  const int32_t total = hlit + hdist;
+  uint8_t cl_sym[VS_MD_LITLEN_CODES + VS_MD_DIST_CODES];
+  uint8_t cl_arg[VS_MD_LITLEN_CODES + VS_MD_DIST_CODES];
+  uint32_t cl_freq[19];
+  memset(cl_freq, 0, sizeof(cl_freq));
+  int32_t ncl = 0;
+  for (int32_t i = 0; i < total;) {
+    const uint8_t v = all[i];
+    int32_t run = 1;
+    while (i + run < total && all[i + run] == v) run++;
+    i += run;
+    if (v == 0) {
+      while (run >= 11) {
+        const int32_t k = run < 138 ? run : 138;
+        cl_sym[ncl] = 18;
+        cl_arg[ncl++] = (uint8_t)(k - 11);
+        run -= k;
+      }
+      if (run >= 3) {
+        cl_sym[ncl] = 17;
+        cl_arg[ncl++] = (uint8_t)(run - 3);
+        run = 0;
+      }
+    } else {
+      cl_sym[ncl] = v;
+      cl_arg[ncl++] = 0;
+      run--;
+      while (run >= 3) {
+        const int32_t k = run < 6 ? run : 6;
+        cl_sym[ncl] = 16;
+        cl_arg[ncl++] = (uint8_t)(k - 3);
+        run -= k;
+      }
+    }
+    for (; run > 0; run--) {
+      cl_sym[ncl] = v;
+      cl_arg[ncl++] = 0;
+    }
+  }
+  for (int32_t i = 0; i < ncl; i++) cl_freq[cl_sym[i]]++;
+  int32_t cl_used = 0;
+  for (int32_t s = 0; s < 19; s++) cl_used += cl_freq[s] != 0;
+  if (cl_used < 2) {
+    if (!cl_freq[0]) cl_freq[0] = 1;
+    else cl_freq[1] = 1;
+  }
+  uint8_t cl_len[19];
+  _huff_lengths(cl_freq, 19, 7, cl_len);
+  int32_t hclen = 19;
+  while (hclen > 4 && !cl_len[kClOrder[hclen - 1]]) hclen--;
+
+  // Bit costs of both encodings.
+  uint8_t fixed_lit[288];
+  uint8_t fixed_dist[VS_MD_DIST_CODES];
+  _fixed_lengths(fixed_lit, fixed_dist);
+  uint64_t dyn_bits = 3 + 5 + 5 + 4 + 3 * (uint64_t)hclen;
+  for (int32_t i = 0; i < ncl; i++) dyn_bits += cl_len[cl_sym[i]] + kClExtra[cl_sym[i]];
+  uint64_t fixed_bits = 3;
+  for (int32_t s = 0; s < VS_MD_LITLEN_CODES; s++) {
+    if (!lit_freq[s]) continue;
+    const uint32_t extra = s > 256 ? kLenExtra[s - 257] : 0;
+    dyn_bits += (uint64_t)lit_freq[s] * (lit_len[s] + extra);
+    fixed_bits += (uint64_t)lit_freq[s] * (fixed_lit[s] + extra);
+  }
+  for (int32_t s = 0; s < VS_MD_DIST_CODES; s++) {
+    if (!dist_freq[s]) continue;
+    dyn_bits += (uint64_t)dist_freq[s] * (dist_len[s] + kDistExtra[s]);
+    fixed_bits += (uint64_t)dist_freq[s] * (fixed_dist[s] + kDistExtra[s]);
+  }
+  const int dynamic = dyn_bits < fixed_bits;
+  const uint64_t bits = dynamic ? dyn_bits : fixed_bits;
+  if (!_reserve_out(e, (size_t)(bits / 8) + 16)) return 0;
+
+  uint16_t lit_code[288];
+  uint16_t dist_code[VS_MD_DIST_CODES];
+  const uint8_t* ll = dynamic ? lit_len : fixed_lit;
+  const uint8_t* dl = dynamic ? dist_len : fixed_dist;
+  _huff_codes(ll, dynamic ? VS_MD_LITLEN_CODES : 288, lit_code);
+  _huff_codes(dl, VS_MD_DIST_CODES, dist_code);
+
+  _put_bits(e, final ? 1u : 0u, 1);
+  _put_bits(e, dynamic ? 2u : 1u, 2);
+  if (dynamic) {
+    uint16_t cl_code[19];
+    _huff_codes(cl_len, 19, cl_code);
+    _put_bits(e, (uint32_t)(hlit - 257), 5);
+    _put_bits(e, (uint32_t)(hdist - 1), 5);
+    _put_bits(e, (uint32_t)(hclen - 4), 4);
+    for (int32_t i = 0; i < hclen; i++) _put_bits(e, cl_len[kClOrder[i]], 3);
+    for (int32_t i = 0; i < ncl; i++) {
+      const uint8_t s = cl_sym[i];
+      _put_bits(e, cl_code[s], cl_len[s]);
+      if (kClExtra[s]) _put_bits(e, cl_arg[i], kClExtra[s]);
+    }
+  }
+  for (int32_t i = 0; i < e->token_count; i++) {
+    const uint32_t t = e->tokens[i];
+    if (t & VS_MD_MATCH_FLAG) {
+      const int32_t len = (int32_t)((t >> 16) & 0xFFu) + VS_MD_MIN_MATCH;
+      const int32_t dist = (int32_t)(t & 0x7FFFu) + 1;
+      const int32_t lc = _len_code(len);
+      const int32_t dc = _dist_code(dist);
+      _put_bits(e, lit_code[257 + lc], ll[257 + lc]);
+      if (kLenExtra[lc]) _put_bits(e, (uint32_t)(len - kLenBase[lc]), kLenExtra[lc]);
+      _put_bits(e, dist_code[dc], dl[dc]);
+      if (kDistExtra[dc]) _put_bits(e, (uint32_t)(dist - kDistBase[dc]), kDistExtra[dc]);
+    } else {
+      _put_bits(e, lit_code[t], ll[t]);
+    }
+  }
+  _put_bits(e, lit_code[256], ll[256]);
+  e->token_count = 0;
+  return 1;
+}
+
+// ── Tokens ──────────────────────────────────────────────────────────────────
+
+static int _push_token(VsMaskDeflater* e, uint32_t token) {
+  if (e->token_count == e->token_cap) {
+    if (e->token_cap >= VS_MD_BLOCK_TOKENS) {
+      if (!_emit_block(e, 0)) return 0;
+    } else {
+      const int32_t want = e->token_cap ? e->token_cap * 2 : 4096;
+      uint32_t* grown = (uint32_t*)realloc(e->tokens, (size_t)want * sizeof(uint32_t));
+      if (!grown) return 0;
+      e->tokens = grown;
+      e->token_cap = want;
+    }
+  }
+  e->tokens[e->token_count++] = token;
+  return 1;
+}
+
+/**
+ * @brief Emit the pending match as tokens of at most 258 bytes.
+ */
+static int _flush_pending(VsMaskDeflater* e) {
+  int64_t len = e->pending_len;
+  const uint32_t dist_bits = (uint32_t)(e->pending_dist - 1);
+  while (len > 0) {
+    // Keep the remainder at least 3 bytes long.
+    int64_t k = len;
+    if (k > VS_MD_MAX_MATCH) {
+      k = len - VS_MD_MAX_MATCH < VS_MD_MIN_MATCH ? len - VS_MD_MIN_MATCH : VS_MD_MAX_MATCH;
+    }
+    if (!_push_token(e, VS_MD_MATCH_FLAG |
+                            ((uint32_t)(k - VS_MD_MIN_MATCH) << 16) | dist_bits)) {
+      return 0;
+    }
+    len -= k;
+  }
+  e->pending_dist = 0;
+  e->pending_len = 0;
+  return 1;
+}
+
+/// Matches follow each other in output order, so one continuing at the
+/// pending distance simply extends it.
+static int _emit_match(VsMaskDeflater* e, int32_t dist, int64_t len) {
+  if (e->pending_dist == dist) {
+    e->pending_len += len;
+    return 1;
+  }
+  if (e->pending_dist && !_flush_pending(e)) return 0;
+  e->pending_dist = dist;
+  e->pending_len = len;
+  return 1;
+}
+
+static int _emit_literal(VsMaskDeflater* e, uint8_t byte) {
+  if (e->pending_dist && !_flush_pending(e)) return 0;
+  return _push_token(e, byte);
+}
+
+// ── Public (library-internal) API ───────────────────────────────────────────
+
+int vs_mask_deflate_begin(
+    VsMaskDeflater* e,
+    int32_t scanline_size,
+    int32_t window_bits,
+    uint8_t* out,
+    size_t cap,
+    size_t used,
+    size_t tail,
+    int32_t grow) {
+  if (scanline_size < 1) return 0;
+  if (e->scanline_size < scanline_size || !e->prev) {
+    free(e->prev);
+    e->prev = (uint8_t*)malloc((size_t)scanline_size);
+    if (!e->prev) {
+      e->scanline_size = 0;
+      return 0;
+    }
+  }
+  e->out = out;
+  e->cap = cap;
+  e->used = used;
+  e->tail = tail;
+  e->grow = grow;
+  e->bit_buf = 0;
+  e->bit_count = 0;
+  e->token_count = 0;
+  e->pending_dist = 0;
+  e->pending_len = 0;
+  e->prev_zero = 0;
+  e->rows = 0;
+  e->scanline_size = scanline_size;
+  e->max_dist = 1 << (window_bits < 9 ? 9 : window_bits > 15 ? 15 : window_bits);
+  e->up_slack = 0;
+  e->up_rows = 0;
+  if (scanline_size <= e->max_dist) {
+    // Rough bit costs: a 258-byte token is ~4 bits plus extra bits, a
+    // literal ~6. Whole rows go by row match when that beats two literals
+    // and a run per row.
+    const int32_t extra = kDistExtra[_dist_code(scanline_size)];
+    const int64_t run_tokens = (scanline_size + VS_MD_MAX_MATCH - 3) / VS_MD_MAX_MATCH;
+    e->up_slack = extra;
+    e->up_rows = scanline_size >= VS_MD_MIN_MATCH &&
+                 (int64_t)scanline_size * (4 + extra) < VS_MD_MAX_MATCH * (12 + 4 * run_tokens);
+  }
+  e->adler = 1;
+  return 1;
+}
+
+int vs_mask_deflate_row(VsMaskDeflater* e, const uint8_t* s) {
+  const int32_t n = e->scanline_size;
+  const uint8_t* up = e->rows > 0 && n <= e->max_dist ? e->prev : NULL;
+  int32_t i = 0;
+  while (i < n) {
+    const int32_t up_len = up ? _match_len(s + i, up + i, n - i) : 0;
+    const int32_t run_len = i > 0 ? _match_len(s + i, s + i - 1, n - i) : 0;
+    // A match one row up pays its distance's extra bits on every 258-byte
+    // token, a run none, so the row match has to be clearly longer. A row
+    // repeating the one above merges with the pending match instead.
+    const int whole_row = i == 0 && up_len == n && e->up_rows;
+    int use_up = up_len >= VS_MD_MIN_MATCH &&
+                 (whole_row || up_len > run_len + e->up_slack);
+    if (use_up && run_len < VS_MD_MIN_MATCH && !whole_row) {
+      // One or two literals and a run may still cover about as much.
+      for (int32_t k = 1; k <= 2 && use_up && i + k < n; k++) {
+        const int32_t next_run = _match_len(s + i + k, s + i + k - 1, n - i - k);
+        use_up = !(next_run >= VS_MD_MIN_MATCH &&
+                   next_run + k + e->up_slack >= up_len);
+      }
+      if (!use_up) {
+        if (!_emit_literal(e, s[i])) return 0;
+        i++;
+        continue;
+      }
+    }
+    if (use_up) {
+      if (!_emit_match(e, n, up_len)) return 0;
+      i += up_len;
+    } else if (run_len >= VS_MD_MIN_MATCH) {
+      if (!_emit_match(e, 1, run_len)) return 0;
+      i += run_len;
+    } else {
+      if (!_emit_literal(e, s[i])) return 0;
+      i++;
+    }
+  }
+  e->adler = vs_adler32(e->adler, s, (size_t)n);
+  memcpy(e->prev, s, (size_t)n);
+  e->prev_zero = 0;
+  e->rows++;
+  return 1;
+}
+
+/// One Up-filtered zero row: the filter byte, then a run of zeros.
+static int _emit_zero_row(VsMaskDeflater* e) {
+  const int32_t n = e->scanline_size;
+  if (!_emit_literal(e, 2)) return 0;
+  if (n > 1 && !_emit_literal(e, 0)) return 0;
+  if (n - 2 >= VS_MD_MIN_MATCH) return _emit_match(e, 1, n - 2);
+  for (int32_t k = 2; k < n; k++) {
+    if (!_emit_literal(e, 0)) return 0;
+  }
+  return 1;
+}
+
+int vs_mask_deflate_zero_rows(VsMaskDeflater* e, int32_t rows) {
+  if (rows <= 0) return 1;
+  const int32_t n = e->scanline_size;
+  e->adler = vs_adler32_zero_rows(e->adler, n, rows);
+  for (int32_t y = 0; y < rows; y++) {
+    if (e->up_rows && e->prev_zero) {
+      // Every further row repeats the one above.
+      if (!_emit_match(e, n, (int64_t)(rows - y) * n)) return 0;
+      break;
+    }
+    if (!_emit_zero_row(e)) return 0;
+    if (!e->prev_zero) {
+      memset(e->prev, 0, (size_t)n);
+      e->prev[0] = 2;
+      e->prev_zero = 1;
+    }
+  }
+  e->rows += rows;
+  return 1;
+}
+
+int vs_mask_deflate_finish(VsMaskDeflater* e) {
+  if (e->pending_dist && !_flush_pending(e)) return 0;
+  if (!_emit_block(e, 1)) return 0;
+  if (!_reserve_out(e, 8)) return 0;
+  _align_bits(e);
+  uint8_t* p = e->out + e->used;
+  p[0] = (uint8_t)(e->adler >> 24);
+  p[1] = (uint8_t)(e->adler >> 16);
+  p[2] = (uint8_t)(e->adler >> 8);
+  p[3] = (uint8_t)e->adler;
+  e->used += 4;
+  return 1;
+}
+
+void vs_mask_deflater_free(VsMaskDeflater* e) {
+  if (!e) return;
+  free(e->tokens);
+  free(e->prev);
+  e->tokens = NULL;
+  e->prev = NULL;
+  e->token_cap = 0;
+  e->token_count = 0;
+  e->scanline_size = 0;
+}
+
+size_t vs_mask_deflate_bound(size_t len) {
+  // Blocks never cost more than fixed codes, at most 9 bits a byte, and
+  // reserve 16 bytes of slack each; plus header, final reserve and Adler-32.
+  const size_t blocks = len / VS_MD_BLOCK_TOKENS + 1;
+  return len + (len >> 3) + blocks * 24 + 32;
+}
+
+int vs_mask_deflate_zlib(
+    VsMaskDeflater* e,
+    const uint8_t* in,
+    size_t len,
+    int32_t scanline_size,
+    int32_t window_bits,
+    uint16_t header,
+    uint8_t* out,
+    size_t cap,
+    size_t* out_len) {
+  if (scanline_size < 1 || len % (size_t)scanline_size != 0 || cap < 2) return 0;
+  out[0] = (uint8_t)(header >> 8);
+  out[1] = (uint8_t)(header & 0xFFu);
+  if (!vs_mask_deflate_begin(e, scanline_size, window_bits, out, cap, 2, 0, 0)) {
+    return 0;
+  }
+  const size_t rows = len / (size_t)scanline_size;
+  int ok = 1;
+  for (size_t y = 0; y < rows && ok; y++) {
+    ok = vs_mask_deflate_row(e, in + y * (size_t)scanline_size);
+  }
+  ok = ok && vs_mask_deflate_finish(e);
+  e->out = NULL;
+  if (!ok) return 0;
+  *out_len = e->used;
+  return 1;
+}
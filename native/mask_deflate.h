@@ -0,0 +1,96 @@
+/**
+ * @file mask_deflate.h
+ * @brief Library-internal built-in deflate encoder for layer scanlines.
+ *
+ * Not part of the FFI surface; see mask_deflate.c for the match model. The
+ * encoder is selected per job through vs_encode_job_open().
+ */
+#ifndef VOXELSHIFT_MASK_DEFLATE_H
+#define VOXELSHIFT_MASK_DEFLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// One raw deflate stream over scanlines of a fixed size, fed a row at a
+/// time. Output goes to a buffer lent to the encoder between begin and
+/// finish. Zero-initialise before first use; the token and row buffers are
+/// kept across streams until vs_mask_deflater_free.
+typedef struct VsMaskDeflater {
+  uint8_t* out;
+  size_t cap;
+  size_t used;
+  size_t tail;               // bytes kept free at the end of [out]
+  int32_t grow;              // 0: fail instead of reallocating [out]
+  uint64_t bit_buf;
+  int32_t bit_count;
+  uint32_t* tokens;          // pending tokens of the current block
+  int32_t token_count;
+  int32_t token_cap;
+  int32_t pending_dist;      // match being extended, 0 for none
+  int64_t pending_len;
+  uint8_t* prev;             // previous scanline
+  int32_t prev_zero;         // previous scanline is an all-zero Up row
+  int32_t rows;              // scanlines fed so far
+  int32_t scanline_size;
+  int32_t max_dist;
+  int32_t up_slack;          // bytes a row match must beat a run by
+  int32_t up_rows;           // repeated rows are cheaper as row matches
+  uint32_t adler;
+} VsMaskDeflater;
+
+/// Start a stream over [scanline_size]-byte rows at [used] in [out]
+/// ([cap] bytes, [tail] kept free). Matches reach at most 2^[window_bits]
+/// back. With [grow], [out] must be malloc'd and may be reallocated.
+/// Returns 0 on allocation failure.
+int vs_mask_deflate_begin(
+    VsMaskDeflater* e,
+    int32_t scanline_size,
+    int32_t window_bits,
+    uint8_t* out,
+    size_t cap,
+    size_t used,
+    size_t tail,
+    int32_t grow);
+
+/// Add one scanline (filter byte included).
+int vs_mask_deflate_row(VsMaskDeflater* e, const uint8_t* scanline);
+
+/// Add [rows] Up-filtered all-zero scanlines without materialising them.
+int vs_mask_deflate_zero_rows(VsMaskDeflater* e, int32_t rows);
+
+/// End the stream: final block, then the big-endian Adler-32 of every byte
+/// fed, so [out] holds a complete zlib stream when the caller wrote the
+/// header. The result is e->out / e->used.
+int vs_mask_deflate_finish(VsMaskDeflater* e);
+
+/// Release the encoder's working buffers (not e->out).
+void vs_mask_deflater_free(VsMaskDeflater* e);
+
+/// Encode [len] bytes of [scanline_size]-byte rows as one zlib stream in
+/// [out], starting with [header], using [e]'s working buffers. Returns 0 if
+/// it does not fit in [cap].
+int vs_mask_deflate_zlib(
+    VsMaskDeflater* e,
+    const uint8_t* in,
+    size_t len,
+    int32_t scanline_size,
+    int32_t window_bits,
+    uint16_t header,
+    uint8_t* out,
+    size_t cap,
+    size_t* out_len);
+
+/// Upper bound on vs_mask_deflate_zlib's output for [len] input bytes.
+size_t vs_mask_deflate_bound(size_t len);
+
+/// Adler-32 of [len] bytes continuing from [adler].
+uint32_t vs_adler32(uint32_t adler, const uint8_t* data, size_t len);
+
+/// Adler-32 of two spans joined, from each span's Adler-32 and the second
+/// span's length.
+uint32_t vs_adler32_combine(uint32_t adler1, uint32_t adler2, size_t len2);
+
+/// Adler-32 continued over [rows] Up-filtered zero scanlines.
+uint32_t vs_adler32_zero_rows(uint32_t adler, int32_t scanline_size, int32_t rows);
+
+#endif // VOXELSHIFT_MASK_DEFLATE_H
@@ -4,8 +4,194 @@
  *
  * Converts greyscale subpixel buffers into packed scanlines and applies
  * the PNG Up filter in-place. Used as the CPU fallback and baseline path.
+ * The row variant lets callers stream scanlines without a full-frame buffer.
+ *
+ * The greyscale pair average and the Up filter have SSE2/AVX2/NEON kernels
+ * picked at runtime (see cpu_features.h); the scalar kernels are the
+ * reference they must match bit for bit. RGB packing is a padded copy.
  */
 #include "voxelshift_native.h"
+#include "cpu_features.h"
+
+#include <string.h>
+
+#if defined(VS_ARCH_X64)
+  #include <emmintrin.h>
+  #include <immintrin.h>
+#elif defined(VS_ARCH_ARM64)
+  #include <arm_neon.h>
+#endif
+
+/// dst[i] = (src[2i] + src[2i + 1]) >> 1 for i < count.
+typedef void (*pair_average_fn)(const uint8_t* src, uint8_t* dst, int32_t count);
+/// dst[i] = cur[i] - prev[i] (mod 256) for i < count; dst may alias cur.
+typedef void (*up_filter_fn)(
+    const uint8_t* cur, const uint8_t* prev, uint8_t* dst, int32_t count);
+
+static void _pair_average_scalar(const uint8_t* src, uint8_t* dst, int32_t count) {
+  for (int32_t i = 0; i < count; i++) {
+    dst[i] = (uint8_t)((src[2 * i] + src[2 * i + 1]) >> 1);
+  }
+}
+
+static void _up_filter_scalar(
+    const uint8_t* cur, const uint8_t* prev, uint8_t* dst, int32_t count) {
+  for (int32_t i = 0; i < count; i++) {
+    dst[i] = (uint8_t)((cur[i] - prev[i]) & 0xFF);
+  }
+}
+
+#if defined(VS_ARCH_X64)
+static void _pair_average_sse2(const uint8_t* src, uint8_t* dst, int32_t count) {
+  const __m128i lo_mask = _mm_set1_epi16(0x00FF);
+  int32_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const __m128i a = _mm_loadu_si128((const __m128i*)(src + 2 * i));
+    const __m128i b = _mm_loadu_si128((const __m128i*)(src + 2 * i + 16));
+    const __m128i sa = _mm_srli_epi16(
+        _mm_add_epi16(_mm_and_si128(a, lo_mask), _mm_srli_epi16(a, 8)), 1);
+    const __m128i sb = _mm_srli_epi16(
+        _mm_add_epi16(_mm_and_si128(b, lo_mask), _mm_srli_epi16(b, 8)), 1);
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(sa, sb));
+  }
+  _pair_average_scalar(src + 2 * i, dst + i, count - i);
+}
+
+static void _up_filter_sse2(
+    const uint8_t* cur, const uint8_t* prev, uint8_t* dst, int32_t count) {
+  int32_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const __m128i c = _mm_loadu_si128((const __m128i*)(cur + i));
+    const __m128i p = _mm_loadu_si128((const __m128i*)(prev + i));
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_sub_epi8(c, p));
+  }
+  _up_filter_scalar(cur + i, prev + i, dst + i, count - i);
+}
+
+static VS_TARGET_AVX2 void _pair_average_avx2(
+    const uint8_t* src, uint8_t* dst, int32_t count) {
+  const __m256i lo_mask = _mm256_set1_epi16(0x00FF);
+  int32_t i = 0;
+  for (; i + 32 <= count; i += 32) {
+    const __m256i a = _mm256_loadu_si256((const __m256i*)(src + 2 * i));
+    const __m256i b = _mm256_loadu_si256((const __m256i*)(src + 2 * i + 32));
+    const __m256i sa = _mm256_srli_epi16(
+        _mm256_add_epi16(_mm256_and_si256(a, lo_mask), _mm256_srli_epi16(a, 8)), 1);
+    const __m256i sb = _mm256_srli_epi16(
+        _mm256_add_epi16(_mm256_and_si256(b, lo_mask), _mm256_srli_epi16(b, 8)), 1);
+    // packus works per 128-bit lane; restore a0..a15, b0..b15 order.
+    const __m256i packed = _mm256_permute4x64_epi64(
+        _mm256_packus_epi16(sa, sb), 0xD8);
+    _mm256_storeu_si256((__m256i*)(dst + i), packed);
+  }
+  _pair_average_sse2(src + 2 * i, dst + i, count - i);
+}
+
+static VS_TARGET_AVX2 void _up_filter_avx2(
+    const uint8_t* cur, const uint8_t* prev, uint8_t* dst, int32_t count) {
+  int32_t i = 0;
+  for (; i + 32 <= count; i += 32) {
+    const __m256i c = _mm256_loadu_si256((const __m256i*)(cur + i));
+    const __m256i p = _mm256_loadu_si256((const __m256i*)(prev + i));
+    _mm256_storeu_si256((__m256i*)(dst + i), _mm256_sub_epi8(c, p));
+  }
+  _up_filter_sse2(cur + i, prev + i, dst + i, count - i);
+}
+#elif defined(VS_ARCH_ARM64)
+static void _pair_average_neon(const uint8_t* src, uint8_t* dst, int32_t count) {
+  int32_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const uint8x16x2_t v = vld2q_u8(src + 2 * i);
+    vst1q_u8(dst + i, vhaddq_u8(v.val[0], v.val[1]));
+  }
+  _pair_average_scalar(src + 2 * i, dst + i, count - i);
+}
+
+static void _up_filter_neon(
+    const uint8_t* cur, const uint8_t* prev, uint8_t* dst, int32_t count) {
+  int32_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    vst1q_u8(dst + i, vsubq_u8(vld1q_u8(cur + i), vld1q_u8(prev + i)));
+  }
+  _up_filter_scalar(cur + i, prev + i, dst + i, count - i);
+}
+#endif
+
+static pair_average_fn _pair_average_kernel(void) {
+  const int32_t level = vs_simd_level();
+#if defined(VS_ARCH_X64)
+  if (level >= VS_SIMD_AVX2) return _pair_average_avx2;
+  if (level >= VS_SIMD_SSE2) return _pair_average_sse2;
+#elif defined(VS_ARCH_ARM64)
+  if (level >= VS_SIMD_NEON) return _pair_average_neon;
+#else
+  (void)level;
+#endif
+  return _pair_average_scalar;
+}
+
+static up_filter_fn _up_filter_kernel(void) {
+  const int32_t level = vs_simd_level();
+#if defined(VS_ARCH_X64)
+  if (level >= VS_SIMD_AVX2) return _up_filter_avx2;
+  if (level >= VS_SIMD_SSE2) return _up_filter_sse2;
+#elif defined(VS_ARCH_ARM64)
+  if (level >= VS_SIMD_NEON) return _up_filter_neon;
+#else
+  (void)level;
+#endif
+  return _up_filter_scalar;
+}
+
+/**
+ * @brief Pack one greyscale source row into an unfiltered output row.
+ *
+ * RGB maps three subpixels to one pixel; greyscale averages two. The source
+ * is centred with zero padding when the output row is wider. Only the
+ * padding edges are bounds-checked; interior columns go to [average].
+ */
+static void _pack_row(
+    const uint8_t* grey_row,
+    int32_t src_width,
+    int32_t out_width,
+    int32_t channels,
+    uint8_t* out_row,
+    pair_average_fn average) {
+  if (channels == 3) {
+    // Subpixels map 1:1 onto output bytes, so this is a shifted copy.
+    const int32_t out_len = out_width * 3;
+    const int32_t pad_total = out_len - src_width;
+    const int32_t pad_left = pad_total > 0 ? (pad_total / 2) : 0;
+    int32_t copy = out_len - pad_left;
+    if (copy > src_width) copy = src_width;
+    memset(out_row, 0, (size_t)pad_left);
+    memcpy(out_row + pad_left, grey_row, (size_t)copy);
+    memset(out_row + pad_left + copy, 0, (size_t)(out_len - pad_left - copy));
+    return;
+  }
+
+  const int32_t pad_total = out_width * 2 - src_width;
+  const int32_t pad_left = pad_total > 0 ? (pad_total / 2) : 0;
+
+  // Columns whose two subpixels are both inside the source row.
+  int32_t x_hi = (src_width + pad_left) / 2;
+  if (x_hi > out_width) x_hi = out_width;
+  int32_t x_lo = (pad_left + 1) / 2;
+  if (x_lo > x_hi) x_lo = x_hi;
+
+  for (int32_t x = 0; x < out_width; x++) {
+    if (x == x_lo && x_hi > x_lo) {
+      average(grey_row + 2 * x - pad_left, out_row + x, x_hi - x_lo);
+      x = x_hi - 1;
+      continue;
+    }
+    const int32_t si = x * 2 - pad_left;
+    const uint8_t a = (si >= 0 && si < src_width) ? grey_row[si] : 0;
+    const uint8_t b =
+        (si + 1 >= 0 && si + 1 < src_width) ? grey_row[si + 1] : 0;
+    out_row[x] = (uint8_t)((a + b) >> 1);
+  }
+}
 
 /**
  * @brief Build packed PNG scanlines and apply the Up filter in-place.
@@ -35,59 +221,26 @@ int build_png_scanlines(
     return 0;
   }
 
-  if (channels == 3) {
-    // RGB path: 3 greyscale subpixels -> 1 RGB pixel.
-    const int32_t required_subpixels = out_width * 3;
-    const int32_t pad_total = required_subpixels - src_width;
-    const int32_t pad_left = pad_total > 0 ? (pad_total / 2) : 0;
+  const pair_average_fn average = _pair_average_kernel();
+  const up_filter_fn up_filter = _up_filter_kernel();
 
-    for (int32_t y = 0; y < height; y++) {
-      const int32_t row_offset = y * src_width;
-      int32_t dst = y * scanline_size;
-      out_scanlines[dst++] = 0; // placeholder filter byte
-
-      for (int32_t x = 0; x < out_width; x++) {
-        const int32_t si = x * 3 - pad_left;
-
-        out_scanlines[dst++] =
-            (si >= 0 && si < src_width) ? grey_pixels[row_offset + si] : 0;
-        out_scanlines[dst++] =
-            (si + 1 >= 0 && si + 1 < src_width) ? grey_pixels[row_offset + si + 1] : 0;
-        out_scanlines[dst++] =
-            (si + 2 >= 0 && si + 2 < src_width) ? grey_pixels[row_offset + si + 2] : 0;
-      }
-    }
-  } else {
-    // Greyscale path: average 2 subpixels -> 1 grey pixel.
-    const int32_t required_subpixels = out_width * 2;
-    const int32_t pad_total = required_subpixels - src_width;
-    const int32_t pad_left = pad_total > 0 ? (pad_total / 2) : 0;
-
-    for (int32_t y = 0; y < height; y++) {
-      const int32_t row_offset = y * src_width;
-      const int32_t dst_row = y * scanline_size;
-      out_scanlines[dst_row] = 0; // placeholder filter byte
-
-      for (int32_t x = 0; x < out_width; x++) {
-        const int32_t si = x * 2 - pad_left;
-        const uint8_t a =
-            (si >= 0 && si < src_width) ? grey_pixels[row_offset + si] : 0;
-        const uint8_t b =
-            (si + 1 >= 0 && si + 1 < src_width) ? grey_pixels[row_offset + si + 1] : 0;
-        out_scanlines[dst_row + 1 + x] = (uint8_t)((a + b) >> 1);
-      }
-    }
+  for (int32_t y = 0; y < height; y++) {
+    const int32_t dst_row = y * scanline_size;
+    out_scanlines[dst_row] = 0; // placeholder filter byte
+    _pack_row(
+        grey_pixels + (size_t)y * src_width,
+        src_width,
+        out_width,
+        channels,
+        out_scanlines + dst_row + 1,
+        average);
   }
 
   // Apply PNG Up filter bottom-to-top so previous row is still unmodified.
   for (int32_t y = height - 1; y >= 1; y--) {
-    const int32_t cur_start = y * scanline_size;
-    const int32_t prev_start = (y - 1) * scanline_size;
-    out_scanlines[cur_start] = 2; // Up filter type
-    for (int32_t i = 1; i <= bytes_per_row; i++) {
-      out_scanlines[cur_start + i] =
-          (uint8_t)((out_scanlines[cur_start + i] - out_scanlines[prev_start + i]) & 0xFF);
-    }
+    uint8_t* cur = out_scanlines + (size_t)y * scanline_size;
+    cur[0] = 2; // Up filter type
+    up_filter(cur + 1, cur + 1 - scanline_size, cur + 1, bytes_per_row);
   }
 
   // First row: Up with zero row above.
@@ -95,3 +248,36 @@ int build_png_scanlines(
 
   return 1;
 }
+
+/**
+ * @brief Build one Up-filtered PNG scanline from one greyscale source row.
+ *
+ * The row is packed into [out_row] (unfiltered, kept by the caller as the
+ * next row's [prev_row]) and written filtered, with its filter byte, to
+ * [out_scanline]. [prev_row] is NULL for the first row.
+ */
+int build_png_scanline_row(
+    const uint8_t* grey_row,
+    int32_t src_width,
+    int32_t out_width,
+    int32_t channels,
+    const uint8_t* prev_row,
+    uint8_t* out_row,
+    uint8_t* out_scanline) {
+  if (!grey_row || !out_row || !out_scanline || src_width <= 0 ||
+      out_width <= 0 || (channels != 1 && channels != 3)) {
+    return 0;
+  }
+
+  const int32_t bytes_per_row = out_width * channels;
+  _pack_row(grey_row, src_width, out_width, channels, out_row,
+            _pair_average_kernel());
+
+  out_scanline[0] = 2; // Up filter type
+  if (!prev_row) {
+    memcpy(out_scanline + 1, out_row, (size_t)bytes_per_row);
+  } else {
+    _up_filter_kernel()(out_row, prev_row, out_scanline + 1, bytes_per_row);
+  }
+  return 1;
+}
@@ -5,8 +5,18 @@
  * Parses PNG containers, inflates the IDAT stream, and recompresses it
  * with a target zlib level. Used to shrink output size without altering
  * image content.
+ *
+ * With the built-in encoder selected (vs_encode_job_open) the inflated
+ * scanlines are re-encoded by mask_deflate.c instead of zlib.
+ *
+ * Batch workers keep their inflate/deflate streams and buffers in the
+ * VS_POOL_SLOT_RECOMPRESS pool slot, so streams are only reset between
+ * PNGs rather than set up and torn down for each one.
  */
 #include "voxelshift_native.h"
+#include "mask_deflate.h"
+#include "worker_pool.h"
+#include "zlib_stream.h"
 
 #include <stdint.h>
 #include <stdlib.h>
@@ -14,42 +24,10 @@
 
 #ifdef _WIN32
 #include <windows.h>
-typedef HMODULE vs_lib_handle;
-static vs_lib_handle vs_dlopen(const char *name) { return LoadLibraryA(name); }
-static void *vs_dlsym(vs_lib_handle h, const char *sym) { return (void *)GetProcAddress(h, sym); }
-
-typedef CRITICAL_SECTION vs_mutex;
-static void vs_mutex_init(vs_mutex *m) { InitializeCriticalSection(m); }
-static void vs_mutex_lock(vs_mutex *m) { EnterCriticalSection(m); }
-static void vs_mutex_unlock(vs_mutex *m) { LeaveCriticalSection(m); }
-static void vs_mutex_destroy(vs_mutex *m) { DeleteCriticalSection(m); }
 #else
-#include <dlfcn.h>
-#include <pthread.h>
 #include <unistd.h>
-typedef void *vs_lib_handle;
-static vs_lib_handle vs_dlopen(const char *name) { return dlopen(name, RTLD_LAZY); }
-static void *vs_dlsym(vs_lib_handle h, const char *sym) { return dlsym(h, sym); }
-
-typedef pthread_mutex_t vs_mutex;
-static void vs_mutex_init(vs_mutex *m) { pthread_mutex_init(m, NULL); }
-static void vs_mutex_lock(vs_mutex *m) { pthread_mutex_lock(m); }
-static void vs_mutex_unlock(vs_mutex *m) { pthread_mutex_unlock(m); }
-static void vs_mutex_destroy(vs_mutex *m) { pthread_mutex_destroy(m); }
 #endif
 
-typedef int (*compress2_fn)(unsigned char *, unsigned long *, const unsigned char *, unsigned long, int);
-typedef int (*uncompress_fn)(unsigned char *, unsigned long *, const unsigned char *, unsigned long);
-
-typedef struct ZlibApi
-{
-  int loaded;
-  int available;
-  compress2_fn compress2_ptr;
-  uncompress_fn uncompress_ptr;
-} ZlibApi;
-
-static ZlibApi g_zlib = {0, 0, NULL, NULL};
 static int32_t g_recompress_batch_threads = 0;
 
 /**
@@ -78,154 +56,50 @@ static int32_t _detect_cpu_threads(void)
 #endif
 }
 
-typedef struct BatchWork
-{
-  const uint8_t *input_blob;
-  int32_t input_blob_len;
-  const int32_t *input_offsets;
-  const int32_t *input_lengths;
-  int32_t count;
-  int32_t level;
-  uint8_t **item_outputs;
-  int32_t *item_sizes;
-
-  int32_t next_index;
-  int32_t failed;
-  vs_mutex lock;
-} BatchWork;
-
-/**
- * @brief Claim the next batch index for a worker thread.
- */
-static int _batch_take_index(BatchWork *w, int32_t *out_idx)
-{
-  int ok = 0;
-  vs_mutex_lock(&w->lock);
-  if (!w->failed && w->next_index < w->count)
-  {
-    *out_idx = w->next_index++;
-    ok = 1;
-  }
-  vs_mutex_unlock(&w->lock);
-  return ok;
-}
-
-/**
- * @brief Mark the batch as failed to stop other workers.
- */
-static void _batch_mark_failed(BatchWork *w)
+// Streams and growable buffers reused across PNGs by one worker.
+typedef struct RecompressScratch
 {
-  vs_mutex_lock(&w->lock);
-  w->failed = 1;
-  vs_mutex_unlock(&w->lock);
-}
-
-/**
- * @brief Recompress a single PNG payload within a batch.
- */
-static void _batch_process_one(BatchWork *w, int32_t i)
+  VsInflater inflater;
+  VsDeflater deflater;
+  VsMaskDeflater mask_deflater;
+  uint8_t *idat;
+  size_t idat_cap;
+  uint8_t *scanlines;
+  size_t scanlines_cap;
+  uint8_t *compressed;
+  size_t compressed_cap;
+} RecompressScratch;
+
+static void _free_recompress_scratch(void *p)
 {
-  const int32_t off = w->input_offsets[i];
-  const int32_t len = w->input_lengths[i];
-
-  if (off < 0 || len <= 0 || off + len > w->input_blob_len)
-  {
-    _batch_mark_failed(w);
-    return;
-  }
-
-  uint8_t *recompressed = NULL;
-  int32_t recompressed_len = 0;
-  const int ok = recompress_png_idat(
-      w->input_blob + off,
-      len,
-      w->level,
-      &recompressed,
-      &recompressed_len);
-
-  if (!ok || !recompressed || recompressed_len <= 0)
-  {
-    _batch_mark_failed(w);
+  RecompressScratch *s = (RecompressScratch *)p;
+  if (!s)
     return;
-  }
-
-  w->item_outputs[i] = recompressed;
-  w->item_sizes[i] = recompressed_len;
-}
-
-#ifdef _WIN32
-static DWORD WINAPI _batch_worker_proc(LPVOID arg)
-{
-  BatchWork *w = (BatchWork *)arg;
-  int32_t idx;
-  while (_batch_take_index(w, &idx))
-  {
-    _batch_process_one(w, idx);
-  }
-  return 0;
-}
-#else
-static void *_batch_worker_proc(void *arg)
-{
-  BatchWork *w = (BatchWork *)arg;
-  int32_t idx;
-  while (_batch_take_index(w, &idx))
-  {
-    _batch_process_one(w, idx);
-  }
-  return NULL;
+  vs_inflater_end(&s->inflater);
+  vs_deflater_end(&s->deflater);
+  vs_mask_deflater_free(&s->mask_deflater);
+  free(s->idat);
+  free(s->scanlines);
+  free(s->compressed);
+  free(s);
 }
-#endif
 
 /**
- * @brief Load zlib symbols from the platform runtime.
- *
- * On Windows, looks first in the application directory, then system paths.
- * This ensures bundled zlib.dll is found before any system installation.
+ * @brief Grow a scratch buffer to at least `need` bytes, keeping contents.
  */
-static void _init_zlib(void)
+static int _reserve(uint8_t **buf, size_t *cap, size_t need)
 {
-  if (g_zlib.loaded)
-    return;
-  g_zlib.loaded = 1;
-
-#ifdef _WIN32
-  // Windows: prioritize bundled zlib.dll in app directory
-  const char *candidates[] = {
-      "zlib1.dll", // Try current directory first (where bundled DLL is)
-      "zlib.dll",  // Alternative name
-      "zlib1.dll", // Try system paths via LoadLibraryA search order
-      "zlib.dll",
-  };
-#elif __APPLE__
-  const char *candidates[] = {
-      "libz.1.dylib",
-      "libz.dylib",
-  };
-#else
-  const char *candidates[] = {
-      "libz.so.1",
-      "libz.so",
-  };
-#endif
-
-  for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++)
-  {
-    vs_lib_handle h = vs_dlopen(candidates[i]);
-    if (!h)
-      continue;
-
-    compress2_fn c2 = (compress2_fn)vs_dlsym(h, "compress2");
-    uncompress_fn uc = (uncompress_fn)vs_dlsym(h, "uncompress");
-
-    if (c2 && uc)
-    {
-      g_zlib.compress2_ptr = c2;
-      g_zlib.uncompress_ptr = uc;
-      g_zlib.available = 1;
-      return;
-    }
-  }
+  if (*cap >= need)
+    return 1;
+  size_t grown = *cap ? *cap : 4096;
+  while (grown < need)
+    grown *= 2;
+  uint8_t *p = (uint8_t *)realloc(*buf, grown);
+  if (!p)
+    return 0;
+  *buf = p;
+  *cap = grown;
+  return 1;
 }
 
 static uint32_t _read_u32_be(const uint8_t *p)
@@ -305,12 +179,20 @@ static int _channels_for_color_type(uint8_t color_type)
 }
 
 /**
- * @brief Recompress the IDAT payload inside a PNG file.
+ * @brief Recompress one PNG with the streams and buffers in `s`.
+ *
+ * `params` are `job`'s stream settings for requested `level`; under the
+ * auto strategy the PNG may be claimed as a trial sample for that level.
+ * With `threads` > 1 a large image is deflated in parallel bands.
  */
-int recompress_png_idat(
+static int _recompress_png(
     const uint8_t *png_data,
     int32_t png_len,
+    VsEncodeJob *job,
     int32_t level,
+    const VsDeflateParams *params,
+    int32_t threads,
+    RecompressScratch *s,
     uint8_t **out_data,
     int32_t *out_len)
 {
@@ -319,8 +201,8 @@ int recompress_png_idat(
     return 0;
   }
 
-  _init_zlib();
-  if (!g_zlib.available)
+  const VsZlib *z = vs_zlib();
+  if (!z->available)
   {
     return 0;
   }
@@ -336,7 +218,6 @@ int recompress_png_idat(
   uint8_t ihdr[13];
   int have_ihdr = 0;
 
-  uint8_t *idat = NULL;
   size_t idat_len = 0;
 
   int32_t offset = 8;
@@ -350,7 +231,6 @@ int recompress_png_idat(
 
     if (crc_end > png_len || data_end < data_start)
     {
-      free(idat);
       return 0;
     }
 
@@ -361,7 +241,6 @@ int recompress_png_idat(
     {
       if (len < 13)
       {
-        free(idat);
         return 0;
       }
       memcpy(ihdr, data, 13);
@@ -371,14 +250,11 @@ int recompress_png_idat(
     }
     else if (type[0] == 'I' && type[1] == 'D' && type[2] == 'A' && type[3] == 'T')
     {
-      uint8_t *grown = (uint8_t *)realloc(idat, idat_len + len);
-      if (!grown)
+      if (!_reserve(&s->idat, &s->idat_cap, idat_len + len))
       {
-        free(idat);
         return 0;
       }
-      idat = grown;
-      memcpy(idat + idat_len, data, len);
+      memcpy(s->idat + idat_len, data, len);
       idat_len += len;
     }
     else if (type[0] == 'I' && type[1] == 'E' && type[2] == 'N' && type[3] == 'D')
@@ -391,7 +267,6 @@ int recompress_png_idat(
 
   if (!have_ihdr || idat_len == 0 || width == 0 || height == 0)
   {
-    free(idat);
     return 0;
   }
 
@@ -401,73 +276,121 @@ int recompress_png_idat(
 
   if (bit_depth != 8 || channels == 0)
   {
-    free(idat);
     return 0;
   }
 
-  const unsigned long expected_scanlines = (unsigned long)height *
-                                           (unsigned long)(1 + (width * (uint32_t)channels));
+  const uint64_t expected_scanlines = (uint64_t)height *
+                                      (1u + (uint64_t)width * (uint64_t)channels);
 
-  if (expected_scanlines == 0)
+  if (expected_scanlines == 0 || expected_scanlines > 0x7FFFFFFFu)
   {
-    free(idat);
     return 0;
   }
 
-  unsigned char *scanlines = (unsigned char *)malloc((size_t)expected_scanlines);
-  if (!scanlines)
+  if (!_reserve(&s->scanlines, &s->scanlines_cap, (size_t)expected_scanlines))
   {
-    free(idat);
     return 0;
   }
 
-  unsigned long scanlines_len = expected_scanlines;
-  const int uret = g_zlib.uncompress_ptr(
-      scanlines,
-      &scanlines_len,
-      (const unsigned char *)idat,
-      (unsigned long)idat_len);
-  free(idat);
+  size_t scanlines_len = 0;
+  if (z->stream_available)
+  {
+    if (!vs_inflate_zlib(&s->inflater, s->idat, idat_len, s->scanlines,
+                         (size_t)expected_scanlines, &scanlines_len))
+    {
+      return 0;
+    }
+  }
+  else
+  {
+    unsigned long ulen = (unsigned long)expected_scanlines;
+    if (z->uncompress(s->scanlines, &ulen, s->idat, (unsigned long)idat_len) != VS_Z_OK)
+    {
+      return 0;
+    }
+    scanlines_len = (size_t)ulen;
+  }
 
-  if (uret != 0 || scanlines_len == 0)
+  if (scanlines_len == 0)
   {
-    free(scanlines);
     return 0;
   }
 
-  if (level < 0)
-    level = 0;
-  if (level > 9)
-    level = 9;
-
-  unsigned long comp_cap = scanlines_len + (scanlines_len / 1000u) + 64u;
-  unsigned char *compressed = (unsigned char *)malloc((size_t)comp_cap);
-  if (!compressed)
+  const size_t comp_cap = vs_deflate_bound(params, scanlines_len);
+  if (!_reserve(&s->compressed, &s->compressed_cap, comp_cap))
   {
-    free(scanlines);
     return 0;
   }
 
-  unsigned long comp_len = comp_cap;
-  const int cret = g_zlib.compress2_ptr(
-      compressed,
-      &comp_len,
-      scanlines,
-      scanlines_len,
-      level);
-  free(scanlines);
+  const int32_t scanline_size = (int32_t)(expected_scanlines / height);
+  const int32_t bands = scanlines_len == (size_t)expected_scanlines
+                            ? vs_deflate_split_bands(params, scanlines_len, threads)
+                            : 1;
+  size_t comp_len = 0;
+  if (params->encoder == VS_DEFLATE_ENCODER_BUILTIN &&
+      scanlines_len == (size_t)expected_scanlines)
+  {
+    if (!vs_mask_deflate_zlib(&s->mask_deflater, s->scanlines, scanlines_len,
+                              scanline_size, params->window_bits,
+                              vs_zlib_header(params), s->compressed,
+                              s->compressed_cap, &comp_len))
+    {
+      return 0;
+    }
+  }
+  else if (vs_deflate_auto_claim(job, level))
+  {
+    if (!vs_deflate_zlib_trial(&s->deflater, job, level, s->scanlines, scanlines_len,
+                               s->compressed, s->compressed_cap, &comp_len))
+    {
+      return 0;
+    }
+  }
+  else if (bands > 1)
+  {
+    const uint16_t header = vs_zlib_header(params);
+    s->compressed[0] = (uint8_t)(header >> 8);
+    s->compressed[1] = (uint8_t)(header & 0xFFu);
+    comp_len = 2;
+    uint32_t adler = 1;
+    if (!vs_deflate_split(params, s->scanlines, scanlines_len,
+                          (size_t)scanline_size, bands, 1, &s->compressed,
+                          &s->compressed_cap, &comp_len, 4, &adler))
+    {
+      return 0;
+    }
+    _write_u32_be(s->compressed + comp_len, adler);
+    comp_len += 4;
+  }
+  else if (vs_deflate_available(params))
+  {
+    if (!vs_deflate_zlib(&s->deflater, params, s->scanlines, scanlines_len,
+                         s->compressed, s->compressed_cap, &comp_len))
+    {
+      return 0;
+    }
+  }
+  else
+  {
+    unsigned long clen = (unsigned long)s->compressed_cap;
+    if (z->compress2(s->compressed, &clen, s->scanlines,
+                     (unsigned long)scanlines_len, params->level) != VS_Z_OK)
+    {
+      return 0;
+    }
+    comp_len = (size_t)clen;
+  }
 
-  if (cret != 0 || comp_len == 0)
+  if (comp_len == 0 || comp_len > 0x7FFFFFC0u)
   {
-    free(compressed);
     return 0;
   }
+  const uint8_t *compressed = s->compressed;
 
-  const size_t out_size = 8 + (12 + 13) + (12 + (size_t)comp_len) + 12;
+  const size_t out_size = 8 + (12 + 13) + (12 + comp_len) + 12;
   uint8_t *out = (uint8_t *)malloc(out_size);
   if (!out)
   {
-    free(compressed);
     return 0;
   }
 
@@ -498,17 +421,15 @@ int recompress_png_idat(
   out[w++] = 'D';
   out[w++] = 'A';
   out[w++] = 'T';
-  memcpy(out + w, compressed, (size_t)comp_len);
-  w += (size_t)comp_len;
+  memcpy(out + w, compressed, comp_len);
+  w += comp_len;
   {
     const uint8_t t[4] = {'I', 'D', 'A', 'T'};
-    const uint32_t crc = _crc32_type_and_data(t, compressed, (size_t)comp_len);
+    const uint32_t crc = _crc32_type_and_data(t, compressed, comp_len);
     _write_u32_be(out + w, crc);
     w += 4;
   }
 
-  free(compressed);
-
   // IEND
   _write_u32_be(out + w, 0);
   w += 4;
@@ -528,6 +449,122 @@ int recompress_png_idat(
   return 1;
 }
 
+/**
+ * @brief Recompress the IDAT payload inside a PNG file.
+ */
+int recompress_png_idat(
+    const uint8_t *png_data,
+    int32_t png_len,
+    int32_t level,
+    int64_t encode_job,
+    uint8_t **out_data,
+    int32_t *out_len)
+{
+  RecompressScratch *s = (RecompressScratch *)calloc(1, sizeof(RecompressScratch));
+  if (!s)
+  {
+    return 0;
+  }
+  VsEncodeJob *job = (VsEncodeJob *)(intptr_t)encode_job;
+  const VsDeflateParams params = vs_deflate_params(job, level);
+  const int32_t threads = vs_deflate_split_threads(
+      job, g_recompress_batch_threads > 0 ? g_recompress_batch_threads : _detect_cpu_threads());
+  const int32_t prev_background = vs_pool_set_background(vs_encode_job_background(job));
+  const int ok = _recompress_png(png_data, png_len, job, level, &params, threads, s,
+                                 out_data, out_len);
+  vs_pool_set_background(prev_background);
+  _free_recompress_scratch(s);
+  return ok;
+}
+
+typedef struct BatchWork
+{
+  const uint8_t *input_blob;
+  int32_t input_blob_len;
+  const int32_t *input_offsets;
+  const int32_t *input_lengths;
+  int32_t count;
+  int32_t level;
+  VsDeflateParams deflate;
+  VsEncodeJob *job;
+  int32_t deflate_threads; // threads per PNG for split deflate
+  uint8_t **item_outputs;
+  int32_t *item_sizes;
+
+  VsWorkQueue queue; // cancelled on the first failure
+} BatchWork;
+
+/**
+ * @brief Mark the batch as failed to stop other workers.
+ */
+static void _batch_mark_failed(BatchWork *w)
+{
+  vs_queue_cancel(&w->queue);
+}
+
+/**
+ * @brief Recompress a single PNG payload within a batch.
+ */
+static void _batch_process_one(BatchWork *w, int32_t i, RecompressScratch *s)
+{
+  const int32_t off = w->input_offsets[i];
+  const int32_t len = w->input_lengths[i];
+
+  if (off < 0 || len <= 0 || off + len > w->input_blob_len)
+  {
+    _batch_mark_failed(w);
+    return;
+  }
+
+  uint8_t *recompressed = NULL;
+  int32_t recompressed_len = 0;
+  const int ok = _recompress_png(
+      w->input_blob + off,
+      len,
+      w->job,
+      w->level,
+      &w->deflate,
+      w->deflate_threads,
+      s,
+      &recompressed,
+      &recompressed_len);
+
+  if (!ok || !recompressed || recompressed_len <= 0)
+  {
+    free(recompressed);
+    _batch_mark_failed(w);
+    return;
+  }
+
+  w->item_outputs[i] = recompressed;
+  w->item_sizes[i] = recompressed_len;
+}
+
+/**
+ * @brief Pool task: recompress batch items until none are left.
+ */
+static void _batch_worker_task(void *ctx, int32_t worker_index, void **scratch)
+{
+  BatchWork *w = (BatchWork *)ctx;
+  RecompressScratch *s = (RecompressScratch *)*scratch;
+  if (!s)
+  {
+    s = (RecompressScratch *)calloc(1, sizeof(RecompressScratch));
+    if (!s)
+    {
+      _batch_mark_failed(w);
+      return;
+    }
+    *scratch = s;
+  }
+  int32_t start, end;
+  while (vs_queue_take(&w->queue, worker_index, &start, &end))
+  {
+    for (int32_t p = start; p < end; p++)
+      _batch_process_one(w, vs_queue_item(&w->queue, p), s);
+  }
+}
+
 /**
  * @brief Recompress many PNGs in one native call using a worker pool.
  */
@@ -538,6 +575,7 @@ int recompress_png_batch(
     const int32_t *input_lengths,
     int32_t count,
     int32_t level,
+    int64_t encode_job,
     uint8_t **out_blob,
     int32_t *out_blob_len,
     int32_t **out_offsets,
@@ -570,111 +608,50 @@ int recompress_png_batch(
   work.input_lengths = input_lengths;
   work.count = count;
   work.level = level;
+  work.job = (VsEncodeJob *)(intptr_t)encode_job;
+  work.deflate = vs_deflate_params(work.job, level);
   work.item_outputs = item_outputs;
   work.item_sizes = item_sizes;
-  work.next_index = 0;
-  work.failed = 0;
-  vs_mutex_init(&work.lock);
 
   int32_t cpu_threads = _detect_cpu_threads();
   int32_t requested = g_recompress_batch_threads > 0 ? g_recompress_batch_threads : cpu_threads;
   if (requested < 1)
     requested = 1;
+  // Fewer PNGs than threads: spare threads deflate each PNG in bands.
+  work.deflate_threads =
+      vs_deflate_split_threads(work.job, requested > count ? requested / count : 1);
   if (requested > count)
     requested = count;
 
-  if (requested == 1)
+  if (!vs_queue_init(&work.queue, count, requested, 1, 0))
   {
-    for (int32_t i = 0; i < count; i++)
-    {
-      _batch_process_one(&work, i);
-      if (work.failed)
-        break;
-    }
+    free(item_outputs);
+    free(item_sizes);
+    free(out_offs);
+    free(out_lens);
+    return 0;
   }
-  else
-  {
-#ifdef _WIN32
-    HANDLE *threads = (HANDLE *)malloc((size_t)requested * sizeof(HANDLE));
-    if (!threads)
-    {
-      vs_mutex_destroy(&work.lock);
-      free(item_outputs);
-      free(item_sizes);
-      free(out_offs);
-      free(out_lens);
-      return 0;
-    }
-
-    int32_t started = 0;
-    for (int32_t t = 0; t < requested; t++)
-    {
-      threads[t] = CreateThread(NULL, 0, _batch_worker_proc, &work, 0, NULL);
-      if (threads[t])
-        started++;
-    }
-
-    if (started == 0)
-    {
-      free(threads);
-      vs_mutex_destroy(&work.lock);
-      free(item_outputs);
-      free(item_sizes);
-      free(out_offs);
-      free(out_lens);
-      return 0;
-    }
+  // Largest PNGs first: inflate/deflate cost scales with the payload size.
+  vs_queue_order_by_cost(&work.queue, input_lengths);
 
-    WaitForMultipleObjects((DWORD)started, threads, TRUE, INFINITE);
-    for (int32_t t = 0; t < requested; t++)
-    {
-      if (threads[t])
-        CloseHandle(threads[t]);
-    }
-    free(threads);
-#else
-    pthread_t *threads = (pthread_t *)malloc((size_t)requested * sizeof(pthread_t));
-    if (!threads)
-    {
-      vs_mutex_destroy(&work.lock);
-      free(item_outputs);
-      free(item_sizes);
-      free(out_offs);
-      free(out_lens);
-      return 0;
-    }
-
-    int32_t started = 0;
-    for (int32_t t = 0; t < requested; t++)
-    {
-      if (pthread_create(&threads[t], NULL, _batch_worker_proc, &work) == 0)
-      {
-        started++;
-      }
-    }
-
-    if (started == 0)
-    {
-      free(threads);
-      vs_mutex_destroy(&work.lock);
-      free(item_outputs);
-      free(item_sizes);
-      free(out_offs);
-      free(out_lens);
-      return 0;
-    }
-
-    for (int32_t t = 0; t < started; t++)
-    {
-      pthread_join(threads[t], NULL);
-    }
-    free(threads);
-#endif
+  // Serial runs go through the pool too so the warm streams are reused.
+  const int32_t prev_background = vs_pool_set_background(vs_encode_job_background(work.job));
+  const int32_t ran = vs_pool_run(requested, VS_POOL_SLOT_RECOMPRESS,
+                                  _free_recompress_scratch, _batch_worker_task, &work);
+  vs_pool_set_background(prev_background);
+  if (!ran)
+  {
+    vs_queue_destroy(&work.queue);
+    free(item_outputs);
+    free(item_sizes);
+    free(out_offs);
+    free(out_lens);
+    return 0;
   }
 
-  vs_mutex_destroy(&work.lock);
+  vs_queue_destroy(&work.queue);
 
-  if (work.failed)
+  if (vs_queue_cancelled(&work.queue))
   {
     for (int32_t i = 0; i < count; i++)
     {
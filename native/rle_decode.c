@@ -3,43 +3,393 @@
  * @brief Native CTB decrypt + RLE decode (UVtools-compatible).
  *
  * This module performs optional per-layer decryption and expands CTB
- * run-length encoding into greyscale pixel buffers.
+ * run-length encoding into greyscale pixel buffers. analyze_layer_rle walks
+ * the same runs without expanding them, for stats that only depend on where
+ * the lit runs are. decrypt_and_decode_layer_mt splits one large layer over
+ * several threads through a run-boundary index. hash_layer_rle
+ * fingerprints the decrypted payload so
+ * batches can spot repeated layers; hash_file runs the same hash over a
+ * whole file to key the job result cache.
+ *
+ * The CTB keystream is linear (the 32-bit key grows by `init` every four
+ * bytes), so encrypted payloads are decrypted a chunk at a time with
+ * SSE2/AVX2/NEON kernels (see cpu_features.h) before being parsed. Runs are
+ * written in order with memset, zero runs included, so every pixel is
+ * stored once and there is no separate clearing pass over the frame.
  */
 #include "voxelshift_native.h"
+#include "cpu_features.h"
+#include "worker_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(VS_ARCH_X64)
+  #include <emmintrin.h>
+  #include <immintrin.h>
+#elif defined(VS_ARCH_ARM64)
+  #include <arm_neon.h>
+#endif
+
+// Decrypted bytes parsed per refill; a multiple of 4 so every chunk starts
+// on a key boundary.
+#define VS_DECRYPT_CHUNK 4096
+// Longest run encoding: code byte, length byte, three extension bytes.
+#define VS_RUN_MAX_BYTES 5
+// Bytes read per refill by hash_file; a whole number of hash stripes.
+#define VS_HASH_FILE_CHUNK (1 << 20)
+// Run-boundary index spacing: a new slice starts after this many runs, and
+// no slice covers more than this many pixels.
+#define VS_DECODE_SLICE_RUNS 4096
+#define VS_DECODE_SLICE_PIXELS (1 << 20)
+// Layers below this many pixels, or with fewer pixels per payload byte
+// (parsing rather than filling dominates), decode on one thread.
+#define VS_DECODE_MIN_PIXELS (1 << 22)
+#define VS_DECODE_MIN_PIXELS_PER_BYTE 32
+
+/// XOR [len] bytes with the keystream that starts with [key] on src[0].
+typedef void (*keystream_xor_fn)(
+    const uint8_t* src, uint8_t* dst, int32_t len, uint32_t key, uint32_t init);
+
+static void _keystream_xor_scalar(
+    const uint8_t* src, uint8_t* dst, int32_t len, uint32_t key, uint32_t init) {
+  int32_t i = 0;
+  for (; i + 4 <= len; i += 4) {
+    dst[i] = src[i] ^ (uint8_t)key;
+    dst[i + 1] = src[i + 1] ^ (uint8_t)(key >> 8);
+    dst[i + 2] = src[i + 2] ^ (uint8_t)(key >> 16);
+    dst[i + 3] = src[i + 3] ^ (uint8_t)(key >> 24);
+    key += init;
+  }
+  for (int32_t b = 0; i < len; i++, b++) {
+    dst[i] = src[i] ^ (uint8_t)(key >> (8 * b));
+  }
+}
+
+// The vector kernels XOR whole 32-bit lanes; key bytes are little-endian
+// within a lane, which matches both x86-64 and AArch64.
+#if defined(VS_ARCH_X64)
+static void _keystream_xor_sse2(
+    const uint8_t* src, uint8_t* dst, int32_t len, uint32_t key, uint32_t init) {
+  __m128i keys = _mm_setr_epi32(
+      (int)key, (int)(key + init), (int)(key + 2 * init), (int)(key + 3 * init));
+  const __m128i step = _mm_set1_epi32((int)(4 * init));
+  int32_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    const __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(v, keys));
+    keys = _mm_add_epi32(keys, step);
+  }
+  _keystream_xor_scalar(src + i, dst + i, len - i, key + (uint32_t)(i / 4) * init, init);
+}
+
+static VS_TARGET_AVX2 void _keystream_xor_avx2(
+    const uint8_t* src, uint8_t* dst, int32_t len, uint32_t key, uint32_t init) {
+  __m256i keys = _mm256_setr_epi32(
+      (int)key, (int)(key + init), (int)(key + 2 * init), (int)(key + 3 * init),
+      (int)(key + 4 * init), (int)(key + 5 * init), (int)(key + 6 * init),
+      (int)(key + 7 * init));
+  const __m256i step = _mm256_set1_epi32((int)(8 * init));
+  int32_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    const __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+    _mm256_storeu_si256((__m256i*)(dst + i), _mm256_xor_si256(v, keys));
+    keys = _mm256_add_epi32(keys, step);
+  }
+  _keystream_xor_sse2(src + i, dst + i, len - i, key + (uint32_t)(i / 4) * init, init);
+}
+#elif defined(VS_ARCH_ARM64)
+static void _keystream_xor_neon(
+    const uint8_t* src, uint8_t* dst, int32_t len, uint32_t key, uint32_t init) {
+  const uint32_t lanes[4] = {key, key + init, key + 2 * init, key + 3 * init};
+  uint32x4_t keys = vld1q_u32(lanes);
+  const uint32x4_t step = vdupq_n_u32(4 * init);
+  int32_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    const uint8x16_t v = vld1q_u8(src + i);
+    vst1q_u8(dst + i, veorq_u8(v, vreinterpretq_u8_u32(keys)));
+    keys = vaddq_u32(keys, step);
+  }
+  _keystream_xor_scalar(src + i, dst + i, len - i, key + (uint32_t)(i / 4) * init, init);
+}
+#endif
+
+static keystream_xor_fn _keystream_xor_kernel(void) {
+  const int32_t level = vs_simd_level();
+#if defined(VS_ARCH_X64)
+  if (level >= VS_SIMD_AVX2) return _keystream_xor_avx2;
+  if (level >= VS_SIMD_SSE2) return _keystream_xor_sse2;
+#elif defined(VS_ARCH_ARM64)
+  if (level >= VS_SIMD_NEON) return _keystream_xor_neon;
+#else
+  (void)level;
+#endif
+  return _keystream_xor_scalar;
+}
+
+// Layer hash: 64-byte stripes are accumulated into eight 64-bit lanes
+// (lane i += lo32(d ^ k) * hi32(d ^ k), lane i ^ 1 += d), the keys shift
+// by one lane per stripe, and the lanes are scrambled every 16 stripes.
+// This is the XXH3 scheme with its own constants; the 32x32->64 multiply
+// keeps every SIMD level bit-identical to the scalar kernel.
+#define VS_HASH_STRIPE 64
+#define VS_HASH_BLOCK_STRIPES 16
+#define VS_HASH_PRIME32 0x9E3779B1u
+#define VS_HASH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define VS_HASH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+
+// Stripe s, lane i uses key s + i (0..22); 24..31 scramble the lanes.
+static const uint64_t _hash_keys[32] = {
+    0x5497A44AF0241949ULL, 0xF795CD988341DED5ULL,
+    0xFAC6DEF180E4FE81ULL, 0x40D45D94557F3823ULL,
+    0x49F6E08B67CEA9A3ULL, 0x8AEFCAEE506A74C3ULL,
+    0x246F85DDFE2C20A3ULL, 0xCE6B50EA18796EEDULL,
+    0x9BD453478C0DC7F1ULL, 0xC825B12E40CE9AE3ULL,
+    0x580FC978879CA54BULL, 0xDC24AE0A9C3A3989ULL,
+    0xF5743172A5DBE649ULL, 0x1E166C8F01122A05ULL,
+    0x41702E0543431B4BULL, 0x06AE159EE362A955ULL,
+    0xA12FA682BD9BAECDULL, 0x574E276C37929D45ULL,
+    0xB1F26FE5DE363851ULL, 0x4683BA0E645B92EFULL,
+    0x0665380524036C91ULL, 0x36D94125327C4309ULL,
+    0x0C6CFD9CDB135F0BULL, 0x1EC6DA2ED531C14BULL,
+    0x5E4FA28C05717B7BULL, 0xF72D8CEAABDDFDD7ULL,
+    0x0484EB8DC1A5CA7DULL, 0x02B5CF7DAAA27B05ULL,
+    0xCCD827D784A1FAF3ULL, 0x82A54AC3ABF90005ULL,
+    0x763F8A55B8EE36D1ULL, 0xEB9BB3B3CA23BD65ULL,
+};
+
+/// Accumulate [stripes] 64-byte stripes; stripe s uses keys[s .. s + 7].
+typedef void (*hash_stripes_fn)(
+    uint64_t* acc, const uint8_t* data, int32_t stripes, const uint64_t* keys);
+
+static void _hash_stripes_scalar(
+    uint64_t* acc, const uint8_t* data, int32_t stripes, const uint64_t* keys) {
+  for (int32_t s = 0; s < stripes; s++) {
+    for (int32_t i = 0; i < 8; i++) {
+      uint64_t d;
+      memcpy(&d, data + s * VS_HASH_STRIPE + i * 8, 8);
+      const uint64_t dk = d ^ keys[s + i];
+      acc[i ^ 1] += d;
+      acc[i] += (dk & 0xFFFFFFFFu) * (dk >> 32);
+    }
+  }
+}
+
+#if defined(VS_ARCH_X64)
+static void _hash_stripes_sse2(
+    uint64_t* acc, const uint8_t* data, int32_t stripes, const uint64_t* keys) {
+  __m128i a[4];
+  for (int32_t j = 0; j < 4; j++) a[j] = _mm_loadu_si128((const __m128i*)(acc + 2 * j));
+  for (int32_t s = 0; s < stripes; s++) {
+    for (int32_t j = 0; j < 4; j++) {
+      const __m128i d = _mm_loadu_si128(
+          (const __m128i*)(data + s * VS_HASH_STRIPE + 16 * j));
+      const __m128i dk = _mm_xor_si128(
+          d, _mm_loadu_si128((const __m128i*)(keys + s + 2 * j)));
+      const __m128i product = _mm_mul_epu32(dk, _mm_srli_epi64(dk, 32));
+      const __m128i swapped = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+      a[j] = _mm_add_epi64(a[j], _mm_add_epi64(product, swapped));
+    }
+  }
+  for (int32_t j = 0; j < 4; j++) _mm_storeu_si128((__m128i*)(acc + 2 * j), a[j]);
+}
+
+static VS_TARGET_AVX2 void _hash_stripes_avx2(
+    uint64_t* acc, const uint8_t* data, int32_t stripes, const uint64_t* keys) {
+  __m256i a0 = _mm256_loadu_si256((const __m256i*)acc);
+  __m256i a1 = _mm256_loadu_si256((const __m256i*)(acc + 4));
+  for (int32_t s = 0; s < stripes; s++) {
+    const uint8_t* p = data + s * VS_HASH_STRIPE;
+    const __m256i d0 = _mm256_loadu_si256((const __m256i*)p);
+    const __m256i d1 = _mm256_loadu_si256((const __m256i*)(p + 32));
+    const __m256i dk0 = _mm256_xor_si256(
+        d0, _mm256_loadu_si256((const __m256i*)(keys + s)));
+    const __m256i dk1 = _mm256_xor_si256(
+        d1, _mm256_loadu_si256((const __m256i*)(keys + s + 4)));
+    // Lane pairs (0,1), (2,3) share a 128-bit half, so the swap stays in-lane.
+    a0 = _mm256_add_epi64(a0, _mm256_add_epi64(
+        _mm256_mul_epu32(dk0, _mm256_srli_epi64(dk0, 32)),
+        _mm256_shuffle_epi32(d0, _MM_SHUFFLE(1, 0, 3, 2))));
+    a1 = _mm256_add_epi64(a1, _mm256_add_epi64(
+        _mm256_mul_epu32(dk1, _mm256_srli_epi64(dk1, 32)),
+        _mm256_shuffle_epi32(d1, _MM_SHUFFLE(1, 0, 3, 2))));
+  }
+  _mm256_storeu_si256((__m256i*)acc, a0);
+  _mm256_storeu_si256((__m256i*)(acc + 4), a1);
+}
+#elif defined(VS_ARCH_ARM64)
+static void _hash_stripes_neon(
+    uint64_t* acc, const uint8_t* data, int32_t stripes, const uint64_t* keys) {
+  uint64x2_t a[4];
+  for (int32_t j = 0; j < 4; j++) a[j] = vld1q_u64(acc + 2 * j);
+  for (int32_t s = 0; s < stripes; s++) {
+    for (int32_t j = 0; j < 4; j++) {
+      const uint64x2_t d = vreinterpretq_u64_u8(
+          vld1q_u8(data + s * VS_HASH_STRIPE + 16 * j));
+      const uint64x2_t dk = veorq_u64(d, vld1q_u64(keys + s + 2 * j));
+      const uint64x2_t product = vmull_u32(vmovn_u64(dk), vshrn_n_u64(dk, 32));
+      a[j] = vaddq_u64(a[j], vaddq_u64(product, vextq_u64(d, d, 1)));
+    }
+  }
+  for (int32_t j = 0; j < 4; j++) vst1q_u64(acc + 2 * j, a[j]);
+}
+#endif
+
+static hash_stripes_fn _hash_stripes_kernel(void) {
+  const int32_t level = vs_simd_level();
+#if defined(VS_ARCH_X64)
+  if (level >= VS_SIMD_AVX2) return _hash_stripes_avx2;
+  if (level >= VS_SIMD_SSE2) return _hash_stripes_sse2;
+#elif defined(VS_ARCH_ARM64)
+  if (level >= VS_SIMD_NEON) return _hash_stripes_neon;
+#else
+  (void)level;
+#endif
+  return _hash_stripes_scalar;
+}
 
 /**
- * @brief Read one byte from the encoded stream and update decryption state.
+ * @brief Sequential reader over a layer's runs.
  *
- * When encryption is enabled, the byte is XORed with the evolving key.
- * The key is updated every 4 bytes according to CTB rules.
+ * Plain payloads are parsed in place. Encrypted ones are decrypted into
+ * the caller's [chunk] ahead of the parser; [key] is the key for
+ * data[next_in]. The chunk lives outside the cursor so the cursor's own
+ * address never escapes and its fields can stay in registers.
  */
-static uint8_t read_byte(
+typedef struct RleCursor {
+  const uint8_t* data;
+  int32_t data_len;
+  const uint8_t* cur;
+  const uint8_t* end;
+  int32_t next_in;
+  uint32_t key;
+  uint32_t init;
+  keystream_xor_fn keystream_xor;
+  uint8_t* chunk;           // VS_DECRYPT_CHUNK + VS_RUN_MAX_BYTES bytes
+} RleCursor;
+
+/// Keystream start and step for one layer of an encrypted file.
+static void _ctb_layer_key(
+    int32_t layer_index,
+    int32_t encryption_key,
+    uint32_t* out_key,
+    uint32_t* out_init) {
+  const uint32_t init = ((uint32_t)encryption_key * 0x2d83cdacu + 0xd8a83423u);
+  *out_key = ((uint32_t)layer_index * 0x1e1530cdu + 0xec3d47cdu) * init;
+  *out_init = init;
+}
+
+static void _rle_cursor_init(
+    RleCursor* c,
+    uint8_t* chunk,
     const uint8_t* data,
-    int* n,
     int32_t data_len,
-    int encrypted,
-    uint32_t* key,
-    uint32_t init,
-    int* key_byte_index,
-    int* ok) {
-  if (*n >= data_len) {
-    *ok = 0;
-    return 0;
+    int32_t layer_index,
+    int32_t encryption_key) {
+  c->data = data;
+  c->data_len = data_len;
+  c->cur = data;
+  c->end = data + data_len;
+  c->next_in = data_len;
+  c->key = 0;
+  c->init = 0;
+  c->keystream_xor = NULL;
+  c->chunk = chunk;
+
+  if (encryption_key != 0) {
+    _ctb_layer_key(layer_index, encryption_key, &c->key, &c->init);
+    c->keystream_xor = _keystream_xor_kernel();
+    c->cur = c->chunk;
+    c->end = c->chunk;
+    c->next_in = 0;
+  }
+}
+
+/// Carry the unread tail to the front of [chunk] and decrypt behind it.
+VS_INLINE void _rle_refill(RleCursor* c) {
+  const int32_t carry = (int32_t)(c->end - c->cur);
+  memmove(c->chunk, c->cur, (size_t)carry);
+  int32_t take = c->data_len - c->next_in;
+  if (take > VS_DECRYPT_CHUNK) take = VS_DECRYPT_CHUNK;
+  c->keystream_xor(c->data + c->next_in, c->chunk + carry, take, c->key, c->init);
+  c->key += (uint32_t)(take / 4) * c->init;
+  c->next_in += take;
+  c->cur = c->chunk;
+  c->end = c->chunk + carry + take;
+}
+
+/// Payload offset of the next unread byte.
+VS_INLINE int32_t _rle_cursor_offset(const RleCursor* c) {
+  return c->keystream_xor ? c->next_in - (int32_t)(c->end - c->cur)
+                          : (int32_t)(c->cur - c->data);
+}
+
+/**
+ * @brief Move a freshly initialised cursor to payload byte [offset].
+ *
+ * The key advances by `init` every four bytes, so the key for any aligned
+ * position follows from the layer's first key without decrypting what
+ * comes before it.
+ */
+static void _rle_cursor_seek(RleCursor* c, int32_t offset) {
+  if (!c->keystream_xor) {
+    c->cur = c->data + offset;
+    return;
+  }
+  const int32_t aligned = offset & ~3;
+  c->key += (uint32_t)(aligned / 4) * c->init;
+  c->next_in = aligned;
+  c->cur = c->chunk;
+  c->end = c->chunk;
+  _rle_refill(c);
+  c->cur += offset - aligned;
+}
+
+/**
+ * @brief Read the next run as a pixel value and length.
+ *
+ * @return 0 at the end of the payload or on a truncated run.
+ */
+VS_INLINE int _rle_next_run(RleCursor* c, uint8_t* out_value, int32_t* out_stride) {
+  if (c->end - c->cur < VS_RUN_MAX_BYTES && c->next_in < c->data_len) {
+    _rle_refill(c);
   }
 
-  uint8_t value = data[(*n)++];
-  if (!encrypted) return value;
+  const uint8_t* cur = c->cur;
+  const uint8_t* end = c->end;
+  if (cur >= end) return 0;
 
-  const uint8_t k = (uint8_t)((*key >> (8 * (*key_byte_index))) & 0xFFu);
-  value ^= k;
+  uint8_t code = *cur++;
+  int32_t stride = 1;
 
-  (*key_byte_index)++;
-  if (((*key_byte_index) & 3) == 0) {
-    *key = *key + init;
-    *key_byte_index = 0;
+  if ((code & 0x80u) != 0) {
+    code &= 0x7Fu;
+
+    if (cur >= end) return 0;
+    const uint8_t slen = *cur++;
+
+    if ((slen & 0x80u) == 0) {
+      stride = slen;
+    } else if ((slen & 0xC0u) == 0x80u) {
+      if (end - cur < 1) return 0;
+      stride = ((slen & 0x3F) << 8) + cur[0];
+      cur += 1;
+    } else if ((slen & 0xE0u) == 0xC0u) {
+      if (end - cur < 2) return 0;
+      stride = ((slen & 0x1F) << 16) + (cur[0] << 8) + cur[1];
+      cur += 2;
+    } else if ((slen & 0xF0u) == 0xE0u) {
+      if (end - cur < 3) return 0;
+      stride = ((slen & 0x0F) << 24) + (cur[0] << 16) + (cur[1] << 8) + cur[2];
+      cur += 3;
+    }
   }
 
-  return value;
+  c->cur = cur;
+  *out_value = code == 0 ? 0 : (uint8_t)((code << 1) | 1);
+  *out_stride = stride;
+  return 1;
 }
 
 /**
@@ -60,78 +410,530 @@ int decrypt_and_decode_layer(
     return 0;
   }
 
-  for (int32_t i = 0; i < pixel_count; i++) {
-    out_pixels[i] = 0;
-  }
-
-  const int encrypted = encryption_key != 0;
-  uint32_t key = 0;
-  uint32_t init = 0;
-  int key_byte_index = 0;
-
-  if (encrypted) {
-    init = ((uint32_t)encryption_key * 0x2d83cdacu + 0xd8a83423u);
-    key = ((uint32_t)layer_index * 0x1e1530cdu + 0xec3d47cdu);
-    key = key * init;
-  }
-
-  int n = 0;
-  int pixel = 0;
-  int ok = 1;
-
-  while (n < data_len && pixel < pixel_count && ok) {
-    uint8_t code = read_byte(
-        data, &n, data_len, encrypted, &key, init, &key_byte_index, &ok);
-    if (!ok) break;
-
-    int stride = 1;
-
-    if ((code & 0x80u) != 0) {
-      code &= 0x7Fu;
-
-      uint8_t slen = read_byte(
-          data, &n, data_len, encrypted, &key, init, &key_byte_index, &ok);
-      if (!ok) break;
-
-      if ((slen & 0x80u) == 0) {
-        stride = slen;
-      } else if ((slen & 0xC0u) == 0x80u) {
-        const uint8_t b0 = read_byte(
-            data, &n, data_len, encrypted, &key, init, &key_byte_index, &ok);
-        if (!ok) break;
-        stride = ((slen & 0x3Fu) << 8) + b0;
-      } else if ((slen & 0xE0u) == 0xC0u) {
-        const uint8_t b0 = read_byte(
-            data, &n, data_len, encrypted, &key, init, &key_byte_index, &ok);
-        const uint8_t b1 = read_byte(
-            data, &n, data_len, encrypted, &key, init, &key_byte_index, &ok);
-        if (!ok) break;
-        stride = ((slen & 0x1Fu) << 16) + (b0 << 8) + b1;
-      } else if ((slen & 0xF0u) == 0xE0u) {
-        const uint8_t b0 = read_byte(
-            data, &n, data_len, encrypted, &key, init, &key_byte_index, &ok);
-        const uint8_t b1 = read_byte(
-            data, &n, data_len, encrypted, &key, init, &key_byte_index, &ok);
-        const uint8_t b2 = read_byte(
-            data, &n, data_len, encrypted, &key, init, &key_byte_index, &ok);
-        if (!ok) break;
-        stride = ((slen & 0x0Fu) << 24) + (b0 << 16) + (b1 << 8) + b2;
+  uint8_t chunk[VS_DECRYPT_CHUNK + VS_RUN_MAX_BYTES];
+  RleCursor c;
+  _rle_cursor_init(&c, chunk, data, data_len, layer_index, encryption_key);
+
+  int32_t pixel = 0;
+  uint8_t pixel_value = 0;
+  int32_t stride = 0;
+  while (pixel < pixel_count && _rle_next_run(&c, &pixel_value, &stride)) {
+    int32_t run_end = pixel + stride;
+    if (run_end > pixel_count) run_end = pixel_count;
+
+    memset(out_pixels + pixel, pixel_value, (size_t)(run_end - pixel));
+    pixel = run_end;
+  }
+
+  // Truncated or short payloads leave the rest of the layer empty.
+  if (pixel < pixel_count) {
+    memset(out_pixels + pixel, 0, (size_t)(pixel_count - pixel));
+  }
+
+  return 1;
+}
+
+// One slice of a layer for the parallel decoder: the pixels from [pixel]
+// to the next slice's start, beginning with the run at payload [offset]
+// that covers [run_pixel] onwards.
+typedef struct RleSlice {
+  int32_t offset;
+  int32_t run_pixel;
+  int32_t pixel;
+} RleSlice;
+
+typedef struct RleDecodeWork {
+  const uint8_t* data;
+  int32_t data_len;
+  int32_t layer_index;
+  int32_t encryption_key;
+  int32_t pixel_count;
+  uint8_t* out_pixels;
+  RleSlice* slices;
+  int32_t slice_count;
+  int32_t slice_cap;
+  VsWorkQueue queue;
+} RleDecodeWork;
+
+static int _push_slice(RleDecodeWork* w, int32_t offset, int32_t run_pixel, int32_t pixel) {
+  if (w->slice_count == w->slice_cap) {
+    const int32_t cap = w->slice_cap > 0 ? w->slice_cap * 2 : 64;
+    RleSlice* grown = (RleSlice*)realloc(w->slices, (size_t)cap * sizeof(RleSlice));
+    if (!grown) return 0;
+    w->slices = grown;
+    w->slice_cap = cap;
+  }
+  RleSlice* s = &w->slices[w->slice_count++];
+  s->offset = offset;
+  s->run_pixel = run_pixel;
+  s->pixel = pixel;
+  return 1;
+}
+
+/**
+ * @brief First pass: walk the runs without writing pixels and cut the
+ * layer into slices every VS_DECODE_SLICE_RUNS runs or
+ * VS_DECODE_SLICE_PIXELS pixels, whichever comes first. A run longer than
+ * a slice is cut mid-run.
+ */
+static int _index_slices(RleDecodeWork* w) {
+  uint8_t chunk[VS_DECRYPT_CHUNK + VS_RUN_MAX_BYTES];
+  RleCursor c;
+  _rle_cursor_init(&c, chunk, w->data, w->data_len, w->layer_index,
+                   w->encryption_key);
+  if (!_push_slice(w, 0, 0, 0)) return 0;
+
+  int32_t pixel = 0;
+  int32_t slice_start = 0;
+  int32_t runs = 0;
+  uint8_t value = 0;
+  int32_t stride = 0;
+  while (pixel < w->pixel_count) {
+    const int32_t offset = _rle_cursor_offset(&c);
+    if (!_rle_next_run(&c, &value, &stride)) break;
+    int32_t run_end = pixel + stride;
+    if (run_end > w->pixel_count) run_end = w->pixel_count;
+
+    while (run_end - slice_start > VS_DECODE_SLICE_PIXELS) {
+      slice_start += VS_DECODE_SLICE_PIXELS;
+      if (!_push_slice(w, offset, pixel, slice_start)) return 0;
+      runs = 0;
+    }
+    pixel = run_end;
+    if (++runs >= VS_DECODE_SLICE_RUNS && pixel > slice_start &&
+        pixel < w->pixel_count) {
+      slice_start = pixel;
+      if (!_push_slice(w, _rle_cursor_offset(&c), pixel, pixel)) return 0;
+      runs = 0;
+    }
+  }
+  return 1;
+}
+
+/// Second pass over one slice; a payload that ends early leaves the rest
+/// of the slice zero, as in the serial decoder.
+static void _decode_slice(RleDecodeWork* w, int32_t index, uint8_t* chunk) {
+  const RleSlice* s = &w->slices[index];
+  const int32_t end = index + 1 < w->slice_count ? w->slices[index + 1].pixel
+                                                 : w->pixel_count;
+  RleCursor c;
+  _rle_cursor_init(&c, chunk, w->data, w->data_len, w->layer_index,
+                   w->encryption_key);
+  _rle_cursor_seek(&c, s->offset);
+
+  int32_t pixel = s->run_pixel;
+  uint8_t value = 0;
+  int32_t stride = 0;
+  while (pixel < end && _rle_next_run(&c, &value, &stride)) {
+    int32_t run_end = pixel + stride;
+    if (run_end > end) run_end = end;
+    const int32_t from = pixel > s->pixel ? pixel : s->pixel;
+    if (run_end > from) {
+      memset(w->out_pixels + from, value, (size_t)(run_end - from));
+    }
+    pixel = run_end;
+  }
+  const int32_t from = pixel > s->pixel ? pixel : s->pixel;
+  if (from < end) {
+    memset(w->out_pixels + from, 0, (size_t)(end - from));
+  }
+}
+
+static void _decode_slice_task(void* ctx, int32_t worker_index, void** scratch) {
+  (void)scratch;
+  RleDecodeWork* w = (RleDecodeWork*)ctx;
+  uint8_t chunk[VS_DECRYPT_CHUNK + VS_RUN_MAX_BYTES];
+  int32_t start, end;
+  while (vs_queue_take(&w->queue, worker_index, &start, &end)) {
+    for (int32_t i = start; i < end; i++) _decode_slice(w, i, chunk);
+  }
+}
+
+/**
+ * @brief decrypt_and_decode_layer using up to [thread_count] threads.
+ *
+ * A run's position depends on every run before it, so a first serial pass
+ * only parses the runs and records slice starts (payload offset and pixel);
+ * the slices are then decrypted and filled in parallel, by the calling
+ * worker and any idle pool workers when called from a batch task. Output
+ * is identical to the serial decoder. Small layers, and layers dense enough
+ * in runs that the first pass would cost as much as the fill, decode
+ * serially.
+ */
+int decrypt_and_decode_layer_mt(
+    const uint8_t* data,
+    int32_t data_len,
+    int32_t layer_index,
+    int32_t encryption_key,
+    int32_t pixel_count,
+    int32_t thread_count,
+    uint8_t* out_pixels) {
+  if (!data || data_len <= 0 || pixel_count <= 0 || !out_pixels) {
+    return 0;
+  }
+  if (thread_count < 2 || pixel_count < VS_DECODE_MIN_PIXELS ||
+      (int64_t)data_len * VS_DECODE_MIN_PIXELS_PER_BYTE > pixel_count) {
+    return decrypt_and_decode_layer(
+        data, data_len, layer_index, encryption_key, pixel_count, out_pixels);
+  }
+
+  RleDecodeWork work;
+  memset(&work, 0, sizeof(work));
+  work.data = data;
+  work.data_len = data_len;
+  work.layer_index = layer_index;
+  work.encryption_key = encryption_key;
+  work.pixel_count = pixel_count;
+  work.out_pixels = out_pixels;
+  int ok = _index_slices(&work);
+  if (ok && work.slice_count < 2) {
+    free(work.slices);
+    return decrypt_and_decode_layer(
+        data, data_len, layer_index, encryption_key, pixel_count, out_pixels);
+  }
+
+  int32_t threads = thread_count < work.slice_count ? thread_count
+                                                    : work.slice_count;
+  ok = ok && vs_queue_init(&work.queue, work.slice_count, threads, 1, 0);
+  if (ok) {
+    ok = vs_pool_run(threads, VS_POOL_NO_SCRATCH, NULL, _decode_slice_task,
+                     &work) > 0 &&
+         !vs_queue_cancelled(&work.queue);
+    vs_queue_destroy(&work.queue);
+  }
+  free(work.slices);
+  return ok ? 1
+            : decrypt_and_decode_layer(data, data_len, layer_index,
+                                       encryption_key, pixel_count, out_pixels);
+}
+
+/**
+ * @brief Summarise a CTB layer from its runs without decoding it.
+ *
+ * Lit runs (non-zero value) are clipped to the frame and mapped to rows:
+ * a run inside one row only widens that row's extent, one that wraps
+ * covers the rows in between in full. Work is proportional to the number
+ * of runs plus the rows they span, not to the pixel count.
+ */
+int analyze_layer_rle(
+    const uint8_t* data,
+    int32_t data_len,
+    int32_t layer_index,
+    int32_t encryption_key,
+    int32_t width,
+    int32_t height,
+    RleLayerStats* out_stats,
+    int32_t* out_row_first,
+    int32_t* out_row_last,
+    int32_t* out_row_run) {
+  if (!data || data_len <= 0 || width <= 0 || height <= 0 || !out_stats ||
+      (int64_t)width * height > INT32_MAX) {
+    return 0;
+  }
+
+  const int32_t pixel_count = width * height;
+  memset(out_stats, 0, sizeof(*out_stats));
+  for (int32_t y = 0; y < height; y++) {
+    if (out_row_first) out_row_first[y] = -1;
+    if (out_row_last) out_row_last[y] = -1;
+    if (out_row_run) out_row_run[y] = -1;
+  }
+
+  uint8_t chunk[VS_DECRYPT_CHUNK + VS_RUN_MAX_BYTES];
+  RleCursor c;
+  _rle_cursor_init(&c, chunk, data, data_len, layer_index, encryption_key);
+
+  int64_t lit = 0;
+  int32_t min_x = width;
+  int32_t min_y = height;
+  int32_t max_x = 0;
+  int32_t max_y = 0;
+  int32_t runs = 0;
+  int32_t pixel = 0;
+  int32_t y = 0;  // row and column of [pixel]
+  int32_t x = 0;
+  uint8_t value = 0;
+  int32_t stride = 0;
+  while (pixel < pixel_count && _rle_next_run(&c, &value, &stride)) {
+    int32_t run_end = pixel + stride;
+    if (run_end > pixel_count) run_end = pixel_count;
+
+    // Row and column of run_end; only runs reaching a row end divide.
+    int32_t ye = y;
+    int32_t xe = x + (run_end - pixel);
+    if (xe >= width) {
+      ye += xe / width;
+      xe %= width;
+    }
+
+    if (out_row_run) {
+      // Rows whose first pixel falls inside this run.
+      for (int32_t r = x == 0 ? y : y + 1; r < ye + (xe > 0) && r < height; r++) {
+        out_row_run[r] = runs;
       }
     }
 
-    const uint8_t pixel_value = code == 0 ? 0 : (uint8_t)((code << 1) | 1);
+    if (value != 0 && run_end > pixel) {
+      const int32_t y0 = y;
+      const int32_t x0 = x;
+      const int32_t y1 = xe > 0 ? ye : ye - 1;
+      const int32_t x1 = xe > 0 ? xe - 1 : width - 1;
+      const int32_t run_min_x = y1 > y0 ? 0 : x0;
+      const int32_t run_max_x = y1 > y0 ? width - 1 : x1;
+      lit += run_end - pixel;
+      if (y0 < min_y) min_y = y0;
+      max_y = y1;
+      if (run_min_x < min_x) min_x = run_min_x;
+      if (run_max_x > max_x) max_x = run_max_x;
+
+      for (int32_t r = y0; r <= y1 && (out_row_first || out_row_last); r++) {
+        if (out_row_first && out_row_first[r] < 0) {
+          out_row_first[r] = r == y0 ? x0 : 0;
+        }
+        if (out_row_last) out_row_last[r] = r == y1 ? x1 : width - 1;
+      }
+    }
 
-    int end = pixel + stride;
-    if (end > pixel_count) end = pixel_count;
+    pixel = run_end;
+    y = ye;
+    x = xe;
+    runs++;
+  }
 
-    if (pixel_value != 0) {
-      for (int i = pixel; i < end; i++) {
-        out_pixels[i] = pixel_value;
+  out_stats->lit_pixels = lit;
+  out_stats->run_count = runs;
+  out_stats->decoded_pixels = pixel;
+  if (lit > 0) {
+    out_stats->min_x = min_x;
+    out_stats->min_y = min_y;
+    out_stats->max_x = max_x;
+    out_stats->max_y = max_y;
+  }
+  return 1;
+}
+
+typedef struct LayerHash {
+  uint64_t acc[8];
+  int32_t stripe;           // stripes accumulated in the current block
+  hash_stripes_fn stripes;
+} LayerHash;
+
+static void _layer_hash_init(LayerHash* h) {
+  for (int32_t i = 0; i < 8; i++) {
+    h->acc[i] = _hash_keys[i] * VS_HASH_PRIME64_1 + (uint64_t)i;
+  }
+  h->stripe = 0;
+  h->stripes = _hash_stripes_kernel();
+}
+
+/// Absorb [stripes] whole stripes, scrambling at each block boundary.
+static void _layer_hash_update(LayerHash* h, const uint8_t* data, int32_t stripes) {
+  while (stripes > 0) {
+    int32_t n = VS_HASH_BLOCK_STRIPES - h->stripe;
+    if (n > stripes) n = stripes;
+    h->stripes(h->acc, data, n, _hash_keys + h->stripe);
+    h->stripe += n;
+    data += n * VS_HASH_STRIPE;
+    stripes -= n;
+    if (h->stripe == VS_HASH_BLOCK_STRIPES) {
+      for (int32_t i = 0; i < 8; i++) {
+        uint64_t a = h->acc[i];
+        a ^= a >> 47;
+        a ^= _hash_keys[24 + i];
+        h->acc[i] = a * VS_HASH_PRIME32;
       }
+      h->stripe = 0;
     }
+  }
+}
+
+/// Low 64 bits XOR high 64 bits of a * b.
+static uint64_t _mul_fold64(uint64_t a, uint64_t b) {
+  const uint64_t a_lo = a & 0xFFFFFFFFu, a_hi = a >> 32;
+  const uint64_t b_lo = b & 0xFFFFFFFFu, b_hi = b >> 32;
+  const uint64_t ll = a_lo * b_lo;
+  const uint64_t lh = a_lo * b_hi;
+  const uint64_t hl = a_hi * b_lo;
+  const uint64_t cross = (ll >> 32) + (lh & 0xFFFFFFFFu) + hl;
+  const uint64_t upper = a_hi * b_hi + (lh >> 32) + (cross >> 32);
+  const uint64_t lower = (cross << 32) | (ll & 0xFFFFFFFFu);
+  return lower ^ upper;
+}
 
-    pixel = end;
+static uint64_t _avalanche64(uint64_t h) {
+  h ^= h >> 37;
+  h *= 0x165667919E3779F9ULL;
+  return h ^ (h >> 32);
+}
+
+/// Absorb the last partial stripe (zero-padded) and fold to 128 bits.
+static void _layer_hash_final(
+    LayerHash* h,
+    const uint8_t* tail,
+    int32_t tail_len,
+    int64_t total_len,
+    uint64_t* out_hash) {
+  if (tail_len > 0) {
+    uint8_t last[VS_HASH_STRIPE];
+    memset(last, 0, sizeof(last));
+    memcpy(last, tail, (size_t)tail_len);
+    h->stripes(h->acc, last, 1, _hash_keys + h->stripe);
+  }
+  uint64_t lo = (uint64_t)total_len * VS_HASH_PRIME64_1;
+  uint64_t hi = ~((uint64_t)total_len * VS_HASH_PRIME64_2);
+  for (int32_t j = 0; j < 4; j++) {
+    lo += _mul_fold64(h->acc[2 * j] ^ _hash_keys[2 * j],
+                      h->acc[2 * j + 1] ^ _hash_keys[2 * j + 1]);
+    hi += _mul_fold64(h->acc[2 * j] ^ _hash_keys[8 + 2 * j],
+                      h->acc[2 * j + 1] ^ _hash_keys[9 + 2 * j]);
+  }
+  out_hash[0] = _avalanche64(lo);
+  out_hash[1] = _avalanche64(hi);
+}
+
+/**
+ * @brief 128-bit hash of a layer's decrypted RLE payload.
+ *
+ * Encrypted payloads are decrypted a chunk at a time into a stack buffer,
+ * so the same layer content hashes the same at any layer index or key.
+ */
+int hash_layer_rle(
+    const uint8_t* data,
+    int32_t data_len,
+    int32_t layer_index,
+    int32_t encryption_key,
+    uint64_t* out_hash) {
+  if (!data || data_len <= 0 || !out_hash) {
+    return 0;
+  }
+
+  LayerHash h;
+  _layer_hash_init(&h);
+  if (encryption_key == 0) {
+    const int32_t whole = data_len / VS_HASH_STRIPE;
+    _layer_hash_update(&h, data, whole);
+    _layer_hash_final(&h, data + whole * VS_HASH_STRIPE,
+                      data_len - whole * VS_HASH_STRIPE, data_len, out_hash);
+    return 1;
+  }
+
+  // VS_DECRYPT_CHUNK is a whole number of stripes, so only the last chunk
+  // leaves a partial one.
+  uint8_t chunk[VS_DECRYPT_CHUNK];
+  uint32_t key, init;
+  _ctb_layer_key(layer_index, encryption_key, &key, &init);
+  const keystream_xor_fn keystream_xor = _keystream_xor_kernel();
+  for (int32_t off = 0; off < data_len;) {
+    int32_t take = data_len - off;
+    if (take > VS_DECRYPT_CHUNK) take = VS_DECRYPT_CHUNK;
+    keystream_xor(data + off, chunk, take, key, init);
+    key += (uint32_t)(take / 4) * init;
+    off += take;
+
+    const int32_t whole = take / VS_HASH_STRIPE;
+    _layer_hash_update(&h, chunk, whole);
+    if (off == data_len) {
+      _layer_hash_final(&h, chunk + whole * VS_HASH_STRIPE,
+                        take - whole * VS_HASH_STRIPE, data_len, out_hash);
+    }
+  }
+  return 1;
+}
+
+/// Plain bytes [off, off + take) of one layer's payload: [data] itself when
+/// unencrypted, else decrypted into [buf] with the keystream at [*key].
+static const uint8_t* _plain_chunk(
+    const uint8_t* data,
+    int32_t off,
+    int32_t take,
+    int32_t encryption_key,
+    uint32_t* key,
+    uint32_t init,
+    keystream_xor_fn keystream_xor,
+    uint8_t* buf) {
+  if (encryption_key == 0) return data + off;
+  keystream_xor(data + off, buf, take, *key, init);
+  *key += (uint32_t)(take / 4) * init;
+  return buf;
+}
+
+/**
+ * @brief Whether two layers' decrypted RLE payloads are byte-identical.
+ *
+ * Confirms a hash_layer_rle match before a layer's result is reused.
+ * Encrypted payloads are compared a chunk at a time after decryption.
+ */
+int layer_rle_equal(
+    const uint8_t* a,
+    int32_t a_layer_index,
+    int32_t a_encryption_key,
+    const uint8_t* b,
+    int32_t b_layer_index,
+    int32_t b_encryption_key,
+    int32_t data_len) {
+  if (!a || !b || data_len < 0) {
+    return 0;
+  }
+  if (a_encryption_key == 0 && b_encryption_key == 0) {
+    return memcmp(a, b, (size_t)data_len) == 0;
   }
 
+  uint8_t chunk_a[VS_DECRYPT_CHUNK];
+  uint8_t chunk_b[VS_DECRYPT_CHUNK];
+  uint32_t key_a, init_a, key_b, init_b;
+  _ctb_layer_key(a_layer_index, a_encryption_key, &key_a, &init_a);
+  _ctb_layer_key(b_layer_index, b_encryption_key, &key_b, &init_b);
+  const keystream_xor_fn keystream_xor = _keystream_xor_kernel();
+  for (int32_t off = 0; off < data_len; off += VS_DECRYPT_CHUNK) {
+    int32_t take = data_len - off;
+    if (take > VS_DECRYPT_CHUNK) take = VS_DECRYPT_CHUNK;
+    const uint8_t* pa = _plain_chunk(a, off, take, a_encryption_key, &key_a,
+                                     init_a, keystream_xor, chunk_a);
+    const uint8_t* pb = _plain_chunk(b, off, take, b_encryption_key, &key_b,
+                                     init_b, keystream_xor, chunk_b);
+    if (memcmp(pa, pb, (size_t)take) != 0) return 0;
+  }
   return 1;
 }
+
+/**
+ * @brief 128-bit hash of a whole file, streamed in 1 MiB reads.
+ *
+ * Same hash as hash_layer_rle over the raw bytes; returns 0 if the file
+ * cannot be read.
+ */
+int hash_file(const char* path, uint64_t* out_hash) {
+  if (!path || !out_hash) {
+    return 0;
+  }
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    return 0;
+  }
+  uint8_t* buf = (uint8_t*)malloc(VS_HASH_FILE_CHUNK);
+  if (!buf) {
+    fclose(f);
+    return 0;
+  }
+
+  LayerHash h;
+  _layer_hash_init(&h);
+  int64_t total = 0;
+  size_t got;
+  // Only a short read (end of file) leaves a partial stripe behind.
+  while ((got = fread(buf, 1, VS_HASH_FILE_CHUNK, f)) == VS_HASH_FILE_CHUNK) {
+    _layer_hash_update(&h, buf, VS_HASH_FILE_CHUNK / VS_HASH_STRIPE);
+    total += VS_HASH_FILE_CHUNK;
+  }
+  const int ok = !ferror(f);
+  if (ok) {
+    const int32_t whole = (int32_t)(got / VS_HASH_STRIPE);
+    _layer_hash_update(&h, buf, whole);
+    total += (int64_t)got;
+    _layer_hash_final(&h, buf + whole * VS_HASH_STRIPE,
+                      (int32_t)got - whole * VS_HASH_STRIPE, total, out_hash);
+  }
+  free(buf);
+  fclose(f);
+  return ok;
+}
@@ -46,6 +46,48 @@ VS_EXPORT int compute_layer_area_stats(
     double y_pixel_size_mm,
     AreaStatsResult* out_result);
 
+/// compute_layer_area_stats split over up to [thread_count] threads.
+///
+/// The layer is labelled in row bands in parallel and the islands are
+/// stitched across band seams; results are identical to the
+/// single-threaded call. Small layers run single-threaded.
+///
+/// Returns 1 on success, 0 on failure.
+VS_EXPORT int compute_layer_area_stats_mt(
+    const uint8_t* pixels,
+    int32_t width,
+    int32_t height,
+    double x_pixel_size_mm,
+    double y_pixel_size_mm,
+    int32_t thread_count,
+    AreaStatsResult* out_result);
+
+/// Area statistics levels for [compute_layer_area_stats_mode] and the
+/// process_layers_batch* entry points, from most to least work.
+enum {
+  VS_AREA_MODE_FULL = 0,    // islands, total area and bounding box
+  VS_AREA_MODE_BBOX = 1,    // total area and bounding box; island fields 0
+  VS_AREA_MODE_TOTAL = 2,   // total area only; other fields 0
+  VS_AREA_MODE_NONE = 3,    // no pass; every field 0
+};
+
+/// Compute only the area statistics selected by area_mode (VS_AREA_MODE_*).
+///
+/// FULL matches [compute_layer_area_stats_mt]. BBOX and TOTAL count solid
+/// pixels in one SIMD pass without labelling islands; their total is the
+/// solid pixel count times the pixel area.
+///
+/// Returns 1 on success, 0 on failure.
+VS_EXPORT int compute_layer_area_stats_mode(
+    const uint8_t* pixels,
+    int32_t width,
+    int32_t height,
+    double x_pixel_size_mm,
+    double y_pixel_size_mm,
+    int32_t area_mode,
+    int32_t thread_count,
+    AreaStatsResult* out_result);
+
 /// Decrypt (when encrypted) and decode NanoDLP CTB RLE data into greyscale pixels.
 ///
 /// Returns 1 on success, 0 on failure.
@@ -57,6 +99,87 @@ VS_EXPORT int decrypt_and_decode_layer(
     int32_t pixel_count,
     uint8_t* out_pixels);
 
+/// decrypt_and_decode_layer split over up to [thread_count] threads.
+///
+/// A serial pass indexes run boundaries (payload offset and pixel) every
+/// few thousand runs or million pixels, then slices are decrypted and
+/// filled in parallel; the key at any 4-byte position follows from the
+/// layer's first key. Output is identical to the serial call. Small or
+/// run-dense layers decode single-threaded.
+///
+/// Returns 1 on success, 0 on failure.
+VS_EXPORT int decrypt_and_decode_layer_mt(
+    const uint8_t* data,
+    int32_t data_len,
+    int32_t layer_index,
+    int32_t encryption_key,
+    int32_t pixel_count,
+    int32_t thread_count,
+    uint8_t* out_pixels);
+
+/// Layer summary computed from CTB runs by [analyze_layer_rle].
+typedef struct RleLayerStats {
+  int64_t lit_pixels;       // pixels with a non-zero value
+  int32_t min_x;            // bounding box of lit pixels; all 0 when blank
+  int32_t min_y;
+  int32_t max_x;
+  int32_t max_y;
+  int32_t run_count;        // runs parsed
+  int32_t decoded_pixels;   // pixels covered before the payload ended
+} RleLayerStats;
+
+/// Summarise a layer straight from its (optionally encrypted) RLE runs,
+/// without expanding it into a width*height buffer.
+///
+/// Fills the lit pixel count and bounding box; a layer is blank when
+/// lit_pixels is 0. The optional per-row arrays (height entries each, NULL
+/// to skip) receive the first and last lit column of each row and the
+/// index of the run holding the row's first pixel, or -1 when the row has
+/// no lit pixels / is not reached by the payload.
+///
+/// Returns 1 on success, 0 on failure.
+VS_EXPORT int analyze_layer_rle(
+    const uint8_t* data,
+    int32_t data_len,
+    int32_t layer_index,
+    int32_t encryption_key,
+    int32_t width,
+    int32_t height,
+    RleLayerStats* out_stats,
+    int32_t* out_row_first,
+    int32_t* out_row_last,
+    int32_t* out_row_run);
+
+/// 128-bit content hash of a layer's RLE payload, taken after decryption so
+/// identical layers match regardless of their index. out_hash receives two
+/// 64-bit words. Not cryptographic; used to spot repeated layers.
+///
+/// Returns 1 on success, 0 on failure.
+VS_EXPORT int hash_layer_rle(
+    const uint8_t* data,
+    int32_t data_len,
+    int32_t layer_index,
+    int32_t encryption_key,
+    uint64_t* out_hash);
+
+/// Returns 1 when two layer payloads of `data_len` bytes are identical after
+/// decryption (each with its own layer index and key, 0 for plain), else 0.
+/// Confirms a hash_layer_rle match before a result is reused.
+VS_EXPORT int layer_rle_equal(
+    const uint8_t* a,
+    int32_t a_layer_index,
+    int32_t a_encryption_key,
+    const uint8_t* b,
+    int32_t b_layer_index,
+    int32_t b_encryption_key,
+    int32_t data_len);
+
+/// The same 128-bit hash over a whole file, read in 1 MiB chunks. Used to
+/// key the job result cache.
+///
+/// Returns 1 on success, 0 if the file cannot be read.
+VS_EXPORT int hash_file(const char* path, uint64_t* out_hash);
+
 /// Build PNG scanlines from decoded greyscale pixels and apply PNG Up filter.
 ///
 /// channels = 3 for RGB output (8-bit panel), channels = 1 for greyscale
@@ -72,7 +195,24 @@ VS_EXPORT int build_png_scanlines(
   uint8_t* out_scanlines,
   int32_t out_len);
 
-/// Recompress PNG IDAT payload to a target zlib level.
+/// Build a single Up-filtered PNG scanline from one greyscale source row.
+///
+/// [out_row] receives the packed, unfiltered row and must be passed back as
+/// [prev_row] for the next row (NULL for the first). [out_scanline] receives
+/// the filter byte plus the filtered row (1 + out_width * channels bytes).
+///
+/// Returns 1 on success, 0 on failure.
+VS_EXPORT int build_png_scanline_row(
+  const uint8_t* grey_row,
+  int32_t src_width,
+  int32_t out_width,
+  int32_t channels,
+  const uint8_t* prev_row,
+  uint8_t* out_row,
+  uint8_t* out_scanline);
+
+/// Recompress PNG IDAT payload to a target zlib level with the stream
+/// settings of `encode_job` ([vs_encode_job_open], 0 for zlib's defaults).
 ///
 /// Allocates output bytes with malloc and stores pointer/length in out params.
 /// Caller must release via [free_native_buffer].
@@ -82,10 +222,12 @@ VS_EXPORT int recompress_png_idat(
     const uint8_t* png_data,
     int32_t png_len,
     int32_t level,
+    int64_t encode_job,
     uint8_t** out_data,
     int32_t* out_len);
 
-/// Recompress multiple PNG payloads in one native call.
+/// Recompress multiple PNG payloads in one native call, like
+/// [recompress_png_idat].
 ///
 /// Input is represented as one concatenated byte blob plus per-item
 /// offset/length arrays.
@@ -101,6 +243,7 @@ VS_EXPORT int recompress_png_batch(
   const int32_t* input_lengths,
   int32_t count,
   int32_t level,
+  int64_t encode_job,
   uint8_t** out_blob,
   int32_t* out_blob_len,
   int32_t** out_offsets,
@@ -111,6 +254,117 @@ VS_EXPORT int recompress_png_batch(
 /// threads <= 0 resets to auto mode (based on CPU count).
 VS_EXPORT void set_recompress_batch_threads(int32_t threads);
 
+/// Open the deflate settings of one job, for its layer batches and
+/// recompression (`encode_job`, VsConvertOptions.encode_job): window_bits
+/// 9..15, mem_level 1..9, strategy 0 (default), 1 (filtered), 2 (Huffman
+/// only), 3 (RLE), 4 (fixed) or 5 (auto). Out-of-range values select zlib's
+/// defaults (15, 8, 0); so does passing 0 instead of a handle. Jobs running
+/// side by side each keep their own settings.
+///
+/// Auto trial-compresses the first few layers at each requested level with
+/// the default, filtered and RLE strategies and with lower levels, then uses
+/// the fastest setting whose output is within 1/64 of the smallest for the
+/// rest of the job. The trials belong to the handle.
+///
+/// `encoder` selects what writes the layer PNG streams: 0 zlib, 1 the
+/// built-in encoder for Up-filtered mask scanlines. The built-in encoder
+/// tries only run and row-above matches, merges repeated rows into long
+/// matches and builds Huffman tables per block; it writes standard zlib
+/// streams faster than zlib level 1 and, on layer masks, typically smaller
+/// than level 6. It ignores level, memLevel and strategy; the window size
+/// still applies.
+///
+/// 2 selects zlib-ng's native API and 3 libdeflate, both loaded at runtime
+/// like zlib and replaced by zlib when missing. libdeflate compresses whole
+/// layers only (no row streaming) and ignores memLevel and strategy. 4
+/// (auto) times the loaded zlib, zlib-ng and libdeflate once per level on a
+/// synthetic mask and uses the fastest whose output is within 1/64 of the
+/// smallest; the timings belong to the handle. Out-of-range values select
+/// zlib, as does passing 0 instead of a handle.
+///
+/// `split` (nonzero) lets a layer be deflated in parallel row bands when a
+/// batch has fewer layers than threads (single-layer previews, small jobs,
+/// recompressing a few PNGs). Each band is primed with the 32 KB window
+/// before it and ends on a sync flush; the bands join into one zlib stream
+/// whose Adler-32 is combined from theirs. Output is a few bytes per band
+/// larger and depends on the thread count. 0 keeps every layer one stream;
+/// passing 0 instead of a handle splits.
+///
+/// Returns a handle, or 0 on allocation failure.
+VS_EXPORT int64_t vs_encode_job_open(
+    int32_t window_bits,
+    int32_t mem_level,
+    int32_t strategy,
+    int32_t encoder,
+    int32_t split);
+
+/// Free `job`. No batch using it may still be running.
+VS_EXPORT void vs_encode_job_close(int64_t job);
+
+/// Run `job`'s batches from the next one on with their native worker
+/// threads below normal priority (see
+/// set_current_thread_background_priority), e.g. for a background
+/// recompress pass. The calling thread and other jobs sharing the worker
+/// pool are not changed. 1 lowers, 0 restores.
+VS_EXPORT void vs_encode_job_set_background(int64_t job, int32_t background);
+
+/// The encoder code (0..3) that writes streams for batches of `job`
+/// requested at `level`, after fallback and the auto encoder's benchmark
+/// (run now if it has not run at `level` yet).
+VS_EXPORT int32_t get_deflate_encoder(int64_t job, int32_t level);
+
+/// The auto strategy's choice for batches of `job` requested at `level`:
+/// returns 1 and the chosen zlib strategy and level once trials are
+/// complete, else 0.
+VS_EXPORT int32_t get_deflate_auto_choice(
+    int64_t job,
+    int32_t level,
+    int32_t* out_strategy,
+    int32_t* out_level);
+
+/// Levels a compression plan chooses between.
+#define VS_COMPRESS_PLAN_LEVELS 3
+
+/// Projection and progress of a compression plan (vs_compress_plan_report).
+typedef struct VsCompressPlanReport {
+  int64_t budget_ms;         // 0: no time budget
+  int64_t target_bytes;      // 0: no size target
+  int64_t planned_bytes;     // PNG bytes projected by the first plan
+  int64_t planned_ms;        // job time projected by the first plan
+  int64_t actual_bytes;      // PNG bytes of the layers finished so far
+  int64_t actual_ms;         // time since the plan was opened
+  int32_t layers_done;
+  int32_t layers_reused;     // finished without an encode
+  int32_t replans;
+  int32_t probes;            // layers encoded to measure a level
+  int32_t unreachable;       // 1 when the last plan could not meet the goal
+  int32_t levels[VS_COMPRESS_PLAN_LEVELS];
+  int32_t level_layers[VS_COMPRESS_PLAN_LEVELS];   // encoded at each level
+  int32_t planned_layers[VS_COMPRESS_PLAN_LEVELS]; // projected by the first plan
+} VsCompressPlanReport;
+
+/// Open a per-layer compression plan for a job of `layer_count` layers.
+///
+/// With `budget_ms` > 0 the plan picks each layer's zlib level (1, 6 or 9)
+/// for the smallest output that still finishes within the budget, counted
+/// from now; with `target_bytes` > 0, for the fastest job whose PNGs total
+/// at most the target. With both, the target is met first if the budget
+/// allows. Levels come from measured per-level throughput and size of
+/// layers of similar density and are re-planned as layers finish. Pass the
+/// handle to the job's batches (`compress_plan`) or to
+/// [vs_convert_file] (VsConvertOptions.compress_plan). Returns a handle, or
+/// 0 when neither goal is set or on allocation failure.
+VS_EXPORT int64_t vs_compress_plan_open(
+    int32_t layer_count,
+    int64_t budget_ms,
+    int64_t target_bytes);
+
+/// Fill `out` with the plan's projection and progress. Returns 1 on success.
+VS_EXPORT int32_t vs_compress_plan_report(int64_t plan, VsCompressPlanReport* out);
+
+/// Free `plan`. No batch using it may still be running.
+VS_EXPORT void vs_compress_plan_close(int64_t plan);
+
 /// Release a heap buffer returned from native APIs.
 VS_EXPORT void free_native_buffer(uint8_t* buffer);
 
@@ -167,7 +421,14 @@ VS_EXPORT int set_current_thread_background_priority(int32_t background);
   /// worker threads.
   ///
   /// Each layer is decoded, area stats are computed, scanlines are built,
-  /// and final PNG bytes are produced.
+  /// and final PNG bytes are produced. area_mode (VS_AREA_MODE_*) selects
+  /// which area stats are filled in; see [compute_layer_area_stats_mode].
+  /// A non-zero compress_plan ([vs_compress_plan_open]) picks each layer's
+  /// zlib level in place of png_level; layer indices are the job's
+  /// (layer_index_base + i). The built-in encoder is never planned.
+  /// encode_job ([vs_encode_job_open]) holds the job's stream settings; 0
+  /// selects zlib's defaults. layer_cache ([vs_layer_cache_open]) is the
+  /// job's layer cache, or 0 for none.
   ///
   /// Output buffers must be freed by:
   ///   - [free_native_buffer] for out_blob
@@ -190,6 +451,10 @@ VS_EXPORT int set_current_thread_background_priority(int32_t background);
     double x_pixel_size_mm,
     double y_pixel_size_mm,
     int32_t png_level,
+    int64_t compress_plan,
+    int64_t encode_job,
+    int64_t layer_cache,
+    int32_t area_mode,
     int32_t thread_count,
     uint8_t** out_blob,
     int32_t* out_blob_len,
@@ -197,11 +462,48 @@ VS_EXPORT int set_current_thread_background_priority(int32_t background);
     int32_t** out_lengths,
     AreaStatsResult** out_areas);
 
+  /// Streaming variant of [process_layers_batch] that writes PNGs directly
+  /// into an archive opened with [vs_zip_open].
+  ///
+  /// Layers are added as "<layer_index_base + i + 1>.png" in index order.
+  /// Workers run at most max_in_flight layers ahead of the writer
+  /// (<= 0 selects 2x the thread count), so memory stays bounded by the
+  /// window instead of the batch size. out_areas must hold count entries.
+  ///
+  /// Returns 1 on success, 0 on failure (the archive should then be aborted).
+  VS_EXPORT int process_layers_batch_to_zip(
+    int64_t zip_handle,
+    const uint8_t* input_blob,
+    int32_t input_blob_len,
+    const int32_t* input_offsets,
+    const int32_t* input_lengths,
+    int32_t count,
+    int32_t layer_index_base,
+    int32_t encryption_key,
+    int32_t src_width,
+    int32_t height,
+    int32_t out_width,
+    int32_t channels,
+    double x_pixel_size_mm,
+    double y_pixel_size_mm,
+    int32_t png_level,
+    int64_t compress_plan,
+    int64_t encode_job,
+    int64_t layer_cache,
+    int32_t area_mode,
+    int32_t thread_count,
+    int32_t max_in_flight,
+    AreaStatsResult* out_areas);
+
   /// Configure default thread count for process_layers_batch.
   ///
   /// threads <= 0 resets to auto mode.
   VS_EXPORT void set_process_layers_batch_threads(int32_t threads);
 
+  /// Free the per-thread scratch buffers the shared native worker pool keeps
+  /// alive between batches. Pool threads stay parked; call after a job.
+  VS_EXPORT void vs_worker_pool_release_scratch(void);
+
   /// Enable or disable analytics collection for process_layers_batch.
   ///
   /// When enabled, per-thread timing stats are recorded for the last batch.
@@ -222,6 +524,17 @@ VS_EXPORT int set_current_thread_background_priority(int32_t background);
     int32_t* out_layers,
     int32_t max_count);
 
+  /// Number of per-layer cost samples from the last analytics-enabled batch.
+  VS_EXPORT int32_t process_layers_last_cost_count(void);
+
+  /// Copy per-layer cost samples from the last analytics-enabled batch, in
+  /// layer order: the scheduler's predicted cost (encoded input bytes) and the
+  /// measured processing time in nanoseconds.
+  VS_EXPORT void process_layers_last_cost_samples(
+    int64_t* out_predicted,
+    int64_t* out_actual_ns,
+    int32_t max_count);
+
   /// Returns backend used by the most recent process_layers_batch call.
   ///
   /// 0 = CPU, 1 = OpenCL GPU, 2 = Metal GPU, 3 = CUDA/Tensor GPU.
@@ -244,6 +557,39 @@ VS_EXPORT int set_current_thread_background_priority(int32_t background);
   /// 0 means no CUDA error captured (or unavailable).
   VS_EXPORT int32_t process_layers_last_cuda_error(void);
 
+  /// Layers in the last process_layers_batch call whose input matched an
+  /// earlier layer (in the batch or at the end of the previous one) and
+  /// whose PNG and area were reused instead of being processed again.
+  VS_EXPORT int32_t process_layers_last_dedup_hits(void);
+
+  /// Drop the layers kept for dedup across batches and idle encoder caches.
+  /// Call after a job, next to [vs_worker_pool_release_scratch].
+  VS_EXPORT void process_layers_release_caches(void);
+
+  /// Open the layer cache in [dir] (which must exist) for one job: batches
+  /// given the handle (`layer_cache`) read finished layers back from it and
+  /// store the ones they encode, so later conversions of the same layers
+  /// under the same output settings reuse them. The handle keeps the
+  /// directory under [max_bytes], evicting the least recently used layers.
+  /// Jobs open their own handle; none changes another's directory or limit.
+  ///
+  /// Returns a handle, or 0 when [dir] is NULL, empty or unreadable or
+  /// [max_bytes] is not positive.
+  VS_EXPORT int64_t vs_layer_cache_open(const char* dir, int64_t max_bytes);
+
+  /// Free [cache]. No batch using it may still be running.
+  VS_EXPORT void vs_layer_cache_close(int64_t cache);
+
+  /// Copy [src] to [dst] through a temporary file and a rename; an existing
+  /// [dst] is replaced only once the copy is complete.
+  ///
+  /// Returns 1 on success, 0 on failure.
+  VS_EXPORT int copy_file(const char* src, const char* dst);
+
+  /// Layers in the last process_layers_batch call read back from the
+  /// layer cache (see [vs_layer_cache_open]).
+  VS_EXPORT int32_t process_layers_last_cache_hits(void);
+
   /// Returns 1 if the most recent phased batch used GPU mega-batch successfully.
   VS_EXPORT int32_t process_layers_last_gpu_batch_ok(void);
 
@@ -272,6 +618,8 @@ VS_EXPORT int set_current_thread_background_priority(int32_t background);
     double x_pixel_size_mm,
     double y_pixel_size_mm,
     int32_t png_level,
+    int64_t encode_job,
+    int32_t area_mode,
     int32_t thread_count,
     int32_t use_gpu_batch,
     uint8_t** out_blob,
@@ -283,6 +631,15 @@ VS_EXPORT int set_current_thread_background_priority(int32_t background);
   /// Release a heap AreaStatsResult buffer returned from native APIs.
   VS_EXPORT void free_native_area_buffer(AreaStatsResult* buffer);
 
+  /// Cap the SIMD level used by CPU kernels.
+  ///
+  /// -1 = auto (best detected), 0 = scalar reference, 1 = SSE2/NEON,
+  /// 2 = AVX2. Outputs are bit-identical at every level.
+  VS_EXPORT void set_native_simd_level(int32_t level);
+
+  /// SIMD level in use: 0 = scalar, 1 = SSE2/NEON, 2 = AVX2.
+  VS_EXPORT int32_t native_simd_level(void);
+
   /// Set whether optional GPU acceleration is enabled (1) or disabled (0).
   VS_EXPORT void set_gpu_acceleration_enabled(int32_t enabled);
 
@@ -348,6 +705,136 @@ VS_EXPORT int set_current_thread_background_priority(int32_t background);
   /// Abort ZIP writer and close underlying file without finalization.
   VS_EXPORT void vs_zip_abort(int64_t handle);
 
+  /// Backends for [vs_layer_source_open].
+  enum {
+    VS_LAYER_SOURCE_AUTO = 0,   // mmap when possible, else pread
+    VS_LAYER_SOURCE_MMAP = 1,
+    VS_LAYER_SOURCE_PREAD = 2,
+  };
+
+  /// Open a CTB file for native layer reads.
+  ///
+  /// layer_offsets/layer_lengths give each layer's raw RLE payload location
+  /// in the file (copied; the caller may free them). Returns an opaque
+  /// handle, or 0 on failure.
+  VS_EXPORT int64_t vs_layer_source_open(
+    const char* path,
+    const uint32_t* layer_offsets,
+    const uint32_t* layer_lengths,
+    int32_t layer_count,
+    int32_t backend);
+
+  /// Backend in use for an open source (VS_LAYER_SOURCE_MMAP or _PREAD).
+  VS_EXPORT int32_t vs_layer_source_backend(int64_t source);
+
+  /// Get layers [start, end) as a blob + per-layer offsets/lengths that can
+  /// be passed straight to the process_layers_batch* input arguments.
+  ///
+  /// mmap sources return pointers into the mapping (zero-copy); pread
+  /// sources return a buffer filled by read-ahead during the previous
+  /// chunk. Pointers stay valid until the next fetch or close; the next
+  /// chunk of the same size is prefetched before returning.
+  ///
+  /// Returns 1 on success, 0 on failure.
+  VS_EXPORT int vs_layer_source_fetch(
+    int64_t source,
+    int32_t start,
+    int32_t end,
+    const uint8_t** out_blob,
+    int32_t* out_blob_len,
+    const int32_t** out_offsets,
+    const int32_t** out_lengths);
+
+  /// Close a layer source and release its mapping/buffers.
+  VS_EXPORT void vs_layer_source_close(int64_t source);
+
+  /// Failure reasons reported in [VsConvertResult.error].
+  enum {
+    VS_CONVERT_OK = 0,
+    VS_CONVERT_ERROR_ARGS = 1,
+    VS_CONVERT_ERROR_INPUT = 2,
+    VS_CONVERT_ERROR_HEADER = 3,
+    VS_CONVERT_ERROR_LAYER_TABLE = 4,
+    VS_CONVERT_ERROR_MEMORY = 5,
+    VS_CONVERT_ERROR_OUTPUT = 6,
+    VS_CONVERT_ERROR_PROCESS = 7,
+  };
+
+  /// Options for [vs_convert_file].
+  typedef struct VsConvertOptions {
+    int32_t out_width;
+    int32_t channels;
+    double x_pixel_size_mm;
+    double y_pixel_size_mm;
+    int32_t png_level;
+    int64_t compress_plan;   // vs_compress_plan_open handle, or 0
+    int64_t encode_job;      // vs_encode_job_open handle, or 0
+    int64_t layer_cache;     // vs_layer_cache_open handle, or 0
+    int32_t thread_count;    // <= 0 selects the batch default
+    int32_t max_in_flight;   // <= 0 selects 2x the thread count
+    int32_t chunk_layers;    // <= 0 selects the built-in default
+    int32_t input_backend;   // VS_LAYER_SOURCE_*
+    int32_t area_mode;       // VS_AREA_MODE_*
+
+    // CTBv4E keeps its settings AES-encrypted; set header_override and fill
+    // the fields below from the Dart parser instead of the file header.
+    int32_t header_override;
+    int64_t layer_table_offset;
+    int32_t layer_count;
+    int32_t resolution_x;
+    int32_t resolution_y;
+    int32_t encryption_key;
+
+    // Entries written before the layer PNGs (profile.json, options.json, ...).
+    int32_t head_entry_count;
+    const char* const* head_entry_names;
+    const uint8_t* const* head_entry_data;
+    const int32_t* head_entry_lengths;
+  } VsConvertOptions;
+
+  /// Output of [vs_convert_file].
+  typedef struct VsConvertResult {
+    int64_t zip_handle;        // still open on success; see vs_convert_file
+    AreaStatsResult* areas;    // layer_count entries; free_native_area_buffer
+    int32_t layer_count;
+    int32_t layers_done;
+    int32_t resolution_x;
+    int32_t resolution_y;
+    int32_t error;             // VS_CONVERT_ERROR_* when the call fails
+    int32_t backend;           // highest backend used (see process_layers_last_backend)
+    int32_t gpu_attempts;
+    int32_t gpu_successes;
+    int32_t gpu_fallbacks;
+    int32_t input_backend;     // VS_LAYER_SOURCE_MMAP or _PREAD
+    int64_t read_ns;
+    int64_t process_ns;
+    int32_t dedup_hits;        // layers reused from an identical layer
+    int32_t cache_hits;        // layers read back from the layer cache
+  } VsConvertResult;
+
+  /// Progress callback for [vs_convert_file]; runs on the calling thread.
+  typedef void (*vs_convert_progress_fn)(int32_t done, int32_t total);
+
+  /// Convert a CTB file to a NanoDLP archive in a single call.
+  ///
+  /// Parses the CTB header and layer table, writes the head entries from
+  /// options, then streams every layer (read → decode → PNG) into
+  /// "<n>.png" entries at out_path with bounded memory. progress_cb may be
+  /// NULL.
+  ///
+  /// On success the archive is left open in out_result->zip_handle so the
+  /// caller can append entries derived from out_result->areas (plate.json,
+  /// info.json) before [vs_zip_close]. On failure the partial file is
+  /// removed and out_result->error says why.
+  ///
+  /// Returns 1 on success, 0 on failure.
+  VS_EXPORT int vs_convert_file(
+    const char* ctb_path,
+    const char* out_path,
+    const VsConvertOptions* options,
+    vs_convert_progress_fn progress_cb,
+    VsConvertResult* out_result);
+
 #ifdef __cplusplus
 }
 #endif
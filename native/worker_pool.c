@@ -0,0 +1,684 @@
+/**
+ * @file worker_pool.c
+ * @brief Process-wide native worker pool shared by all batch entry points.
+ *
+ * The pool is created lazily on first use, sized from the CPU count, and
+ * only grows if a caller asks for more workers. A run executes one task
+ * function on N workers (the calling thread is worker 0) and returns when
+ * all of them have finished. Each worker owns a few scratch slots that
+ * survive between runs, so per-thread buffers are not reallocated for every
+ * batch. A run submitted from inside a task (area labelling, decode or
+ * deflate of one layer split over bands) is offered to pool workers that
+ * are idle at that moment, either because the outer run did not need them
+ * or because they ran out of work; the submitting worker always takes part.
+ * If the pool is busy with another caller's run (e.g. two conversions in
+ * parallel), the run falls back to short-lived threads with temporary
+ * scratch.
+ *
+ * Priority travels with the work, not the pool: a run takes the submitting
+ * thread's background hint (vs_pool_set_background), every worker applies
+ * it for the duration of that run, and nested runs submitted from inside a
+ * task inherit it. A background job therefore never slows a foreground job
+ * that uses the pool before or after it.
+ *
+ * Also provides the lock-free work-stealing index scheduler (VsWorkQueue)
+ * that batch tasks use to claim layers.
+ */
+#include "voxelshift_native.h"
+#include "worker_pool.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+typedef CRITICAL_SECTION vs_mutex;
+static void vs_mutex_init(vs_mutex* m) { InitializeCriticalSection(m); }
+static void vs_mutex_lock(vs_mutex* m) { EnterCriticalSection(m); }
+static void vs_mutex_unlock(vs_mutex* m) { LeaveCriticalSection(m); }
+typedef CONDITION_VARIABLE vs_cond;
+static void vs_cond_init(vs_cond* c) { InitializeConditionVariable(c); }
+static void vs_cond_wait(vs_cond* c, vs_mutex* m) { SleepConditionVariableCS(c, m, INFINITE); }
+static void vs_cond_broadcast(vs_cond* c) { WakeAllConditionVariable(c); }
+static int32_t _cpu_threads(void) {
+  DWORD n = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+  return n == 0 ? 1 : (int32_t)n;
+}
+#else
+#include <pthread.h>
+#include <unistd.h>
+typedef pthread_mutex_t vs_mutex;
+static void vs_mutex_init(vs_mutex* m) { pthread_mutex_init(m, NULL); }
+static void vs_mutex_lock(vs_mutex* m) { pthread_mutex_lock(m); }
+static void vs_mutex_unlock(vs_mutex* m) { pthread_mutex_unlock(m); }
+typedef pthread_cond_t vs_cond;
+static void vs_cond_init(vs_cond* c) { pthread_cond_init(c, NULL); }
+static void vs_cond_wait(vs_cond* c, vs_mutex* m) { pthread_cond_wait(c, m); }
+static void vs_cond_broadcast(vs_cond* c) { pthread_cond_broadcast(c); }
+static int32_t _cpu_threads(void) {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n < 1 ? 1 : (int32_t)n;
+}
+#endif
+
+#define VS_POOL_MAX_WORKERS 256
+#define VS_POOL_SCRATCH_SLOTS 4
+
+// A run submitted from inside a task; lives on the submitter's stack.
+typedef struct NestedRun {
+  vs_pool_task_fn fn;
+  void* ctx;
+  vs_pool_free_fn scratch_free;
+  int use_scratch;
+  int32_t threads;            // worker indices on offer; lowered on close
+  int32_t claimed;            // indices handed out, the submitter's 0 included
+  int32_t running;            // helpers still inside fn
+  int32_t background;
+  struct NestedRun* next;
+} NestedRun;
+
+typedef struct WorkerPool {
+  vs_mutex lock;
+  vs_cond work_cond;
+  vs_cond done_cond;
+  int32_t spawned;            // pool threads (workers 1..spawned)
+  int32_t busy;
+  uint64_t generation;
+
+  vs_pool_task_fn fn;
+  void* ctx;
+  int32_t slot;
+  int32_t background;         // priority hint of the current run
+  int32_t active;             // workers taking part in the current run
+  int32_t remaining;          // pool workers still running the current run
+  uint64_t seen[VS_POOL_MAX_WORKERS];  // last generation each worker handled
+  NestedRun* nested;          // open nested runs, newest first
+
+  void* scratch[VS_POOL_MAX_WORKERS][VS_POOL_SCRATCH_SLOTS];
+  vs_pool_free_fn scratch_free[VS_POOL_SCRATCH_SLOTS];
+} WorkerPool;
+
+static WorkerPool g_pool;
+
+#ifdef _MSC_VER
+#define VS_THREAD_LOCAL __declspec(thread)
+#else
+#define VS_THREAD_LOCAL __thread
+#endif
+
+// Background hint of the work running on this thread; runs submitted from
+// here take it over.
+static VS_THREAD_LOCAL int32_t t_background;
+// Nonzero while this thread runs a task of a pool run.
+static VS_THREAD_LOCAL int32_t t_in_run;
+
+#ifdef _WIN32
+static INIT_ONCE g_pool_once = INIT_ONCE_STATIC_INIT;
+static BOOL CALLBACK _pool_init_once(PINIT_ONCE once, PVOID param, PVOID* ctx) {
+  (void)once; (void)param; (void)ctx;
+  vs_mutex_init(&g_pool.lock);
+  vs_cond_init(&g_pool.work_cond);
+  vs_cond_init(&g_pool.done_cond);
+  return TRUE;
+}
+static void _pool_init(void) {
+  InitOnceExecuteOnce(&g_pool_once, _pool_init_once, NULL, NULL);
+}
+#else
+static pthread_once_t g_pool_once = PTHREAD_ONCE_INIT;
+static void _pool_init_once(void) {
+  vs_mutex_init(&g_pool.lock);
+  vs_cond_init(&g_pool.work_cond);
+  vs_cond_init(&g_pool.done_cond);
+}
+static void _pool_init(void) {
+  pthread_once(&g_pool_once, _pool_init_once);
+}
+#endif
+
+/// Switch the calling worker thread to [background] if [applied] (the
+/// priority it currently runs at) differs, and let its nested runs inherit it.
+static void _apply_background_hint(int32_t background, int32_t* applied) {
+  t_background = background;
+  if (background == *applied) return;
+  set_current_thread_background_priority(background);
+  *applied = background;
+}
+
+/// Hand out the next worker index of an open nested run (lock held).
+static NestedRun* _claim_nested(int32_t* out_index) {
+  for (NestedRun* r = g_pool.nested; r; r = r->next) {
+    if (r->claimed >= r->threads) continue;
+    *out_index = r->claimed++;
+    r->running++;
+    return r;
+  }
+  return NULL;
+}
+
+/// Run one claimed index of a nested run (lock held, released meanwhile).
+static void _help_nested(NestedRun* r, int32_t index, int32_t* background) {
+  vs_mutex_unlock(&g_pool.lock);
+  _apply_background_hint(r->background, background);
+  void* scratch = NULL;
+  r->fn(r->ctx, index, r->use_scratch ? &scratch : NULL);
+  if (scratch && r->scratch_free) r->scratch_free(scratch);
+  vs_mutex_lock(&g_pool.lock);
+  if (--r->running == 0) vs_cond_broadcast(&g_pool.done_cond);
+}
+
+static void _pool_worker_loop(int32_t index) {
+  int32_t background = 0;
+  t_in_run = 1;
+  vs_mutex_lock(&g_pool.lock);
+  for (;;) {
+    NestedRun* help = NULL;
+    int32_t help_index = 0;
+    while (g_pool.generation == g_pool.seen[index] &&
+           !(help = _claim_nested(&help_index))) {
+      vs_cond_wait(&g_pool.work_cond, &g_pool.lock);
+    }
+    if (help) {
+      _help_nested(help, help_index, &background);
+      continue;
+    }
+    g_pool.seen[index] = g_pool.generation;
+    if (index >= g_pool.active) continue;
+
+    vs_pool_task_fn fn = g_pool.fn;
+    void* ctx = g_pool.ctx;
+    void** scratch = g_pool.slot >= 0 ? &g_pool.scratch[index][g_pool.slot] : NULL;
+    const int32_t run_background = g_pool.background;
+    vs_mutex_unlock(&g_pool.lock);
+
+    _apply_background_hint(run_background, &background);
+    fn(ctx, index, scratch);
+
+    vs_mutex_lock(&g_pool.lock);
+    if (--g_pool.remaining == 0) vs_cond_broadcast(&g_pool.done_cond);
+  }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI _pool_thread_proc(LPVOID arg) {
+  _pool_worker_loop((int32_t)(intptr_t)arg);
+  return 0;
+}
+#else
+static void* _pool_thread_proc(void* arg) {
+  _pool_worker_loop((int32_t)(intptr_t)arg);
+  return NULL;
+}
+#endif
+
+/**
+ * @brief Spawn pool threads until workers 1..want-1 exist (lock held).
+ *
+ * A new worker starts at the current generation, so it joins the next run
+ * published by the caller even if it only gets scheduled after the publish.
+ * Returns the number of workers (including the caller) that can take part.
+ */
+static int32_t _pool_grow(int32_t want) {
+  while (g_pool.spawned + 1 < want) {
+    const int32_t index = g_pool.spawned + 1;
+    g_pool.seen[index] = g_pool.generation;
+#ifdef _WIN32
+    HANDLE h = CreateThread(NULL, 0, _pool_thread_proc, (LPVOID)(intptr_t)index, 0, NULL);
+    if (!h) break;
+    CloseHandle(h);
+#else
+    pthread_t t;
+    if (pthread_create(&t, NULL, _pool_thread_proc, (void*)(intptr_t)index) != 0) break;
+    pthread_detach(t);
+#endif
+    g_pool.spawned = index;
+  }
+  return g_pool.spawned + 1 < want ? g_pool.spawned + 1 : want;
+}
+
+// ── Fallback: short-lived threads when the pool is busy ─────────────────────
+
+typedef struct TransientWorker {
+  vs_pool_task_fn fn;
+  void* ctx;
+  int32_t index;
+  int32_t background;
+  int use_scratch;
+  void* scratch;
+} TransientWorker;
+
+#ifdef _WIN32
+static DWORD WINAPI _transient_proc(LPVOID arg) {
+  TransientWorker* t = (TransientWorker*)arg;
+  int32_t background = 0;
+  _apply_background_hint(t->background, &background);
+  t->fn(t->ctx, t->index, t->use_scratch ? &t->scratch : NULL);
+  return 0;
+}
+#else
+static void* _transient_proc(void* arg) {
+  TransientWorker* t = (TransientWorker*)arg;
+  int32_t background = 0;
+  _apply_background_hint(t->background, &background);
+  t->fn(t->ctx, t->index, t->use_scratch ? &t->scratch : NULL);
+  return NULL;
+}
+#endif
+
+static int _run_transient(
+    int32_t threads,
+    int use_scratch,
+    vs_pool_free_fn scratch_free,
+    vs_pool_task_fn fn,
+    void* ctx) {
+  TransientWorker* ws = (TransientWorker*)calloc((size_t)threads, sizeof(TransientWorker));
+#ifdef _WIN32
+  HANDLE* hs = (HANDLE*)calloc((size_t)threads, sizeof(HANDLE));
+#else
+  pthread_t* hs = (pthread_t*)calloc((size_t)threads, sizeof(pthread_t));
+  uint8_t* started = (uint8_t*)calloc((size_t)threads, 1);
+  if (!started) {
+    free(ws);
+    free(hs);
+    return 0;
+  }
+#endif
+  if (!ws || !hs) {
+    free(ws);
+    free(hs);
+#ifndef _WIN32
+    free(started);
+#endif
+    return 0;
+  }
+
+  for (int32_t t = 0; t < threads; t++) {
+    ws[t].fn = fn;
+    ws[t].ctx = ctx;
+    ws[t].index = t;
+    ws[t].background = t_background;
+    ws[t].use_scratch = use_scratch;
+  }
+  for (int32_t t = 1; t < threads; t++) {
+#ifdef _WIN32
+    hs[t] = CreateThread(NULL, 0, _transient_proc, &ws[t], 0, NULL);
+#else
+    started[t] = pthread_create(&hs[t], NULL, _transient_proc, &ws[t]) == 0;
+#endif
+  }
+
+  fn(ctx, 0, use_scratch ? &ws[0].scratch : NULL);
+
+  for (int32_t t = 1; t < threads; t++) {
+#ifdef _WIN32
+    if (hs[t]) {
+      WaitForSingleObject(hs[t], INFINITE);
+      CloseHandle(hs[t]);
+    }
+#else
+    if (started[t]) pthread_join(hs[t], NULL);
+#endif
+  }
+  for (int32_t t = 0; t < threads; t++) {
+    if (ws[t].scratch && scratch_free) scratch_free(ws[t].scratch);
+  }
+
+  free(ws);
+  free(hs);
+#ifndef _WIN32
+  free(started);
+#endif
+  return 1;
+}
+
+// ── Nested runs: idle pool workers help ─────────────────────────────────────
+
+/**
+ * @brief Run a nested call on the submitter plus whichever pool workers are
+ * idle (lock held on entry, released on return).
+ *
+ * Workers claim indices 1..threads-1 until the submitter finishes worker 0;
+ * indices nobody claimed by then are withdrawn, which is safe because tasks
+ * pull their work from a queue. Returns the number of workers that ran.
+ */
+static int32_t _run_nested(
+    int32_t threads,
+    int use_scratch,
+    vs_pool_free_fn scratch_free,
+    vs_pool_task_fn fn,
+    void* ctx) {
+  NestedRun r;
+  memset(&r, 0, sizeof(r));
+  r.fn = fn;
+  r.ctx = ctx;
+  r.scratch_free = scratch_free;
+  r.use_scratch = use_scratch;
+  r.threads = threads;
+  r.claimed = 1;
+  r.background = t_background;
+  r.next = g_pool.nested;
+  g_pool.nested = &r;
+  vs_cond_broadcast(&g_pool.work_cond);
+  vs_mutex_unlock(&g_pool.lock);
+
+  void* scratch = NULL;
+  fn(ctx, 0, use_scratch ? &scratch : NULL);
+  if (scratch && scratch_free) scratch_free(scratch);
+
+  vs_mutex_lock(&g_pool.lock);
+  r.threads = r.claimed;
+  NestedRun** link = &g_pool.nested;
+  while (*link != &r) link = &(*link)->next;
+  *link = r.next;
+  while (r.running > 0) vs_cond_wait(&g_pool.done_cond, &g_pool.lock);
+  vs_mutex_unlock(&g_pool.lock);
+  return r.claimed;
+}
+
+// ── Public (library-internal) API ───────────────────────────────────────────
+
+/**
+ * @brief Run fn(ctx, i, scratch) for worker i in [0, threads) and wait.
+ *
+ * The caller runs worker 0. Tasks must pull work dynamically: when the pool
+ * cannot provide `threads` workers fewer are used, so a task must not rely
+ * on every worker index being run. `slot` selects the persistent scratch
+ * slot (VS_POOL_SLOT_*), or VS_POOL_NO_SCRATCH to pass a NULL slot; `scratch_free`
+ * releases a slot value on vs_worker_pool_release_scratch or after a
+ * fallback run. Calls from inside a task run on the caller and the pool
+ * workers idle at the time (possibly none); other calls made while the
+ * pool is busy run on short-lived threads instead. Workers run at the
+ * caller's background hint (vs_pool_set_background).
+ *
+ * Returns the number of workers that ran, or 0 on failure.
+ */
+int32_t vs_pool_run(
+    int32_t threads,
+    int32_t slot,
+    vs_pool_free_fn scratch_free,
+    vs_pool_task_fn fn,
+    void* ctx) {
+  if (!fn) return 0;
+  if (threads < 1) threads = 1;
+  if (threads > VS_POOL_MAX_WORKERS) threads = VS_POOL_MAX_WORKERS;
+  if (slot >= VS_POOL_SCRATCH_SLOTS) slot = -1;
+
+  _pool_init();
+  vs_mutex_lock(&g_pool.lock);
+  if (g_pool.busy) {
+    if (t_in_run && threads > 1) {
+      return _run_nested(threads, slot >= 0, scratch_free, fn, ctx);
+    }
+    vs_mutex_unlock(&g_pool.lock);
+    if (threads == 1) {
+      void* scratch = NULL;
+      fn(ctx, 0, slot >= 0 ? &scratch : NULL);
+      if (scratch && scratch_free) scratch_free(scratch);
+      return 1;
+    }
+    return _run_transient(threads, slot >= 0, scratch_free, fn, ctx) ? threads : 0;
+  }
+
+  g_pool.busy = 1;
+  if (g_pool.spawned == 0) {
+    const int32_t cpu = _cpu_threads();
+    _pool_grow(cpu > VS_POOL_MAX_WORKERS ? VS_POOL_MAX_WORKERS : cpu);
+  }
+  threads = _pool_grow(threads);
+  if (slot >= 0) g_pool.scratch_free[slot] = scratch_free;
+
+  if (threads > 1) {
+    g_pool.fn = fn;
+    g_pool.ctx = ctx;
+    g_pool.slot = slot;
+    g_pool.background = t_background;
+    g_pool.active = threads;
+    g_pool.remaining = threads - 1;
+    g_pool.generation++;
+    vs_cond_broadcast(&g_pool.work_cond);
+  }
+  void** scratch0 = slot >= 0 ? &g_pool.scratch[0][slot] : NULL;
+  vs_mutex_unlock(&g_pool.lock);
+
+  const int32_t was_in_run = t_in_run;
+  t_in_run = 1;
+  fn(ctx, 0, scratch0);
+  t_in_run = was_in_run;
+
+  vs_mutex_lock(&g_pool.lock);
+  if (threads > 1) {
+    while (g_pool.remaining > 0) vs_cond_wait(&g_pool.done_cond, &g_pool.lock);
+    g_pool.fn = NULL;
+    g_pool.ctx = NULL;
+    g_pool.active = 0;
+  }
+  g_pool.busy = 0;
+  vs_cond_broadcast(&g_pool.done_cond);
+  vs_mutex_unlock(&g_pool.lock);
+  return threads;
+}
+
+/**
+ * @brief Set the calling thread's background hint for the runs it submits.
+ *
+ * Helper workers of those runs drop below normal priority (see
+ * set_current_thread_background_priority); the calling thread itself is
+ * left alone. Returns the previous hint so entry points can restore it.
+ */
+int32_t vs_pool_set_background(int32_t background) {
+  const int32_t previous = t_background;
+  t_background = background != 0;
+  return previous;
+}
+
+/**
+ * @brief Free every worker's persistent scratch buffers.
+ *
+ * Waits for an in-flight pool run to finish first. Pool threads stay alive.
+ */
+void vs_worker_pool_release_scratch(void) {
+  _pool_init();
+  vs_mutex_lock(&g_pool.lock);
+  while (g_pool.busy) vs_cond_wait(&g_pool.done_cond, &g_pool.lock);
+  for (int32_t s = 0; s < VS_POOL_SCRATCH_SLOTS; s++) {
+    for (int32_t w = 0; w < VS_POOL_MAX_WORKERS; w++) {
+      void* p = g_pool.scratch[w][s];
+      if (!p) continue;
+      if (g_pool.scratch_free[s]) g_pool.scratch_free[s](p);
+      g_pool.scratch[w][s] = NULL;
+    }
+  }
+  vs_mutex_unlock(&g_pool.lock);
+}
+
+
+// ── Work-stealing index scheduler ───────────────────────────────────────────
+
+#define VS_QUEUE_STRIDE 8  // int64 slots per worker range (one cache line)
+
+static int64_t _range_pack(int32_t begin, int32_t end) {
+  return (int64_t)(((uint64_t)(uint32_t)end << 32) | (uint64_t)(uint32_t)begin);
+}
+
+static int32_t _range_begin(int64_t v) { return (int32_t)(uint32_t)((uint64_t)v); }
+static int32_t _range_end(int64_t v) { return (int32_t)(uint32_t)((uint64_t)v >> 32); }
+
+/**
+ * @brief Piece size taken off the front of a range with `remaining` items.
+ *
+ * A quarter of what is left, capped at the grain: large early claims keep
+ * the atomics cheap, single-item claims near the end keep the tail short.
+ */
+static int32_t _queue_piece(const VsWorkQueue* q, int32_t remaining) {
+  int32_t k = remaining / 4;
+  if (k > q->grain) k = q->grain;
+  return k < 1 ? 1 : k;
+}
+
+int vs_queue_init(
+    VsWorkQueue* q,
+    int32_t count,
+    int32_t workers,
+    int32_t grain,
+    int32_t flags) {
+  memset(q, 0, sizeof(*q));
+  if (count < 0) count = 0;
+  if (workers < 1) workers = 1;
+  q->workers = workers;
+  q->count = count;
+  q->grain = grain < 1 ? 1 : grain;
+  q->flags = flags;
+  if (flags & VS_QUEUE_ORDERED) return 1;
+
+  const size_t line = VS_QUEUE_STRIDE * sizeof(int64_t);
+  q->ranges_alloc = malloc((size_t)workers * line + line);
+  if (!q->ranges_alloc) return 0;
+  q->ranges = (volatile int64_t*)(((uintptr_t)q->ranges_alloc + line - 1) &
+                                  ~(uintptr_t)(line - 1));
+  for (int32_t w = 0; w < workers; w++) {
+    const int32_t begin = (int32_t)(((int64_t)count * w) / workers);
+    const int32_t end = (int32_t)(((int64_t)count * (w + 1)) / workers);
+    q->ranges[(size_t)w * VS_QUEUE_STRIDE] = _range_pack(begin, end);
+  }
+  return 1;
+}
+
+void vs_queue_destroy(VsWorkQueue* q) {
+  free(q->ranges_alloc);
+  free(q->order);
+  q->ranges_alloc = NULL;
+  q->ranges = NULL;
+  q->order = NULL;
+}
+
+typedef struct CostItem {
+  int32_t cost;
+  int32_t index;
+} CostItem;
+
+static int _cost_item_desc(const void* a, const void* b) {
+  const CostItem* x = (const CostItem*)a;
+  const CostItem* y = (const CostItem*)b;
+  if (x->cost != y->cost) return x->cost > y->cost ? -1 : 1;
+  return x->index < y->index ? -1 : (x->index > y->index);
+}
+
+/**
+ * @brief Install a longest-processing-time-first dispatch order.
+ *
+ * Items are sorted by descending cost and dealt round-robin into the
+ * workers' initial shares, so every share starts with its most expensive
+ * item and the shares carry similar total cost. Thieves take the back half
+ * of a share, i.e. its cheapest items, which keeps the batch tail short.
+ * Only applies to the default (unordered) mode.
+ */
+int vs_queue_order_by_cost(VsWorkQueue* q, const int32_t* costs) {
+  if (!costs || (q->flags & VS_QUEUE_ORDERED) || q->workers < 2 ||
+      q->count <= q->workers) {
+    return 0;
+  }
+
+  const int32_t count = q->count;
+  const int32_t workers = q->workers;
+  CostItem* items = (CostItem*)malloc((size_t)count * sizeof(CostItem));
+  int32_t* fill = (int32_t*)malloc((size_t)workers * sizeof(int32_t));
+  int32_t* order = (int32_t*)malloc((size_t)count * sizeof(int32_t));
+  if (!items || !fill || !order) {
+    free(items);
+    free(fill);
+    free(order);
+    return 0;
+  }
+
+  for (int32_t i = 0; i < count; i++) {
+    items[i].cost = costs[i];
+    items[i].index = i;
+  }
+  qsort(items, (size_t)count, sizeof(CostItem), _cost_item_desc);
+
+  for (int32_t w = 0; w < workers; w++) {
+    fill[w] = (int32_t)(((int64_t)count * w) / workers);
+  }
+  int32_t w = 0;
+  for (int32_t k = 0; k < count; k++) {
+    while (fill[w] >= (int32_t)(((int64_t)count * (w + 1)) / workers)) {
+      w = (w + 1) % workers;
+    }
+    order[fill[w]++] = items[k].index;
+    w = (w + 1) % workers;
+  }
+
+  free(items);
+  free(fill);
+  free(q->order);
+  q->order = order;
+  return 1;
+}
+
+void vs_queue_cancel(VsWorkQueue* q) {
+  vs_atomic_store32(&q->cancelled, 1);
+}
+
+int vs_queue_cancelled(VsWorkQueue* q) {
+  return vs_atomic_load32(&q->cancelled) != 0;
+}
+
+int vs_queue_take(VsWorkQueue* q, int32_t worker, int32_t* out_start, int32_t* out_end) {
+  if (vs_queue_cancelled(q)) return 0;
+
+  if (q->flags & VS_QUEUE_ORDERED) {
+    const int32_t start = vs_atomic_fetch_add32(&q->cursor, q->grain);
+    if (start >= q->count) return 0;
+    *out_start = start;
+    *out_end = start + q->grain < q->count ? start + q->grain : q->count;
+    return 1;
+  }
+
+  if (worker < 0) worker = 0;
+  worker %= q->workers;
+  volatile int64_t* mine = &q->ranges[(size_t)worker * VS_QUEUE_STRIDE];
+
+  // Own range: take a piece off the front.
+  int64_t own;
+  for (;;) {
+    own = vs_atomic_load64(mine);
+    const int32_t begin = _range_begin(own);
+    const int32_t end = _range_end(own);
+    if (begin >= end) break;
+    const int32_t k = _queue_piece(q, end - begin);
+    if (vs_atomic_cas64(mine, own, _range_pack(begin + k, end))) {
+      *out_start = begin;
+      *out_end = begin + k;
+      return 1;
+    }
+  }
+
+  // Empty: steal the upper half of the next non-empty victim's range, run
+  // one piece of it and keep the rest as our own range.
+  for (int32_t n = 1; n < q->workers; n++) {
+    volatile int64_t* victim =
+        &q->ranges[(size_t)((worker + n) % q->workers) * VS_QUEUE_STRIDE];
+    for (;;) {
+      if (vs_queue_cancelled(q)) return 0;
+      const int64_t v = vs_atomic_load64(victim);
+      const int32_t begin = _range_begin(v);
+      const int32_t end = _range_end(v);
+      if (begin >= end) break;
+      const int32_t stolen = (end - begin + 1) / 2;
+      const int32_t mid = end - stolen;
+      if (!vs_atomic_cas64(victim, v, _range_pack(begin, mid))) continue;
+
+      const int32_t k = _queue_piece(q, stolen);
+      *out_start = mid;
+      *out_end = end;
+      // Thieves never touch an empty range, so this only fails if another
+      // worker shares our slot; then just run the whole stolen range.
+      if (stolen > k && vs_atomic_cas64(mine, own, _range_pack(mid + k, end))) {
+        *out_end = mid + k;
+      }
+      return 1;
+    }
+  }
+  return 0;
+}
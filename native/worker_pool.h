@@ -0,0 +1,143 @@
+/**
+ * @file worker_pool.h
+ * @brief Library-internal interface to the shared native worker pool.
+ *
+ * Not part of the FFI surface; see worker_pool.c for the run semantics.
+ */
+#ifndef VOXELSHIFT_WORKER_POOL_H
+#define VOXELSHIFT_WORKER_POOL_H
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#ifdef _MSC_VER
+#define VS_INLINE static __inline
+#else
+#define VS_INLINE static inline
+#endif
+
+// ── Atomics ─────────────────────────────────────────────────────────────────
+// Sequentially consistent read-modify-write, acquire loads, release stores.
+
+#ifdef _WIN32
+VS_INLINE int32_t vs_atomic_load32(volatile int32_t* p) {
+  return (int32_t)InterlockedOr((volatile LONG*)p, 0);
+}
+VS_INLINE void vs_atomic_store32(volatile int32_t* p, int32_t v) {
+  InterlockedExchange((volatile LONG*)p, (LONG)v);
+}
+VS_INLINE int32_t vs_atomic_fetch_add32(volatile int32_t* p, int32_t v) {
+  return (int32_t)InterlockedExchangeAdd((volatile LONG*)p, (LONG)v);
+}
+VS_INLINE int64_t vs_atomic_load64(volatile int64_t* p) {
+  return (int64_t)InterlockedOr64((volatile LONG64*)p, 0);
+}
+VS_INLINE void vs_atomic_store64(volatile int64_t* p, int64_t v) {
+  InterlockedExchange64((volatile LONG64*)p, (LONG64)v);
+}
+VS_INLINE int vs_atomic_cas64(volatile int64_t* p, int64_t expected, int64_t desired) {
+  return InterlockedCompareExchange64((volatile LONG64*)p, (LONG64)desired, (LONG64)expected) ==
+         (LONG64)expected;
+}
+#else
+VS_INLINE int32_t vs_atomic_load32(volatile int32_t* p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+VS_INLINE void vs_atomic_store32(volatile int32_t* p, int32_t v) {
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+VS_INLINE int32_t vs_atomic_fetch_add32(volatile int32_t* p, int32_t v) {
+  return __atomic_fetch_add(p, v, __ATOMIC_SEQ_CST);
+}
+VS_INLINE int64_t vs_atomic_load64(volatile int64_t* p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+VS_INLINE void vs_atomic_store64(volatile int64_t* p, int64_t v) {
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+VS_INLINE int vs_atomic_cas64(volatile int64_t* p, int64_t expected, int64_t desired) {
+  return __atomic_compare_exchange_n(
+      p, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+#endif
+
+// ── Worker pool ─────────────────────────────────────────────────────────────
+
+// Persistent per-worker scratch slots. Each entry point that keeps buffers
+// alive between runs owns one slot.
+#define VS_POOL_NO_SCRATCH (-1)
+#define VS_POOL_SLOT_PROCESS 0
+#define VS_POOL_SLOT_COMPRESS 1
+#define VS_POOL_SLOT_RECOMPRESS 2
+
+/// Task body: runs once per worker. `scratch` is that worker's slot for the
+/// run (NULL when the run was submitted with VS_POOL_NO_SCRATCH).
+typedef void (*vs_pool_task_fn)(void* ctx, int32_t worker_index, void** scratch);
+/// Releases one scratch slot value.
+typedef void (*vs_pool_free_fn)(void* scratch);
+
+int32_t vs_pool_run(
+    int32_t threads,
+    int32_t slot,
+    vs_pool_free_fn scratch_free,
+    vs_pool_task_fn fn,
+    void* ctx);
+/// Background hint for runs submitted from the calling thread; returns the
+/// previous hint. Entry points set it from their job and restore it.
+int32_t vs_pool_set_background(int32_t background);
+
+// ── Work-stealing index scheduler ───────────────────────────────────────────
+
+/// Hands out [0, count) to `workers` workers.
+///
+/// Default mode: each worker starts with a contiguous share held in its own
+/// slot and takes small pieces off the front; once empty it steals the upper
+/// half of another worker's remaining range. Piece sizes shrink as a range
+/// drains, so the batch tail is spread over all workers.
+///
+/// Ordered mode (VS_QUEUE_ORDERED): a single shared cursor hands out indices
+/// in ascending order, for consumers that emit results in index order.
+///
+/// Takes return positions; with a cost order installed
+/// (vs_queue_order_by_cost) map them to item indices with vs_queue_item.
+///
+/// Cancelling (on failure) makes every further take return 0. All operations
+/// are lock-free.
+typedef struct VsWorkQueue {
+  volatile int64_t* ranges;   // per worker: begin | end << 32, one cache line each
+  void* ranges_alloc;
+  int32_t* order;             // position -> item index, NULL for identity
+  int32_t workers;
+  int32_t count;
+  int32_t grain;
+  int32_t flags;
+  volatile int32_t cursor;
+  volatile int32_t cancelled;
+} VsWorkQueue;
+
+#define VS_QUEUE_ORDERED 1
+
+/// Returns 1 on success, 0 on allocation failure.
+int vs_queue_init(
+    VsWorkQueue* q,
+    int32_t count,
+    int32_t workers,
+    int32_t grain,
+    int32_t flags);
+void vs_queue_destroy(VsWorkQueue* q);
+/// Claim the next range for `worker`; returns 0 when no work is left.
+int vs_queue_take(VsWorkQueue* q, int32_t worker, int32_t* out_start, int32_t* out_end);
+void vs_queue_cancel(VsWorkQueue* q);
+int vs_queue_cancelled(VsWorkQueue* q);
+/// Dispatch longest-processing-time first using per-item cost estimates.
+/// Returns 0 (identity order kept) when ordering is not possible or useful.
+int vs_queue_order_by_cost(VsWorkQueue* q, const int32_t* costs);
+
+VS_INLINE int32_t vs_queue_item(const VsWorkQueue* q, int32_t position) {
+  return q->order ? q->order[position] : position;
+}
+
+#endif // VOXELSHIFT_WORKER_POOL_H
@@ -0,0 +1,1068 @@
+/**
+ * @file zlib_stream.c
+ * @brief Runtime compressor bindings and warm per-worker deflate/inflate
+ * streams.
+ *
+ * zlib is loaded from the platform runtime (on Windows the bundled
+ * zlib1.dll next to the app comes first in the LoadLibraryA search order)
+ * and shared by the layer pipeline and PNG recompression. zlib-ng (native
+ * zng_ API) and libdeflate are looked up the same way when first selected;
+ * nothing is linked at build time, so a host without them keeps zlib.
+ * Inflate always goes through zlib.
+ *
+ * Setting up a deflate stream allocates its window and hash tables, which
+ * at high levels costs about as much as compressing a sparse layer. Batch
+ * workers therefore keep a VsDeflater / VsInflater in their pool scratch
+ * and only reset it between layers. Deflate streams are raw; the zlib
+ * header and Adler-32 are written around them, so one warm stream serves
+ * whole layers and the spliced bands of the row-streaming encoder alike.
+ *
+ * Window bits, memLevel and strategy are job-wide: they live in the
+ * VsEncodeJob handle (vs_encode_job_open) that the job passes to each of
+ * its batches, so concurrent jobs keep their own. The level is chosen per
+ * batch. With the auto strategy the first layers at each level are
+ * compressed with every candidate (default, filtered and RLE strategies,
+ * and lower levels), and the fastest candidate whose output is within 1/64
+ * of the smallest is used for the rest of the job; the trials are kept in
+ * the job's handle too.
+ *
+ * The handle also picks the backend: zlib, zlib-ng (same streams, same
+ * parameters), libdeflate (whole buffers only, so row-streamed batches fall
+ * back to the full-frame path) or the built-in encoder in mask_deflate.c.
+ * The auto strategy only trials zlib and zlib-ng. The auto encoder times
+ * each loaded backend once per level and job on a synthetic mask and keeps
+ * the fastest whose output is within 1/64 of the smallest; the built-in
+ * encoder ignores the level and is never picked that way.
+ */
+#include "voxelshift_native.h"
+#include "zlib_stream.h"
+#include "mask_deflate.h"
+#include "worker_pool.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+typedef HMODULE vs_lib_handle;
+static vs_lib_handle vs_dlopen(const char* name) { return LoadLibraryA(name); }
+static void* vs_dlsym(vs_lib_handle h, const char* sym) { return (void*)GetProcAddress(h, sym); }
+#else
+#include <dlfcn.h>
+#include <pthread.h>
+#include <time.h>
+typedef void* vs_lib_handle;
+static vs_lib_handle vs_dlopen(const char* name) { return dlopen(name, RTLD_LAZY); }
+static void* vs_dlsym(vs_lib_handle h, const char* sym) { return dlsym(h, sym); }
+#endif
+
+typedef const char* (*zlib_version_fn)(void);
+
+#define VS_DEFLATE_AUTO_SAMPLES 6  // trial layers per level before choosing
+#define VS_ENCODER_BENCH_WIDTH 1024
+#define VS_ENCODER_BENCH_ROWS 192
+#define VS_ENCODER_BENCH_RUNS 3
+#define VS_DEFLATE_MIN_BAND (128 * 1024)  // smallest split deflate band
+
+// Auto-strategy trials for one requested level.
+typedef struct AutoSlot {
+  volatile int32_t claimed;
+  volatile int32_t recorded;
+  volatile int32_t choice;  // candidate index + 1 once chosen
+  volatile int64_t ns[VS_DEFLATE_AUTO_MAX_CANDIDATES];
+  volatile int64_t bytes[VS_DEFLATE_AUTO_MAX_CANDIDATES];
+} AutoSlot;
+
+// Stream settings and auto-strategy trials of one job.
+struct VsEncodeJob {
+  int32_t window_bits;
+  int32_t mem_level;
+  int32_t strategy;
+  int32_t encoder;
+  int32_t split;
+  volatile int32_t background;         // runs below normal priority
+  AutoSlot trials[10];
+  volatile int32_t encoder_bench[10];  // auto encoder's pick + 1
+};
+
+static VsZlib g_zlib;
+static VsZng g_zng;
+static VsLibdeflate g_libdeflate;
+
+#ifdef _WIN32
+static uint64_t _now_ns(void) {
+  static LARGE_INTEGER freq;
+  static int initialized = 0;
+  if (!initialized) {
+    QueryPerformanceFrequency(&freq);
+    initialized = 1;
+  }
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return (uint64_t)((counter.QuadPart * 1000000000ULL) / freq.QuadPart);
+}
+#else
+static uint64_t _now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+static void _atomic_add64(volatile int64_t* p, int64_t v) {
+  int64_t cur = vs_atomic_load64(p);
+  while (!vs_atomic_cas64(p, cur, cur + v)) cur = vs_atomic_load64(p);
+}
+
+static void _load_zlib(void) {
+  const char* candidates[] = {
+#ifdef _WIN32
+      "zlib1.dll", "zlib.dll",
+#elif __APPLE__
+      "libz.1.dylib", "libz.dylib",
+#else
+      "libz.so.1", "libz.so",
+#endif
+  };
+
+  for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+    vs_lib_handle h = vs_dlopen(candidates[i]);
+    if (!h) continue;
+    VsZlib z;
+    memset(&z, 0, sizeof(z));
+    z.compress2 = (vs_compress2_fn)vs_dlsym(h, "compress2");
+    z.uncompress = (vs_uncompress_fn)vs_dlsym(h, "uncompress");
+    if (!z.compress2 || !z.uncompress) continue;
+    z.available = 1;
+
+    zlib_version_fn zv = (zlib_version_fn)vs_dlsym(h, "zlibVersion");
+    z.deflate_init2 = (vs_deflate_init2_fn)vs_dlsym(h, "deflateInit2_");
+    z.deflate = (vs_zstream_flush_fn)vs_dlsym(h, "deflate");
+    z.deflate_reset = (vs_zstream_fn)vs_dlsym(h, "deflateReset");
+    z.deflate_end = (vs_zstream_fn)vs_dlsym(h, "deflateEnd");
+    z.inflate_init = (vs_inflate_init_fn)vs_dlsym(h, "inflateInit_");
+    z.inflate = (vs_zstream_flush_fn)vs_dlsym(h, "inflate");
+    z.inflate_reset = (vs_zstream_fn)vs_dlsym(h, "inflateReset");
+    z.inflate_end = (vs_zstream_fn)vs_dlsym(h, "inflateEnd");
+    z.adler32 = (vs_adler32_fn)vs_dlsym(h, "adler32");
+    z.deflate_set_dictionary =
+        (vs_deflate_dict_fn)vs_dlsym(h, "deflateSetDictionary");
+    z.version = zv ? zv() : NULL;
+    z.stream_available = z.version && z.deflate_init2 && z.deflate &&
+        z.deflate_reset && z.deflate_end && z.inflate_init && z.inflate &&
+        z.inflate_reset && z.inflate_end && z.adler32;
+    g_zlib = z;
+    return;
+  }
+}
+
+#ifdef _WIN32
+static INIT_ONCE g_zlib_once = INIT_ONCE_STATIC_INIT;
+static BOOL CALLBACK _zlib_init_once(PINIT_ONCE once, PVOID param, PVOID* ctx) {
+  (void)once;
+  (void)param;
+  (void)ctx;
+  _load_zlib();
+  return TRUE;
+}
+const VsZlib* vs_zlib(void) {
+  InitOnceExecuteOnce(&g_zlib_once, _zlib_init_once, NULL, NULL);
+  return &g_zlib;
+}
+#else
+static pthread_once_t g_zlib_once = PTHREAD_ONCE_INIT;
+const VsZlib* vs_zlib(void) {
+  pthread_once(&g_zlib_once, _load_zlib);
+  return &g_zlib;
+}
+#endif
+
+static void _load_zng(void) {
+  const char* candidates[] = {
+#ifdef _WIN32
+      "zlib-ng2.dll", "zlib-ng.dll",
+#elif __APPLE__
+      "libz-ng.2.dylib", "libz-ng.dylib",
+#else
+      "libz-ng.so.2", "libz-ng.so",
+#endif
+  };
+
+  for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+    vs_lib_handle h = vs_dlopen(candidates[i]);
+    if (!h) continue;
+    VsZng z;
+    memset(&z, 0, sizeof(z));
+    zlib_version_fn zv = (zlib_version_fn)vs_dlsym(h, "zlibng_version");
+    z.deflate_init2 = (vs_zng_deflate_init2_fn)vs_dlsym(h, "zng_deflateInit2");
+    z.deflate = (vs_zng_stream_flush_fn)vs_dlsym(h, "zng_deflate");
+    z.deflate_reset = (vs_zng_stream_fn)vs_dlsym(h, "zng_deflateReset");
+    z.deflate_end = (vs_zng_stream_fn)vs_dlsym(h, "zng_deflateEnd");
+    z.adler32 = (vs_zng_adler32_fn)vs_dlsym(h, "zng_adler32");
+    z.deflate_set_dictionary =
+        (vs_zng_dict_fn)vs_dlsym(h, "zng_deflateSetDictionary");
+    z.version = zv ? zv() : NULL;
+    z.available = z.version && z.deflate_init2 && z.deflate &&
+        z.deflate_reset && z.deflate_end && z.adler32;
+    if (!z.available) continue;
+    g_zng = z;
+    return;
+  }
+}
+
+static void _load_libdeflate(void) {
+  const char* candidates[] = {
+#ifdef _WIN32
+      "libdeflate.dll", "deflate.dll",
+#elif __APPLE__
+      "libdeflate.0.dylib", "libdeflate.dylib",
+#else
+      "libdeflate.so.0", "libdeflate.so",
+#endif
+  };
+
+  for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+    vs_lib_handle h = vs_dlopen(candidates[i]);
+    if (!h) continue;
+    VsLibdeflate l;
+    memset(&l, 0, sizeof(l));
+    l.alloc_compressor =
+        (vs_libdeflate_alloc_fn)vs_dlsym(h, "libdeflate_alloc_compressor");
+    l.zlib_compress =
+        (vs_libdeflate_compress_fn)vs_dlsym(h, "libdeflate_zlib_compress");
+    l.free_compressor =
+        (vs_libdeflate_free_fn)vs_dlsym(h, "libdeflate_free_compressor");
+    l.available = l.alloc_compressor && l.zlib_compress && l.free_compressor;
+    if (!l.available) continue;
+    g_libdeflate = l;
+    return;
+  }
+}
+
+static void _load_backends(void) {
+  _load_zng();
+  _load_libdeflate();
+}
+
+#ifdef _WIN32
+static INIT_ONCE g_backends_once = INIT_ONCE_STATIC_INIT;
+static BOOL CALLBACK _backends_init_once(PINIT_ONCE once, PVOID param, PVOID* ctx) {
+  (void)once;
+  (void)param;
+  (void)ctx;
+  _load_backends();
+  return TRUE;
+}
+static void _backends_init(void) {
+  InitOnceExecuteOnce(&g_backends_once, _backends_init_once, NULL, NULL);
+}
+#else
+static pthread_once_t g_backends_once = PTHREAD_ONCE_INIT;
+static void _backends_init(void) {
+  pthread_once(&g_backends_once, _load_backends);
+}
+#endif
+
+const VsZng* vs_zng(void) {
+  _backends_init();
+  return &g_zng;
+}
+
+const VsLibdeflate* vs_libdeflate(void) {
+  _backends_init();
+  return &g_libdeflate;
+}
+
+/// 1 if [encoder]'s library is loaded (zlib with its stream API).
+static int _encoder_loaded(int32_t encoder) {
+  switch (encoder) {
+    case VS_DEFLATE_ENCODER_BUILTIN:
+      return 1;
+    case VS_DEFLATE_ENCODER_ZLIB_NG:
+      return vs_zng()->available;
+    case VS_DEFLATE_ENCODER_LIBDEFLATE:
+      return vs_libdeflate()->available;
+    default:
+      return vs_zlib()->stream_available;
+  }
+}
+
+/**
+ * @brief Open a job's deflate settings with no auto-strategy trials or
+ * encoder benchmark yet.
+ *
+ * Out-of-range values select zlib's defaults (15, 8, default strategy) and
+ * the zlib encoder; any nonzero [split] lets layers deflate in bands.
+ */
+int64_t vs_encode_job_open(
+    int32_t window_bits,
+    int32_t mem_level,
+    int32_t strategy,
+    int32_t encoder,
+    int32_t split) {
+  VsEncodeJob* job = (VsEncodeJob*)calloc(1, sizeof(VsEncodeJob));
+  if (!job) return 0;
+  job->window_bits = window_bits >= 9 && window_bits <= 15 ? window_bits : 15;
+  job->mem_level = mem_level >= 1 && mem_level <= 9 ? mem_level : 8;
+  job->strategy =
+      strategy >= 0 && strategy <= VS_DEFLATE_STRATEGY_AUTO ? strategy : 0;
+  job->encoder = encoder >= 0 && encoder <= VS_DEFLATE_ENCODER_AUTO
+                     ? encoder
+                     : VS_DEFLATE_ENCODER_ZLIB;
+  job->split = split != 0;
+  return (int64_t)(intptr_t)job;
+}
+
+void vs_encode_job_close(int64_t job) {
+  free((VsEncodeJob*)(intptr_t)job);
+}
+
+static int32_t _job_window_bits(const VsEncodeJob* job) {
+  return job ? job->window_bits : 15;
+}
+
+static int32_t _job_mem_level(const VsEncodeJob* job) {
+  return job ? job->mem_level : 8;
+}
+
+static int32_t _job_strategy(const VsEncodeJob* job) {
+  return job ? job->strategy : 0;
+}
+
+static int32_t _job_encoder(const VsEncodeJob* job) {
+  return job ? job->encoder : VS_DEFLATE_ENCODER_ZLIB;
+}
+
+int32_t vs_deflate_split_threads(const VsEncodeJob* job, int32_t threads) {
+  // Without a handle layers split, as they do by default.
+  return job && !job->split ? 1 : threads;
+}
+
+/**
+ * @brief Mark [job]'s later batches as background work.
+ *
+ * Batches started afterwards run their pool workers below normal priority;
+ * other jobs sharing the pool are unaffected.
+ */
+void vs_encode_job_set_background(int64_t job, int32_t background) {
+  VsEncodeJob* j = (VsEncodeJob*)(intptr_t)job;
+  if (j) vs_atomic_store32(&j->background, background != 0);
+}
+
+int32_t vs_encode_job_background(VsEncodeJob* job) {
+  return job ? vs_atomic_load32(&job->background) : 0;
+}
+
+/**
+ * @brief Fill [out] with the synthetic benchmark layer: Up-filtered
+ * scanlines of a few discs, mostly zero with short edge runs.
+ */
+static void _bench_sample(uint8_t* out) {
+  static const int32_t discs[3][3] = {{512, 96, 80}, {200, 60, 30}, {820, 140, 44}};
+  const int32_t stride = VS_ENCODER_BENCH_WIDTH;
+  for (int32_t y = 0; y < VS_ENCODER_BENCH_ROWS; y++) {
+    uint8_t* row = out + (size_t)y * stride;
+    row[0] = 0;
+    for (int32_t x = 1; x < stride; x++) {
+      uint8_t v = 0;
+      for (int32_t k = 0; k < 3; k++) {
+        const int32_t dx = x - discs[k][0];
+        const int32_t dy = y - discs[k][1];
+        if (dx * dx + dy * dy <= discs[k][2] * discs[k][2]) v = 0xFF;
+      }
+      row[x] = v;
+    }
+  }
+  // Up filter in place, bottom row first.
+  for (int32_t y = VS_ENCODER_BENCH_ROWS - 1; y >= 0; y--) {
+    uint8_t* row = out + (size_t)y * stride;
+    if (y > 0) {
+      const uint8_t* up = row - stride;
+      for (int32_t x = 1; x < stride; x++) row[x] = (uint8_t)(row[x] - up[x]);
+    }
+    row[0] = 2;
+  }
+}
+
+/**
+ * @brief Pick the auto encoder's backend at [level] by timing every loaded
+ * one on the synthetic layer; cached per level in [job].
+ *
+ * Concurrent first callers may each run the benchmark; they store the same
+ * kind of answer, so no lock is taken.
+ */
+static int32_t _bench_encoder(VsEncodeJob* job, int32_t level) {
+  const int32_t known = vs_atomic_load32(&job->encoder_bench[level]);
+  if (known > 0) return known - 1;
+
+  static const int32_t backends[3] = {
+      VS_DEFLATE_ENCODER_ZLIB, VS_DEFLATE_ENCODER_ZLIB_NG,
+      VS_DEFLATE_ENCODER_LIBDEFLATE};
+  const size_t len = (size_t)VS_ENCODER_BENCH_WIDTH * VS_ENCODER_BENCH_ROWS;
+  const size_t cap = len * 2 + 1024;
+  uint8_t* sample = (uint8_t*)malloc(len);
+  uint8_t* out = (uint8_t*)malloc(cap);
+  if (!sample || !out) {
+    free(sample);
+    free(out);
+    return VS_DEFLATE_ENCODER_ZLIB;
+  }
+  _bench_sample(sample);
+
+  uint64_t ns[3] = {0, 0, 0};
+  size_t bytes[3] = {0, 0, 0};
+  size_t min_bytes = 0;
+  for (int32_t k = 0; k < 3; k++) {
+    if (!_encoder_loaded(backends[k])) continue;
+    if (backends[k] == VS_DEFLATE_ENCODER_LIBDEFLATE && level == 0) continue;
+    VsDeflateParams p;
+    p.level = level;
+    p.window_bits = _job_window_bits(job);
+    p.mem_level = _job_mem_level(job);
+    p.strategy = 0;
+    p.encoder = backends[k];
+    VsDeflater d;
+    memset(&d, 0, sizeof(d));
+    // The first run also sets the stream up; the best of the rest counts.
+    for (int32_t run = 0; run <= VS_ENCODER_BENCH_RUNS; run++) {
+      size_t got = 0;
+      const uint64_t t0 = _now_ns();
+      if (!vs_deflate_zlib(&d, &p, sample, len, out, cap, &got)) {
+        bytes[k] = 0;
+        break;
+      }
+      const uint64_t t = _now_ns() - t0;
+      if (run == 1 || (run > 1 && t < ns[k])) ns[k] = t;
+      bytes[k] = got;
+    }
+    vs_deflater_end(&d);
+    if (bytes[k] > 0 && (min_bytes == 0 || bytes[k] < min_bytes)) {
+      min_bytes = bytes[k];
+    }
+  }
+  free(sample);
+  free(out);
+
+  // Fastest backend whose output is within 1/64 of the smallest.
+  int32_t best = -1;
+  for (int32_t k = 0; k < 3; k++) {
+    if (bytes[k] == 0 || bytes[k] > min_bytes + min_bytes / 64) continue;
+    if (best < 0 || ns[k] < ns[best]) best = k;
+  }
+  const int32_t encoder = best < 0 ? VS_DEFLATE_ENCODER_ZLIB : backends[best];
+  vs_atomic_store32(&job->encoder_bench[level], encoder + 1);
+  return encoder;
+}
+
+/**
+ * @brief The backend that writes streams at [level]: [job]'s, the
+ * benchmark's pick under auto, or zlib when the selected library is absent.
+ */
+static int32_t _resolve_encoder(VsEncodeJob* job, int32_t level) {
+  const int32_t encoder = _job_encoder(job);
+  // Only a job handle can select the auto encoder.
+  if (encoder == VS_DEFLATE_ENCODER_AUTO) return _bench_encoder(job, level);
+  // Level 0 is stored blocks whoever writes them.
+  if (encoder == VS_DEFLATE_ENCODER_LIBDEFLATE && level == 0) {
+    return VS_DEFLATE_ENCODER_ZLIB;
+  }
+  return _encoder_loaded(encoder) ? encoder : VS_DEFLATE_ENCODER_ZLIB;
+}
+
+/// 1 if the auto strategy can trial [encoder]'s streams.
+static int _encoder_trials(int32_t encoder) {
+  return (encoder == VS_DEFLATE_ENCODER_ZLIB ||
+          encoder == VS_DEFLATE_ENCODER_ZLIB_NG) &&
+         _encoder_loaded(encoder);
+}
+
+/**
+ * @brief Report the backend that writes streams at a requested level.
+ *
+ * Resolves the selected encoder as a batch of [job] would (running the
+ * auto encoder's benchmark if it has not run at [level] yet) and returns
+ * its vs_encode_job_open encoder code.
+ */
+int32_t get_deflate_encoder(int64_t job, int32_t level) {
+  return vs_deflate_params((VsEncodeJob*)(intptr_t)job, level).encoder;
+}
+
+/**
+ * @brief Report the auto strategy's choice at a requested level.
+ *
+ * Returns 1 and the chosen strategy and level once [job]'s trials at
+ * [level] are complete, 0 otherwise.
+ */
+int32_t get_deflate_auto_choice(
+    int64_t job,
+    int32_t level,
+    int32_t* out_strategy,
+    int32_t* out_level) {
+  VsEncodeJob* j = (VsEncodeJob*)(intptr_t)job;
+  if (level < 0 || level > 9) return 0;
+  if (_job_strategy(j) != VS_DEFLATE_STRATEGY_AUTO) return 0;
+  if (!_encoder_trials(_resolve_encoder(j, level))) return 0;
+  if (vs_atomic_load32(&j->trials[level].choice) == 0) return 0;
+  const VsDeflateParams p = vs_deflate_params(j, level);
+  if (out_strategy) *out_strategy = p.strategy;
+  if (out_level) *out_level = p.level;
+  return 1;
+}
+
+int32_t vs_deflate_auto_candidates(
+    VsEncodeJob* job,
+    int32_t level,
+    VsDeflateParams* out) {
+  VsDeflateParams base;
+  base.level = level < 0 ? 0 : level > 9 ? 9 : level;
+  base.window_bits = _job_window_bits(job);
+  base.mem_level = _job_mem_level(job);
+  base.strategy = 0;
+  base.encoder = _resolve_encoder(job, base.level);
+  int32_t n = 0;
+  out[n++] = base;
+  // Z_FILTERED only changes lazy matching, used from level 4 up; Z_RLE
+  // ignores the level.
+  if (base.level >= 4) {
+    out[n] = base;
+    out[n++].strategy = 1;
+  }
+  out[n] = base;
+  out[n++].strategy = 3;
+  const int32_t lower[2] = {base.level / 2, 1};
+  for (int32_t k = 0; k < 2; k++) {
+    if (lower[k] < 1 || lower[k] >= base.level) continue;
+    if (k == 1 && lower[1] == lower[0]) continue;
+    out[n] = base;
+    out[n++].level = lower[k];
+  }
+  return n;
+}
+
+VsDeflateParams vs_deflate_params(VsEncodeJob* job, int32_t level) {
+  VsDeflateParams p;
+  p.level = level < 0 ? 0 : level > 9 ? 9 : level;
+  p.window_bits = _job_window_bits(job);
+  p.mem_level = _job_mem_level(job);
+  p.strategy = _job_strategy(job);
+  p.encoder = _resolve_encoder(job, p.level);
+  if (!_encoder_trials(p.encoder)) {
+    // libdeflate and the built-in encoder have no strategies; a zlib
+    // without streams cannot trial.
+    if (p.encoder != VS_DEFLATE_ENCODER_ZLIB ||
+        p.strategy == VS_DEFLATE_STRATEGY_AUTO) {
+      p.strategy = 0;
+    }
+  } else if (p.strategy == VS_DEFLATE_STRATEGY_AUTO) {
+    p.strategy = 0;
+    // Only a job handle can select the auto strategy.
+    const int32_t choice = vs_atomic_load32(&job->trials[p.level].choice);
+    VsDeflateParams c[VS_DEFLATE_AUTO_MAX_CANDIDATES];
+    if (choice > 0 && choice <= vs_deflate_auto_candidates(job, p.level, c)) {
+      p = c[choice - 1];
+    }
+  }
+  return p;
+}
+
+int vs_deflate_auto_claim(VsEncodeJob* job, int32_t level) {
+  if (level > 9) level = 9;
+  if (level < 1) return 0;
+  if (_job_strategy(job) != VS_DEFLATE_STRATEGY_AUTO) return 0;
+  if (!_encoder_trials(_resolve_encoder(job, level))) return 0;
+  AutoSlot* s = &job->trials[level];
+  if (vs_atomic_load32(&s->choice) != 0) return 0;
+  return vs_atomic_fetch_add32(&s->claimed, 1) < VS_DEFLATE_AUTO_SAMPLES;
+}
+
+void vs_deflate_auto_record(
+    VsEncodeJob* job,
+    int32_t level,
+    const uint64_t* ns,
+    const size_t* bytes,
+    int32_t count) {
+  if (level > 9) level = 9;
+  if (!job || level < 1 || count < 1) return;
+  if (count > VS_DEFLATE_AUTO_MAX_CANDIDATES) count = VS_DEFLATE_AUTO_MAX_CANDIDATES;
+  AutoSlot* s = &job->trials[level];
+  for (int32_t k = 0; k < count; k++) {
+    _atomic_add64(&s->ns[k], (int64_t)ns[k]);
+    _atomic_add64(&s->bytes[k], (int64_t)bytes[k]);
+  }
+  if (vs_atomic_fetch_add32(&s->recorded, 1) + 1 != VS_DEFLATE_AUTO_SAMPLES) return;
+
+  // Fastest candidate whose total output is within 1/64 of the smallest.
+  int64_t min_bytes = vs_atomic_load64(&s->bytes[0]);
+  for (int32_t k = 1; k < count; k++) {
+    const int64_t b = vs_atomic_load64(&s->bytes[k]);
+    if (b < min_bytes) min_bytes = b;
+  }
+  const int64_t limit = min_bytes + min_bytes / 64;
+  int32_t best = -1;
+  int64_t best_ns = 0;
+  for (int32_t k = 0; k < count; k++) {
+    const int64_t t = vs_atomic_load64(&s->ns[k]);
+    if (vs_atomic_load64(&s->bytes[k]) > limit) continue;
+    if (best < 0 || t < best_ns) {
+      best = k;
+      best_ns = t;
+    }
+  }
+  vs_atomic_store32(&s->choice, best + 1);
+}
+
+uint16_t vs_zlib_header(const VsDeflateParams* p) {
+  const int32_t level = p->level;
+  const uint32_t flevel = (p->strategy >= VS_Z_HUFFMAN_ONLY || level < 2) ? 0u
+                          : level < 6 ? 1u : level == 6 ? 2u : 3u;
+  const uint32_t cmf = ((uint32_t)(p->window_bits - 8) << 4) | VS_Z_DEFLATED;
+  uint32_t header = (cmf << 8) | (flevel << 6);
+  header += 31u - (header % 31u);
+  return (uint16_t)header;
+}
+
+size_t vs_deflate_bound(const VsDeflateParams* p, size_t len) {
+  if (p->encoder == VS_DEFLATE_ENCODER_BUILTIN) return vs_mask_deflate_bound(len);
+  if (p->encoder == VS_DEFLATE_ENCODER_LIBDEFLATE) {
+    // libdeflate_zlib_compress_bound: a stored block header per 5000 bytes
+    // at worst, plus its output padding.
+    return len + 5 * (len / 4096 + 1) + 1 + 8 + 6;
+  }
+  if (p->window_bits == 15 && p->mem_level == 8) {
+    return len + (len >> 12) + (len >> 14) + (len >> 25) + 13 + 6;
+  }
+  return len + ((len + 7) >> 3) + ((len + 63) >> 6) + 5 + 6;
+}
+
+int vs_deflate_can_stream(const VsDeflateParams* p) {
+  if (p->encoder == VS_DEFLATE_ENCODER_ZLIB_NG) return vs_zng()->available;
+  if (p->encoder == VS_DEFLATE_ENCODER_ZLIB) return vs_zlib()->stream_available;
+  return 0;
+}
+
+int vs_deflate_available(const VsDeflateParams* p) {
+  if (p->encoder == VS_DEFLATE_ENCODER_LIBDEFLATE) {
+    return vs_libdeflate()->available;
+  }
+  return vs_deflate_can_stream(p);
+}
+
+int vs_deflate_stream_params(const VsDeflateParams* p, VsDeflateParams* out) {
+  *out = *p;
+  if (vs_deflate_can_stream(out)) return 1;
+  out->encoder = VS_DEFLATE_ENCODER_ZLIB;
+  if (vs_deflate_can_stream(out)) return 1;
+  out->encoder = VS_DEFLATE_ENCODER_ZLIB_NG;
+  return vs_deflate_can_stream(out);
+}
+
+uint32_t vs_zlib_adler32(uint32_t adler, const uint8_t* data, size_t len) {
+  const VsZng* zng = vs_zng();
+  const VsZlib* z = vs_zlib();
+  while (len > 0) {
+    const unsigned int n = len > 0x40000000u ? 0x40000000u : (unsigned int)len;
+    if (zng->available) {
+      adler = zng->adler32(adler, data, n);
+    } else if (z->adler32) {
+      adler = (uint32_t)z->adler32(adler, data, n);
+    } else {
+      adler = vs_adler32(adler, data, n);
+    }
+    data += n;
+    len -= n;
+  }
+  return adler;
+}
+
+int vs_deflater_begin(VsDeflater* d, const VsDeflateParams* p) {
+  if (!vs_deflate_available(p)) return 0;
+  if (d->live) {
+    if (memcmp(&d->params, p, sizeof(VsDeflateParams)) == 0) {
+      switch (p->encoder) {
+        case VS_DEFLATE_ENCODER_ZLIB_NG:
+          return vs_zng()->deflate_reset(&d->zng) == VS_Z_OK;
+        case VS_DEFLATE_ENCODER_LIBDEFLATE:
+          return 1;
+        default:
+          return vs_zlib()->deflate_reset(&d->zs) == VS_Z_OK;
+      }
+    }
+    vs_deflater_end(d);
+  }
+  if (p->encoder == VS_DEFLATE_ENCODER_LIBDEFLATE) {
+    d->libdeflate = vs_libdeflate()->alloc_compressor(p->level);
+    if (!d->libdeflate) return 0;
+  } else if (p->encoder == VS_DEFLATE_ENCODER_ZLIB_NG) {
+    const VsZng* zng = vs_zng();
+    memset(&d->zng, 0, sizeof(d->zng));
+    if (zng->deflate_init2(&d->zng, p->level, VS_Z_DEFLATED, -p->window_bits,
+                           p->mem_level, p->strategy) != VS_Z_OK) {
+      return 0;
+    }
+  } else {
+    const VsZlib* z = vs_zlib();
+    memset(&d->zs, 0, sizeof(d->zs));
+    if (z->deflate_init2(&d->zs, p->level, VS_Z_DEFLATED, -p->window_bits,
+                         p->mem_level, p->strategy, z->version,
+                         (int)sizeof(VsZStream)) != VS_Z_OK) {
+      return 0;
+    }
+  }
+  d->params = *p;
+  d->live = 1;
+  return 1;
+}
+
+void vs_deflater_end(VsDeflater* d) {
+  if (!d || !d->live) return;
+  switch (d->params.encoder) {
+    case VS_DEFLATE_ENCODER_ZLIB_NG:
+      vs_zng()->deflate_end(&d->zng);
+      break;
+    case VS_DEFLATE_ENCODER_LIBDEFLATE:
+      vs_libdeflate()->free_compressor(d->libdeflate);
+      break;
+    default:
+      vs_zlib()->deflate_end(&d->zs);
+      break;
+  }
+  d->live = 0;
+}
+
+void vs_deflater_set_output(VsDeflater* d, uint8_t* out, size_t avail) {
+  const unsigned int n = avail > 0x7FFFFFFFu ? 0x7FFFFFFFu : (unsigned int)avail;
+  if (d->params.encoder == VS_DEFLATE_ENCODER_ZLIB_NG) {
+    d->zng.next_out = out;
+    d->zng.avail_out = n;
+  } else {
+    d->zs.next_out = out;
+    d->zs.avail_out = n;
+  }
+}
+
+uint8_t* vs_deflater_next_out(const VsDeflater* d) {
+  return d->params.encoder == VS_DEFLATE_ENCODER_ZLIB_NG ? d->zng.next_out
+                                                         : d->zs.next_out;
+}
+
+/**
+ * @brief One deflate call on [d]'s stream; [avail_in] / [avail_out] report
+ * what is left afterwards.
+ */
+static int _deflater_step(
+    VsDeflater* d,
+    int flush,
+    size_t* avail_in,
+    size_t* avail_out) {
+  int ret;
+  if (d->params.encoder == VS_DEFLATE_ENCODER_ZLIB_NG) {
+    ret = vs_zng()->deflate(&d->zng, flush);
+    *avail_in = d->zng.avail_in;
+    *avail_out = d->zng.avail_out;
+  } else {
+    ret = vs_zlib()->deflate(&d->zs, flush);
+    *avail_in = d->zs.avail_in;
+    *avail_out = d->zs.avail_out;
+  }
+  return ret;
+}
+
+static void _deflater_set_input(VsDeflater* d, const uint8_t* in, size_t len) {
+  if (d->params.encoder == VS_DEFLATE_ENCODER_ZLIB_NG) {
+    d->zng.next_in = in;
+    d->zng.avail_in = (uint32_t)len;
+  } else {
+    d->zs.next_in = in;
+    d->zs.avail_in = (unsigned int)len;
+  }
+}
+
+int vs_deflater_feed(
+    VsDeflater* d,
+    const uint8_t* in,
+    size_t len,
+    int flush,
+    uint8_t** out,
+    size_t* cap,
+    size_t tail) {
+  _deflater_set_input(d, in, len);
+  size_t avail_in = len;
+  size_t avail_out = d->params.encoder == VS_DEFLATE_ENCODER_ZLIB_NG
+                         ? d->zng.avail_out
+                         : d->zs.avail_out;
+  for (;;) {
+    if (avail_out == 0) {
+      const size_t used = (size_t)(vs_deflater_next_out(d) - *out);
+      uint8_t* grown = (uint8_t*)realloc(*out, *cap * 2);
+      if (!grown) return 0;
+      *out = grown;
+      *cap *= 2;
+      vs_deflater_set_output(d, *out + used, *cap - used - tail);
+    }
+    const int ret = _deflater_step(d, flush, &avail_in, &avail_out);
+    if (ret == VS_Z_STREAM_END) return 1;
+    if (ret != VS_Z_OK && ret != VS_Z_BUF_ERROR) return 0;
+    if (flush != VS_Z_FINISH && avail_in == 0 && avail_out > 0) return 1;
+  }
+}
+
+static int _deflater_set_dictionary(VsDeflater* d, const uint8_t* dict, size_t len) {
+  if (d->params.encoder == VS_DEFLATE_ENCODER_ZLIB_NG) {
+    return vs_zng()->deflate_set_dictionary(&d->zng, dict, (uint32_t)len) == VS_Z_OK;
+  }
+  return vs_zlib()->deflate_set_dictionary(&d->zs, dict, (unsigned int)len) == VS_Z_OK;
+}
+
+int32_t vs_deflate_split_bands(const VsDeflateParams* p, size_t len, int32_t threads) {
+  if (threads < 2) return 1;
+  if (!vs_deflate_can_stream(p)) return 1;
+  if (p->encoder == VS_DEFLATE_ENCODER_ZLIB_NG
+          ? !vs_zng()->deflate_set_dictionary
+          : !vs_zlib()->deflate_set_dictionary) {
+    return 1;
+  }
+  const size_t most = len / VS_DEFLATE_MIN_BAND;
+  return most < 2 ? 1 : most < (size_t)threads ? (int32_t)most : threads;
+}
+
+// Bands of one split stream, each deflated into a buffer of its own.
+typedef struct SplitWork {
+  const VsDeflateParams* params;
+  const uint8_t* in;
+  size_t len;
+  size_t band_len;
+  int32_t bands;
+  int finish;
+  uint8_t** outs;
+  size_t* out_lens;
+  uint32_t* adlers;
+  VsWorkQueue queue;  // cancelled on the first failure
+} SplitWork;
+
+static int _split_band(SplitWork* w, VsDeflater* d, int32_t b) {
+  const size_t start = (size_t)b * w->band_len;
+  const size_t len = b == w->bands - 1 ? w->len - start : w->band_len;
+  const uint8_t* in = w->in + start;
+  if (!vs_deflater_begin(d, w->params)) return 0;
+  if (start > 0) {
+    // The window before the band, as the serial stream would have it.
+    const size_t window = (size_t)1 << w->params->window_bits;
+    const size_t dict = start < window ? start : window;
+    if (!_deflater_set_dictionary(d, in - dict, dict)) return 0;
+  }
+  size_t cap = len / 4 + 1024;
+  uint8_t* out = (uint8_t*)malloc(cap);
+  if (!out) return 0;
+  vs_deflater_set_output(d, out, cap);
+  const int last = b == w->bands - 1;
+  if (!vs_deflater_feed(d, in, len,
+                        last && w->finish ? VS_Z_FINISH : VS_Z_SYNC_FLUSH,
+                        &out, &cap, 0)) {
+    free(out);
+    return 0;
+  }
+  w->outs[b] = out;
+  w->out_lens[b] = (size_t)(vs_deflater_next_out(d) - out);
+  w->adlers[b] = vs_zlib_adler32(1, in, len);
+  return 1;
+}
+
+static void _split_task(void* ctx, int32_t worker_index, void** scratch) {
+  (void)scratch;
+  SplitWork* w = (SplitWork*)ctx;
+  VsDeflater d;
+  memset(&d, 0, sizeof(d));
+  int32_t start, end;
+  while (vs_queue_take(&w->queue, worker_index, &start, &end)) {
+    for (int32_t b = start; b < end; b++) {
+      if (!_split_band(w, &d, b)) {
+        vs_queue_cancel(&w->queue);
+        break;
+      }
+    }
+  }
+  vs_deflater_end(&d);
+}
+
+int vs_deflate_split(
+    const VsDeflateParams* p,
+    const uint8_t* in,
+    size_t len,
+    size_t align,
+    int32_t bands,
+    int finish,
+    uint8_t** out,
+    size_t* cap,
+    size_t* used,
+    size_t tail,
+    uint32_t* adler) {
+  if (bands < 1 || align < 1) return 0;
+  SplitWork w;
+  memset(&w, 0, sizeof(w));
+  w.params = p;
+  w.in = in;
+  w.len = len;
+  w.finish = finish;
+  const size_t rows = len / align;
+  w.band_len = ((rows + (size_t)bands - 1) / (size_t)bands) * align;
+  if (w.band_len == 0) w.band_len = len;
+  w.bands = (int32_t)((len + w.band_len - 1) / w.band_len);
+  if (w.bands < 1) w.bands = 1;
+  w.outs = (uint8_t**)calloc((size_t)w.bands, sizeof(uint8_t*));
+  w.out_lens = (size_t*)calloc((size_t)w.bands, sizeof(size_t));
+  w.adlers = (uint32_t*)calloc((size_t)w.bands, sizeof(uint32_t));
+  int ok = w.outs && w.out_lens && w.adlers &&
+           vs_queue_init(&w.queue, w.bands, w.bands, 1, 0);
+  if (ok) {
+    ok = vs_pool_run(w.bands, VS_POOL_NO_SCRATCH, NULL, _split_task, &w) > 0 &&
+         !vs_queue_cancelled(&w.queue);
+    vs_queue_destroy(&w.queue);
+  }
+
+  for (int32_t b = 0; b < w.bands && ok; b++) {
+    size_t want = *cap;
+    while (want < *used + tail + w.out_lens[b]) want *= 2;
+    if (want != *cap) {
+      uint8_t* grown = (uint8_t*)realloc(*out, want);
+      if (!grown) {
+        ok = 0;
+        break;
+      }
+      *out = grown;
+      *cap = want;
+    }
+    memcpy(*out + *used, w.outs[b], w.out_lens[b]);
+    *used += w.out_lens[b];
+    const size_t band_len =
+        b == w.bands - 1 ? len - (size_t)b * w.band_len : w.band_len;
+    *adler = vs_adler32_combine(*adler, w.adlers[b], band_len);
+  }
+  for (int32_t b = 0; w.outs && b < w.bands; b++) free(w.outs[b]);
+  free(w.outs);
+  free(w.out_lens);
+  free(w.adlers);
+  return ok;
+}
+
+int vs_deflate_zlib(
+    VsDeflater* d,
+    const VsDeflateParams* p,
+    const uint8_t* in,
+    size_t len,
+    uint8_t* out,
+    size_t cap,
+    size_t* out_len) {
+  if (len > 0x7FFFFFFFu || cap < 6 || !vs_deflater_begin(d, p)) return 0;
+  if (p->encoder == VS_DEFLATE_ENCODER_LIBDEFLATE) {
+    // libdeflate writes the whole zlib stream, header and Adler-32 included.
+    const size_t got =
+        vs_libdeflate()->zlib_compress(d->libdeflate, in, len, out, cap);
+    if (got == 0) return 0;
+    *out_len = got;
+    return 1;
+  }
+  const uint16_t header = vs_zlib_header(p);
+  out[0] = (uint8_t)(header >> 8);
+  out[1] = (uint8_t)(header & 0xFFu);
+
+  _deflater_set_input(d, in, len);
+  vs_deflater_set_output(d, out + 2, cap - 6);
+  // All input is given up front, so Z_OK with room left only means deflate
+  // wants another call; a full buffer means the stream does not fit.
+  for (;;) {
+    size_t avail_in = 0;
+    size_t avail_out = 0;
+    const int ret = _deflater_step(d, VS_Z_FINISH, &avail_in, &avail_out);
+    if (ret == VS_Z_STREAM_END) break;
+    if (ret != VS_Z_OK || avail_out == 0) {
+      return 0;
+    }
+  }
+
+  size_t w = (size_t)(vs_deflater_next_out(d) - out);
+  const uint32_t adler = vs_zlib_adler32(1, in, len);
+  out[w++] = (uint8_t)(adler >> 24);
+  out[w++] = (uint8_t)(adler >> 16);
+  out[w++] = (uint8_t)(adler >> 8);
+  out[w++] = (uint8_t)adler;
+  *out_len = w;
+  return 1;
+}
+
+int vs_inflate_zlib(
+    VsInflater* d,
+    const uint8_t* in,
+    size_t len,
+    uint8_t* out,
+    size_t cap,
+    size_t* out_len) {
+  const VsZlib* z = vs_zlib();
+  if (!z->stream_available || len > 0x7FFFFFFFu || cap > 0x7FFFFFFFu) return 0;
+  if (d->live) {
+    if (z->inflate_reset(&d->zs) != VS_Z_OK) return 0;
+  } else {
+    memset(&d->zs, 0, sizeof(d->zs));
+    if (z->inflate_init(&d->zs, z->version, (int)sizeof(VsZStream)) != VS_Z_OK) {
+      return 0;
+    }
+    d->live = 1;
+  }
+
+  VsZStream* zs = &d->zs;
+  zs->next_in = in;
+  zs->avail_in = (unsigned int)len;
+  zs->next_out = out;
+  zs->avail_out = (unsigned int)cap;
+  if (z->inflate(zs, VS_Z_FINISH) != VS_Z_STREAM_END) return 0;
+  *out_len = cap - zs->avail_out;
+  return 1;
+}
+
+void vs_inflater_end(VsInflater* d) {
+  if (!d || !d->live) return;
+  vs_zlib()->inflate_end(&d->zs);
+  d->live = 0;
+}
+
+int vs_deflate_zlib_trial(
+    VsDeflater* d,
+    VsEncodeJob* job,
+    int32_t level,
+    const uint8_t* in,
+    size_t len,
+    uint8_t* out,
+    size_t cap,
+    size_t* out_len) {
+  VsDeflateParams c[VS_DEFLATE_AUTO_MAX_CANDIDATES];
+  uint64_t ns[VS_DEFLATE_AUTO_MAX_CANDIDATES];
+  size_t bytes[VS_DEFLATE_AUTO_MAX_CANDIDATES];
+  const int32_t n = vs_deflate_auto_candidates(job, level, c);
+  uint8_t* spare = (uint8_t*)malloc(cap);
+  if (!spare) return vs_deflate_zlib(d, &c[0], in, len, out, cap, out_len);
+
+  // Candidate 0 runs last so its stream is the one left in [out]. Stream
+  // setup is kept out of the timings; a warm worker only pays the reset.
+  for (int32_t k = n - 1; k >= 0; k--) {
+    if (!vs_deflater_begin(d, &c[k])) {
+      free(spare);
+      return 0;
+    }
+    size_t got = 0;
+    const uint64_t t0 = _now_ns();
+    const int ok = vs_deflate_zlib(d, &c[k], in, len, k ? spare : out, cap, &got);
+    ns[k] = _now_ns() - t0;
+    if (!ok) {
+      if (k == 0) {
+        free(spare);
+        return 0;
+      }
+      got = cap;  // did not fit: never the smallest
+    }
+    bytes[k] = got;
+  }
+  free(spare);
+  vs_deflate_auto_record(job, level, ns, bytes, n);
+  *out_len = bytes[0];
+  return 1;
+}
@@ -0,0 +1,328 @@
+/**
+ * @file zlib_stream.h
+ * @brief Library-internal binding of the runtime compressors and warm streams.
+ *
+ * Not part of the FFI surface; see zlib_stream.c for how zlib, zlib-ng and
+ * libdeflate are located. Job-wide stream parameters are kept in a
+ * VsEncodeJob (vs_encode_job_open), passed to every batch of the job.
+ */
+#ifndef VOXELSHIFT_ZLIB_STREAM_H
+#define VOXELSHIFT_ZLIB_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// zlib is loaded at runtime without its header, so the stream API is bound
+// through a mirror of z_stream; the init functions check the size we pass.
+typedef struct VsZStream {
+  const uint8_t* next_in;
+  unsigned int avail_in;
+  unsigned long total_in;
+  uint8_t* next_out;
+  unsigned int avail_out;
+  unsigned long total_out;
+  const char* msg;
+  void* state;
+  void* zalloc;
+  void* zfree;
+  void* opaque;
+  int data_type;
+  unsigned long adler;
+  unsigned long reserved;
+} VsZStream;
+
+#define VS_Z_OK 0
+#define VS_Z_STREAM_END 1
+#define VS_Z_BUF_ERROR (-5)
+#define VS_Z_NO_FLUSH 0
+#define VS_Z_SYNC_FLUSH 2
+#define VS_Z_FINISH 4
+#define VS_Z_DEFLATED 8
+#define VS_Z_HUFFMAN_ONLY 2
+
+typedef int (*vs_compress2_fn)(unsigned char*, unsigned long*, const unsigned char*, unsigned long, int);
+typedef int (*vs_uncompress_fn)(unsigned char*, unsigned long*, const unsigned char*, unsigned long);
+typedef int (*vs_deflate_init2_fn)(VsZStream*, int, int, int, int, int, const char*, int);
+typedef int (*vs_inflate_init_fn)(VsZStream*, const char*, int);
+typedef int (*vs_zstream_fn)(VsZStream*);
+typedef int (*vs_zstream_flush_fn)(VsZStream*, int);
+typedef unsigned long (*vs_adler32_fn)(unsigned long, const uint8_t*, unsigned int);
+typedef int (*vs_deflate_dict_fn)(VsZStream*, const uint8_t*, unsigned int);
+
+typedef struct VsZlib {
+  int available;             // compress2 and uncompress
+  int stream_available;      // everything below
+  const char* version;
+  vs_compress2_fn compress2;
+  vs_uncompress_fn uncompress;
+  vs_deflate_init2_fn deflate_init2;
+  vs_zstream_flush_fn deflate;
+  vs_zstream_fn deflate_reset;
+  vs_zstream_fn deflate_end;
+  vs_inflate_init_fn inflate_init;
+  vs_zstream_flush_fn inflate;
+  vs_zstream_fn inflate_reset;
+  vs_zstream_fn inflate_end;
+  vs_adler32_fn adler32;
+  vs_deflate_dict_fn deflate_set_dictionary;  // optional: split deflate
+} VsZlib;
+
+/// The process-wide zlib binding, loaded on first use. Never NULL; check
+/// `available` / `stream_available`.
+const VsZlib* vs_zlib(void);
+
+// zlib-ng's native API (zng_ prefix) uses fixed-width fields, so its stream
+// has a layout of its own.
+typedef struct VsZngStream {
+  const uint8_t* next_in;
+  uint32_t avail_in;
+  size_t total_in;
+  uint8_t* next_out;
+  uint32_t avail_out;
+  size_t total_out;
+  const char* msg;
+  void* state;
+  void* zalloc;
+  void* zfree;
+  void* opaque;
+  int data_type;
+  uint32_t adler;
+  unsigned long reserved;
+} VsZngStream;
+
+typedef int32_t (*vs_zng_deflate_init2_fn)(VsZngStream*, int32_t, int32_t, int32_t, int32_t, int32_t);
+typedef int32_t (*vs_zng_stream_fn)(VsZngStream*);
+typedef int32_t (*vs_zng_stream_flush_fn)(VsZngStream*, int32_t);
+typedef uint32_t (*vs_zng_adler32_fn)(uint32_t, const uint8_t*, uint32_t);
+typedef int32_t (*vs_zng_dict_fn)(VsZngStream*, const uint8_t*, uint32_t);
+
+typedef struct VsZng {
+  int available;
+  const char* version;
+  vs_zng_deflate_init2_fn deflate_init2;
+  vs_zng_stream_flush_fn deflate;
+  vs_zng_stream_fn deflate_reset;
+  vs_zng_stream_fn deflate_end;
+  vs_zng_adler32_fn adler32;
+  vs_zng_dict_fn deflate_set_dictionary;  // optional: split deflate
+} VsZng;
+
+/// The process-wide zlib-ng binding, loaded on first use. Never NULL.
+const VsZng* vs_zng(void);
+
+typedef void* (*vs_libdeflate_alloc_fn)(int);
+typedef size_t (*vs_libdeflate_compress_fn)(void*, const void*, size_t, void*, size_t);
+typedef void (*vs_libdeflate_free_fn)(void*);
+
+typedef struct VsLibdeflate {
+  int available;
+  vs_libdeflate_alloc_fn alloc_compressor;
+  vs_libdeflate_compress_fn zlib_compress;  // 0 when the output does not fit
+  vs_libdeflate_free_fn free_compressor;
+} VsLibdeflate;
+
+/// The process-wide libdeflate binding, loaded on first use. Never NULL.
+const VsLibdeflate* vs_libdeflate(void);
+
+/// Deflate stream parameters, as passed to deflateInit2.
+typedef struct VsDeflateParams {
+  int32_t level;
+  int32_t window_bits;       // 9..15, raw streams use the negated value
+  int32_t mem_level;         // 1..9
+  int32_t strategy;          // 0 default, 1 filtered, 2 Huffman only, 3 RLE, 4 fixed
+  int32_t encoder;           // VS_DEFLATE_ENCODER_*
+} VsDeflateParams;
+
+/// Who writes the deflate streams: zlib, the built-in scanline encoder
+/// (mask_deflate.h, ignores level, memLevel and strategy), zlib-ng, or
+/// libdeflate (whole buffers only, ignores memLevel and strategy). Auto is
+/// only ever requested; vs_deflate_params resolves it to the backend the
+/// job benchmarked, and a backend that failed to load to zlib.
+#define VS_DEFLATE_ENCODER_ZLIB 0
+#define VS_DEFLATE_ENCODER_BUILTIN 1
+#define VS_DEFLATE_ENCODER_ZLIB_NG 2
+#define VS_DEFLATE_ENCODER_LIBDEFLATE 3
+#define VS_DEFLATE_ENCODER_AUTO 4
+
+/// vs_encode_job_open strategy that picks a strategy and level per job by
+/// trial compression.
+#define VS_DEFLATE_STRATEGY_AUTO 5
+#define VS_DEFLATE_AUTO_MAX_CANDIDATES 5
+
+/// One job's stream settings, encoder, split deflate switch, auto-strategy
+/// trials and auto encoder benchmark (vs_encode_job_open). Every function taking one
+/// accepts NULL for zlib with its defaults.
+typedef struct VsEncodeJob VsEncodeJob;
+
+/// [job]'s stream parameters at [level]. Under the auto strategy this is
+/// the trial winner for [level] once chosen, and the default strategy at
+/// [level] until then.
+VsDeflateParams vs_deflate_params(VsEncodeJob* job, int32_t level);
+
+/// zlib stream header (CMF, FLG) as deflate writes it for [p].
+uint16_t vs_zlib_header(const VsDeflateParams* p);
+
+/// 1 if [p]'s encoder can deflate row by row through a VsDeflater.
+int vs_deflate_can_stream(const VsDeflateParams* p);
+
+/// 1 if vs_deflate_zlib can run with [p].
+int vs_deflate_available(const VsDeflateParams* p);
+
+/// [p] with a streaming encoder in place of one that is not (libdeflate),
+/// for output spliced into [p]'s streams. Returns 0 if there is none.
+int vs_deflate_stream_params(const VsDeflateParams* p, VsDeflateParams* out);
+
+/// Adler-32 of [len] bytes continuing from [adler], through the fastest
+/// loaded implementation.
+uint32_t vs_zlib_adler32(uint32_t adler, const uint8_t* data, size_t len);
+
+/// Upper bound on vs_deflate_zlib's output for [len] input bytes, following
+/// zlib's deflateBound (looser for reduced window or memLevel), or on
+/// vs_mask_deflate_zlib's for the built-in encoder.
+size_t vs_deflate_bound(const VsDeflateParams* p, size_t len);
+
+/// A raw deflate stream kept alive between layers, or a libdeflate
+/// compressor. Zero-initialise before first use; release with
+/// vs_deflater_end.
+typedef struct VsDeflater {
+  union {
+    VsZStream zs;
+    VsZngStream zng;
+    void* libdeflate;
+  };
+  VsDeflateParams params;
+  int32_t live;
+} VsDeflater;
+
+/// Ready [d] for a new raw stream with [p]: a warm stream with the same
+/// parameters is reset, otherwise it is set up again. Returns 0 on failure.
+int vs_deflater_begin(VsDeflater* d, const VsDeflateParams* p);
+
+void vs_deflater_end(VsDeflater* d);
+
+/// Point a begun streaming [d] at [avail] free bytes at [out].
+void vs_deflater_set_output(VsDeflater* d, uint8_t* out, size_t avail);
+
+/// Where [d] will write its next output byte.
+uint8_t* vs_deflater_next_out(const VsDeflater* d);
+
+/// Feed [len] bytes to a begun streaming [d] with a VS_Z_* [flush],
+/// doubling the malloc'd buffer [out]/[cap] it writes into when full;
+/// [tail] bytes at its end are kept free. Returns 0 on a deflate or
+/// allocation failure.
+int vs_deflater_feed(
+    VsDeflater* d,
+    const uint8_t* in,
+    size_t len,
+    int flush,
+    uint8_t** out,
+    size_t* cap,
+    size_t tail);
+
+// ── Split deflate ───────────────────────────────────────────────────────────
+// One stream cut into bands deflated in parallel (as pigz does): each band
+// is primed with the window before it as a dictionary and ends on a sync
+// flush, so the bands join byte-aligned into one raw stream, and the
+// Adler-32 is combined from the bands'.
+
+/// Threads one stream of [job] may be split over out of [threads]: 1 when
+/// the job turned split deflate off.
+int32_t vs_deflate_split_threads(const VsEncodeJob* job, int32_t threads);
+
+/// 1 when [job] was marked background (vs_encode_job_set_background); entry
+/// points pass it to vs_pool_set_background for the batch.
+int32_t vs_encode_job_background(VsEncodeJob* job);
+
+/// Bands worth cutting [len] input bytes into for [threads] threads with
+/// [p], or 1 when the stream should stay whole (one thread, short input, or
+/// an encoder without dictionaries).
+int32_t vs_deflate_split_bands(const VsDeflateParams* p, size_t len, int32_t threads);
+
+/// Append [in] to the raw stream at [*used] in the malloc'd [*out]/[*cap]
+/// (grown as needed, [tail] bytes kept free) as [bands] bands of whole
+/// [align]-byte rows deflated in parallel, and continue [*adler] over it.
+/// The stream ends with [finish]; otherwise it stays open on a sync flush.
+/// From inside a batch task the bands run on the caller and the pool's idle
+/// workers; the output depends only on [bands]. Returns 0 on failure.
+int vs_deflate_split(
+    const VsDeflateParams* p,
+    const uint8_t* in,
+    size_t len,
+    size_t align,
+    int32_t bands,
+    int finish,
+    uint8_t** out,
+    size_t* cap,
+    size_t* used,
+    size_t tail,
+    uint32_t* adler);
+
+/// Deflate [in] as one complete zlib stream (header, raw deflate, Adler-32)
+/// into [out]. Returns 0 if the encoder fails or the result does not fit in
+/// [cap].
+int vs_deflate_zlib(
+    VsDeflater* d,
+    const VsDeflateParams* p,
+    const uint8_t* in,
+    size_t len,
+    uint8_t* out,
+    size_t cap,
+    size_t* out_len);
+
+/// A zlib-format inflate stream kept alive between layers. Zero-initialise
+/// before first use; release with vs_inflater_end.
+typedef struct VsInflater {
+  VsZStream zs;
+  int32_t live;
+} VsInflater;
+
+/// Inflate one complete zlib stream into [out]. Returns 0 if the stream is
+/// invalid, truncated or does not fit in [cap].
+int vs_inflate_zlib(
+    VsInflater* d,
+    const uint8_t* in,
+    size_t len,
+    uint8_t* out,
+    size_t cap,
+    size_t* out_len);
+
+void vs_inflater_end(VsInflater* d);
+
+// ── Auto strategy ───────────────────────────────────────────────────────────
+// While no choice has been made for a level, callers claim layers as trial
+// samples, compress each with every candidate and record time and size; the
+// sample that completes the set makes the choice for the rest of the job.
+
+/// 1 if the caller should trial-compress its next layer of [job] at
+/// requested [level]. Each call that returns 1 claims one sample and must be
+/// followed by vs_deflate_auto_record (or vs_deflate_zlib_trial).
+int vs_deflate_auto_claim(VsEncodeJob* job, int32_t level);
+
+/// Candidate settings for [level]; [0] is what vs_deflate_params returns
+/// before a choice is made. Returns the count.
+int32_t vs_deflate_auto_candidates(
+    VsEncodeJob* job,
+    int32_t level,
+    VsDeflateParams* out);
+
+/// Add one sample: per candidate, the time taken and the output size.
+void vs_deflate_auto_record(
+    VsEncodeJob* job,
+    int32_t level,
+    const uint64_t* ns,
+    const size_t* bytes,
+    int32_t count);
+
+/// vs_deflate_zlib for a claimed sample: every candidate is timed, the
+/// sample recorded, and candidate 0's stream is left in [out].
+int vs_deflate_zlib_trial(
+    VsDeflater* d,
+    VsEncodeJob* job,
+    int32_t level,
+    const uint8_t* in,
+    size_t len,
+    uint8_t* out,
+    size_t cap,
+    size_t* out_len);
+
+#endif // VOXELSHIFT_ZLIB_STREAM_H
@@ -0,0 +1,188 @@
+import 'dart:math' as math;
+import 'dart:typed_data';
+
+import 'package:flutter_test/flutter_test.dart';
+import 'package:voxelshift/core/conversion/layer_encoder.dart';
+import 'package:voxelshift/core/conversion/native_area_stats.dart';
+import 'package:voxelshift/core/conversion/native_layer_batch_process.dart';
+import 'package:voxelshift/core/models/models.dart';
+
+/// The native run-based island labelling, single-threaded and in row
+/// bands, checked field for field against the Dart flood fill in
+/// [LayerEncoder.computeLayerArea] on randomized layers.
+void main() {
+  final area = NativeAreaStats.instance;
+  final batch = NativeLayerBatchProcess.instance;
+  const xPixel = 0.019;
+  const yPixel = 0.024;
+
+  /// Random layer of 0/255 pixels in one of several shapes: sparse and
+  /// dense noise (many diagonal-only contacts), checkerboards, filled
+  /// rectangles and discs, and blank or full frames.
+  Uint8List randomLayer(math.Random rng, int width, int height) {
+    final grey = Uint8List(width * height);
+    void set(int x, int y) {
+      if (x >= 0 && x < width && y >= 0 && y < height) {
+        grey[y * width + x] = 255;
+      }
+    }
+
+    switch (rng.nextInt(6)) {
+      case 0:
+        final density = 0.05 + rng.nextDouble() * 0.6;
+        for (int i = 0; i < grey.length; i++) {
+          if (rng.nextDouble() < density) grey[i] = 255;
+        }
+      case 1:
+        final cell = 1 + rng.nextInt(3);
+        for (int y = 0; y < height; y++) {
+          for (int x = 0; x < width; x++) {
+            if (((x ~/ cell) + (y ~/ cell)).isEven) set(x, y);
+          }
+        }
+      case 2:
+        for (int n = rng.nextInt(12); n >= 0; n--) {
+          final x0 = rng.nextInt(width);
+          final y0 = rng.nextInt(height);
+          final w = 1 + rng.nextInt(math.max(1, width ~/ 3));
+          final h = 1 + rng.nextInt(math.max(1, height ~/ 3));
+          for (int y = y0; y < y0 + h; y++) {
+            for (int x = x0; x < x0 + w; x++) {
+              set(x, y);
+            }
+          }
+        }
+      case 3:
+        for (int n = rng.nextInt(8); n >= 0; n--) {
+          final cx = rng.nextInt(width);
+          final cy = rng.nextInt(height);
+          final r = 1 + rng.nextInt(math.max(1, math.min(width, height) ~/ 4));
+          for (int y = cy - r; y <= cy + r; y++) {
+            for (int x = cx - r; x <= cx + r; x++) {
+              final dx = x - cx;
+              final dy = y - cy;
+              if (dx * dx + dy * dy <= r * r) set(x, y);
+            }
+          }
+        }
+      case 4:
+        // Staircases touch only at corners, one island per diagonal.
+        for (int d = 0; d < width + height; d += 2 + rng.nextInt(4)) {
+          for (int y = 0; y < height; y++) {
+            set(d - y, y);
+          }
+        }
+      default:
+        if (rng.nextBool()) grey.fillRange(0, grey.length, 255);
+    }
+    return grey;
+  }
+
+  /// CTB RLE for [grey], whose values must be 0 or odd to round-trip.
+  Uint8List encodeRle(Uint8List grey) {
+    final out = BytesBuilder(copy: false);
+    int i = 0;
+    while (i < grey.length) {
+      final value = grey[i];
+      int j = i + 1;
+      while (j < grey.length && grey[j] == value && j - i < 0x0FFFFFFF) {
+        j++;
+      }
+      final run = j - i;
+      final code = value >> 1;
+      if (run == 1) {
+        out.addByte(code);
+      } else {
+        out.addByte(code | 0x80);
+        if (run < 0x80) {
+          out.addByte(run);
+        } else if (run < 0x4000) {
+          out.add([0x80 | (run >> 8), run & 0xFF]);
+        } else if (run < 0x200000) {
+          out.add([0xC0 | (run >> 16), (run >> 8) & 0xFF, run & 0xFF]);
+        } else {
+          out.add([
+            0xE0 | (run >> 24),
+            (run >> 16) & 0xFF,
+            (run >> 8) & 0xFF,
+            run & 0xFF,
+          ]);
+        }
+      }
+      i = j;
+    }
+    return out.takeBytes();
+  }
+
+  LayerAreaInfo reference(Uint8List grey, int width, int height) =>
+      LayerEncoder.computeLayerArea(grey, width, height, xPixel, yPixel);
+
+  group('Native area stats vs flood fill', () {
+    test('randomized layers, single-threaded', () {
+      final rng = math.Random(20240611);
+      for (int n = 0; n < 300; n++) {
+        final width = 1 + rng.nextInt(n < 50 ? 8 : 240);
+        final height = 1 + rng.nextInt(n < 50 ? 8 : 240);
+        final grey = randomLayer(rng, width, height);
+        final native = area.compute(grey, width, height, xPixel, yPixel);
+        expect(native, isNotNull);
+        expect(
+          native!.toJson(),
+          equals(reference(grey, width, height).toJson()),
+          reason: 'layer $n (${width}x$height)',
+        );
+      }
+    });
+
+    test('rows wider than 65535 pixels', () {
+      final rng = math.Random(65536);
+      const width = 70001;
+      const height = 4;
+      final grey = Uint8List(width * height);
+      for (int i = 0; i < grey.length; i++) {
+        if (rng.nextDouble() < 0.3) grey[i] = 255;
+      }
+      grey[width - 1] = 255;
+      grey[(height - 1) * width + width - 2] = 255;
+      final native = area.compute(grey, width, height, xPixel, yPixel);
+      expect(native, isNotNull);
+      expect(
+        native!.toJson(),
+        equals(reference(grey, width, height).toJson()),
+      );
+    });
+
+    test('randomized layers stitched across row bands', () {
+      final rng = math.Random(1106);
+      for (int n = 0; n < 24; n++) {
+        // At least two 256-row bands, so the stitched path runs.
+        final width = 64 + rng.nextInt(400);
+        final height = 512 + rng.nextInt(700);
+        final grey = randomLayer(rng, width, height);
+        final expected = reference(grey, width, height).toJson();
+        for (final threads in [1, 3, 8]) {
+          // Forget the previous run, or its result is reused as a repeat.
+          batch.releaseWorkerScratch();
+          final result = batch.processBatch(
+            rawLayers: [encodeRle(grey)],
+            layerIndexBase: n,
+            encryptionKey: 0,
+            srcWidth: width,
+            height: height,
+            outWidth: (width + 1) ~/ 2,
+            channels: 1,
+            xPixelSizeMm: xPixel,
+            yPixelSizeMm: yPixel,
+            threadCount: threads,
+          );
+          expect(result, isNotNull);
+          expect(
+            result!.single.areaInfo.toJson(),
+            equals(expected),
+            reason: 'layer $n (${width}x$height), $threads threads',
+          );
+        }
+      }
+    }, skip: batch.available ? false : 'native batch library not found');
+  }, skip: area.available ? false : 'native library not found');
+}
@@ -0,0 +1,316 @@
+import 'dart:ffi' as ffi;
+import 'dart:io';
+import 'dart:math' as math;
+import 'dart:typed_data';
+
+import 'package:ffi/ffi.dart';
+import 'package:flutter_test/flutter_test.dart';
+import 'package:voxelshift/core/conversion/native_layer_batch_process.dart';
+
+typedef _NativeLayerRleEqual = ffi.Int32 Function(
+  ffi.Pointer<ffi.Uint8> a,
+  ffi.Int32 aLayerIndex,
+  ffi.Int32 aEncryptionKey,
+  ffi.Pointer<ffi.Uint8> b,
+  ffi.Int32 bLayerIndex,
+  ffi.Int32 bEncryptionKey,
+  ffi.Int32 dataLen,
+);
+typedef _DartLayerRleEqual = int Function(
+  ffi.Pointer<ffi.Uint8> a,
+  int aLayerIndex,
+  int aEncryptionKey,
+  ffi.Pointer<ffi.Uint8> b,
+  int bLayerIndex,
+  int bEncryptionKey,
+  int dataLen,
+);
+
+/// Layer dedup inside and across native batches: repeats must come back
+/// with exactly the PNG and area stats of the layer converted on its own,
+/// and only byte-identical (decrypted) layers may be reused.
+void main() {
+  final batch = NativeLayerBatchProcess.instance;
+  final skip = batch.available ? false : 'native library not found';
+  const width = 96;
+  const height = 64;
+  const key = 0x4F4295C8;
+
+  /// A layer of lit rectangles plus isolated single pixels, whose RLE
+  /// codes can be changed without changing the payload length.
+  Uint8List randomLayer(math.Random rng) {
+    final grey = Uint8List(width * height);
+    for (int n = 0; n < 6; n++) {
+      final x0 = rng.nextInt(width - 8);
+      final y0 = rng.nextInt(height - 8);
+      final w = 2 + rng.nextInt(20);
+      final h = 2 + rng.nextInt(20);
+      final x1 = math.min(width, x0 + w);
+      for (int y = y0; y < math.min(height, y0 + h); y++) {
+        grey.fillRange(y * width + x0, y * width + x1, 255);
+      }
+    }
+    for (int n = 0; n < 12; n++) {
+      final x = 2 + rng.nextInt(width - 4);
+      final y = 2 + rng.nextInt(height - 4);
+      if (grey[y * width + x - 1] == 0 && grey[y * width + x + 1] == 0) {
+        grey[y * width + x] = 255;
+      }
+    }
+    return grey;
+  }
+
+  /// CTB RLE for [grey], whose values must be 0 or odd.
+  Uint8List encodeRle(Uint8List grey) {
+    final out = BytesBuilder(copy: false);
+    int i = 0;
+    while (i < grey.length) {
+      final value = grey[i];
+      int j = i + 1;
+      while (j < grey.length && grey[j] == value && j - i < 0x3FFF) {
+        j++;
+      }
+      final run = j - i;
+      if (run == 1) {
+        out.addByte(value >> 1);
+      } else if (run < 0x80) {
+        out.add([0x80 | (value >> 1), run]);
+      } else {
+        out.add([0x80 | (value >> 1), 0x80 | (run >> 8), run & 0xFF]);
+      }
+      i = j;
+    }
+    return out.takeBytes();
+  }
+
+  /// The CTB layer cipher (XOR keystream, so it also decrypts).
+  Uint8List encrypt(Uint8List data, int layerIndex, int encryptionKey) {
+    final out = Uint8List.fromList(data);
+    final init = (encryptionKey * 0x2d83cdac + 0xd8a83423) & 0xFFFFFFFF;
+    var k = (layerIndex * 0x1e1530cd + 0xec3d47cd) & 0xFFFFFFFF;
+    k = (k * init) & 0xFFFFFFFF;
+    for (int i = 0; i < out.length; i++) {
+      out[i] ^= (k >> (8 * (i & 3))) & 0xFF;
+      if ((i & 3) == 3) k = (k + init) & 0xFFFFFFFF;
+    }
+    return out;
+  }
+
+  // Unsplit streams, so a layer's PNG does not depend on the thread count.
+  var encodeJob = 0;
+
+  /// Convert [layers] as one batch starting at [base].
+  List<NativeBatchLayerResult> run(
+    List<Uint8List> layers, {
+    int base = 0,
+    int encryptionKey = 0,
+    int threads = 4,
+  }) {
+    final result = batch.processBatch(
+      rawLayers: layers,
+      layerIndexBase: base,
+      encryptionKey: encryptionKey,
+      srcWidth: width,
+      height: height,
+      outWidth: width ~/ 2,
+      channels: 1,
+      xPixelSizeMm: 0.05,
+      yPixelSizeMm: 0.05,
+      pngLevel: 6,
+      encodeJob: encodeJob,
+      threadCount: threads,
+    );
+    expect(result, isNotNull);
+    expect(result!.length, layers.length);
+    return result;
+  }
+
+  /// Each layer converted alone, with nothing carried over to reuse.
+  void expectSameAsAlone(
+    List<NativeBatchLayerResult> results,
+    List<Uint8List> layers, {
+    int base = 0,
+    int encryptionKey = 0,
+  }) {
+    for (int i = 0; i < layers.length; i++) {
+      batch.releaseWorkerScratch();
+      final alone = run(
+        [layers[i]],
+        base: base + i,
+        encryptionKey: encryptionKey,
+        threads: 1,
+      ).single;
+      expect(results[i].pngBytes, equals(alone.pngBytes), reason: 'layer $i');
+      expect(
+        results[i].areaInfo.toJson(),
+        equals(alone.areaInfo.toJson()),
+        reason: 'layer $i',
+      );
+    }
+  }
+
+  group('Native layer dedup', () {
+    setUpAll(() {
+      encodeJob = batch.openEncodeJob(-1, -1, -1, 0, splitDeflate: false);
+    });
+    tearDownAll(() => batch.closeEncodeJob(encodeJob));
+    setUp(batch.releaseWorkerScratch);
+    tearDown(batch.releaseWorkerScratch);
+
+    test('repeated layers in one batch are reused', () {
+      final rng = math.Random(15);
+      final a = encodeRle(randomLayer(rng));
+      final b = encodeRle(randomLayer(rng));
+      final layers = [a, a, b, a, b, b];
+      final results = run(layers);
+      expect(batch.lastDedupHits, 4);
+      expectSameAsAlone(results, layers);
+    });
+
+    test('blank layers repeat across batch boundaries', () {
+      final rng = math.Random(16);
+      final blank = encodeRle(Uint8List(width * height));
+      final b = encodeRle(randomLayer(rng));
+      final c = encodeRle(randomLayer(rng));
+      final first = run([b, blank, blank]);
+      expect(batch.lastDedupHits, 1);
+      final second = run([blank, blank, c], base: 3);
+      // The first blank comes from the previous batch, the second from it.
+      expect(batch.lastDedupHits, 2);
+      expect(second[0].areaInfo.areaCount, 0);
+      expect(second[0].pngBytes, equals(first[1].pngBytes));
+      expectSameAsAlone(second, [blank, blank, c], base: 3);
+    });
+
+    test('near-identical layers of equal length are not reused', () {
+      final rng = math.Random(17);
+      final grey = randomLayer(rng);
+      final a = encodeRle(grey);
+      // Dim one isolated pixel: its one-byte run code changes, the
+      // payload length does not.
+      final lone = List.generate(grey.length, (i) => i).firstWhere(
+            (i) =>
+                i > 0 &&
+                i < grey.length - 1 &&
+                grey[i] == 255 &&
+                grey[i - 1] == 0 &&
+                grey[i + 1] == 0,
+          );
+      grey[lone] = 253;
+      final nearA = encodeRle(grey);
+      expect(nearA.length, a.length);
+      expect(nearA, isNot(equals(a)));
+
+      final layers = [a, nearA, a, nearA];
+      final results = run(layers);
+      expect(batch.lastDedupHits, 2);
+      expect(results[0].pngBytes, isNot(equals(results[1].pngBytes)));
+      expectSameAsAlone(results, layers);
+
+      // Across a batch boundary too: the carried-over layer must not be
+      // handed to its near twin.
+      batch.releaseWorkerScratch();
+      run([a]);
+      run([nearA], base: 1);
+      expect(batch.lastDedupHits, 0);
+    });
+
+    test('encrypted repeats match after decryption', () {
+      final rng = math.Random(18);
+      final plain = encodeRle(randomLayer(rng));
+      final other = encodeRle(randomLayer(rng));
+      const base = 40;
+      // The same layer at three indices: three different ciphertexts.
+      final layers = [
+        encrypt(plain, base, key),
+        encrypt(plain, base + 1, key),
+        encrypt(other, base + 2, key),
+        encrypt(plain, base + 3, key),
+      ];
+      expect(layers[0], isNot(equals(layers[1])));
+      final results = run(layers, base: base, encryptionKey: key);
+      expect(batch.lastDedupHits, 2);
+      expectSameAsAlone(results, layers, base: base, encryptionKey: key);
+    });
+  }, skip: skip);
+
+  group('layer_rle_equal', () {
+    late _DartLayerRleEqual equal;
+
+    setUpAll(() {
+      final lib = Platform.isWindows
+          ? ffi.DynamicLibrary.open('area_stats.dll')
+          : ffi.DynamicLibrary.open(
+              Platform.isMacOS ? 'libarea_stats.dylib' : 'libarea_stats.so',
+            );
+      equal = lib.lookupFunction<_NativeLayerRleEqual, _DartLayerRleEqual>(
+        'layer_rle_equal',
+      );
+    });
+
+    /// layer_rle_equal on [a] (stored encrypted for [aIndex]/[aKey]) and
+    /// [b] (likewise), with the payloads encrypted here.
+    bool same(
+      Uint8List a,
+      int aIndex,
+      int aKey,
+      Uint8List b,
+      int bIndex,
+      int bKey,
+    ) {
+      final storedA = aKey == 0 ? a : encrypt(a, aIndex, aKey);
+      final storedB = bKey == 0 ? b : encrypt(b, bIndex, bKey);
+      final pa = malloc<ffi.Uint8>(math.max(1, a.length));
+      final pb = malloc<ffi.Uint8>(math.max(1, b.length));
+      try {
+        pa.asTypedList(a.length).setAll(0, storedA);
+        pb.asTypedList(b.length).setAll(0, storedB);
+        return equal(pa, aIndex, aKey, pb, bIndex, bKey, a.length) != 0;
+      } finally {
+        malloc.free(pa);
+        malloc.free(pb);
+      }
+    }
+
+    // Around the 4 KB decryption chunk and the 4-byte key step.
+    const lengths = [1, 3, 4, 5, 4095, 4096, 4097, 10001];
+    const keyPairs = [(0, 0), (key, key), (key, 0), (0x1234567, key)];
+
+    test('identical payloads match for any index and key', () {
+      final rng = math.Random(19);
+      for (final len in lengths) {
+        final data = Uint8List.fromList(
+          List.generate(len, (_) => rng.nextInt(256)),
+        );
+        for (final (aKey, bKey) in keyPairs) {
+          expect(
+            same(data, 3, aKey, Uint8List.fromList(data), 9, bKey),
+            isTrue,
+            reason: 'length $len, keys $aKey/$bKey',
+          );
+        }
+      }
+    });
+
+    test('a single differing byte never matches', () {
+      final rng = math.Random(20);
+      for (final len in lengths) {
+        final data = Uint8List.fromList(
+          List.generate(len, (_) => rng.nextInt(256)),
+        );
+        final positions = {0, len ~/ 2, len - 1, 4095, 4096}
+            .where((p) => p < len);
+        for (final pos in positions) {
+          final other = Uint8List.fromList(data)..[pos] ^= 1;
+          for (final (aKey, bKey) in keyPairs) {
+            expect(
+              same(data, 3, aKey, other, 9, bKey),
+              isFalse,
+              reason: 'length $len, byte $pos, keys $aKey/$bKey',
+            );
+          }
+        }
+      }
+    });
+  }, skip: skip);
+}
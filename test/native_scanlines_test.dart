@@ -0,0 +1,148 @@
+import 'dart:math' as math;
+import 'dart:typed_data';
+
+import 'package:flutter_test/flutter_test.dart';
+import 'package:voxelshift/core/conversion/native_png_encode.dart';
+
+/// Scanline packing and the PNG Up filter at every SIMD level, checked
+/// byte for byte against a plain Dart reference (the same packing as the
+/// Dart fallback in layer_processor.dart).
+void main() {
+  final native = NativePngEncode.instance;
+  final skip = native.available ? false : 'native library not found';
+
+  // Around the 16- and 32-byte vector widths, so every kernel sees an
+  // interior with a ragged tail and padding on both edges.
+  const srcWidths = [
+    1, 2, 3, 5, 15, 16, 17, 31, 32, 33, 47, 63, 64, 65, 127, 129, 255, 1000,
+    1023,
+  ];
+  const height = 5;
+
+  /// Pack [grey] like the native builder would and apply the Up filter.
+  Uint8List reference(
+    Uint8List grey,
+    int srcWidth,
+    int outWidth,
+    int channels,
+  ) {
+    final bytesPerRow = outWidth * channels;
+    final scanlineSize = 1 + bytesPerRow;
+    final out = Uint8List(scanlineSize * height);
+    final padTotal = outWidth * (channels == 3 ? 3 : 2) - srcWidth;
+    final padLeft = padTotal > 0 ? padTotal ~/ 2 : 0;
+    int at(int row, int si) =>
+        si >= 0 && si < srcWidth ? grey[row * srcWidth + si] : 0;
+    for (int y = 0; y < height; y++) {
+      final dst = y * scanlineSize + 1;
+      for (int x = 0; x < outWidth; x++) {
+        if (channels == 3) {
+          final si = x * 3 - padLeft;
+          out[dst + x * 3] = at(y, si);
+          out[dst + x * 3 + 1] = at(y, si + 1);
+          out[dst + x * 3 + 2] = at(y, si + 2);
+        } else {
+          final si = x * 2 - padLeft;
+          out[dst + x] = (at(y, si) + at(y, si + 1)) >> 1;
+        }
+      }
+    }
+    for (int y = height - 1; y >= 0; y--) {
+      final row = y * scanlineSize;
+      out[row] = 2;
+      if (y == 0) continue;
+      for (int i = 1; i <= bytesPerRow; i++) {
+        out[row + i] = (out[row + i] - out[row - scanlineSize + i]) & 0xFF;
+      }
+    }
+    return out;
+  }
+
+  /// Random bytes (including 255 + 255 pairs for the averaging carry) or a
+  /// layer-like mask of 0 and 255 runs.
+  Uint8List layer(math.Random rng, int srcWidth, {required bool mask}) {
+    final grey = Uint8List(srcWidth * height);
+    if (!mask) {
+      for (int i = 0; i < grey.length; i++) {
+        grey[i] = rng.nextInt(256);
+      }
+      return grey;
+    }
+    int i = 0;
+    var on = rng.nextBool();
+    while (i < grey.length) {
+      final run = 1 + rng.nextInt(40);
+      grey.fillRange(i, math.min(i + run, grey.length), on ? 255 : 0);
+      i += run;
+      on = !on;
+    }
+    return grey;
+  }
+
+  group('Native scanlines vs scalar reference', () {
+    tearDown(() => native.setSimdLevel(-1));
+
+    for (final level in [0, 1, 2]) {
+      for (final channels in [1, 3]) {
+        test('SIMD level $level, $channels channel(s)', () {
+          native.setSimdLevel(level);
+          final used = native.simdLevel;
+          expect(used, isNotNull);
+          expect(used!, lessThanOrEqualTo(level));
+
+          final rng = math.Random(1000 * level + channels);
+          for (final srcWidth in srcWidths) {
+            final perPixel = channels == 3 ? 3 : 2;
+            final exact = (srcWidth + perPixel - 1) ~/ perPixel;
+            final outWidths = {exact, exact + 7, math.max(1, exact - 5)};
+            for (final outWidth in outWidths) {
+              for (final mask in [false, true]) {
+                final grey = layer(rng, srcWidth, mask: mask);
+                final built = channels == 3
+                    ? native.buildRgbScanlines(grey, srcWidth, height, outWidth)
+                    : native.buildGreyscaleScanlines(
+                        grey,
+                        srcWidth,
+                        height,
+                        outWidth,
+                      );
+                expect(
+                  built,
+                  equals(reference(grey, srcWidth, outWidth, channels)),
+                  reason: 'level $used, src $srcWidth, out $outWidth, '
+                      '${mask ? 'mask' : 'random'}',
+                );
+              }
+            }
+          }
+        });
+      }
+    }
+
+    test('every SIMD level matches the scalar kernels on a full row', () {
+      final rng = math.Random(7);
+      const srcWidth = 15120;
+      final grey = layer(rng, srcWidth, mask: true);
+      native.setSimdLevel(0);
+      final scalarRgb =
+          native.buildRgbScanlines(grey, srcWidth, height, srcWidth ~/ 3);
+      final scalarGrey =
+          native.buildGreyscaleScanlines(grey, srcWidth, height, 7680);
+      expect(scalarRgb, isNotNull);
+      expect(scalarGrey, isNotNull);
+      for (final level in [1, 2]) {
+        native.setSimdLevel(level);
+        expect(
+          native.buildRgbScanlines(grey, srcWidth, height, srcWidth ~/ 3),
+          equals(scalarRgb),
+          reason: 'RGB at level ${native.simdLevel}',
+        );
+        expect(
+          native.buildGreyscaleScanlines(grey, srcWidth, height, 7680),
+          equals(scalarGrey),
+          reason: 'greyscale at level ${native.simdLevel}',
+        );
+      }
+    });
+  }, skip: skip);
+}
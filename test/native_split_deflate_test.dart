@@ -0,0 +1,203 @@
+import 'dart:io';
+import 'dart:math' as math;
+import 'dart:typed_data';
+
+import 'package:flutter_test/flutter_test.dart';
+import 'package:voxelshift/core/conversion/native_layer_batch_process.dart';
+import 'package:voxelshift/core/conversion/native_png_encode.dart';
+import 'package:voxelshift/core/conversion/native_png_recompress.dart';
+
+/// Layers deflated in parallel row bands, from a batch and from
+/// recompression: every stream must inflate to the layer's scanlines and
+/// end on their Adler-32, whatever the level, strategy, encoder and
+/// thread count.
+void main() {
+  final batch = NativeLayerBatchProcess.instance;
+  final png = NativePngEncode.instance;
+  final recompress = NativePngRecompress.instance;
+  final skip = batch.available && png.available && recompress.batchAvailable
+      ? false
+      : 'native library not found';
+
+  // 1.2 MB of scanlines: room for 8 bands of the 128 KB minimum.
+  const width = 2400;
+  const height = 1000;
+  const outWidth = width ~/ 2;
+  const levels = [1, 6, 9];
+  const threadCounts = [1, 2, 3, 4, 8];
+
+  /// Filled discs plus scattered single pixels, so bands see both long
+  /// matches and literals.
+  Uint8List maskLayer(math.Random rng) {
+    final grey = Uint8List(width * height);
+    for (int n = 0; n < 40; n++) {
+      final cx = rng.nextInt(width);
+      final cy = rng.nextInt(height);
+      final r = 20 + rng.nextInt(150);
+      final y1 = math.min(height, cy + r + 1);
+      for (int y = math.max(0, cy - r); y < y1; y++) {
+        final dy = y - cy;
+        final dx = math.sqrt(r * r - dy * dy).floor();
+        final x0 = math.max(0, cx - dx);
+        final x1 = math.min(width, cx + dx + 1);
+        grey.fillRange(y * width + x0, y * width + x1, 255);
+      }
+    }
+    for (int n = 0; n < 3000; n++) {
+      grey[rng.nextInt(grey.length)] = 255;
+    }
+    return grey;
+  }
+
+  /// CTB RLE for [grey], whose values must be 0 or odd.
+  Uint8List encodeRle(Uint8List grey) {
+    final out = BytesBuilder(copy: false);
+    int i = 0;
+    while (i < grey.length) {
+      final value = grey[i];
+      int j = i + 1;
+      while (j < grey.length && grey[j] == value && j - i < 0x3FFF) {
+        j++;
+      }
+      final run = j - i;
+      if (run == 1) {
+        out.addByte(value >> 1);
+      } else if (run < 0x80) {
+        out.add([0x80 | (value >> 1), run]);
+      } else {
+        out.add([0x80 | (value >> 1), 0x80 | (run >> 8), run & 0xFF]);
+      }
+      i = j;
+    }
+    return out.takeBytes();
+  }
+
+  /// The zlib stream of [pngBytes]: its IDAT chunks joined.
+  Uint8List idatStream(Uint8List pngBytes) {
+    final view = ByteData.sublistView(pngBytes);
+    final out = BytesBuilder(copy: false);
+    int pos = 8;
+    while (pos + 8 <= pngBytes.length) {
+      final len = view.getUint32(pos);
+      final type = String.fromCharCodes(pngBytes, pos + 4, pos + 8);
+      if (type == 'IDAT') {
+        out.add(Uint8List.sublistView(pngBytes, pos + 8, pos + 8 + len));
+      }
+      pos += 12 + len;
+    }
+    return out.takeBytes();
+  }
+
+  int adler32(Uint8List data) {
+    int a = 1;
+    int b = 0;
+    for (int i = 0; i < data.length; i++) {
+      a = (a + data[i]) % 65521;
+      b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+  }
+
+  late Uint8List raw;
+  late Uint8List scanlines;
+  late int scanlinesAdler;
+
+  setUpAll(() {
+    if (skip != false) return;
+    final grey = maskLayer(math.Random(22));
+    raw = encodeRle(grey);
+    scanlines = png.buildGreyscaleScanlines(grey, width, height, outWidth)!;
+    scanlinesAdler = adler32(scanlines);
+  });
+
+  /// Inflate [pngBytes] and check it against the layer; returns the
+  /// zlib stream.
+  Uint8List expectRoundTrip(Uint8List pngBytes, String reason) {
+    final stream = idatStream(pngBytes);
+    final inflated = Uint8List.fromList(zlib.decode(stream));
+    expect(inflated.length, scanlines.length, reason: reason);
+    expect(inflated, equals(scanlines), reason: reason);
+    // The trailer is combined from the bands' checksums; check it directly.
+    final trailer = ByteData.sublistView(stream).getUint32(stream.length - 4);
+    expect(trailer, scanlinesAdler, reason: reason);
+    return stream;
+  }
+
+  Uint8List convert(int job, int level, int threads) {
+    // A repeat of the previous run would be reused, not deflated again.
+    batch.releaseWorkerScratch();
+    final result = batch.processBatch(
+      rawLayers: [raw],
+      layerIndexBase: 0,
+      encryptionKey: 0,
+      srcWidth: width,
+      height: height,
+      outWidth: outWidth,
+      channels: 1,
+      xPixelSizeMm: 0.05,
+      yPixelSizeMm: 0.05,
+      pngLevel: level,
+      encodeJob: job,
+      threadCount: threads,
+    );
+    expect(result, isNotNull);
+    return result!.single.pngBytes;
+  }
+
+  group('Split deflate round trip', () {
+    tearDown(() {
+      recompress.setBatchThreads(0);
+      batch.releaseWorkerScratch();
+    });
+
+    const encoders = {
+      0: 'zlib',
+      1: 'built-in',
+      2: 'zlib-ng',
+      3: 'libdeflate',
+      4: 'auto',
+    };
+    for (final MapEntry(key: encoder, value: name) in encoders.entries) {
+      // Only zlib and zlib-ng take a strategy.
+      final strategies = encoder == 0 || encoder == 2
+          ? const [0, 1, 2, 3, 4, 5]
+          : const [-1];
+      test('$name encoder', () {
+        for (final strategy in strategies) {
+          final job = batch.openEncodeJob(-1, -1, strategy, encoder);
+          expect(job, isNot(0));
+          try {
+            for (final level in levels) {
+              final streams = <int, Uint8List>{};
+              for (final threads in threadCounts) {
+                final reason =
+                    'strategy $strategy, level $level, $threads threads';
+                final layer = convert(job, level, threads);
+                streams[threads] = expectRoundTrip(layer, reason);
+
+                recompress.setBatchThreads(threads);
+                final again = recompress.recompressBatch(
+                  [layer],
+                  level: level,
+                  encodeJob: job,
+                );
+                expect(again, isNotNull, reason: reason);
+                expectRoundTrip(again!.single, 'recompressed, $reason');
+              }
+              if (encoder == 0 && strategy == 0) {
+                // Otherwise nothing above was split.
+                expect(
+                  streams[4],
+                  isNot(equals(streams[1])),
+                  reason: 'level $level',
+                );
+              }
+            }
+          } finally {
+            batch.closeEncodeJob(job);
+          }
+        }
+      }, timeout: const Timeout(Duration(minutes: 2)));
+    }
+  }, skip: skip);
+}